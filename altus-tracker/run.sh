@@ -18,12 +18,33 @@ fi
 if [ "$INPUT_FILE" != "" ]; then
   cmd+=" --file \"$INPUT_FILE\""
 fi
+if [ "$FILE_FORMAT" != "" ]; then
+  cmd+=" --file_format $FILE_FORMAT"
+fi
 if [ "$CHANNELS" != "" ]; then
   cmd+=" --channels $CHANNELS"
 fi
 if [ "$SQUELCH" != "" ]; then
   cmd+=" --squelch $SQUELCH"
 fi
+if [ "$QUEUE_SIZE" != "" ]; then
+  cmd+=" --queue_size $QUEUE_SIZE"
+fi
+if [ "$QUEUE_DROP" != "" ]; then
+  cmd+=" --queue_drop $QUEUE_DROP"
+fi
+if [ "$SPOOL_DIR" != "" ]; then
+  cmd+=" --spool_dir \"$SPOOL_DIR\""
+fi
+if [ "$SPOOL_MAX_MB" != "" ]; then
+  cmd+=" --spool_max_mb $SPOOL_MAX_MB"
+fi
+if [ "$COMPRESS_LEVEL" != "" ]; then
+  cmd+=" --compress_level $COMPRESS_LEVEL"
+fi
+for sink in $SINKS; do
+  cmd+=" --sink \"$sink\""
+done
 if [ "$SOURCE" != "" ]; then
   cmd+=" --source \"$SOURCE\""
 fi
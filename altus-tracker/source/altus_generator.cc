@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "altus_generator.h"
+#include "blocks/altus_frame_decoder.h"
+
+const uint8_t generator_packet_types[] = {
+  0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x10, 0x13
+};
+const size_t generator_packet_type_count = sizeof(generator_packet_types);
+
+// AltOS sends a few bytes of 1010 before the sync word
+const uint32_t preamble = 0xAAAAAAAA;
+const uint8_t preamble_bits = 32;
+
+// Two trellis terminators follow the CRC
+const uint8_t trellis_terminator = 0x0B;
+
+// SNRs are given over the noise in this much bandwidth, about one channel
+const double snr_bandwidth = 100000;
+
+// Random transmitters go on channels this far apart
+const double channel_spacing = 100000;
+
+// Resolution of the tabulated frequency pulse, per symbol
+const double pulse_points_per_symbol = 256;
+
+void build_altus_data(
+  uint8_t type,
+  uint16_t serial,
+  uint16_t tick,
+  std::mt19937 &rng,
+  uint8_t data[DATA_BYTES_PER_MESSAGE]
+) {
+  for (int i = 0; i < DATA_BYTES_PER_MESSAGE; i++) {
+    data[i] = rng();
+  }
+  data[0] = serial;
+  data[1] = serial >> 8;
+  data[2] = tick;
+  data[3] = tick >> 8;
+  data[4] = type;
+
+  switch (type) {
+    case 0x04: {
+      // Configuration, the callsign and version are strings
+      const char callsign[8] = "N0CALL";
+      const char version[8] = "1.9.18";
+      std::memcpy(&data[16], callsign, 8);
+      std::memcpy(&data[24], version, 8);
+      break;
+    }
+    case 0x06:
+      // Satellite, at most 12 channels
+      data[5] %= 13;
+      break;
+    case 0x07:
+      // Companion, at most 12 channels of data
+      data[7] %= 13;
+      break;
+  }
+}
+
+void frame_altus_message(
+  const uint8_t data[DATA_BYTES_PER_MESSAGE],
+  uint8_t message[BYTES_PER_MESSAGE]
+) {
+  std::memcpy(message, data, DATA_BYTES_PER_MESSAGE);
+  uint16_t crc = AltusFrameDecoder::crc(data, DATA_BYTES_PER_MESSAGE);
+  message[DATA_BYTES_PER_MESSAGE] = crc >> 8;
+  message[DATA_BYTES_PER_MESSAGE + 1] = crc;
+  message[DATA_BYTES_PER_MESSAGE + 2] = trellis_terminator;
+  message[DATA_BYTES_PER_MESSAGE + 3] = trellis_terminator;
+}
+
+std::vector<uint8_t> encode_altus_bits(const uint8_t message[BYTES_PER_MESSAGE]) {
+  std::vector<uint8_t> bits;
+  bits.reserve(altus_air_bits());
+  for (int b = preamble_bits - 1; b >= 0; b--) {
+    bits.push_back((preamble >> b) & 1);
+  }
+  for (int b = 15; b >= 0; b--) {
+    bits.push_back((SYNC_WORD >> b) & 1);
+  }
+
+  uint8_t whitened[BYTES_PER_MESSAGE];
+  std::memcpy(whitened, message, BYTES_PER_MESSAGE);
+  AltusFrameDecoder::whiten(whitened, BYTES_PER_MESSAGE);
+
+  // Rate 1/2 convolutional code, two bytes (32 coded bits) at a time so they
+  // can be interleaved
+  uint16_t fec = 0;
+  for (int pair = 0; pair < BYTES_PER_MESSAGE; pair += 2) {
+    uint32_t encoded = 0;
+    for (int byte = 0; byte < 2; byte++) {
+      fec |= whitened[pair + byte];
+      for (int bit = 0; bit < 8; bit++) {
+        encoded = (encoded << 2) | fec_encode_table[fec >> 7];
+        fec = (fec << 1) & 0x7ff;
+      }
+    }
+
+    // The interleaving is a transpose, so it is its own inverse
+    uint32_t interleaved = AltusFrameDecoder::deinterleave(encoded);
+    for (int b = BITS_TO_BUFFER - 1; b >= 0; b--) {
+      bits.push_back((interleaved >> b) & 1);
+    }
+  }
+
+  return bits;
+}
+
+size_t altus_air_bits() {
+  return preamble_bits + PACKET_BITS;
+}
+
+GfskModulator::GfskModulator(double rate, double dev, double bt) {
+  sample_rate = rate;
+  deviation = dev;
+
+  // A one symbol pulse through a Gaussian filter, in symbols
+  double sigma = std::sqrt(std::log(2.0)) / (2 * M_PI * bt);
+  pulse_half_width = 0.5 + 4 * sigma;
+  pulse_resolution = pulse_points_per_symbol;
+  size_t points = size_t(2 * pulse_half_width * pulse_resolution) + 1;
+  pulse.resize(points);
+  for (size_t i = 0; i < points; i++) {
+    double x = double(i) / pulse_resolution - pulse_half_width;
+    pulse[i] = 0.5 * (
+      std::erf((x + 0.5) / (std::sqrt(2.0) * sigma)) -
+      std::erf((x - 0.5) / (std::sqrt(2.0) * sigma))
+    );
+  }
+}
+
+uint64_t GfskModulator::samples_for(size_t bit_count) {
+  return uint64_t(std::ceil((bit_count * sample_rate) / BAUD_RATE));
+}
+
+double GfskModulator::frequency_at(const std::vector<uint8_t> &bits, uint64_t sample) {
+  double symbol = (double(sample) * BAUD_RATE) / sample_rate;
+  int64_t first = int64_t(std::floor(symbol - pulse_half_width));
+  int64_t last = int64_t(std::ceil(symbol + pulse_half_width));
+  double frequency = 0;
+  for (int64_t k = std::max(int64_t(0), first); k <= last && k < int64_t(bits.size()); k++) {
+    double x = symbol - (k + 0.5);
+    if (x <= -pulse_half_width || x >= pulse_half_width) {
+      continue;
+    }
+    float p = pulse[size_t((x + pulse_half_width) * pulse_resolution + 0.5)];
+    frequency += bits[k] ? p : -p;
+  }
+  return frequency * deviation;
+}
+
+bool parse_transmitter(const std::string &spec, transmitter_t &transmitter) {
+  std::vector<double> values;
+  std::stringstream spec_stream(spec);
+  std::string part;
+  try {
+    while (std::getline(spec_stream, part, ':')) {
+      values.push_back(std::stod(part));
+    }
+  } catch (const std::exception &e) {
+    return false;
+  }
+  if (values.size() < 2 || values.size() > 5) {
+    return false;
+  }
+
+  transmitter.offset_hz = values[0];
+  transmitter.snr_db = values[1];
+  if (values.size() > 2) {
+    transmitter.drift_hz_per_s = values[2];
+  }
+  if (values.size() > 3) {
+    transmitter.interval_s = values[3];
+  }
+  if (values.size() > 4) {
+    transmitter.start_s = values[4];
+  }
+  return transmitter.interval_s > 0;
+}
+
+size_t add_random_transmitters(
+  scenario_config_t &config,
+  size_t count,
+  double snr_min_db,
+  double snr_max_db,
+  double max_drift_hz_per_s
+) {
+  std::mt19937 rng(config.seed + config.transmitters.size());
+
+  // Every free channel in the part of the band the tracker watches
+  std::vector<double> offsets;
+  int64_t max_channel = int64_t((config.sample_rate * 0.4) / channel_spacing);
+  for (int64_t c = -max_channel; c <= max_channel; c++) {
+    double offset = c * channel_spacing;
+    bool used = false;
+    for (std::vector<transmitter_t>::iterator it = config.transmitters.begin(); it != config.transmitters.end(); it++) {
+      used = used || std::fabs(it->offset_hz - offset) < channel_spacing / 2;
+    }
+    if (!used) {
+      offsets.push_back(offset);
+    }
+  }
+  std::shuffle(offsets.begin(), offsets.end(), rng);
+
+  std::uniform_real_distribution<double> snr(snr_min_db, snr_max_db);
+  std::uniform_real_distribution<double> drift(-max_drift_hz_per_s, max_drift_hz_per_s);
+  std::uniform_real_distribution<double> interval(0.2, 1.0);
+  std::uniform_real_distribution<double> phase(0, 1);
+  size_t added = std::min(count, offsets.size());
+  for (size_t i = 0; i < added; i++) {
+    transmitter_t transmitter;
+    transmitter.offset_hz = offsets[i];
+    transmitter.snr_db = snr(rng);
+    transmitter.drift_hz_per_s = drift(rng);
+    transmitter.interval_s = interval(rng);
+    transmitter.start_s = phase(rng) * transmitter.interval_s;
+    transmitter.serial = 0;
+    config.transmitters.push_back(transmitter);
+  }
+  return added;
+}
+
+ScenarioGenerator::ScenarioGenerator(
+  const scenario_config_t &c
+) : config(c), rng(c.seed), modulator(c.sample_rate) {
+  double noise_power = std::pow(10.0, config.noise_dbfs / 10);
+  noise = std::normal_distribution<float>(0, std::sqrt(noise_power / 2));
+
+  next_sample = 0;
+  total_samples = uint64_t(config.duration_s * config.sample_rate);
+  for (size_t i = 0; i < config.transmitters.size(); i++) {
+    if (config.transmitters[i].serial == 0) {
+      config.transmitters[i].serial = 1000 + i;
+    }
+    next_packet.push_back(uint64_t(std::max(0.0, config.transmitters[i].start_s) * config.sample_rate));
+    packets_sent.push_back(0);
+  }
+}
+
+void ScenarioGenerator::start_bursts(uint64_t before_sample) {
+  size_t first_new = truth.size();
+  double noise_power = std::pow(10.0, config.noise_dbfs / 10);
+
+  for (size_t i = 0; i < config.transmitters.size(); i++) {
+    const transmitter_t &transmitter = config.transmitters[i];
+    while (next_packet[i] < before_sample) {
+      burst_t burst;
+      burst.transmitter = i;
+      burst.first_sample = next_packet[i];
+      burst.amplitude = std::sqrt(
+        std::pow(10.0, transmitter.snr_db / 10) * noise_power * (snr_bandwidth / config.sample_rate)
+      );
+      burst.phase = std::uniform_real_distribution<double>(0, 2 * M_PI)(rng);
+
+      ground_truth_t packet;
+      packet.sample = burst.first_sample;
+      packet.time_s = double(burst.first_sample) / config.sample_rate;
+      packet.freq = config.center_freq + transmitter.offset_hz + transmitter.drift_hz_per_s * packet.time_s;
+      packet.serial = transmitter.serial;
+      packet.type = generator_packet_types[packets_sent[i] % generator_packet_type_count];
+      packet.snr_db = transmitter.snr_db;
+
+      uint8_t data[DATA_BYTES_PER_MESSAGE];
+      build_altus_data(packet.type, packet.serial, uint16_t(packet.time_s * 100), rng, data);
+      frame_altus_message(data, packet.message);
+      burst.bits = encode_altus_bits(packet.message);
+      burst.end_sample = burst.first_sample + modulator.samples_for(burst.bits.size());
+
+      bursts.push_back(burst);
+      truth.push_back(packet);
+      packets_sent[i]++;
+      next_packet[i] += uint64_t(transmitter.interval_s * config.sample_rate);
+    }
+  }
+
+  std::sort(truth.begin() + first_new, truth.end(), [](const ground_truth_t &a, const ground_truth_t &b) {
+    return a.sample < b.sample;
+  });
+}
+
+size_t ScenarioGenerator::generate(std::complex<float> *out, size_t count) {
+  if (next_sample >= total_samples) {
+    return 0;
+  }
+  count = std::min(uint64_t(count), total_samples - next_sample);
+  uint64_t end_sample = next_sample + count;
+  start_bursts(end_sample);
+
+  for (size_t i = 0; i < count; i++) {
+    out[i] = std::complex<float>(noise(rng), noise(rng));
+  }
+
+  // Each burst carries on its phase from the last block
+  for (std::vector<burst_t>::iterator burst = bursts.begin(); burst != bursts.end(); burst++) {
+    const transmitter_t &transmitter = config.transmitters[burst->transmitter];
+    uint64_t first = std::max(burst->first_sample, next_sample);
+    uint64_t last = std::min(burst->end_sample, end_sample);
+    for (uint64_t s = first; s < last; s++) {
+      double carrier = transmitter.offset_hz + (transmitter.drift_hz_per_s * s) / config.sample_rate;
+      double frequency = carrier + modulator.frequency_at(burst->bits, s - burst->first_sample);
+      burst->phase = std::fmod(burst->phase + (2 * M_PI * frequency) / config.sample_rate, 2 * M_PI);
+      out[s - next_sample] += std::complex<float>(
+        burst->amplitude * std::cos(burst->phase),
+        burst->amplitude * std::sin(burst->phase)
+      );
+    }
+  }
+  bursts.erase(
+    std::remove_if(bursts.begin(), bursts.end(), [end_sample](const burst_t &burst) {
+      return burst.end_sample <= end_sample;
+    }),
+    bursts.end()
+  );
+
+  next_sample = end_sample;
+  return count;
+}
+
+const std::vector<ground_truth_t> &ScenarioGenerator::ground_truth() {
+  return truth;
+}
+
+std::string ScenarioGenerator::truth_to_string(const ground_truth_t &packet) {
+  std::stringstream line;
+  line << "{\"Serial\":" << packet.serial << ",";
+  line << "\"Freq\":" << std::fixed << std::setprecision(3) << (packet.freq / 1000000) << ",";
+  line << "\"Type\":" << +packet.type << ",";
+  line << "\"Sample\":" << packet.sample << ",";
+  line << "\"Seconds\":" << std::fixed << std::setprecision(6) << packet.time_s << ",";
+  line << "\"SNR\":" << std::fixed << std::setprecision(1) << packet.snr_db << ",";
+  line << "\"Raw\":\"" << std::hex;
+  for (int i = 0; i < BYTES_PER_MESSAGE; i++) {
+    line << std::setw(2) << std::setfill('0') << +packet.message[i];
+  }
+  line << std::dec << "\"}";
+  return line.str();
+}
@@ -0,0 +1,221 @@
+#ifndef ALTUS_GENERATOR_H
+#define ALTUS_GENERATOR_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+/**
+ * @brief Packet types the generator cycles through, one of each parser
+ */
+extern const uint8_t generator_packet_types[];
+extern const size_t generator_packet_type_count;
+
+/**
+ * @brief Fill in the data bytes of a packet with plausible values
+ * Counts and strings are kept in range so every parser is happy, the rest is
+ * random
+ *
+ * @param type The packet type
+ * @param serial The device serial number
+ * @param tick The device clock (100 Hz)
+ * @param rng The random source for the sensor values
+ * @param data Set to the DATA_BYTES_PER_MESSAGE data bytes
+ */
+void build_altus_data(
+  uint8_t type,
+  uint16_t serial,
+  uint16_t tick,
+  std::mt19937 &rng,
+  uint8_t data[DATA_BYTES_PER_MESSAGE]
+);
+
+/**
+ * @brief Append the CRC and trellis terminators to the data bytes
+ * The result is what the tracker decodes and reports as Raw
+ *
+ * @param data The data bytes
+ * @param message Set to the full message
+ */
+void frame_altus_message(
+  const uint8_t data[DATA_BYTES_PER_MESSAGE],
+  uint8_t message[BYTES_PER_MESSAGE]
+);
+
+/**
+ * @brief Whiten, FEC encode and interleave a message the way AltOS does, with
+ * the preamble and sync word in front
+ *
+ * @param message The framed message
+ * @return std::vector<uint8_t> The bits to send, one per byte
+ */
+std::vector<uint8_t> encode_altus_bits(const uint8_t message[BYTES_PER_MESSAGE]);
+
+/**
+ * @brief Bits sent per packet, preamble included
+ */
+size_t altus_air_bits();
+
+/**
+ * Gaussian filtered FSK at the Altus symbol rate and deviation, at any output
+ * sample rate
+ *
+ * The frequency pulse is tabulated once, so each output sample costs a few
+ * table lookups and a sincos.
+ */
+class GfskModulator {
+  private:
+    double sample_rate;
+    double deviation;
+    std::vector<float> pulse;
+    double pulse_resolution;
+    double pulse_half_width;
+
+  public:
+    /**
+     * @param sample_rate The output sample rate
+     * @param deviation The peak deviation (in Hz)
+     * @param bt The Gaussian filter bandwidth time product
+     */
+    GfskModulator(double sample_rate, double deviation = 20500, double bt = 0.5);
+
+    /**
+     * @brief The number of samples a run of bits takes
+     */
+    uint64_t samples_for(size_t bit_count);
+
+    /**
+     * @brief The frequency deviation at a sample of a burst
+     *
+     * @param bits The bits being sent
+     * @param sample The sample from the start of the burst
+     * @return double The deviation from the carrier (in Hz)
+     */
+    double frequency_at(const std::vector<uint8_t> &bits, uint64_t sample);
+};
+
+/**
+ * @brief One simulated flight computer
+ */
+struct transmitter_t {
+  double offset_hz = 0;       // From the center frequency
+  double snr_db = 20;         // Over the noise in a 100 kHz channel
+  double drift_hz_per_s = 0;  // The carrier moves this much per second
+  double interval_s = 1;      // Between the starts of packets
+  double start_s = 0;         // The first packet
+  uint16_t serial = 0;
+};
+
+/**
+ * @brief A wideband capture to simulate
+ */
+struct scenario_config_t {
+  double sample_rate = 10000000;
+  double center_freq = 435025000;
+  double duration_s = 10;
+  double noise_dbfs = -30;    // Total noise power per sample
+  uint32_t seed = 1;
+  std::vector<transmitter_t> transmitters;
+};
+
+/**
+ * @brief A packet that was put on the air, for scoring the decoder
+ */
+struct ground_truth_t {
+  uint64_t sample;
+  double time_s;
+  double freq;
+  uint16_t serial;
+  uint8_t type;
+  double snr_db;
+  uint8_t message[BYTES_PER_MESSAGE];
+};
+
+/**
+ * @brief Parse a transmitter spec, offset_hz:snr_db[:drift_hz_per_s[:interval_s[:start_s]]]
+ *
+ * @param spec The spec
+ * @param transmitter Updated with the values given
+ * @return true If the spec was valid
+ */
+bool parse_transmitter(const std::string &spec, transmitter_t &transmitter);
+
+/**
+ * @brief Add transmitters on free 100 kHz channels across the band
+ *
+ * @param config The scenario to add to
+ * @param count The number of transmitters
+ * @param snr_min_db The lowest SNR
+ * @param snr_max_db The highest SNR
+ * @param max_drift_hz_per_s The largest drift (either way)
+ * @return size_t The number added, less than count if the band is full
+ */
+size_t add_random_transmitters(
+  scenario_config_t &config,
+  size_t count,
+  double snr_min_db,
+  double snr_max_db,
+  double max_drift_hz_per_s
+);
+
+/**
+ * Streams the samples of a scenario a block at a time
+ *
+ * Noise is complex Gaussian, every transmitter sends a packet each interval
+ * cycling through the packet types, and each packet is recorded as ground
+ * truth when it starts.
+ */
+class ScenarioGenerator {
+  private:
+    struct burst_t {
+      size_t transmitter;
+      uint64_t first_sample;
+      uint64_t end_sample;
+      double amplitude;
+      double phase;
+      std::vector<uint8_t> bits;
+    };
+
+    scenario_config_t config;
+    std::mt19937 rng;
+    std::normal_distribution<float> noise;
+    GfskModulator modulator;
+
+    uint64_t next_sample;
+    uint64_t total_samples;
+    std::vector<uint64_t> next_packet;
+    std::vector<uint32_t> packets_sent;
+    std::vector<burst_t> bursts;
+    std::vector<ground_truth_t> truth;
+
+    void start_bursts(uint64_t before_sample);
+
+  public:
+    ScenarioGenerator(const scenario_config_t &config);
+
+    /**
+     * @brief Generate the next samples
+     *
+     * @param out Where to write them
+     * @param count The most to write
+     * @return size_t The number written, 0 once the scenario is over
+     */
+    size_t generate(std::complex<float> *out, size_t count);
+
+    /**
+     * @brief Every packet started so far, in order
+     */
+    const std::vector<ground_truth_t> &ground_truth();
+
+    /**
+     * @brief A ground truth packet as an NDJSON line, Raw matches the tracker
+     */
+    static std::string truth_to_string(const ground_truth_t &packet);
+};
+
+#endif
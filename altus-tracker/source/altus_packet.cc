@@ -8,7 +8,8 @@
 
 AltosBasePacket::AltosBasePacket(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
+  double new_channel_freq,
+  int64_t new_time_ms
 ) {
   for (uint8_t i = 0; i < BYTES_PER_MESSAGE; i++) {
     message[i] = new_message[i];
@@ -18,15 +19,12 @@ AltosBasePacket::AltosBasePacket(
   type = message[4];
 
   channel_freq = new_channel_freq;
-  std::chrono::milliseconds ms = duration_cast< std::chrono::milliseconds >(
-    std::chrono::system_clock::now().time_since_epoch()
-  );
 
   str_value << "{\"Serial\":" << std::fixed << std::setprecision(0) << serial << ",";
   str_value << "\"Freq\":" << std::fixed << std::setprecision(3) << (channel_freq / 1000000) << ",";
   str_value << "\"Type\":" << +type << ",";
   str_value << "\"RTime\":" << std::fixed << std::setprecision(0) << rockettime << ",";
-  str_value << "\"Time\":" << std::fixed << std::setprecision(0) << ms.count() << ",";
+  str_value << "\"Time\":" << std::fixed << std::setprecision(0) << new_time_ms << ",";
   str_value << "\"Raw\":\"" << std::hex;
   for (uint8_t i = 0; i < BYTES_PER_MESSAGE; i++) {
     str_value << std::setw(2) << std::setfill('0') << +message[i];
@@ -74,8 +72,9 @@ double AltosBasePacket::tele_gps_voltage(int16_t v) {
 
 AltosTelemetrySensor::AltosTelemetrySensor(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   if (type == 0x01) {
     str_value << "\"GroundAccel\":" << std::fixed << std::setprecision(0) << int16(24) << ",";
     str_value << "\"AccelPlusG\":" << std::fixed << std::setprecision(0) << int16(28) << ",";
@@ -102,8 +101,9 @@ AltosTelemetrySensor::AltosTelemetrySensor(
 
 AltosTelemetryConfiguration::AltosTelemetryConfiguration(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t device_type = uint8(5);
   uint16_t flight = uint16(6);
   uint8_t config_major = uint8(8);
@@ -136,8 +136,9 @@ AltosTelemetryConfiguration::AltosTelemetryConfiguration(
 
 AltosTelemetryLocation::AltosTelemetryLocation(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t flags = uint8(5);
   uint8_t nsat = flags & 0xf;
   uint8_t locked = (flags & (1 << 4)) > 0;
@@ -185,8 +186,9 @@ AltosTelemetryLocation::AltosTelemetryLocation(
 
 AltosTelemetrySatellite::AltosTelemetrySatellite(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t channels = uint8(5);
   if (channels > 12) {
     channels = 12;
@@ -207,11 +209,15 @@ AltosTelemetrySatellite::AltosTelemetrySatellite(
 
 AltosTelemetryCompanion::AltosTelemetryCompanion(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t board_id = uint8(5);
   uint8_t update_period = uint8(6);
   uint8_t channels = uint8(7);
+  if (channels > 12) {
+    channels = 12;
+  }
   if (channels > 0) {
     str_value << "\"BoardId\":" << std::fixed << std::setprecision(0) << +board_id << ",";
     str_value << "\"UpdatePeriod\":" << std::fixed << std::setprecision(0) << +update_period << ",";
@@ -230,8 +236,9 @@ AltosTelemetryCompanion::AltosTelemetryCompanion(
 
 AltosTelemetryMegaSensor::AltosTelemetryMegaSensor(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t v4_sensor = 0x08 == type;
 
   int16_t accel_across = v4_sensor ? -1 * int16(16) : int16(14);
@@ -268,8 +275,9 @@ AltosTelemetryMegaSensor::AltosTelemetryMegaSensor(
 
 AltosTelemetryMegaData::AltosTelemetryMegaData(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t state = uint8(5);
   double v_batt = mega_battery_voltage(int16(6));
   double v_pyro = type == 0x09
@@ -311,8 +319,9 @@ AltosTelemetryMegaData::AltosTelemetryMegaData(
 
 AltosTelemetryMetrumSensor::AltosTelemetryMetrumSensor(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t state = uint8(5);
   int16_t accel = int16(6);
   int32_t pres = int32(8);
@@ -338,8 +347,9 @@ AltosTelemetryMetrumSensor::AltosTelemetryMetrumSensor(
 
 AltosTelemetryMetrumData::AltosTelemetryMetrumData(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   int32_t ground_pres = int32(8);
   int32_t ground_accel = int16(12);
   int32_t accel_plus_g = int16(14);
@@ -353,8 +363,9 @@ AltosTelemetryMetrumData::AltosTelemetryMetrumData(
 
 AltosTelemetryMini::AltosTelemetryMini(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   uint8_t state = uint8(5);
   double v_batt = type == 0x10 ? tele_mini_2_voltage(int16(6)) : tele_mini_3_battery_voltage(int16(6));
   double sense_a = type == 0x10 ? tele_mini_2_voltage(int16(8)) : tele_mini_3_pyro_voltage(int16(8));
@@ -380,8 +391,9 @@ AltosTelemetryMini::AltosTelemetryMini(
 
 AltosTelemetryMegaNorm::AltosTelemetryMegaNorm(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
-) : AltosBasePacket(new_message, new_channel_freq) {
+  double new_channel_freq,
+  int64_t new_time_ms
+) : AltosBasePacket(new_message, new_channel_freq, new_time_ms) {
   int8_t orient = int8(5);
   int16_t accel = int16(6);
   int32_t pres = int32(8);
@@ -413,7 +425,8 @@ AltosTelemetryMegaNorm::AltosTelemetryMegaNorm(
 
 AltosBasePacket *make_altus_packet(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
+  double new_channel_freq,
+  int64_t new_time_ms
 ) {
   switch (new_message[4]) {
     case 0x01:
@@ -421,77 +434,89 @@ AltosBasePacket *make_altus_packet(
     case 0x03: {
       return new AltosTelemetrySensor(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x04: {
       return new AltosTelemetryConfiguration(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x05: {
       return new AltosTelemetryLocation(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x06: {
       return new AltosTelemetrySatellite(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x07: {
       return new AltosTelemetryCompanion(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x08:
     case 0x12: {
       return new AltosTelemetryMegaSensor(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x09:
     case 0x15: {
       return new AltosTelemetryMegaData(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x0A: {
       return new AltosTelemetryMetrumSensor(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x0B: {
       return new AltosTelemetryMetrumData(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x10:
     case 0x11: {
       return new AltosTelemetryMini(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     case 0x13:
     case 0x14: {
       return new AltosTelemetryMegaNorm(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
     default: {
       return new AltosBasePacket(
         new_message,
-        new_channel_freq
+        new_channel_freq,
+        new_time_ms
       );
     }
   }
@@ -53,9 +53,10 @@ class AltosBasePacket {
   public:
     AltosBasePacket(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
-    ~AltosBasePacket();
+    virtual ~AltosBasePacket();
 
     double mega_battery_voltage(int16_t v);
     double mega_pyro_voltage(int16_t v);
@@ -74,7 +75,8 @@ class AltosTelemetrySensor : public AltosBasePacket {
   public:
     AltosTelemetrySensor(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -83,7 +85,8 @@ class AltosTelemetryConfiguration : public AltosBasePacket {
   public:
     AltosTelemetryConfiguration(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -92,7 +95,8 @@ class AltosTelemetryLocation : public AltosBasePacket {
   public:
     AltosTelemetryLocation(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -101,7 +105,8 @@ class AltosTelemetrySatellite : public AltosBasePacket {
   public:
     AltosTelemetrySatellite(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -110,7 +115,8 @@ class AltosTelemetryCompanion : public AltosBasePacket {
   public:
     AltosTelemetryCompanion(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -119,7 +125,8 @@ class AltosTelemetryMegaSensor : public AltosBasePacket {
   public:
     AltosTelemetryMegaSensor(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -128,7 +135,8 @@ class AltosTelemetryMegaData : public AltosBasePacket {
   public:
     AltosTelemetryMegaData(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -137,7 +145,8 @@ class AltosTelemetryMetrumSensor : public AltosBasePacket {
   public:
     AltosTelemetryMetrumSensor(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -146,7 +155,8 @@ class AltosTelemetryMetrumData : public AltosBasePacket {
   public:
     AltosTelemetryMetrumData(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -155,7 +165,8 @@ class AltosTelemetryMini : public AltosBasePacket {
   public:
     AltosTelemetryMini(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
@@ -164,13 +175,15 @@ class AltosTelemetryMegaNorm : public AltosBasePacket {
   public:
     AltosTelemetryMegaNorm(
       uint8_t new_message[BYTES_PER_MESSAGE],
-      double new_channel_freq
+      double new_channel_freq,
+      int64_t new_time_ms
     );
 };
 
 AltosBasePacket *make_altus_packet(
   uint8_t new_message[BYTES_PER_MESSAGE],
-  double new_channel_freq
+  double new_channel_freq,
+  int64_t new_time_ms
 );
 
 #endif
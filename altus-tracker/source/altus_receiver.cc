@@ -0,0 +1,544 @@
+#include "altus_receiver.h"
+
+#include <gnuradio/blocks/complex_to_interleaved_short.h>
+#include <gnuradio/blocks/interleaved_short_to_complex.h>
+
+#include <algorithm>
+#include <iostream>
+
+// Full scale of the int16 samples
+const float int16_scale = 32767.0;
+
+altus_receiver_sptr make_altus_receiver(
+  gr::top_block_sptr tb,
+  gr::basic_block_sptr source,
+  receiver_config_t config,
+  packet_ring_sptr packet_ring,
+  channel_changed_t channel_changed
+) {
+  return std::make_shared<AltusReceiver>(
+    tb,
+    source,
+    config,
+    packet_ring,
+    channel_changed
+  );
+}
+
+AltusReceiver::AltusReceiver(
+  gr::top_block_sptr t,
+  gr::basic_block_sptr s,
+  receiver_config_t c,
+  packet_ring_sptr ring,
+  channel_changed_t changed
+) {
+  tb = t;
+  source = s;
+  config = c;
+  packet_ring = ring;
+  channel_changed = changed;
+  if (config.channel_count > MAX_CHANNELS) {
+    config.channel_count = MAX_CHANNELS;
+  }
+
+  // Generate all of the channels, spread across the band
+  std::vector<uint32_t> start_freqs;
+  for (uint8_t i = 0; i < config.channel_count; i++) {
+    start_freqs.push_back(spread_freq(i));
+  }
+  build(start_freqs);
+}
+
+uint32_t AltusReceiver::spread_freq(size_t channel) {
+  uint32_t channel_freq = config.min_channel_freq() + (ROUND_CHANNEL_TO / 2) - 1;
+  channel_freq -= channel_freq % ROUND_CHANNEL_TO;
+  return channel_freq + channel * ROUND_CHANNEL_TO * 2;
+}
+
+void AltusReceiver::build(const std::vector<uint32_t> &channel_freqs) {
+  // Everything but an int16 pool takes gr_complex, so an int16 source is
+  // converted once for all of them
+  gr::basic_block_sptr complex_source = source;
+  if (config.cs16_source) {
+    to_complex = gr::blocks::interleaved_short_to_complex::make(true, false, int16_scale);
+    tb->connect(source, 0, to_complex, 0);
+    complex_source = to_complex;
+  }
+
+  if (config.channel_pool) {
+    bool int16_pool = config.int16_frontend || config.cs16_source;
+    pool = gr::AltusDecoder::ChannelPool::make(
+      config.sample_rate,
+      double(config.center_freq),
+      channel_freqs,
+      packet_ring,
+      config.first_channel,
+      config.pool_threads,
+      int16_pool
+    );
+    pool->set_demod(config.demod);
+    if (config.cs16_source) {
+      tb->connect(source, 0, pool, 0);
+    } else if (int16_pool) {
+      // One pass to int16 here saves every channel its float first stage
+      to_int16 = gr::blocks::complex_to_interleaved_short::make(true, int16_scale);
+      tb->connect(source, 0, to_int16, 0);
+      tb->connect(to_int16, 0, pool, 0);
+    } else {
+      tb->connect(source, 0, pool, 0);
+    }
+  } else {
+    for (uint8_t i = 0; i < config.channel_count; i++) {
+      channel_blocks[i] = make_altus_channel(
+        channel_freqs[i],
+        double(config.center_freq),
+        config.sample_rate,
+        packet_ring,
+        config.first_channel + i
+      );
+      tb->connect(complex_source, 0, channel_blocks[i], 0);
+    }
+  }
+
+  // Build the detector
+  power_level = make_altus_power_level(
+    config.sample_rate,
+    config.fft_size,
+    config.detector_rate
+  );
+  tb->connect(complex_source, 0, power_level, 0);
+  detector = gr::AltusDecoder::Detector::make(
+    [this](uint32_t freq) {
+      if (detection_handler) {
+        detection_handler(freq);
+      } else {
+        add_channel(freq);
+      }
+    },
+    config.center_freq,
+    config.sample_rate,
+    config.fft_size,
+    config.channel_count,
+    config.min_channel_freq(),
+    config.max_channel_freq(),
+    config.spur_seconds,
+    power_level->frame_rate()
+  );
+  detector->set_squelch(config.squelch);
+  detector->get_spur_mask()->set_exclusions(exclusions);
+  tb->connect(power_level, 0, detector, 0);
+
+  // A rebuild brings the new blocks up to the settings of the old ones
+  if (event_handler) {
+    set_event_handler(event_handler);
+  }
+  if (latency_histogram != nullptr) {
+    set_latency_histogram(latency_histogram);
+  }
+  if (record_dir != "") {
+    enable_channel_recording(record_dir, record_format);
+  }
+  if (load_shedding) {
+    enable_load_shedding();
+  }
+  if (low_cost) {
+    if (pool != nullptr) {
+      pool->set_low_cost(true);
+    } else {
+      for (int i = 0; i < config.channel_count; i++) {
+        channel_blocks[i]->set_low_cost(true);
+      }
+    }
+  }
+}
+
+void AltusReceiver::disconnect() {
+  gr::basic_block_sptr complex_source = to_complex != nullptr ? to_complex : source;
+  if (pool != nullptr) {
+    if (to_int16 != nullptr) {
+      tb->disconnect(to_int16, 0, pool, 0);
+      tb->disconnect(source, 0, to_int16, 0);
+      to_int16.reset();
+    } else {
+      tb->disconnect(source, 0, pool, 0);
+    }
+    pool.reset();
+  }
+  for (int i = 0; i < MAX_CHANNELS; i++) {
+    if (channel_blocks[i] != nullptr) {
+      tb->disconnect(complex_source, 0, channel_blocks[i], 0);
+      channel_blocks[i].reset();
+    }
+  }
+  tb->disconnect(power_level, 0, detector, 0);
+  tb->disconnect(complex_source, 0, power_level, 0);
+  if (to_complex != nullptr) {
+    tb->disconnect(source, 0, to_complex, 0);
+    to_complex.reset();
+  }
+}
+
+bool AltusReceiver::is_free(size_t channel) {
+  return !pinned[channel] && !is_channel_parked(channel);
+}
+
+void AltusReceiver::add_channel(uint32_t channel_freq) {
+  std::unique_lock<std::mutex> lock(channel_mutex);
+
+  // Check to see if the channel already exists
+  for (int i = 0; i < config.channel_count; i++) {
+    if (this->channel_freq(i) == channel_freq) {
+      channel_counters(i)->add(channel_counter_t::DETECTIONS);
+      return;
+    }
+  }
+
+  // Parked and pinned channels keep their frequency
+  for (int i = 0; i < config.channel_count && !is_free(channel_idx); i++) {
+    channel_idx = (channel_idx + 1) % config.channel_count;
+  }
+  if (!is_free(channel_idx)) {
+    return;
+  }
+
+  // Add the channel
+  uint32_t channel_being_removed = this->channel_freq(channel_idx);
+  if (pool != nullptr) {
+    pool->set_channel(channel_idx, channel_freq);
+  } else {
+    channel_blocks[channel_idx]->set_channel(channel_freq);
+  }
+  channel_counters(channel_idx)->add(channel_counter_t::DETECTIONS);
+
+  // Increment the index
+  channel_idx++;
+  if (channel_idx >= config.channel_count) {
+    channel_idx = 0;
+  }
+  lock.unlock();
+
+  if (channel_changed) {
+    channel_changed(channel_being_removed, channel_freq);
+  }
+  if (event_handler) {
+    event_handler(altus_event_t::DETECTION, channel_freq);
+  }
+}
+
+bool AltusReceiver::has_channel(uint32_t channel_freq) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  for (int i = 0; i < config.channel_count; i++) {
+    if (this->channel_freq(i) == channel_freq) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AltusReceiver::pin_channel(uint32_t channel_freq) {
+  if (channel_freq < config.min_channel_freq() || channel_freq > config.max_channel_freq()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  for (int i = 0; i < config.channel_count; i++) {
+    if (this->channel_freq(i) == channel_freq) {
+      pinned[i] = true;
+      return true;
+    }
+  }
+
+  // Take the channel the detector would have moved next
+  for (int i = 0; i < config.channel_count && !is_free(channel_idx); i++) {
+    channel_idx = (channel_idx + 1) % config.channel_count;
+  }
+  if (!is_free(channel_idx)) {
+    return false;
+  }
+  if (pool != nullptr) {
+    pool->set_channel(channel_idx, channel_freq);
+  } else {
+    channel_blocks[channel_idx]->set_channel(channel_freq);
+  }
+  pinned[channel_idx] = true;
+  channel_idx = (channel_idx + 1) % config.channel_count;
+  return true;
+}
+
+bool AltusReceiver::unpin_channel(uint32_t channel_freq) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  bool found = false;
+  for (int i = 0; i < config.channel_count; i++) {
+    if (pinned[i] && this->channel_freq(i) == channel_freq) {
+      pinned[i] = false;
+      found = true;
+    }
+  }
+  return found;
+}
+
+std::vector<uint32_t> AltusReceiver::pinned_freqs() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  std::vector<uint32_t> freqs;
+  for (int i = 0; i < config.channel_count; i++) {
+    if (pinned[i]) {
+      freqs.push_back(channel_freq(i));
+    }
+  }
+  return freqs;
+}
+
+void AltusReceiver::set_center_freq(uint32_t center_freq) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  config.center_freq = center_freq;
+  detector->set_band(center_freq, config.min_channel_freq(), config.max_channel_freq());
+  if (pool != nullptr) {
+    pool->set_center_freq(center_freq);
+  }
+  for (int i = 0; i < config.channel_count; i++) {
+    if (pool == nullptr) {
+      channel_blocks[i]->set_center_freq(center_freq);
+    }
+
+    uint32_t freq = channel_freq(i);
+    if (freq >= config.min_channel_freq() && freq <= config.max_channel_freq()) {
+      continue;
+    }
+    pinned[i] = false;
+    if (pool != nullptr) {
+      pool->set_channel(i, spread_freq(i));
+    } else {
+      channel_blocks[i]->set_channel(spread_freq(i));
+    }
+  }
+}
+
+void AltusReceiver::set_squelch(int16_t squelch) {
+  config.squelch = squelch;
+  detector->set_squelch(squelch);
+}
+
+void AltusReceiver::rebuild(double sample_rate, uint16_t channel_count) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  std::vector<uint32_t> old_freqs;
+  for (int i = 0; i < config.channel_count; i++) {
+    old_freqs.push_back(channel_freq(i));
+  }
+  bool old_pinned[MAX_CHANNELS];
+  std::copy(pinned, pinned + MAX_CHANNELS, old_pinned);
+  std::vector<freq_range_t> spurs = detector->get_spur_mask()->get_learned();
+  suppressed_before += detector->get_spur_mask()->suppressed();
+
+  disconnect();
+  config.sample_rate = sample_rate;
+  config.channel_count = std::min(channel_count, uint16_t(MAX_CHANNELS));
+
+  std::vector<uint32_t> freqs;
+  for (int i = 0; i < config.channel_count; i++) {
+    bool kept = i < int(old_freqs.size()) &&
+      old_freqs[i] >= config.min_channel_freq() &&
+      old_freqs[i] <= config.max_channel_freq();
+    freqs.push_back(kept ? old_freqs[i] : spread_freq(i));
+    pinned[i] = kept && old_pinned[i];
+  }
+  std::fill(pinned + config.channel_count, pinned + MAX_CHANNELS, false);
+  channel_idx = 0;
+  build(freqs);
+  detector->get_spur_mask()->add_learned(spurs);
+}
+
+void AltusReceiver::set_detection_handler(detection_handler_t handler) {
+  detection_handler = handler;
+}
+
+const receiver_config_t &AltusReceiver::get_config() {
+  return config;
+}
+
+void AltusReceiver::set_event_handler(altus_event_handler_t handler) {
+  event_handler = handler;
+  if (pool != nullptr) {
+    pool->set_event_handler(handler);
+    return;
+  }
+  for (int i = 0; i < config.channel_count; i++) {
+    channel_blocks[i]->set_event_handler(handler);
+  }
+}
+
+void AltusReceiver::set_latency_histogram(latency_histogram_sptr histogram) {
+  latency_histogram = histogram;
+  if (pool != nullptr) {
+    pool->set_latency_histogram(histogram);
+    return;
+  }
+  for (int i = 0; i < config.channel_count; i++) {
+    channel_blocks[i]->set_latency_histogram(histogram);
+  }
+}
+
+void AltusReceiver::enable_channel_recording(const std::string &dir, iq_format_t format) {
+  if (pool != nullptr) {
+    std::cout << "[WARN] Channel recording isn't available with the channel pool" << std::endl;
+    return;
+  }
+  record_dir = dir;
+  record_format = format;
+  for (int i = 0; i < config.channel_count; i++) {
+    channel_blocks[i]->enable_recording(dir, format);
+  }
+}
+
+void AltusReceiver::enable_load_shedding() {
+  load_shedding = true;
+  if (pool != nullptr) {
+    return;
+  }
+  for (int i = 0; i < config.channel_count; i++) {
+    channel_blocks[i]->enable_parking();
+  }
+}
+
+void AltusReceiver::set_detector_rate_divisor(int divisor) {
+  power_level->set_frame_rate_divisor(divisor);
+  detector->get_spur_mask()->set_frame_rate(power_level->frame_rate());
+}
+
+int AltusReceiver::get_detector_rate_divisor() {
+  return power_level->get_frame_rate_divisor();
+}
+
+void AltusReceiver::set_low_cost(bool l) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  low_cost = l;
+  if (pool != nullptr) {
+    pool->set_low_cost(low_cost);
+    return;
+  }
+  for (int i = 0; i < config.channel_count; i++) {
+    channel_blocks[i]->set_low_cost(low_cost);
+  }
+}
+
+bool AltusReceiver::set_demod(channel_demod_t demod) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  if (pool == nullptr) {
+    return demod == channel_demod_t::FULL;
+  }
+  config.demod = demod;
+  pool->set_demod(config.demod);
+  return true;
+}
+
+void AltusReceiver::set_exclusions(const std::vector<freq_range_t> &e) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  exclusions = e;
+  detector->get_spur_mask()->set_exclusions(exclusions);
+}
+
+std::vector<freq_range_t> AltusReceiver::learned_spurs() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  return detector->get_spur_mask()->get_learned();
+}
+
+void AltusReceiver::add_learned_spurs(const std::vector<freq_range_t> &spurs) {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  detector->get_spur_mask()->add_learned(spurs);
+}
+
+void AltusReceiver::clear_learned_spurs() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  detector->get_spur_mask()->clear_learned();
+}
+
+uint64_t AltusReceiver::suppressed_detections() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  return suppressed_before + detector->get_spur_mask()->suppressed();
+}
+
+std::vector<uint32_t> AltusReceiver::channel_freqs() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  std::vector<uint32_t> freqs;
+  for (int i = 0; i < config.channel_count; i++) {
+    freqs.push_back(channel_freq(i));
+  }
+  return freqs;
+}
+
+size_t AltusReceiver::channel_count() {
+  return config.channel_count;
+}
+
+uint32_t AltusReceiver::channel_freq(size_t channel) {
+  if (pool != nullptr) {
+    return pool->channel_freq(channel);
+  }
+  return channel_blocks[channel]->channel_freq;
+}
+
+channel_counters_sptr AltusReceiver::channel_counters(size_t channel) {
+  if (pool != nullptr) {
+    return pool->get_counters(channel);
+  }
+  return channel_blocks[channel]->get_counters();
+}
+
+std::vector<channel_counters_sptr> AltusReceiver::all_channel_counters() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  std::vector<channel_counters_sptr> counters;
+  for (int i = 0; i < config.channel_count; i++) {
+    counters.push_back(channel_counters(i));
+  }
+  return counters;
+}
+
+bool AltusReceiver::set_channel_parked(size_t channel, bool parked) {
+  if (pool != nullptr) {
+    if (!load_shedding) {
+      return false;
+    }
+    pool->set_parked(channel, parked);
+    return true;
+  }
+  return channel_blocks[channel]->set_parked(parked);
+}
+
+bool AltusReceiver::is_channel_parked(size_t channel) {
+  if (pool != nullptr) {
+    return pool->is_parked(channel);
+  }
+  return channel_blocks[channel]->is_parked();
+}
+
+double AltusReceiver::channel_input_fill() {
+  if (pool != nullptr) {
+    return pool->input_fill();
+  }
+  double fill = 0;
+  for (int i = 0; i < config.channel_count; i++) {
+    if (!channel_blocks[i]->is_parked()) {
+      fill = std::max(fill, channel_blocks[i]->input_fill());
+    }
+  }
+  return fill;
+}
+
+std::vector<stage_blocks_t> AltusReceiver::channel_stage_blocks() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  std::vector<stage_blocks_t> stages;
+  if (pool != nullptr) {
+    stages.push_back({std::make_pair("channel_pool", pool)});
+    return stages;
+  }
+  for (int i = 0; i < config.channel_count; i++) {
+    stages.push_back(channel_blocks[i]->stage_blocks());
+  }
+  return stages;
+}
+
+stage_blocks_t AltusReceiver::detector_stage_blocks() {
+  std::lock_guard<std::mutex> lock(channel_mutex);
+  stage_blocks_t stages = power_level->stage_blocks();
+  stages.push_back(std::make_pair("detector", detector));
+  return stages;
+}
@@ -0,0 +1,366 @@
+#ifndef ALTUS_RECEIVER_H
+#define ALTUS_RECEIVER_H
+
+#include <gnuradio/top_block.h>
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "packet_ring.h"
+#include "spur_mask.h"
+#include "blocks/altus_channel.h"
+#include "blocks/altus_channel_pool.h"
+#include "blocks/altus_detector.h"
+#include "blocks/altus_power_level.h"
+
+/**
+ * @brief Called when the detector moves a channel to a new frequency
+ */
+typedef std::function<void (
+  uint32_t,
+  uint32_t
+)> channel_changed_t;
+
+/**
+ * @brief Called with each frequency the detector finds
+ */
+typedef std::function<void (
+  uint32_t
+)> detection_handler_t;
+
+/**
+ * @brief Settings for one wideband input
+ */
+struct receiver_config_t {
+  uint32_t center_freq = 435025000;
+  double sample_rate = 10000000;
+  uint16_t channel_count = 5;
+  uint16_t fft_size = 1024;
+  uint16_t detector_rate = 100;   // Detector frames per second
+  bool channel_pool = false;      // Every channel in one block on a thread pool
+  uint16_t pool_threads = 0;      // 0 for one per core
+  uint16_t first_channel = 0;     // The tracker's index of the first channel
+  int16_t squelch = 60;           // Detector level above the mean (in dB)
+  double spur_seconds = 5;        // A bin up this long is masked as a spur, 0 for no learning
+  channel_demod_t demod = channel_demod_t::FULL; // FAST needs the channel pool
+  bool int16_frontend = false;    // The pool's first stage filters int16 samples
+  bool cs16_source = false;       // The source gives int16 pairs, not gr_complex
+
+  // How well a frequency is covered, 1 at the center falling to 0 at the
+  // edge of the channels, negative outside them
+  double coverage(uint32_t freq) const {
+    return 1.0 - std::fabs(double(freq) - center_freq) / (sample_rate * 0.4);
+  }
+
+  uint32_t min_channel_freq() const { return center_freq - (sample_rate * 0.4); }
+  uint32_t max_channel_freq() const { return center_freq + (sample_rate * 0.4); }
+};
+
+class AltusReceiver;
+
+typedef std::shared_ptr<AltusReceiver> altus_receiver_sptr;
+
+/**
+ * @brief Build a receiver on a wideband source
+ *
+ * @param tb The top block to build in
+ * @param source The wideband source, gr_complex or int16 pairs (cs16_source)
+ * @param config The receiver settings
+ * @param packet_ring The ring decoded packets are pushed into
+ * @param channel_changed Called when a channel moves (can be empty)
+ * @return altus_receiver_sptr
+ */
+altus_receiver_sptr make_altus_receiver(
+  gr::top_block_sptr tb,
+  gr::basic_block_sptr source,
+  receiver_config_t config,
+  packet_ring_sptr packet_ring,
+  channel_changed_t channel_changed
+);
+
+/**
+ * The detector and the pool of channels it assigns for one wideband input
+ *
+ * Channels start spread across the band and are moved, oldest first, to
+ * whatever the detector finds. They are either a block of their own each or
+ * all run in one ChannelPool, the per channel accessors work the same for both.
+ */
+class AltusReceiver {
+  private:
+    gr::top_block_sptr tb;
+    gr::basic_block_sptr source;
+    receiver_config_t config;
+    packet_ring_sptr packet_ring;
+    channel_changed_t channel_changed;
+    altus_event_handler_t event_handler;
+    detection_handler_t detection_handler;
+    latency_histogram_sptr latency_histogram;
+    std::string record_dir;
+    iq_format_t record_format;
+    bool low_cost = false;
+    std::vector<freq_range_t> exclusions;
+    uint64_t suppressed_before = 0;     // By the detectors a rebuild replaced
+
+    // Converters between the source and the blocks that take the other type
+    gr::basic_block_sptr to_complex;
+    gr::basic_block_sptr to_int16;
+
+    altus_power_level_sptr power_level;
+    gr::AltusDecoder::Detector::sptr detector;
+    altus_channel_sptr channel_blocks[MAX_CHANNELS];
+    gr::AltusDecoder::ChannelPool::sptr pool;
+    bool pinned[MAX_CHANNELS] = {};
+    int channel_idx = 0;
+    std::mutex channel_mutex;
+    bool load_shedding = false;
+
+    /**
+     * @brief Where channel i starts, spread across the band
+     */
+    uint32_t spread_freq(size_t channel);
+
+    /**
+     * @brief Build and connect the channels and the detector for the config
+     */
+    void build(const std::vector<uint32_t> &channel_freqs);
+
+    /**
+     * @brief Disconnect the channels and the detector from the flowgraph
+     */
+    void disconnect();
+
+    /**
+     * @brief Whether the detector may move a channel
+     */
+    bool is_free(size_t channel);
+
+  public:
+    AltusReceiver(
+      gr::top_block_sptr tb,
+      gr::basic_block_sptr source,
+      receiver_config_t config,
+      packet_ring_sptr packet_ring,
+      channel_changed_t channel_changed
+    );
+
+    /**
+     * @brief Move the oldest channel to a frequency, if no channel is on it
+     *
+     * @param channel_freq The new channel frequency
+     */
+    void add_channel(uint32_t channel_freq);
+
+    /**
+     * @brief Whether a channel is on a frequency
+     */
+    bool has_channel(uint32_t channel_freq);
+
+    /**
+     * @brief Keep a channel on a frequency, the detector won't move it
+     *
+     * @param channel_freq The frequency, a channel is moved there if none is on it
+     * @return true If the frequency is in the band and a channel was free to pin
+     */
+    bool pin_channel(uint32_t channel_freq);
+
+    /**
+     * @brief Let the detector move the channel on a frequency again
+     *
+     * @return true If a channel was pinned there
+     */
+    bool unpin_channel(uint32_t channel_freq);
+
+    /**
+     * @brief The frequencies of the pinned channels
+     */
+    std::vector<uint32_t> pinned_freqs();
+
+    /**
+     * @brief Follow the source to a new frequency without stopping
+     *
+     * The channels keep their frequencies and their filters move to the new
+     * offsets. Channels left outside the band go back to their starting
+     * places and lose any pin.
+     *
+     * @param center_freq The new frequency (in Hz)
+     */
+    void set_center_freq(uint32_t center_freq);
+
+    /**
+     * @brief Set the detector level above the mean (in dB)
+     */
+    void set_squelch(int16_t squelch);
+
+    /**
+     * @brief Replace the channels and the detector for a new sample rate or
+     * channel count, everything else in the config is kept
+     *
+     * Call it between tb->lock() and tb->unlock(), the source and the rest of
+     * the flowgraph stay as they are. Channels still in the band keep their
+     * frequencies and pins.
+     *
+     * @param sample_rate The new sample rate
+     * @param channel_count The new number of channels
+     */
+    void rebuild(double sample_rate, uint16_t channel_count);
+
+    /**
+     * @brief Send the detector's frequencies somewhere other than add_channel
+     * Set it before the flowgraph starts
+     *
+     * @param handler The handler, called on the detector thread
+     */
+    void set_detection_handler(detection_handler_t handler);
+
+    /**
+     * @brief The receiver's settings
+     */
+    const receiver_config_t &get_config();
+
+    /**
+     * @brief Set the handler for detections, decodes and CRC failures
+     * Set it before the flowgraph starts, it is called on the block threads
+     *
+     * @param handler The handler
+     */
+    void set_event_handler(altus_event_handler_t handler);
+
+    /**
+     * @brief Count the decode latency of live packets on every channel
+     *
+     * @param histogram The histogram
+     */
+    void set_latency_histogram(latency_histogram_sptr histogram);
+
+    /**
+     * @brief Record channel rate IQ from every channel
+     * Must be called before the flowgraph starts
+     *
+     * @param dir The directory for the recordings
+     * @param format The sample format to record
+     */
+    void enable_channel_recording(const std::string &dir, iq_format_t format);
+
+    /**
+     * @brief Let channels be parked to shed load
+     * Must be called before the flowgraph starts
+     */
+    void enable_load_shedding();
+
+    /**
+     * @brief Run the detector FFTs at a fraction of the usual rate
+     *
+     * @param divisor 1 for the full rate
+     */
+    void set_detector_rate_divisor(int divisor);
+
+    /**
+     * @brief The current detector rate divisor
+     */
+    int get_detector_rate_divisor();
+
+    /**
+     * @brief Use the cheaper channel filters on every channel
+     *
+     * @param low_cost Whether to use the cheaper filters
+     */
+    void set_low_cost(bool low_cost);
+
+    /**
+     * @brief Switch the demodulator of every channel
+     *
+     * @param demod The demodulator
+     * @return true If the channels can run it, the fast one needs the pool
+     */
+    bool set_demod(channel_demod_t demod);
+
+    /**
+     * @brief Keep the detector off frequencies whatever it sees there
+     *
+     * @param exclusions The ranges, replacing any set before
+     */
+    void set_exclusions(const std::vector<freq_range_t> &exclusions);
+
+    /**
+     * @brief The spurs and carriers the detector has learned to ignore
+     */
+    std::vector<freq_range_t> learned_spurs();
+
+    /**
+     * @brief Ignore spurs learned earlier, like the ones saved from the last
+     * run, until they turn out to be gone
+     */
+    void add_learned_spurs(const std::vector<freq_range_t> &spurs);
+
+    /**
+     * @brief Forget the learned spurs, they are learned again if still there
+     */
+    void clear_learned_spurs();
+
+    /**
+     * @brief The number of bin detections the spur mask has dropped
+     */
+    uint64_t suppressed_detections();
+
+    /**
+     * @brief The current frequency of each channel
+     */
+    std::vector<uint32_t> channel_freqs();
+
+    /**
+     * @brief The number of channels, indexed as packet_slot_t.channel
+     */
+    size_t channel_count();
+
+    /**
+     * @brief The current frequency of a channel
+     */
+    uint32_t channel_freq(size_t channel);
+
+    /**
+     * @brief The decode funnel and link quality counters of a channel
+     */
+    channel_counters_sptr channel_counters(size_t channel);
+
+    /**
+     * @brief The counters of every channel
+     * Safe against a rebuild, unlike looping over channel_counters
+     */
+    std::vector<channel_counters_sptr> all_channel_counters();
+
+    /**
+     * @brief Stop or restart processing a channel
+     *
+     * @param channel The channel
+     * @param parked Whether to park it
+     * @return true If the channel can be parked (load shedding is enabled)
+     */
+    bool set_channel_parked(size_t channel, bool parked);
+
+    /**
+     * @brief Whether a channel is parked
+     */
+    bool is_channel_parked(size_t channel);
+
+    /**
+     * @brief How full the fullest input buffer of an active channel is, 0 to 1
+     */
+    double channel_input_fill();
+
+    /**
+     * @brief The blocks of each channel, named by stage, or of the pool
+     */
+    std::vector<stage_blocks_t> channel_stage_blocks();
+
+    /**
+     * @brief The power level blocks and the detector, named by stage
+     */
+    stage_blocks_t detector_stage_blocks();
+};
+
+#endif
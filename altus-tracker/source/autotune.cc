@@ -0,0 +1,348 @@
+#include <gnuradio/top_block.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include "altus_generator.h"
+#include "altus_receiver.h"
+#include "autotune.h"
+#include "constants.h"
+#include "packet_ring.h"
+#include "blocks/altus_iq_file.h"
+#include "blocks/altus_sample_tagger.h"
+
+// Bump when the flowgraph changes enough to make old measurements wrong
+const std::string autotune_cache_version = "1";
+
+// Channels in the second run, the difference from one channel is the cost of
+// the rest
+const uint16_t autotune_channel_runs = 4;
+
+// Synthetic transmitters, so the channels have packets to decode
+const uint32_t autotune_transmitters = 8;
+
+const std::vector<detector_option_t> &autotune_detector_options() {
+  static const std::vector<detector_option_t> options = {
+    {1024, 100},
+    {1024, 50},
+    {512, 50},
+    {512, 25}
+  };
+  return options;
+}
+
+static double process_cpu_seconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static std::string cpu_model() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.find("model name") == 0) {
+      size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        return line.substr(line.find_first_not_of(' ', colon + 1));
+      }
+    }
+  }
+  return "unknown";
+}
+
+static double run_cpu_seconds(gr::top_block_sptr tb) {
+  double start = process_cpu_seconds();
+  tb->run();
+  return process_cpu_seconds() - start;
+}
+
+// The CPU the whole receiver takes with a number of channels
+static double receiver_cpu_seconds(
+  const autotune_config_t &config,
+  const void *data,
+  uint64_t samples,
+  iq_format_t format,
+  uint16_t channel_count
+) {
+  receiver_config_t receiver_config;
+  receiver_config.center_freq = config.center_freq;
+  receiver_config.sample_rate = config.sample_rate;
+  receiver_config.channel_count = channel_count;
+  receiver_config.fft_size = autotune_detector_options()[0].fft_size;
+  receiver_config.detector_rate = autotune_detector_options()[0].frame_rate;
+  receiver_config.channel_pool = config.channel_pool;
+  receiver_config.pool_threads = config.pool_threads;
+  receiver_config.demod = config.demod;
+  receiver_config.int16_frontend = config.int16_frontend;
+  receiver_config.cs16_source = config.int16_frontend && format == iq_format_t::CS16;
+
+  gr::top_block_sptr tb = gr::make_top_block("AltusAutotune");
+  packet_ring_sptr ring = make_packet_ring(1024, drop_policy_t::DROP_NEWEST);
+  altus_iq_file_source_sptr source = make_altus_iq_memory_source(data, samples, format, receiver_config.cs16_source);
+  gr::AltusDecoder::SampleTagger::sptr tagger = gr::AltusDecoder::SampleTagger::make(
+    config.sample_rate,
+    0,
+    0,
+    false,
+    receiver_config.cs16_source ? 2 * sizeof(int16_t) : sizeof(gr_complex)
+  );
+  tb->connect(source, 0, tagger, 0);
+  altus_receiver_sptr receiver = make_altus_receiver(tb, tagger, receiver_config, ring, nullptr);
+  return run_cpu_seconds(tb);
+}
+
+// The CPU the spectrum path and detector take on their own
+static double detector_cpu_seconds(
+  const autotune_config_t &config,
+  const void *data,
+  uint64_t samples,
+  iq_format_t format,
+  const detector_option_t &option
+) {
+  receiver_config_t receiver_config;
+  receiver_config.center_freq = config.center_freq;
+  receiver_config.sample_rate = config.sample_rate;
+
+  gr::top_block_sptr tb = gr::make_top_block("AltusAutotuneDetector");
+  altus_iq_file_source_sptr source = make_altus_iq_memory_source(data, samples, format, false);
+  altus_power_level_sptr power_level = make_altus_power_level(
+    config.sample_rate,
+    option.fft_size,
+    option.frame_rate
+  );
+  gr::AltusDecoder::Detector::sptr detector = gr::AltusDecoder::Detector::make(
+    [](uint32_t) {},
+    receiver_config.center_freq,
+    receiver_config.sample_rate,
+    option.fft_size,
+    receiver_config.channel_count,
+    receiver_config.min_channel_freq(),
+    receiver_config.max_channel_freq(),
+    receiver_config.spur_seconds,
+    power_level->frame_rate()
+  );
+  tb->connect(source, 0, power_level, 0);
+  tb->connect(power_level, 0, detector, 0);
+  return run_cpu_seconds(tb);
+}
+
+// Either the start of the capture or a synthetic scenario, as cs16 to keep
+// the memory down on small boxes
+static bool benchmark_input(
+  const autotune_config_t &config,
+  std::vector<char> &data,
+  iq_format_t &format
+) {
+  uint64_t samples = uint64_t(config.seconds * config.sample_rate);
+  if (config.file != "") {
+    format = config.file_format;
+    size_t sample_size = iq_format_sample_size(format);
+    std::ifstream file(config.file, std::ios::binary);
+    if (!file.is_open()) {
+      std::cout << "[WARN] Autotune failed to open " << config.file << std::endl;
+      return false;
+    }
+    data.resize(samples * sample_size);
+    file.read(&data[0], data.size());
+    data.resize((file.gcount() / sample_size) * sample_size);
+    if (data.size() < (samples / 2) * sample_size) {
+      std::cout << "[WARN] " << config.file << " is too short to autotune on" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  scenario_config_t scenario;
+  scenario.sample_rate = config.sample_rate;
+  scenario.center_freq = config.center_freq;
+  scenario.duration_s = config.seconds;
+  add_random_transmitters(scenario, autotune_transmitters, 15, 30, 0);
+
+  format = iq_format_t::CS16;
+  data.resize(samples * iq_format_sample_size(format));
+  int16_t *out = (int16_t *)&data[0];
+  size_t written = 0;
+  ScenarioGenerator generator(scenario);
+  std::vector<std::complex<float>> chunk(65536);
+  size_t count;
+  while ((count = generator.generate(&chunk[0], chunk.size())) > 0 && written < samples * 2) {
+    const float *values = (const float *)&chunk[0];
+    for (size_t i = 0; i < count * 2 && written < samples * 2; i++) {
+      out[written++] = int16_t(std::clamp(values[i] * 32767.0f, -32767.0f, 32767.0f));
+    }
+  }
+  data.resize(written * sizeof(int16_t));
+  return true;
+}
+
+static bool measure_costs(const autotune_config_t &config, autotune_costs_t &costs) {
+  std::vector<char> data;
+  iq_format_t format;
+  std::cout << "Autotune benchmarking on " << (config.file != "" ? config.file : "a synthetic scenario") << std::endl;
+  if (!benchmark_input(config, data, format)) {
+    return false;
+  }
+  uint64_t samples = data.size() / iq_format_sample_size(format);
+  double seconds = samples / config.sample_rate;
+
+  uint16_t channel_runs = std::min(autotune_channel_runs, uint16_t(MAX_CHANNELS));
+  double one_channel = receiver_cpu_seconds(config, &data[0], samples, format, 1) / seconds;
+  double many_channels = receiver_cpu_seconds(config, &data[0], samples, format, channel_runs) / seconds;
+  costs.channel_cores = std::max(0.001, (many_channels - one_channel) / (channel_runs - 1));
+
+  costs.detector_cores.clear();
+  const std::vector<detector_option_t> &options = autotune_detector_options();
+  for (std::vector<detector_option_t>::const_iterator it = options.begin(); it != options.end(); it++) {
+    costs.detector_cores.push_back(detector_cpu_seconds(config, &data[0], samples, format, *it) / seconds);
+  }
+  costs.base_cores = std::max(0.0, one_channel - costs.channel_cores - costs.detector_cores[0]);
+  return true;
+}
+
+void choose_autotune(
+  const autotune_costs_t &costs,
+  double headroom,
+  autotune_result_t &result,
+  std::ostream &reasoning
+) {
+  const std::vector<detector_option_t> &options = autotune_detector_options();
+  double budget = costs.cores * (1 - headroom);
+  reasoning << std::fixed << std::setprecision(2);
+  reasoning << "  " << costs.cores << " core(s), leaving " << std::setprecision(0) << (headroom * 100);
+  reasoning << "% free, " << std::setprecision(2) << budget << " cores to spend" << std::endl;
+  reasoning << "  Source and tagger     " << costs.base_cores << " cores" << std::endl;
+  reasoning << "  Each channel          " << costs.channel_cores << " cores" << std::endl;
+
+  // The most channels any detector setting leaves room for
+  std::vector<int> fits;
+  int most = 0;
+  for (size_t i = 0; i < options.size() && i < costs.detector_cores.size(); i++) {
+    double left = budget - costs.base_cores - costs.detector_cores[i];
+    int channels = std::clamp(int(std::floor(left / costs.channel_cores)), 0, int(MAX_CHANNELS));
+    fits.push_back(channels);
+    most = std::max(most, channels);
+    reasoning << "  Detector " << std::setw(4) << options[i].fft_size << " @ " << std::setw(3) << options[i].frame_rate << "/s  ";
+    reasoning << std::setprecision(2) << costs.detector_cores[i] << " cores, room for " << channels << " channel(s)" << std::endl;
+  }
+
+  // The best detector that doesn't cost a channel
+  size_t chosen = 0;
+  for (size_t i = 0; i < fits.size(); i++) {
+    if (fits[i] == most) {
+      chosen = i;
+      break;
+    }
+  }
+  if (most == 0) {
+    chosen = fits.size() > 0 ? fits.size() - 1 : 0;
+    reasoning << "  [WARN] Not even one channel fits, running one with the cheapest detector" << std::endl;
+  }
+
+  result.channel_count = std::max(1, most);
+  result.fft_size = options[chosen].fft_size;
+  result.detector_rate = options[chosen].frame_rate;
+  reasoning << "  Chose " << result.channel_count << " channel(s)";
+  if (most == int(MAX_CHANNELS)) {
+    reasoning << " (the most the tracker runs)";
+  }
+  reasoning << " and the " << result.fft_size << " bin detector at " << result.detector_rate << " frames/s";
+  if (chosen > 0 && most > 0) {
+    reasoning << ", the better settings leave room for fewer channels";
+  }
+  reasoning << std::endl;
+}
+
+bool read_autotune_cache(const std::string &path, const std::string &key, autotune_costs_t &costs) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  bool matched = false;
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t equals = line.find('=');
+    if (equals == std::string::npos) {
+      continue;
+    }
+    std::string name = line.substr(0, equals);
+    std::string value = line.substr(equals + 1);
+    try {
+      if (name == "key") {
+        matched = value == key;
+      } else if (name == "cores") {
+        costs.cores = std::stoul(value);
+      } else if (name == "base_cores") {
+        costs.base_cores = std::stod(value);
+      } else if (name == "channel_cores") {
+        costs.channel_cores = std::stod(value);
+      } else if (name == "detector_cores") {
+        costs.detector_cores.clear();
+        std::stringstream list(value);
+        std::string item;
+        while (std::getline(list, item, ',')) {
+          costs.detector_cores.push_back(std::stod(item));
+        }
+      }
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  return matched && costs.channel_cores > 0 && costs.detector_cores.size() == autotune_detector_options().size();
+}
+
+bool write_autotune_cache(const std::string &path, const std::string &key, const autotune_costs_t &costs) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+  file << "key=" << key << "\n";
+  file << "cores=" << costs.cores << "\n";
+  file << std::fixed << std::setprecision(6);
+  file << "base_cores=" << costs.base_cores << "\n";
+  file << "channel_cores=" << costs.channel_cores << "\n";
+  file << "detector_cores=";
+  for (size_t i = 0; i < costs.detector_cores.size(); i++) {
+    file << (i > 0 ? "," : "") << costs.detector_cores[i];
+  }
+  file << "\n";
+  return file.good();
+}
+
+bool run_autotune(const autotune_config_t &config, autotune_result_t &result) {
+  uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+  std::stringstream key;
+  key << autotune_cache_version << "|" << cpu_model() << "|" << cores << "|";
+  key << std::fixed << std::setprecision(0) << config.sample_rate << "|" << (config.file != "" ? config.file : "synthetic");
+  key << "|" << (config.channel_pool ? "pool" : "blocks") << "|" << config.pool_threads;
+  key << "|" << channel_demod_name(config.demod) << "|" << (config.int16_frontend ? "int16" : "float");
+
+  autotune_costs_t costs;
+  result.cached = config.cache_path != "" && read_autotune_cache(config.cache_path, key.str(), costs);
+  if (result.cached) {
+    std::cout << "Autotune using the measurements in " << config.cache_path << std::endl;
+  } else {
+    if (!measure_costs(config, costs)) {
+      return false;
+    }
+    costs.cores = cores;
+    if (config.cache_path != "" && !write_autotune_cache(config.cache_path, key.str(), costs)) {
+      std::cout << "[WARN] Failed to write the autotune cache " << config.cache_path << std::endl;
+    }
+  }
+
+  result.costs = costs;
+  std::cout << "Autotune at " << std::fixed << std::setprecision(1) << (config.sample_rate / 1000000) << " MS/s";
+  std::cout << " with the " << channel_demod_name(config.demod) << " demodulator";
+  std::cout << (config.channel_pool ? " in the channel pool" : "") << ":" << std::endl;
+  choose_autotune(costs, config.headroom, result, std::cout);
+  return true;
+}
@@ -0,0 +1,116 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "iq_format.h"
+#include "blocks/altus_channel_dsp.h"
+
+/**
+ * @brief What to tune for
+ */
+struct autotune_config_t {
+  double sample_rate = 10000000;
+  uint32_t center_freq = 435025000;
+  double seconds = 2;               // Signal to benchmark each run on
+  double headroom = 0.3;            // Share of the CPU to leave free
+  std::string cache_path;           // Empty to always benchmark
+
+  // The channel chain the tracker will run, as in receiver_config_t
+  bool channel_pool = false;
+  uint16_t pool_threads = 0;
+  channel_demod_t demod = channel_demod_t::FULL;
+  bool int16_frontend = false;
+
+  // Captured samples to benchmark on, a synthetic scenario if empty
+  std::string file;
+  iq_format_t file_format = iq_format_t::CF32;
+};
+
+/**
+ * @brief A detector setting, in order of preference
+ */
+struct detector_option_t {
+  uint16_t fft_size;
+  uint16_t frame_rate;
+};
+
+/**
+ * @brief What the benchmark measured, in cores used at real time
+ */
+struct autotune_costs_t {
+  uint32_t cores = 0;
+  double base_cores = 0;            // The source and sample tagger
+  double channel_cores = 0;         // Each channel
+  std::vector<double> detector_cores;   // Each of autotune_detector_options()
+};
+
+/**
+ * @brief What was chosen and why
+ */
+struct autotune_result_t {
+  uint16_t channel_count = 1;
+  uint16_t fft_size = 1024;
+  uint16_t detector_rate = 100;
+  bool cached = false;
+  autotune_costs_t costs;
+};
+
+/**
+ * @brief The detector settings autotune picks from, best first
+ */
+const std::vector<detector_option_t> &autotune_detector_options();
+
+/**
+ * @brief Benchmark the channel chain and detector on this host, or load the
+ * last results for the same host and sample rate, then pick the settings
+ * Prints the measurements and the reasoning. Run it before the tracker's
+ * flowgraph starts, it measures the CPU time of the whole process.
+ *
+ * @param config What to tune for
+ * @param result The chosen settings
+ * @return true If the settings could be measured or loaded
+ */
+bool run_autotune(const autotune_config_t &config, autotune_result_t &result);
+
+/**
+ * @brief Pick the largest channel count that fits, then the best detector
+ * setting that doesn't cost a channel
+ *
+ * @param costs The measured costs
+ * @param headroom Share of the CPU to leave free
+ * @param result The chosen settings
+ * @param reasoning Where to explain the choice
+ */
+void choose_autotune(
+  const autotune_costs_t &costs,
+  double headroom,
+  autotune_result_t &result,
+  std::ostream &reasoning
+);
+
+/**
+ * @brief Load cached costs, if they were measured for the same host, sample
+ * rate, input and channel chain
+ *
+ * @param path The cache file
+ * @param key What the costs have to have been measured for
+ * @param costs The costs
+ * @return true If the cache matched
+ */
+bool read_autotune_cache(const std::string &path, const std::string &key, autotune_costs_t &costs);
+
+/**
+ * @brief Save measured costs
+ *
+ * @param path The cache file
+ * @param key What the costs were measured for
+ * @param costs The costs
+ * @return true If the file was written
+ */
+bool write_autotune_cache(const std::string &path, const std::string &key, const autotune_costs_t &costs);
+
+#endif
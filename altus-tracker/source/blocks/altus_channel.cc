@@ -5,16 +5,29 @@
 
 #include "altus_channel.h"
 #include <boost/log/trivial.hpp>
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer_reader.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
 
 altus_channel_sptr make_altus_channel(
   double channel_freq,
   double center_freq,
-  double input_sample_rate
+  double input_sample_rate,
+  packet_ring_sptr packet_ring,
+  uint8_t channel_index
 ) {
   return gnuradio::get_initial_sptr(new AltusChannel(
     channel_freq,
     center_freq,
-    input_sample_rate
+    input_sample_rate,
+    packet_ring,
+    channel_index
   ));
 }
 
@@ -23,16 +36,74 @@ AltusChannel::~AltusChannel() {}
 void AltusChannel::handle_message(
   uint8_t message[BYTES_PER_MESSAGE],
   uint16_t computed_crc,
-  uint16_t received_crc
+  uint16_t received_crc,
+  const packet_timing_t &timing
 ) {
-  auto packet = make_altus_packet(
-    message,
-    channel_freq
-  );
-  std::string msg = packet->to_string() + "\n";
-  packet_queue_mutex.lock();
-  packet_queue.push_back(msg);
-  packet_queue_mutex.unlock();
+  // Runs on the decoder thread, so no locking or allocating here
+  double now_ms = std::chrono::duration<double, std::milli>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+
+  // Time the packet from its sync word, falling back to the clock if the
+  // source isn't tagged
+  double packet_ms = now_ms;
+  if (timing.valid) {
+    double bit_ms = 1000.0 / symbol_rate;
+    packet_ms = timing.tag_time_ms + timing.sync_bits * bit_ms;
+    if (timing.live && decode_latency != nullptr) {
+      decode_latency->record(now_ms - (packet_ms + PACKET_BITS * bit_ms));
+    }
+  }
+  int64_t time_ms = std::llround(packet_ms);
+
+  if (computed_crc != received_crc) {
+    counters->add(channel_counter_t::CRC_FAIL);
+    crc_failure_times[crc_failure_idx] = time_ms;
+    crc_failure_idx = (crc_failure_idx + 1) % crc_failure_burst;
+
+    // The next slot holds the oldest of the last few failures
+    if (time_ms - crc_failure_times[crc_failure_idx] <= crc_failure_window_ms) {
+      std::fill(crc_failure_times, crc_failure_times + crc_failure_burst, INT64_MIN / 2);
+      if (event_handler) {
+        event_handler(altus_event_t::CRC_FAILURES, channel_freq);
+      }
+    }
+    return;
+  }
+
+  counters->add(channel_counter_t::CRC_PASS);
+
+  // The symbols are in units of the deviation, whatever the FLL didn't take
+  // out shows up as their mean
+  if (timing.have_symbols) {
+    double fll_hz = -fll_band_edge->get_frequency() * channel_rate / (2 * M_PI);
+    counters->record_link(timing.symbol_snr_db, fll_hz + timing.symbol_mean * fsk_deviation);
+  }
+
+  packet_slot_t packet;
+  std::memcpy(packet.message, message, BYTES_PER_MESSAGE);
+  packet.channel_freq = channel_freq;
+  packet.time_ms = time_ms;
+  packet.channel = channel_index;
+  if (packet_ring->push(packet)) {
+    counters->add(channel_counter_t::FORWARDED);
+  }
+
+  if (event_handler) {
+    event_handler(altus_event_t::DECODE, channel_freq);
+  }
+}
+
+void AltusChannel::set_event_handler(altus_event_handler_t handler) {
+  event_handler = handler;
+}
+
+void AltusChannel::set_latency_histogram(latency_histogram_sptr histogram) {
+  decode_latency = histogram;
+}
+
+channel_counters_sptr AltusChannel::get_counters() {
+  return counters;
 }
 
 void AltusChannel::set_channel(uint32_t c) {
@@ -42,8 +113,32 @@ void AltusChannel::set_channel(uint32_t c) {
     std::cout << "Changing from " << std::fixed << std::setprecision(3) << (float(channel_freq) / 1000000) << " to ";
     std::cout << std::fixed << std::setprecision(3) << (float(c) / 1000000) << std::endl;
   }
+  bool retuned = channel_freq != c;
   channel_freq = c;
+  if (retuned) {
+    counters->add(channel_counter_t::RETUNES);
+  }
+
+  // Each assignment gets its own recording
+  if (recorder != nullptr && retuned) {
+    rotate_recording();
+  }
 
+  if (!channel_rate_input) {
+    retune_first_stage();
+  }
+  altus_decode->reset();
+}
+
+void AltusChannel::set_center_freq(double center) {
+  center_freq = center;
+  if (!channel_rate_input) {
+    retune_first_stage();
+  }
+  altus_decode->reset();
+}
+
+void AltusChannel::retune_first_stage() {
   float channel_offset = channel_freq - center_freq;
   int first_stage_decimation = floor(input_sample_rate / (channel_rate * first_stage_channel_width)); // 13.02
 
@@ -52,7 +147,7 @@ void AltusChannel::set_channel(uint32_t c) {
     input_sample_rate,
     float(channel_rate) / -1,
     float(channel_rate) / 1,
-    float(channel_rate) / 4,
+    float(channel_rate) / (low_cost ? 2 : 4),
     10
   );
 
@@ -74,14 +169,14 @@ void AltusChannel::set_channel(uint32_t c) {
 
   first_stage_filter->set_taps(first_stage_taps);
   xlat_rotator->set_phase_inc(rotator_phase_inc);
-
-  altus_decode->reset();
 }
 
 AltusChannel::AltusChannel(
   double channel,
   double center,
-  double s
+  double s,
+  packet_ring_sptr ring,
+  uint8_t index
 ) : gr::hier_block2(
   "AltusChannel " + std::to_string(int(channel)),
   gr::io_signature::make(
@@ -95,48 +190,23 @@ AltusChannel::AltusChannel(
   channel_freq = channel;
   center_freq = center;
   input_sample_rate = s;
+  packet_ring = ring;
+  channel_index = index;
+  counters = make_channel_counters();
+  parked = false;
+  std::fill(crc_failure_times, crc_failure_times + crc_failure_burst, INT64_MIN / 2);
+
+  // Channel rate recordings are already filtered, so they go straight to the
+  // demodulator
+  channel_rate_input = input_sample_rate <= channel_rate;
 
-  // Calculate the values needed to generate filters
-  // float channel_offset = channel_freq - center_freq;
-  int first_stage_decimation = floor(input_sample_rate / (channel_rate * first_stage_channel_width)); // 13.02
-  float first_stage_sample_rate = input_sample_rate / float(first_stage_decimation);
-  int second_stage_decimation = floor(first_stage_sample_rate / channel_rate); // 4.006
-  float second_stage_sample_rate = first_stage_sample_rate / second_stage_decimation; // 192,307
-  int total_decimation = floor(input_sample_rate / channel_rate); // 100
-  
   // Parameters for GFSK demodulation
   float gain_mu = 0.175;
   float gain_omega = 0.25 * gain_mu * gain_mu;
   float loop_bw = -1 * std::log(((gain_mu + gain_omega) / -2) + 1);
   float max_dev = 0.005 * samples_per_symbol;
 
-  // Generate the internal coefficients
-  std::vector<gr_complex> base_first_stage_taps = gr::filter::firdes::complex_band_pass_2(
-    1,
-    input_sample_rate,
-    channel_rate / -1,
-    channel_rate / 1,
-    channel_rate / 4,
-    10
-  );
-  std::vector<float> second_stage_taps = gr::filter::firdes::low_pass_2(
-    1.0,
-    first_stage_sample_rate,
-    fsk_deviation * 1.5,
-    fsk_deviation / 2,
-    60
-  );
-
   // Make the blocks
-  first_stage_filter = gr::filter::fft_filter_ccc::make(
-    first_stage_decimation,
-    base_first_stage_taps
-  );
-  xlat_rotator = gr::blocks::rotator_cc::make(0);
-  second_stage_filter = gr::filter::fft_filter_ccf::make(
-    second_stage_decimation,
-    second_stage_taps
-  );
   // squelch = gr::analog::pwr_squelch_cc::make(
   //   power_squelch_level,
   //   0.0001,
@@ -169,53 +239,226 @@ AltusChannel::AltusChannel(
     [this](
       uint8_t msg[BYTES_PER_MESSAGE],
       uint16_t c_crc,
-      uint16_t r_crc
+      uint16_t r_crc,
+      const packet_timing_t &timing
     ) { 
-      handle_message(msg, c_crc, r_crc);
+      handle_message(msg, c_crc, r_crc, timing);
     }
     // std::bind(&AltusChannel::handle_message, this)
     // handle_message
   );
+  altus_decode->set_counters(counters);
 
   // Connect things up
-  connect(self(), 0, first_stage_filter, 0);
-  connect(first_stage_filter, 0, xlat_rotator, 0);
-  connect(xlat_rotator, 0, second_stage_filter, 0);
-  
-  // Conditionally add in arb
-  double arb_rate = channel_rate / second_stage_sample_rate;
-  if (arb_rate != 1.0) {
-    // d_logger->warn("Using ARB Resampler");
-    double arb_size = 32;
-    double arb_atten = 10;
-    double percent = 0.80;
-    double halfband = 0.5 * arb_rate;
-    double b_w = percent * halfband;
-    double t_b = (percent / 2.0) * halfband;
-    std::vector<float> arb_taps = gr::filter::firdes::low_pass_2(
-      arb_size,
-      arb_size,
-      b_w,
-      t_b,
-      arb_atten,
-      gr::fft::window::WIN_BLACKMAN_HARRIS
-    );
-    gr::filter::pfb_arb_resampler_ccf::sptr arb_resampler = gr::filter::pfb_arb_resampler_ccf::make(
-      arb_rate,
-      arb_taps
-    );
-    connect(second_stage_filter, 0, arb_resampler, 0);
-    // connect(arb_resampler, 0, squelch, 0);
-    connect(arb_resampler, 0, fll_band_edge, 0);
+  if (channel_rate_input) {
+    first_block = fll_band_edge;
+    connect(self(), 0, fll_band_edge, 0);
   } else {
-    // connect(second_stage_filter, 0, squelch, 0);
-    connect(second_stage_filter, 0, fll_band_edge, 0);
+    channel_rate_block = build_decimation();
+    // connect(channel_rate_block, 0, squelch, 0);
+    connect(channel_rate_block, 0, fll_band_edge, 0);
   }
   // connect(squelch, 0, fll_band_edge, 0);
   connect(fll_band_edge, 0, fmdemod, 0);
   connect(fmdemod, 0, clock_recovery, 0);
   connect(clock_recovery, 0, slicer, 0);
   connect(slicer, 0, altus_decode, 0);
+  connect(clock_recovery, 0, altus_decode, 1);
 
   set_channel(channel);
 }
+
+gr::basic_block_sptr AltusChannel::build_decimation() {
+  // Calculate the values needed to generate filters
+  // float channel_offset = channel_freq - center_freq;
+  int first_stage_decimation = floor(input_sample_rate / (channel_rate * first_stage_channel_width)); // 13.02
+  float first_stage_sample_rate = input_sample_rate / float(first_stage_decimation);
+  int second_stage_decimation = floor(first_stage_sample_rate / channel_rate); // 4.006
+  float second_stage_sample_rate = first_stage_sample_rate / second_stage_decimation; // 192,307
+
+  // Generate the internal coefficients, set_channel offsets the first stage
+  std::vector<gr_complex> base_first_stage_taps = gr::filter::firdes::complex_band_pass_2(
+    1,
+    input_sample_rate,
+    channel_rate / -1,
+    channel_rate / 1,
+    channel_rate / 4,
+    10
+  );
+
+  // Make the blocks
+  first_stage_filter = gr::filter::fft_filter_ccc::make(
+    first_stage_decimation,
+    base_first_stage_taps
+  );
+  xlat_rotator = gr::blocks::rotator_cc::make(0);
+  second_stage_filter = gr::filter::fft_filter_ccf::make(
+    second_stage_decimation,
+    second_stage_taps(first_stage_sample_rate)
+  );
+  first_block = first_stage_filter;
+
+  // Connect things up
+  connect(self(), 0, first_stage_filter, 0);
+  connect(first_stage_filter, 0, xlat_rotator, 0);
+  connect(xlat_rotator, 0, second_stage_filter, 0);
+  
+  // Conditionally add in arb
+  double arb_rate = channel_rate / second_stage_sample_rate;
+  if (arb_rate == 1.0) {
+    return second_stage_filter;
+  }
+
+  // d_logger->warn("Using ARB Resampler");
+  double arb_size = 32;
+  double arb_atten = 10;
+  double percent = 0.80;
+  double halfband = 0.5 * arb_rate;
+  double b_w = percent * halfband;
+  double t_b = (percent / 2.0) * halfband;
+  std::vector<float> arb_taps = gr::filter::firdes::low_pass_2(
+    arb_size,
+    arb_size,
+    b_w,
+    t_b,
+    arb_atten,
+    gr::fft::window::WIN_BLACKMAN_HARRIS
+  );
+  arb_resampler = gr::filter::pfb_arb_resampler_ccf::make(
+    arb_rate,
+    arb_taps
+  );
+  connect(second_stage_filter, 0, arb_resampler, 0);
+  return arb_resampler;
+}
+
+std::vector<float> AltusChannel::second_stage_taps(float first_stage_sample_rate) {
+  // The cheaper filter is about half the length, it lets more of the
+  // neighbouring channels through
+  return gr::filter::firdes::low_pass_2(
+    1.0,
+    first_stage_sample_rate,
+    fsk_deviation * 1.5,
+    low_cost ? fsk_deviation : fsk_deviation / 2,
+    low_cost ? 40 : 60
+  );
+}
+
+void AltusChannel::enable_parking() {
+  if (input_valve != nullptr) {
+    return;
+  }
+
+  input_valve = gr::blocks::copy::make(sizeof(gr_complex));
+  disconnect(self(), 0, first_block, 0);
+  connect(self(), 0, input_valve, 0);
+  connect(input_valve, 0, first_block, 0);
+}
+
+bool AltusChannel::set_parked(bool p) {
+  if (input_valve == nullptr) {
+    return false;
+  }
+  if (parked == p) {
+    return true;
+  }
+
+  parked = p;
+  input_valve->set_enabled(!parked);
+  if (!parked) {
+    // Whatever was half decoded when it was parked is long gone
+    altus_decode->reset();
+  }
+  return true;
+}
+
+bool AltusChannel::is_parked() {
+  return parked;
+}
+
+void AltusChannel::set_low_cost(bool l) {
+  if (channel_rate_input || low_cost == l) {
+    return;
+  }
+
+  low_cost = l;
+  int first_stage_decimation = floor(input_sample_rate / (channel_rate * first_stage_channel_width));
+  float first_stage_sample_rate = input_sample_rate / float(first_stage_decimation);
+  retune_first_stage();
+  second_stage_filter->set_taps(second_stage_taps(first_stage_sample_rate));
+}
+
+double AltusChannel::input_fill() {
+  gr::block_sptr block = input_valve != nullptr ? input_valve : first_block;
+  if (block->detail() == nullptr) {
+    return 0;
+  }
+  gr::buffer_reader_sptr reader = block->detail()->input(0);
+  if (reader == nullptr) {
+    return 0;
+  }
+  return double(reader->items_available()) / reader->buffer()->bufsize();
+}
+
+stage_blocks_t AltusChannel::stage_blocks() {
+  stage_blocks_t stages;
+  if (input_valve != nullptr) {
+    stages.push_back(std::make_pair("input_valve", input_valve));
+  }
+  if (!channel_rate_input) {
+    stages.push_back(std::make_pair("first_stage_filter", first_stage_filter));
+    stages.push_back(std::make_pair("xlat_rotator", xlat_rotator));
+    stages.push_back(std::make_pair("second_stage_filter", second_stage_filter));
+    if (arb_resampler != nullptr) {
+      stages.push_back(std::make_pair("arb_resampler", arb_resampler));
+    }
+  }
+  stages.push_back(std::make_pair("fll_band_edge", fll_band_edge));
+  stages.push_back(std::make_pair("fmdemod", fmdemod));
+  stages.push_back(std::make_pair("clock_recovery", clock_recovery));
+  stages.push_back(std::make_pair("slicer", slicer));
+  stages.push_back(std::make_pair("decoder", altus_decode));
+  if (recorder != nullptr) {
+    stage_blocks_t recorder_stages = recorder->stage_blocks();
+    for (stage_blocks_t::iterator it = recorder_stages.begin(); it != recorder_stages.end(); it++) {
+      stages.push_back(std::make_pair("recorder_" + it->first, it->second));
+    }
+  }
+  return stages;
+}
+
+void AltusChannel::enable_recording(const std::string &dir, iq_format_t format) {
+  if (channel_rate_input || recorder != nullptr) {
+    return;
+  }
+
+  // Nothing is written until the detector assigns a frequency
+  record_dir = dir;
+  record_format = format;
+  recorder = make_altus_iq_file_sink("/dev/null", record_format);
+  recorder->close();
+  connect(channel_rate_block, 0, recorder, 0);
+
+  std::error_code ec;
+  std::filesystem::create_directories(record_dir, ec);
+}
+
+void AltusChannel::rotate_recording() {
+  int64_t now_ms = duration_cast< std::chrono::milliseconds >(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+  std::stringstream path;
+  path << record_dir << "/channel-" << std::fixed << std::setprecision(0) << channel_freq << "-" << now_ms;
+  path << "." << iq_format_name(record_format);
+  if (!recorder->open(path.str())) {
+    std::cout << "[WARN] Failed to open channel recording " << path.str() << std::endl;
+    return;
+  }
+
+  iq_file_info_t info;
+  info.format = record_format;
+  info.sample_rate = channel_rate;
+  info.center_freq = channel_freq;
+  info.description = "channel recording";
+  write_sigmf_meta(path.str(), info);
+}
@@ -4,6 +4,7 @@
 // GNU Radio Blocks
 #include <gnuradio/analog/pwr_squelch_cc.h>
 #include <gnuradio/analog/quadrature_demod_cf.h>
+#include <gnuradio/blocks/copy.h>
 #include <gnuradio/blocks/rotator_cc.h>
 #include <gnuradio/digital/binary_slicer_fb.h>
 #include <gnuradio/digital/constellation.h>
@@ -20,13 +21,18 @@
 #include <gnuradio/message.h>
 #include <gnuradio/msg_queue.h>
 
+#include <atomic>
 #include <functional>
 #include <string>
 #include <vector>
 
+#include "../channel_counters.h"
 #include "../constants.h"
 #include "altus_decoder.h"
-#include "../altus_packet.h"
+#include "altus_iq_file.h"
+#include "../latency_histogram.h"
+#include "../packet_ring.h"
+#include "../perf_counters.h"
 
 #ifdef gnuradio_Altus_Decoder_EXPORTS
 #define ALTUS_DECODER_API __GR_ATTR_EXPORT
@@ -34,6 +40,25 @@
 #define ALTUS_DECODER_API __GR_ATTR_IMPORT
 #endif
 
+/**
+ * @brief Things worth reacting to on a channel (or the detector)
+ * DETECTION is a new signal assigned to a channel, DECODE a good packet and
+ * CRC_FAILURES a burst of packets that synced but failed the CRC
+ */
+enum class altus_event_t {
+  DETECTION,
+  DECODE,
+  CRC_FAILURES
+};
+
+/**
+ * @brief Called from the decoder thread with the event and channel frequency
+ */
+typedef std::function<void (
+  altus_event_t,
+  uint32_t
+)> altus_event_handler_t;
+
 class AltusChannel;
 
 typedef std::shared_ptr<AltusChannel> altus_channel_sptr;
@@ -45,12 +70,16 @@ typedef std::shared_ptr<AltusChannel> altus_channel_sptr;
  * @param channel_freq The frequency of the channel (in Hz)
  * @param center_freq The frequency of the receiver (in Hz)
  * @param input_sample_rate The starting sample rate
+ * @param packet_ring The ring decoded packets are pushed into
+ * @param channel_index The index of this channel in the tracker
  * @return altus_channel_sptr The Altus Channel block
  */
 altus_channel_sptr make_altus_channel(
   double channel_freq,
   double center_freq,
-  double input_sample_rate
+  double input_sample_rate,
+  packet_ring_sptr packet_ring,
+  uint8_t channel_index
 );
 
 class AltusChannel : public gr::hier_block2 {
@@ -61,18 +90,40 @@ class AltusChannel : public gr::hier_block2 {
    * @param channel_freq The frequency of the channel (in Hz)
    * @param center_freq The frequency of the receiver (in Hz)
    * @param input_sample_rate The starting sample rate
+   * @param packet_ring The ring decoded packets are pushed into
+   * @param channel_index The index of this channel in the tracker
    * @return altus_channel_sptr The Altus Channel block
    */
   friend altus_channel_sptr make_altus_channel(
     double channel_freq,
     double center_freq,
-    double input_sample_rate
+    double input_sample_rate,
+    packet_ring_sptr packet_ring,
+    uint8_t channel_index
   );
 
   private:
     // Channel information
     double center_freq;
     double input_sample_rate;
+    uint8_t channel_index;
+
+    // Output queue shared by all of the channels
+    packet_ring_sptr packet_ring;
+
+    // Recent CRC failures, a burst of them means something is there but not
+    // decoding (noise alone syncs about once every couple of seconds)
+    static const uint8_t crc_failure_burst = 5;
+    static const int64_t crc_failure_window_ms = 1000;
+    altus_event_handler_t event_handler;
+    int64_t crc_failure_times[crc_failure_burst];
+    uint8_t crc_failure_idx = 0;
+
+    // Time from the last sample of a live packet arriving to it being decoded
+    latency_histogram_sptr decode_latency;
+
+    // How far signals get through this channel
+    channel_counters_sptr counters;
 
     // Altus channel constants
     const uint8_t samples_per_symbol = 5;
@@ -96,6 +147,44 @@ class AltusChannel : public gr::hier_block2 {
     gr::digital::binary_slicer_fb::sptr slicer;
     gr::AltusDecoder::Decoder::sptr altus_decode;
 
+    // Input that is already at channel rate skips the decimation stages
+    bool channel_rate_input;
+    gr::basic_block_sptr channel_rate_block;
+    gr::block_sptr first_block;
+
+    // Load shedding, a parked channel drops its input at a copy block in
+    // front of the filters and low cost relaxes the filters
+    gr::blocks::copy::sptr input_valve;
+    std::atomic<bool> parked;
+    bool low_cost = false;
+
+    // Optional channel rate recording, a new file for each assignment
+    altus_iq_file_sink_sptr recorder;
+    std::string record_dir;
+    iq_format_t record_format;
+
+    /**
+     * @brief Build the filters that take the input down to channel rate
+     * @return gr::basic_block_sptr The block with the channel rate output
+     */
+    gr::basic_block_sptr build_decimation();
+
+    /**
+     * @brief The taps for the second stage filter
+     * @param first_stage_sample_rate The rate out of the first stage
+     */
+    std::vector<float> second_stage_taps(float first_stage_sample_rate);
+
+    /**
+     * @brief Set the first stage taps and rotator for the channel frequency
+     */
+    void retune_first_stage();
+
+    /**
+     * @brief Start a new recording file for the current frequency
+     */
+    void rotate_recording();
+
   public:
     double channel_freq;
 
@@ -106,11 +195,15 @@ class AltusChannel : public gr::hier_block2 {
      * @param channel The channel frequency
      * @param center The center receiver frequency
      * @param s The receiver sample rate
+     * @param ring The ring decoded packets are pushed into
+     * @param index The index of this channel in the tracker
      */
     AltusChannel(
       double channel_freq,
       double center_freq,
-      double input_sample_rate
+      double input_sample_rate,
+      packet_ring_sptr packet_ring,
+      uint8_t channel_index
     );
 
     /**
@@ -120,15 +213,18 @@ class AltusChannel : public gr::hier_block2 {
 
     /**
      * @brief Internal message handler
-     * Adds the channel information to the message and passes it to the global handler
+     * Adds the channel information to the message and pushes it to the packet
+     * ring, or counts it as a CRC failure
      * @param message Bytes of the message
      * @param computed_crc Computed CRC from the message bytes
      * @param received_crc
+     * @param timing Where the sync word was in the source stream
      */
     void handle_message(
       uint8_t message[BYTES_PER_MESSAGE],
       uint16_t computed_crc,
-      uint16_t received_crc
+      uint16_t received_crc,
+      const packet_timing_t &timing
     );
     
     /**
@@ -137,9 +233,77 @@ class AltusChannel : public gr::hier_block2 {
      */
     void set_channel(uint32_t c);
 
-    // Message queue
-    std::vector<std::string> packet_queue;
-    std::mutex packet_queue_mutex;
+    /**
+     * @brief Follow the receiver to a new center frequency
+     * The channel keeps its frequency and the first stage moves to the new
+     * offset, anything half decoded is dropped
+     * @param center The new receiver frequency
+     */
+    void set_center_freq(double center);
+
+    /**
+     * @brief Set the handler for decode and CRC failure events
+     * @param handler The handler, called on the decoder thread
+     */
+    void set_event_handler(altus_event_handler_t handler);
+
+    /**
+     * @brief Count the decode latency of live packets
+     * @param histogram The histogram, shared with the other channels
+     */
+    void set_latency_histogram(latency_histogram_sptr histogram);
+
+    /**
+     * @brief Record channel rate IQ, a new file each time the channel is
+     * assigned a frequency
+     * Must be called before the flowgraph starts
+     * @param dir The directory for the recordings
+     * @param format The sample format to record
+     */
+    void enable_recording(const std::string &dir, iq_format_t format);
+
+    /**
+     * @brief Let the channel be parked to shed load
+     * Must be called before the flowgraph starts, it adds a copy to the input
+     */
+    void enable_parking();
+
+    /**
+     * @brief Stop or restart processing the input
+     * A parked channel keeps its frequency but drops every sample
+     * @param parked Whether to park the channel
+     * @return true If the channel can be parked (enable_parking was called)
+     */
+    bool set_parked(bool parked);
+
+    /**
+     * @brief Whether the channel is parked
+     */
+    bool is_parked();
+
+    /**
+     * @brief Use cheaper filters, with wider transitions and less stopband
+     * attenuation, to shed load
+     * @param low_cost Whether to use the cheaper filters
+     */
+    void set_low_cost(bool low_cost);
+
+    /**
+     * @brief How full the channel's input buffer is, 0 to 1
+     * Near 1 means the channel isn't keeping up with the source
+     */
+    double input_fill();
+
+    /**
+     * @brief The decode funnel and link quality counters of this channel
+     */
+    channel_counters_sptr get_counters();
+
+    /**
+     * @brief The blocks doing the work, in processing order
+     * @return stage_blocks_t The blocks named by stage
+     */
+    stage_blocks_t stage_blocks();
 };
 
 #endif
\ No newline at end of file
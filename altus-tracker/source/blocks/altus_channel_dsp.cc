@@ -0,0 +1,712 @@
+#include "altus_channel_dsp.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef AltusChannelDsp::sample_t sample_t;
+
+// The same settings as the GNU Radio blocks in AltusChannel
+const float fll_rolloff = 0.2;
+const int fll_filter_size = 2 * AltusChannelDsp::samples_per_symbol + 1;
+const float fll_bandwidth = (2.0 * M_PI) / AltusChannelDsp::samples_per_symbol / 250;
+const double clock_gain_mu = 0.175;
+const double clock_damping = 1.0;
+const double clock_max_deviation = 0.005;
+
+// Slope of the Gardner error at lock for these symbols, per sample. Only the
+// pool uses Gardner, AltusChannel's Mueller and Muller has a gain of 1
+const double clock_ted_gain = 0.43;
+
+// The rotator drifts off the unit circle without this
+const uint32_t rotator_normalize_interval = 512;
+
+// The fast demodulator keeps the tones and half a symbol rate either side,
+// the stages only have to stop what would alias onto that
+const double fast_passband = AltusChannelDsp::fsk_deviation + AltusChannelDsp::symbol_rate / 2.0;
+const double fast_attenuation_db = 40;
+
+// Samples the early/late gate moves the strobe per symbol at full error
+const double gate_gain = 0.2;
+
+bool parse_channel_demod(const std::string &name, channel_demod_t &demod) {
+  if (name == "full") {
+    demod = channel_demod_t::FULL;
+  } else if (name == "fast") {
+    demod = channel_demod_t::FAST;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *channel_demod_name(channel_demod_t demod) {
+  return demod == channel_demod_t::FAST ? "fast" : "full";
+}
+
+// Dot products with four accumulators, so they pipeline without fast math
+static inline sample_t dot(const sample_t *taps, const sample_t *x, size_t count) {
+  const float *t = (const float *)taps;
+  const float *v = (const float *)x;
+  float re[4] = {0, 0, 0, 0};
+  float im[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    for (size_t j = 0; j < 4; j++) {
+      float tr = t[(i + j) * 2], ti = t[(i + j) * 2 + 1];
+      float xr = v[(i + j) * 2], xi = v[(i + j) * 2 + 1];
+      re[j] += tr * xr - ti * xi;
+      im[j] += tr * xi + ti * xr;
+    }
+  }
+  for (; i < count; i++) {
+    float tr = t[i * 2], ti = t[i * 2 + 1];
+    float xr = v[i * 2], xi = v[i * 2 + 1];
+    re[0] += tr * xr - ti * xi;
+    im[0] += tr * xi + ti * xr;
+  }
+  return sample_t(re[0] + re[1] + re[2] + re[3], im[0] + im[1] + im[2] + im[3]);
+}
+
+static inline sample_t dot(const float *taps, const sample_t *x, size_t count) {
+  const float *v = (const float *)x;
+  float re[4] = {0, 0, 0, 0};
+  float im[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    for (size_t j = 0; j < 4; j++) {
+      re[j] += taps[i + j] * v[(i + j) * 2];
+      im[j] += taps[i + j] * v[(i + j) * 2 + 1];
+    }
+  }
+  for (; i < count; i++) {
+    re[0] += taps[i] * v[i * 2];
+    im[0] += taps[i] * v[i * 2 + 1];
+  }
+  return sample_t(re[0] + re[1] + re[2] + re[3], im[0] + im[1] + im[2] + im[3]);
+}
+
+// The int16 dot products of a cs16 window with the interleaved real and
+// imaginary taps, the products summed in int32. Each load of the window feeds
+// both, and a register holds eight lanes where float gets four. pmaddwd on
+// x86 and smlal on ARM, written out as compilers only find them at -O3
+static inline sample_t dot(
+  const int16_t *taps_re,
+  const int16_t *taps_im,
+  const int16_t *x,
+  size_t count,
+  float gain
+) {
+  int32_t re = 0;
+  int32_t im = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128i acc_re = _mm_setzero_si128();
+  __m128i acc_im = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+    acc_re = _mm_add_epi32(acc_re, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(taps_re + i)), v));
+    acc_im = _mm_add_epi32(acc_im, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(taps_im + i)), v));
+  }
+  int32_t lanes_re[4];
+  int32_t lanes_im[4];
+  _mm_storeu_si128((__m128i *)lanes_re, acc_re);
+  _mm_storeu_si128((__m128i *)lanes_im, acc_im);
+  re = lanes_re[0] + lanes_re[1] + lanes_re[2] + lanes_re[3];
+  im = lanes_im[0] + lanes_im[1] + lanes_im[2] + lanes_im[3];
+#elif defined(__ARM_NEON)
+  int32x4_t acc_re = vdupq_n_s32(0);
+  int32x4_t acc_im = vdupq_n_s32(0);
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t v = vld1q_s16(x + i);
+    int16x8_t t_re = vld1q_s16(taps_re + i);
+    int16x8_t t_im = vld1q_s16(taps_im + i);
+    acc_re = vmlal_s16(acc_re, vget_low_s16(t_re), vget_low_s16(v));
+    acc_re = vmlal_s16(acc_re, vget_high_s16(t_re), vget_high_s16(v));
+    acc_im = vmlal_s16(acc_im, vget_low_s16(t_im), vget_low_s16(v));
+    acc_im = vmlal_s16(acc_im, vget_high_s16(t_im), vget_high_s16(v));
+  }
+  int32_t lanes_re[4];
+  int32_t lanes_im[4];
+  vst1q_s32(lanes_re, acc_re);
+  vst1q_s32(lanes_im, acc_im);
+  re = lanes_re[0] + lanes_re[1] + lanes_re[2] + lanes_re[3];
+  im = lanes_im[0] + lanes_im[1] + lanes_im[2] + lanes_im[3];
+#endif
+  for (; i < count; i++) {
+    re += int32_t(taps_re[i]) * int32_t(x[i]);
+    im += int32_t(taps_im[i]) * int32_t(x[i]);
+  }
+  return sample_t(re * gain, im * gain);
+}
+
+/**
+ * Decimating FIR over a stream, taps stored in reverse so each output is a
+ * straight dot product with the window ending at its sample. Only the first
+ * few windows straddle the history, they are built in the edge buffer.
+ */
+template <typename tap_t>
+static void decimate(
+  const std::vector<tap_t> &reversed_taps,
+  int decimation,
+  std::vector<sample_t> &history,
+  std::vector<sample_t> &edge,
+  size_t &phase,
+  const sample_t *in,
+  size_t count,
+  std::vector<sample_t> &out
+) {
+  size_t span = reversed_taps.size() - 1;
+  if (history.size() != span) {
+    history.assign(span, 0);
+  }
+
+  // The window of the output at in[p] is in[p - span] to in[p]
+  size_t p = phase;
+  size_t edge_count = std::min(count, span);
+  if (p < edge_count) {
+    edge.assign(history.begin(), history.end());
+    edge.insert(edge.end(), in, in + edge_count);
+    for (; p < edge_count; p += decimation) {
+      out.push_back(dot(&reversed_taps[0], &edge[p], span + 1));
+    }
+  }
+  for (; p < count; p += decimation) {
+    out.push_back(dot(&reversed_taps[0], in + p - span, span + 1));
+  }
+  phase = p - count;
+
+  if (count >= span) {
+    history.assign(in + count - span, in + count);
+  } else {
+    history.erase(history.begin(), history.begin() + count);
+    history.insert(history.end(), in, in + count);
+  }
+}
+
+/**
+ * The same over cs16, each sample two int16 and each output the real and
+ * imaginary dot products scaled back to float
+ */
+static void decimate_cs16(
+  const std::vector<int16_t> &reversed_taps_re,
+  const std::vector<int16_t> &reversed_taps_im,
+  float gain,
+  int decimation,
+  std::vector<int16_t> &history,
+  std::vector<int16_t> &edge,
+  size_t &phase,
+  const int16_t *in,
+  size_t count,
+  std::vector<sample_t> &out
+) {
+  size_t span = reversed_taps_re.size() / 2 - 1;
+  if (history.size() != span * 2) {
+    history.assign(span * 2, 0);
+  }
+
+  size_t p = phase;
+  size_t edge_count = std::min(count, span);
+  if (p < edge_count) {
+    edge.assign(history.begin(), history.end());
+    edge.insert(edge.end(), in, in + edge_count * 2);
+    for (; p < edge_count; p += decimation) {
+      out.push_back(dot(&reversed_taps_re[0], &reversed_taps_im[0], &edge[p * 2], (span + 1) * 2, gain));
+    }
+  }
+  for (; p < count; p += decimation) {
+    out.push_back(dot(&reversed_taps_re[0], &reversed_taps_im[0], in + (p - span) * 2, (span + 1) * 2, gain));
+  }
+  phase = p - count;
+
+  if (count >= span) {
+    history.assign(in + (count - span) * 2, in + count * 2);
+  } else {
+    history.erase(history.begin(), history.begin() + count * 2);
+    history.insert(history.end(), in, in + count * 2);
+  }
+}
+
+std::vector<float> AltusChannelDsp::low_pass(
+  double sample_rate,
+  double cutoff,
+  double transition,
+  double attenuation_db
+) {
+  int ntaps = int(attenuation_db * sample_rate / (22.0 * transition));
+  if ((ntaps & 1) == 0) {
+    ntaps++;
+  }
+
+  std::vector<float> taps(ntaps);
+  int middle = (ntaps - 1) / 2;
+  double fw = 2 * M_PI * cutoff / sample_rate;
+  double sum = 0;
+  for (int n = 0; n < ntaps; n++) {
+    double window = 0.54 - 0.46 * std::cos(2 * M_PI * n / (ntaps - 1));
+    int k = n - middle;
+    double sinc = k == 0 ? fw / M_PI : std::sin(k * fw) / (k * M_PI);
+    taps[n] = sinc * window;
+    sum += taps[n];
+  }
+  for (int n = 0; n < ntaps; n++) {
+    taps[n] /= sum;
+  }
+  return taps;
+}
+
+AltusChannelDsp::AltusChannelDsp(double rate, double center, double channel) {
+  input_sample_rate = rate;
+  center_freq = center;
+  channel_freq = channel;
+
+  first_decimation = std::max(1, int(std::floor(input_sample_rate / (channel_rate * first_stage_channel_width))));
+
+  design_first_stage();
+  design_second_stage();
+
+  // Band edge filters, the same design as GNU Radio's fll_band_edge_cc
+  int m = std::lrint(float(fll_filter_size) / samples_per_symbol);
+  std::vector<float> base(fll_filter_size);
+  float power = 0;
+  for (int i = 0; i < fll_filter_size; i++) {
+    float k = -m + i * 2.0 / samples_per_symbol;
+    float a = fll_rolloff * k - 0.5;
+    float b = fll_rolloff * k + 0.5;
+    base[i] = (a == 0 ? 1 : std::sin(M_PI * a) / (M_PI * a)) + (b == 0 ? 1 : std::sin(M_PI * b) / (M_PI * b));
+    power += base[i];
+  }
+  int n = (fll_filter_size - 1) / 2;
+  fll_taps_upper.resize(fll_filter_size);
+  fll_taps_lower.resize(fll_filter_size);
+  for (int i = 0; i < fll_filter_size; i++) {
+    float k = (-n + i) / (2.0 * samples_per_symbol);
+    float phase = 2.0 * M_PI * (1 + fll_rolloff) * k;
+    fll_taps_upper[i] = (base[i] / power) * std::polar(1.0f, phase);
+    fll_taps_lower[i] = (base[i] / power) * std::polar(1.0f, -phase);
+  }
+  float damping = std::sqrt(2.0f) / 2;
+  float denom = 1.0 + 2.0 * damping * fll_bandwidth + fll_bandwidth * fll_bandwidth;
+  fll_alpha = (4 * damping * fll_bandwidth) / denom;
+  fll_beta = (4 * fll_bandwidth * fll_bandwidth) / denom;
+  fll_max_freq = 2.0 * M_PI * 2.0 / samples_per_symbol;
+
+  demod_gain = channel_rate / (2 * M_PI * fsk_deviation);
+
+  // symbol_sync's loop filter gains from the loop bandwidth AltusChannel
+  // gives it, critically damped
+  double clock_gain_omega = 0.25 * clock_gain_mu * clock_gain_mu;
+  double loop_bw = -1 * std::log(((clock_gain_mu + clock_gain_omega) / -2) + 1);
+  double omega_n_t = loop_bw / (clock_damping + 0.25 / clock_damping);
+  double zeta_omega_n_t = clock_damping * omega_n_t;
+  double k1 = 2 * std::exp(-zeta_omega_n_t);
+  clock_alpha = (k1 * std::sinh(zeta_omega_n_t)) / clock_ted_gain;
+  clock_beta = (2 - (k1 * std::sinh(zeta_omega_n_t) + k1)) / clock_ted_gain;
+  clock_period_mid = samples_per_symbol;
+  clock_period = clock_period_mid;
+  clock_period_limit = clock_max_deviation * samples_per_symbol;
+
+  reset(0);
+}
+
+void AltusChannelDsp::design_first_stage() {
+  if (demod == channel_demod_t::FAST) {
+    // Anything between the pass band and what folds back onto it is left
+    // for the second stage, so the transition is most of the output rate
+    double first_rate = input_sample_rate / first_decimation;
+    first_base_taps = low_pass(
+      input_sample_rate,
+      first_rate / 2,
+      std::max(first_rate - 2 * fast_passband, double(symbol_rate)),
+      fast_attenuation_db
+    );
+  } else {
+    first_base_taps = low_pass(
+      input_sample_rate,
+      channel_rate,
+      float(channel_rate) / (low_cost ? 2 : 4),
+      10
+    );
+  }
+
+  // Shift the pass band to the channel, the rotator brings the decimated
+  // output back down to baseband
+  double phase_inc = (2.0 * M_PI * (channel_freq - center_freq)) / input_sample_rate;
+  size_t ntaps = first_base_taps.size();
+  first_taps.resize(ntaps);
+  for (size_t k = 0; k < ntaps; k++) {
+    first_taps[ntaps - 1 - k] = first_base_taps[k] * std::polar(1.0f, float(std::fmod(k * phase_inc, 2 * M_PI)));
+  }
+  rotator_inc = std::polar(1.0f, float(std::fmod(-first_decimation * phase_inc, 2 * M_PI)));
+
+  // Scale the integer taps as far as they go without a full scale input
+  // overflowing the int32 sums
+  float peak = 0;
+  double total = 0;
+  for (size_t k = 0; k < ntaps; k++) {
+    peak = std::max(peak, std::max(std::fabs(first_taps[k].real()), std::fabs(first_taps[k].imag())));
+    total += std::fabs(first_taps[k].real()) + std::fabs(first_taps[k].imag());
+  }
+  double scale = std::min(32767.0 / peak, 0.9 * INT32_MAX / (32768.0 * total));
+  first_taps_re.resize(ntaps * 2);
+  first_taps_im.resize(ntaps * 2);
+  for (size_t k = 0; k < ntaps; k++) {
+    first_taps_re[k * 2] = int16_t(std::lrint(first_taps[k].real() * scale));
+    first_taps_re[k * 2 + 1] = int16_t(std::lrint(-first_taps[k].imag() * scale));
+    first_taps_im[k * 2] = int16_t(std::lrint(first_taps[k].imag() * scale));
+    first_taps_im[k * 2 + 1] = int16_t(std::lrint(first_taps[k].real() * scale));
+  }
+  first_cs16_gain = 1.0 / (scale * 32767.0);
+}
+
+void AltusChannelDsp::design_second_stage() {
+  double first_rate = input_sample_rate / first_decimation;
+  std::vector<float> taps;
+  if (demod == channel_demod_t::FAST) {
+    second_decimation = std::max(1, int(std::floor(first_rate / (fast_samples_per_symbol * symbol_rate))));
+    double fast_rate = first_rate / second_decimation;
+    taps = low_pass(
+      first_rate,
+      fast_rate / 2,
+      std::max(fast_rate - 2 * fast_passband, double(symbol_rate)),
+      fast_attenuation_db
+    );
+    fast_samples = fast_rate / symbol_rate;
+    input_per_channel_sample = input_sample_rate / fast_rate;
+    design_tones();
+  } else {
+    second_decimation = std::max(1, int(std::floor(first_rate / channel_rate)));
+    taps = low_pass(
+      first_rate,
+      fsk_deviation * 1.5,
+      low_cost ? fsk_deviation : fsk_deviation / 2,
+      low_cost ? 40 : 60
+    );
+    resample_step = (first_rate / second_decimation) / channel_rate;
+    input_per_channel_sample = input_sample_rate / channel_rate;
+  }
+  second_taps.assign(taps.rbegin(), taps.rend());
+}
+
+void AltusChannelDsp::design_tones() {
+  // One symbol of each tone, reversed like the filter taps so the
+  // correlation is a dot product with the window ending at a sample
+  size_t n = std::max(2l, std::lrint(fast_samples));
+  tone_step = 2 * M_PI * fsk_deviation / (fast_samples * symbol_rate);
+  mark_taps.resize(n);
+  space_taps.resize(n);
+  for (size_t k = 0; k < n; k++) {
+    mark_taps[n - 1 - k] = std::polar(1.0f, tone_step * k);
+    space_taps[n - 1 - k] = std::polar(1.0f, -tone_step * k);
+  }
+}
+
+void AltusChannelDsp::set_channel(double channel) {
+  channel_freq = channel;
+  design_first_stage();
+}
+
+void AltusChannelDsp::set_center_freq(double center) {
+  center_freq = center;
+  design_first_stage();
+}
+
+void AltusChannelDsp::set_low_cost(bool l) {
+  if (low_cost == l) {
+    return;
+  }
+  low_cost = l;
+  design_first_stage();
+  design_second_stage();
+}
+
+void AltusChannelDsp::set_demod(channel_demod_t d) {
+  if (demod == d) {
+    return;
+  }
+  demod = d;
+  design_first_stage();
+  design_second_stage();
+}
+
+channel_demod_t AltusChannelDsp::get_demod() {
+  return demod;
+}
+
+void AltusChannelDsp::reset(uint64_t sample) {
+  first_history.clear();
+  first_history_cs16.clear();
+  first_phase = 0;
+  rotator = 1;
+  second_history.clear();
+  second_phase = 0;
+  resample_history.assign(3, 0);
+  resample_mu = 1;
+  fll_history.assign(fll_filter_size, 0);
+  demod_last = 0;
+  clock_history.clear();
+  clock_mu = 0.5;
+  clock_period = clock_period_mid;
+  clock_last = 0;
+  tone_history.assign(mark_taps.size() > 0 ? mark_taps.size() - 1 : 0, 0);
+  gate_history.clear();
+  gate_next = 1;
+  tone_offset = 0;
+  last_mark = false;
+  stream_base = sample;
+  clock_consumed = 0;
+}
+
+void AltusChannelDsp::first_stage(const sample_t *in, size_t count, std::vector<sample_t> &out) {
+  out.clear();
+  decimate(first_taps, first_decimation, first_history, edge, first_phase, in, count, out);
+  derotate(out);
+}
+
+void AltusChannelDsp::first_stage_cs16(const int16_t *in, size_t count, std::vector<sample_t> &out) {
+  out.clear();
+  decimate_cs16(
+    first_taps_re,
+    first_taps_im,
+    first_cs16_gain,
+    first_decimation,
+    first_history_cs16,
+    edge_cs16,
+    first_phase,
+    in,
+    count,
+    out
+  );
+  derotate(out);
+}
+
+void AltusChannelDsp::derotate(std::vector<sample_t> &out) {
+  for (std::vector<sample_t>::iterator it = out.begin(); it != out.end(); it++) {
+    *it *= rotator;
+    rotator *= rotator_inc;
+    if (++rotator_count >= rotator_normalize_interval) {
+      rotator /= std::abs(rotator);
+      rotator_count = 0;
+    }
+  }
+}
+
+void AltusChannelDsp::second_stage(const std::vector<sample_t> &in, std::vector<sample_t> &out) {
+  out.clear();
+  if (in.size() > 0) {
+    decimate(second_taps, second_decimation, second_history, edge, second_phase, &in[0], in.size(), out);
+  }
+}
+
+void AltusChannelDsp::resample(const std::vector<sample_t> &in, std::vector<sample_t> &out) {
+  out.clear();
+  if (resample_step == 1.0) {
+    out.assign(in.begin(), in.end());
+    return;
+  }
+
+  // Catmull-Rom between buffer[i] and buffer[i + 1], the history holds the
+  // three samples before the input
+  std::vector<sample_t> &buffer = resample_history;
+  buffer.insert(buffer.end(), in.begin(), in.end());
+  double t = resample_mu;
+  size_t i = size_t(t);
+  while (i + 2 < buffer.size()) {
+    float mu = t - i;
+    sample_t p0 = buffer[i - 1], p1 = buffer[i], p2 = buffer[i + 1], p3 = buffer[i + 2];
+    sample_t a = -0.5f * p0 + 1.5f * p1 - 1.5f * p2 + 0.5f * p3;
+    sample_t b = p0 - 2.5f * p1 + 2.0f * p2 - 0.5f * p3;
+    sample_t c = -0.5f * p0 + 0.5f * p2;
+    out.push_back(((a * mu + b) * mu + c) * mu + p1);
+    t += resample_step;
+    i = size_t(t);
+  }
+  size_t keep = 3;
+  size_t drop = buffer.size() - keep;
+  buffer.erase(buffer.begin(), buffer.begin() + drop);
+  resample_mu = t - drop;
+}
+
+void AltusChannelDsp::fll_demod(const std::vector<sample_t> &in, std::vector<float> &out) {
+  out.clear();
+  size_t size = fll_history.size();
+  size_t head = 0;
+  for (std::vector<sample_t>::const_iterator it = in.begin(); it != in.end(); it++) {
+    sample_t corrected = *it * std::polar(1.0f, fll_phase);
+
+    // The history is a ring, newest sample at head
+    head = (head + size - 1) % size;
+    fll_history[head] = corrected;
+    sample_t upper = 0;
+    sample_t lower = 0;
+    for (size_t k = 0; k < size; k++) {
+      sample_t x = fll_history[(head + k) % size];
+      upper += fll_taps_upper[k] * x;
+      lower += fll_taps_lower[k] * x;
+    }
+
+    float error = std::norm(lower) - std::norm(upper);
+    fll_freq += fll_beta * error;
+    fll_phase += fll_freq + fll_alpha * error;
+    fll_phase = std::remainder(fll_phase, float(2 * M_PI));
+    fll_freq = std::clamp(fll_freq, -fll_max_freq, fll_max_freq);
+
+    out.push_back(demod_gain * std::arg(corrected * std::conj(demod_last)));
+    demod_last = corrected;
+  }
+
+  // Keep the newest sample first for the next block
+  std::rotate(fll_history.begin(), fll_history.begin() + head, fll_history.end());
+}
+
+// Catmull-Rom at a fractional position, between x[i] and x[i + 1]
+static inline float interpolate(const float *x, double position) {
+  size_t i = size_t(position);
+  float mu = position - i;
+  const float *p = x + i - 1;
+  float a = -0.5f * p[0] + 1.5f * p[1] - 1.5f * p[2] + 0.5f * p[3];
+  float b = p[0] - 2.5f * p[1] + 2.0f * p[2] - 0.5f * p[3];
+  float c = -0.5f * p[0] + 0.5f * p[2];
+  return ((a * mu + b) * mu + c) * mu + p[1];
+}
+
+void AltusChannelDsp::clock_recovery(const std::vector<float> &in, std::vector<channel_symbol_t> &symbols) {
+  clock_history.insert(clock_history.end(), in.begin(), in.end());
+
+  // Gardner compares the half symbol between strobes with the change across
+  // them, so unlike Mueller and Muller it times off the 1010 preamble and a
+  // frequency offset doesn't pull it. The strobe sits four samples into the
+  // window so the half symbol before it is there too, mu can carry whole
+  // samples stepped past the end of the last block
+  double skip = std::floor(clock_mu);
+  size_t ii = size_t(skip);
+  clock_mu -= skip;
+  while (ii + 6 < clock_history.size()) {
+    double strobe = ii + 4 + clock_mu;
+    float symbol = interpolate(&clock_history[0], strobe);
+    float middle = interpolate(&clock_history[0], strobe - clock_period / 2);
+    float error = middle * (clock_last - symbol);
+    clock_last = symbol;
+
+    // The average period is held within max_dev of nominal, the strobe moves
+    // by it plus the proportional term
+    clock_period += clock_beta * error;
+    clock_period = clock_period_mid + std::clamp(clock_period - clock_period_mid, -clock_period_limit, clock_period_limit);
+    double step = clock_period + clock_alpha * error;
+    if (step <= 0) {
+      step = clock_period;
+    }
+
+    // The symbols are in units of the deviation, so over a packet their
+    // mean is whatever the FLL didn't take out
+    channel_symbol_t out;
+    out.soft = symbol;
+    out.offset_hz = fll_frequency_hz() + symbol * fsk_deviation;
+    out.sample = stream_base + uint64_t((clock_consumed + strobe) * input_per_channel_sample);
+    symbols.push_back(out);
+
+    clock_mu += step;
+    double whole = std::floor(clock_mu);
+    ii += size_t(whole);
+    clock_mu -= whole;
+  }
+
+  size_t drop = std::min(ii, clock_history.size());
+  clock_history.erase(clock_history.begin(), clock_history.begin() + drop);
+  clock_consumed += drop;
+  if (ii > drop) {
+    // Stepped past the end, skip those samples of the next block
+    clock_mu += ii - drop;
+  }
+}
+
+void AltusChannelDsp::tone_energy(const std::vector<sample_t> &in, std::vector<tone_pair_t> &out) {
+  out.clear();
+  size_t n = mark_taps.size();
+  tone_history.insert(tone_history.end(), in.begin(), in.end());
+  for (size_t i = 0; i + n <= tone_history.size(); i++) {
+    tone_pair_t pair;
+    pair.mark = dot(&mark_taps[0], &tone_history[i], n);
+    pair.space = dot(&space_taps[0], &tone_history[i], n);
+    out.push_back(pair);
+  }
+  tone_history.erase(tone_history.begin(), tone_history.end() - (n - 1));
+}
+
+void AltusChannelDsp::early_late(const std::vector<tone_pair_t> &in, std::vector<channel_symbol_t> &symbols) {
+  gate_history.insert(gate_history.end(), in.begin(), in.end());
+
+  // The energy difference peaks with the window over one whole symbol, a
+  // sample either side it takes in part of the neighbours. The strobe moves
+  // toward whichever side is stronger, which only happens at a bit change
+  // The strobe carries over in [0.5, 1.5), round half up so it lands on 1
+  // and never reads before the history (lrint rounds 0.5 to 0)
+  double t = gate_next;
+  size_t i = size_t(std::floor(t + 0.5));
+  while (i + 1 < gate_history.size()) {
+    const tone_pair_t &before = gate_history[i - 1];
+    const tone_pair_t &on = gate_history[i];
+    const tone_pair_t &after = gate_history[i + 1];
+    float mark = std::norm(on.mark);
+    float space = std::norm(on.space);
+    float early = std::fabs(std::norm(before.mark) - std::norm(before.space));
+    float late = std::fabs(std::norm(after.mark) - std::norm(after.space));
+    float error = (late - early) / (late + early + 1e-20f);
+
+    // A window a sample on turns a tone by its frequency, which gives the
+    // offset without an FLL. The early window takes in a sample of the last
+    // symbol, so only a repeated tone is measured
+    bool is_mark = mark > space;
+    if (is_mark == last_mark) {
+      sample_t turn = is_mark ? on.mark * std::conj(before.mark) : on.space * std::conj(before.space);
+      tone_offset = std::arg(turn) - (is_mark ? tone_step : -tone_step);
+    }
+    last_mark = is_mark;
+
+    channel_symbol_t out;
+    out.soft = (mark - space) / (mark + space + 1e-20f);
+    out.offset_hz = tone_offset * fast_samples * symbol_rate / (2 * M_PI);
+    out.sample = stream_base + uint64_t((clock_consumed + i) * input_per_channel_sample);
+    symbols.push_back(out);
+
+    t += fast_samples + gate_gain * error;
+    i = size_t(std::floor(t + 0.5));
+  }
+
+  // Keep the sample before the next strobe for its early gate
+  size_t drop = std::min(i - 1, gate_history.size());
+  gate_history.erase(gate_history.begin(), gate_history.begin() + drop);
+  clock_consumed += drop;
+  gate_next = t - drop;
+}
+
+void AltusChannelDsp::process(const sample_t *in, size_t count, std::vector<channel_symbol_t> &symbols) {
+  first_stage(in, count, stage_a);
+  process_decimated(symbols);
+}
+
+void AltusChannelDsp::process_cs16(const int16_t *in, size_t count, std::vector<channel_symbol_t> &symbols) {
+  first_stage_cs16(in, count, stage_a);
+  process_decimated(symbols);
+}
+
+void AltusChannelDsp::process_decimated(std::vector<channel_symbol_t> &symbols) {
+  second_stage(stage_a, stage_b);
+  if (demod == channel_demod_t::FAST) {
+    tone_energy(stage_b, tones);
+    early_late(tones, symbols);
+    return;
+  }
+  resample(stage_b, stage_a);
+  fll_demod(stage_a, demod_out);
+  clock_recovery(demod_out, symbols);
+}
+
+double AltusChannelDsp::fll_frequency_hz() {
+  return -fll_freq * channel_rate / (2 * M_PI);
+}
\ No newline at end of file
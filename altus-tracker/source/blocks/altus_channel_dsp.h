@@ -0,0 +1,258 @@
+#ifndef ALTUS_CHANNEL_DSP_H
+#define ALTUS_CHANNEL_DSP_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A symbol out of the clock recovery
+ */
+struct channel_symbol_t {
+  float soft;         // In units of the deviation, or -1 to 1 from the fast demodulator
+  float offset_hz;    // How far the signal was off the channel, averaged over a packet
+  uint64_t sample;    // The input sample it was recovered at
+};
+
+/**
+ * @brief Which demodulator a channel runs
+ * FULL is the FLL and quadrature demodulator chain of AltusChannel with
+ * Gardner clock recovery, FAST a non-coherent tone energy detector at a
+ * lower rate
+ */
+enum class channel_demod_t {
+  FULL,
+  FAST
+};
+
+/**
+ * @brief Parse a demodulator name, full or fast
+ * @return true If the name is known
+ */
+bool parse_channel_demod(const std::string &name, channel_demod_t &demod);
+
+/**
+ * @brief The name of a demodulator
+ */
+const char *channel_demod_name(channel_demod_t demod);
+
+/**
+ * The signal chain of an AltusChannel in plain C++, from the wideband input
+ * to soft symbols
+ *
+ * The stages match the GNU Radio blocks of AltusChannel: a frequency
+ * translating first stage filter, a second stage low pass, a fractional
+ * resampler to the channel rate, a band edge FLL, a quadrature demodulator
+ * and clock recovery with symbol_sync's loop bandwidth and deviation limit.
+ * The clock uses a Gardner detector where AltusChannel uses Mueller and
+ * Muller, which gives no timing error on the 1010 preamble and is biased by
+ * what the FLL leaves of the offset. The filters only compute the outputs
+ * they keep and every stage works a block at a time on buffers the struct
+ * owns, so a channel can be run on any thread.
+ *
+ * The fast demodulator trades a few dB of sensitivity for a fraction of the
+ * work. Both decimation stages are sized to keep only the ±40 kHz the tones
+ * occupy at about 4 samples a symbol, so they are a few tens of taps in place
+ * of a few hundred, and there is no resampler or FLL. Each sample is
+ * correlated with the two tones over one symbol, the difference of their
+ * energies is the soft symbol and an early/late gate on it keeps the timing.
+ *
+ * Interleaved int16 input (cs16) runs the first stage in integers, int16
+ * taps into int32 sums, which packs twice the lanes of float into each SIMD
+ * register and reads half the bytes. Its output is a thirteenth of the input
+ * rate, so everything after it stays in float.
+ */
+class AltusChannelDsp {
+  public:
+    typedef std::complex<float> sample_t;
+
+    // Altus channel constants, the same as AltusChannel
+    static constexpr uint8_t samples_per_symbol = 5;
+    static constexpr uint32_t symbol_rate = 38400;
+    static constexpr uint32_t channel_rate = samples_per_symbol * symbol_rate;
+    static constexpr uint16_t fsk_deviation = 20500;
+    static constexpr float first_stage_channel_width = 4;
+    static constexpr uint8_t fast_samples_per_symbol = 4;
+
+  private:
+    double input_sample_rate;
+    double center_freq;
+    double channel_freq;
+    bool low_cost = false;
+    channel_demod_t demod = channel_demod_t::FULL;
+
+    // First stage, frequency translating decimating filter
+    int first_decimation;
+    std::vector<float> first_base_taps;
+    std::vector<sample_t> first_taps;
+    std::vector<sample_t> first_history;
+    size_t first_phase = 0;             // Input samples to skip before the next output
+    sample_t rotator = 1;
+    sample_t rotator_inc = 1;
+    uint32_t rotator_count = 0;
+
+    // The first stage taps again for cs16 input, each output is a dot
+    // product of the interleaved samples with the real taps and then the
+    // imaginary ones
+    std::vector<int16_t> first_taps_re;
+    std::vector<int16_t> first_taps_im;
+    std::vector<int16_t> first_history_cs16;
+    std::vector<int16_t> edge_cs16;
+    float first_cs16_gain;              // Back to full scale being 1
+
+    // Second stage, decimating low pass
+    int second_decimation;
+    std::vector<float> second_taps;
+    std::vector<sample_t> second_history;
+    size_t second_phase = 0;
+
+    // Fractional resampler to exactly the channel rate
+    double resample_step;
+    double resample_mu = 0;
+    std::vector<sample_t> resample_history;
+
+    // Band edge FLL
+    std::vector<sample_t> fll_taps_upper;
+    std::vector<sample_t> fll_taps_lower;
+    std::vector<sample_t> fll_history;
+    float fll_phase = 0;
+    float fll_freq = 0;
+    float fll_alpha;
+    float fll_beta;
+    float fll_max_freq;
+
+    // Quadrature demodulator
+    float demod_gain;
+    sample_t demod_last = 0;
+
+    // Gardner clock recovery, with symbol_sync's loop filter
+    std::vector<float> clock_history;
+    double clock_mu = 0.5;
+    double clock_period;
+    double clock_period_mid;
+    double clock_period_limit;
+    double clock_alpha;
+    double clock_beta;
+    float clock_last = 0;
+
+    // Fast demodulator, the correlations with each tone over a symbol
+    struct tone_pair_t {
+      sample_t mark;
+      sample_t space;
+    };
+    double fast_samples;                // Per symbol, a little over 4
+    std::vector<sample_t> mark_taps;
+    std::vector<sample_t> space_taps;
+    std::vector<sample_t> tone_history;
+    std::vector<tone_pair_t> gate_history;
+    double gate_next = 1;
+    float tone_step;                    // Radians per sample of the deviation
+    float tone_offset = 0;              // Radians per sample, from the last repeated tone
+    bool last_mark = false;
+
+    // Where the channel rate stream starts in the input, for timing symbols
+    uint64_t stream_base = 0;
+    uint64_t clock_consumed = 0;
+    double input_per_channel_sample;
+
+    // Scratch space between the stages
+    std::vector<sample_t> stage_a;
+    std::vector<sample_t> stage_b;
+    std::vector<float> demod_out;
+    std::vector<tone_pair_t> tones;
+    std::vector<sample_t> edge;
+
+    void design_first_stage();
+    void design_second_stage();
+    void design_tones();
+    void first_stage(const sample_t *in, size_t count, std::vector<sample_t> &out);
+    void first_stage_cs16(const int16_t *in, size_t count, std::vector<sample_t> &out);
+    void derotate(std::vector<sample_t> &out);
+    void process_decimated(std::vector<channel_symbol_t> &symbols);
+    void second_stage(const std::vector<sample_t> &in, std::vector<sample_t> &out);
+    void resample(const std::vector<sample_t> &in, std::vector<sample_t> &out);
+    void fll_demod(const std::vector<sample_t> &in, std::vector<float> &out);
+    void clock_recovery(const std::vector<float> &in, std::vector<channel_symbol_t> &symbols);
+    void tone_energy(const std::vector<sample_t> &in, std::vector<tone_pair_t> &out);
+    void early_late(const std::vector<tone_pair_t> &in, std::vector<channel_symbol_t> &symbols);
+
+  public:
+    /**
+     * @param input_sample_rate The wideband sample rate, at least 4 channels wide
+     * @param center_freq The frequency of the receiver (in Hz)
+     * @param channel_freq The frequency of the channel (in Hz)
+     */
+    AltusChannelDsp(double input_sample_rate, double center_freq, double channel_freq);
+
+    /**
+     * @brief Move to a new frequency, the filters and loops keep their state
+     */
+    void set_channel(double channel_freq);
+
+    /**
+     * @brief Follow the receiver to a new frequency, the channel stays where it is
+     */
+    void set_center_freq(double center_freq);
+
+    /**
+     * @brief Use cheaper filters, with wider transitions and less stopband
+     * attenuation
+     */
+    void set_low_cost(bool low_cost);
+
+    /**
+     * @brief Switch demodulator, call reset after as the rates change
+     */
+    void set_demod(channel_demod_t demod);
+
+    /**
+     * @brief The demodulator in use
+     */
+    channel_demod_t get_demod();
+
+    /**
+     * @brief Drop everything buffered and start again at an input sample
+     *
+     * @param sample The index of the next input sample
+     */
+    void reset(uint64_t sample);
+
+    /**
+     * @brief Run a block of input through the chain
+     *
+     * @param in The wideband samples
+     * @param count The number of samples
+     * @param symbols The recovered symbols are appended here
+     */
+    void process(const sample_t *in, size_t count, std::vector<channel_symbol_t> &symbols);
+
+    /**
+     * @brief Run a block of cs16 input through the chain, full scale is 32767
+     *
+     * @param in The wideband samples, I and Q interleaved
+     * @param count The number of samples (pairs)
+     * @param symbols The recovered symbols are appended here
+     */
+    void process_cs16(const int16_t *in, size_t count, std::vector<channel_symbol_t> &symbols);
+
+    /**
+     * @brief The FLL's frequency correction (in Hz)
+     * Negative when the signal is above the channel frequency
+     */
+    double fll_frequency_hz();
+
+    /**
+     * @brief A windowed sinc low pass (Hamming), sized from the attenuation
+     * the same way as GNU Radio's firdes::low_pass_2
+     */
+    static std::vector<float> low_pass(
+      double sample_rate,
+      double cutoff,
+      double transition,
+      double attenuation_db
+    );
+};
+
+#endif
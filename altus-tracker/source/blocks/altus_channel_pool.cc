@@ -0,0 +1,426 @@
+#include "altus_channel_pool.h"
+#include "altus_sample_tagger.h"
+#include <gnuradio/block_detail.h>
+#include <gnuradio/buffer_reader.h>
+#include <gnuradio/io_signature.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+// Linux thread names are cut to this length
+const size_t pool_thread_name_length = 15;
+
+namespace gr {
+  namespace AltusDecoder {
+    ChannelPool::channel_t::channel_t(
+      ChannelPool *pool,
+      uint8_t i,
+      double input_sample_rate,
+      double center_freq,
+      uint32_t f
+    ) : dsp(input_sample_rate, center_freq, f),
+      frame_decoder([this, pool](uint8_t *message, uint16_t computed_crc, uint16_t received_crc) {
+        pool->handle_frame(*this, message, computed_crc, received_crc);
+      }) {
+      index = i;
+      counters = make_channel_counters();
+      freq = f;
+      retune = false;
+      recenter = false;
+      parked = false;
+      std::fill(bit_samples, bit_samples + sync_word_bits, 0);
+      std::fill(crc_failure_times, crc_failure_times + crc_failure_burst, INT64_MIN / 2);
+    }
+
+    ChannelPool::sptr ChannelPool::make(
+      double input_sample_rate,
+      double center_freq,
+      const std::vector<uint32_t> &channel_freqs,
+      packet_ring_sptr packet_ring,
+      uint8_t first_channel,
+      uint16_t threads,
+      bool cs16_input
+    ) {
+      return gnuradio::get_initial_sptr(new ChannelPool(
+        input_sample_rate,
+        center_freq,
+        channel_freqs,
+        packet_ring,
+        first_channel,
+        threads,
+        cs16_input
+      ));
+    }
+
+    ChannelPool::ChannelPool(
+      double s,
+      double center,
+      const std::vector<uint32_t> &channel_freqs,
+      packet_ring_sptr ring,
+      uint8_t first_channel,
+      uint16_t threads,
+      bool cs16
+    ) : gr::sync_block(
+      "AltusChannelPool",
+      gr::io_signature::make(
+        1,
+        1,
+        cs16 ? 2 * sizeof(int16_t) : sizeof(gr_complex)
+      ),
+      gr::io_signature::make(0, 0, 0)
+    ) {
+      input_sample_rate = s;
+      cs16_input = cs16;
+      center_freq = center;
+      packet_ring = ring;
+      low_cost = false;
+      demod = channel_demod_t::FULL;
+      next_channel = 0;
+      channels_left = 0;
+
+      for (size_t i = 0; i < channel_freqs.size(); i++) {
+        channels.push_back(std::make_unique<channel_t>(this, first_channel + i, input_sample_rate, center_freq, channel_freqs[i]));
+        std::cout << "Creating channel on " << std::fixed << std::setprecision(3) << (float(channel_freqs[i]) / 1000000) << std::endl;
+      }
+
+      if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      }
+      thread_count = std::max(size_t(1), std::min(size_t(threads), channels.size()));
+    }
+
+    ChannelPool::~ChannelPool() {
+      stop();
+    }
+
+    bool ChannelPool::start() {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      if (workers.size() > 0) {
+        return true;
+      }
+
+      // Named like the block's own thread, so the layout counts the workers
+      // as the channels rather than the ingest path
+      std::string name = (this->name() + std::to_string(unique_id())).substr(0, pool_thread_name_length);
+      stopping = false;
+      for (uint16_t i = 1; i < thread_count; i++) {
+        workers.push_back(std::thread(&ChannelPool::run_worker, this, i));
+        pthread_setname_np(workers.back().native_handle(), name.c_str());
+        pin_worker(workers.back());
+      }
+      return true;
+    }
+
+    bool ChannelPool::stop() {
+      {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        stopping = true;
+      }
+      block_ready.notify_all();
+      for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); it++) {
+        it->join();
+      }
+      workers.clear();
+      return true;
+    }
+
+    void ChannelPool::set_processor_affinity(const std::vector<int> &mask) {
+      gr::sync_block::set_processor_affinity(mask);
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      worker_cores = mask;
+      for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); it++) {
+        pin_worker(*it);
+      }
+    }
+
+    void ChannelPool::pin_worker(std::thread &worker) {
+      if (worker_cores.size() == 0) {
+        return;
+      }
+      cpu_set_t cores;
+      CPU_ZERO(&cores);
+      for (std::vector<int>::iterator it = worker_cores.begin(); it != worker_cores.end(); it++) {
+        CPU_SET(*it, &cores);
+      }
+      if (pthread_setaffinity_np(worker.native_handle(), sizeof(cores), &cores) != 0) {
+        std::cout << "[WARN] Failed to pin a channel pool worker" << std::endl;
+      }
+    }
+
+    void ChannelPool::run_worker(uint16_t worker) {
+      uint64_t seen = 0;
+      while (true) {
+        {
+          std::unique_lock<std::mutex> lock(pool_mutex);
+          block_ready.wait(lock, [this, seen]() {
+            return stopping || generation != seen;
+          });
+          if (stopping) {
+            return;
+          }
+          seen = generation;
+        }
+        run_channels();
+      }
+    }
+
+    void ChannelPool::run_channels() {
+      size_t channel;
+      while ((channel = next_channel.fetch_add(1)) < channels.size()) {
+        run_channel(*channels[channel]);
+        if (channels_left.fetch_sub(1) == 1) {
+          std::lock_guard<std::mutex> lock(pool_mutex);
+          block_done.notify_all();
+        }
+      }
+    }
+
+    void ChannelPool::run_channel(channel_t &channel) {
+      if (channel.parked) {
+        channel.was_parked = true;
+        return;
+      }
+      if (channel.was_parked) {
+        // Whatever was half decoded when it was parked is long gone
+        channel.was_parked = false;
+        channel.dsp.reset(block_start);
+        channel.frame_decoder.reset();
+      }
+      if (channel.recenter.exchange(false)) {
+        channel.dsp.set_center_freq(center_freq);
+        channel.retune = true;
+      }
+      if (channel.retune.exchange(false)) {
+        channel.dsp.set_channel(channel.freq);
+        if (channel.frame_decoder.in_packet()) {
+          std::cout << "[WARN] Channel " << int(channel.index) << " reset in the middle of a packet" << std::endl;
+          channel.counters->add(channel_counter_t::RESETS);
+        }
+        channel.frame_decoder.reset();
+      }
+      if (channel.low_cost != low_cost) {
+        channel.low_cost = low_cost;
+        channel.dsp.set_low_cost(channel.low_cost);
+      }
+      if (channel.demod != demod) {
+        // The rates change, so nothing carries over
+        channel.demod = demod;
+        channel.dsp.set_demod(channel.demod);
+        channel.dsp.reset(block_start);
+        channel.frame_decoder.reset();
+      }
+
+      channel.symbols.clear();
+      if (cs16_input) {
+        channel.dsp.process_cs16(static_cast<const int16_t *>(block_in), block_count, channel.symbols);
+      } else {
+        channel.dsp.process(static_cast<const gr_complex *>(block_in), block_count, channel.symbols);
+      }
+      for (std::vector<channel_symbol_t>::iterator it = channel.symbols.begin(); it != channel.symbols.end(); it++) {
+        if (channel.frame_decoder.in_packet()) {
+          channel.symbol_abs_sum += std::fabs(it->soft);
+          channel.symbol_sq_sum += it->soft * it->soft;
+          channel.symbol_offset_sum += it->offset_hz;
+          channel.symbol_count++;
+        }
+
+        // The packet is timed from the first bit of the sync word, the oldest
+        // in the ring once this bit is in
+        channel.bit_samples[channel.bit_idx] = it->sample;
+        channel.bit_idx = (channel.bit_idx + 1) % sync_word_bits;
+        if (channel.frame_decoder.push_bit(it->soft > 0)) {
+          channel.sync_sample = channel.bit_samples[channel.bit_idx];
+          channel.symbol_abs_sum = 0;
+          channel.symbol_sq_sum = 0;
+          channel.symbol_offset_sum = 0;
+          channel.symbol_count = 0;
+          channel.counters->add(channel_counter_t::SYNCS);
+        }
+      }
+    }
+
+    void ChannelPool::handle_frame(channel_t &channel, uint8_t *message, uint16_t computed_crc, uint16_t received_crc) {
+      // Runs on the pool's threads, so no locking or allocating here
+      channel.counters->add(channel_counter_t::ATTEMPTS);
+      uint32_t freq = channel.freq;
+      double now_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::system_clock::now().time_since_epoch()
+      ).count();
+
+      // Time the packet from its sync word, falling back to the clock if the
+      // source isn't tagged
+      double packet_ms = now_ms;
+      if (have_time_tag) {
+        double bit_ms = 1000.0 / AltusChannelDsp::symbol_rate;
+        packet_ms = time_tag_ms + (double(channel.sync_sample) - double(time_tag_offset)) * 1000.0 / input_sample_rate;
+        if (time_tag_live && decode_latency != nullptr) {
+          decode_latency->record(now_ms - (packet_ms + PACKET_BITS * bit_ms));
+        }
+      }
+      int64_t time_ms = std::llround(packet_ms);
+
+      if (computed_crc != received_crc) {
+        channel.counters->add(channel_counter_t::CRC_FAIL);
+        channel.crc_failure_times[channel.crc_failure_idx] = time_ms;
+        channel.crc_failure_idx = (channel.crc_failure_idx + 1) % crc_failure_burst;
+
+        // The next slot holds the oldest of the last few failures
+        if (time_ms - channel.crc_failure_times[channel.crc_failure_idx] <= crc_failure_window_ms) {
+          std::fill(channel.crc_failure_times, channel.crc_failure_times + crc_failure_burst, INT64_MIN / 2);
+          if (event_handler) {
+            event_handler(altus_event_t::CRC_FAILURES, freq);
+          }
+        }
+        return;
+      }
+
+      channel.counters->add(channel_counter_t::CRC_PASS);
+
+      // Each symbol carries the offset it saw, over a packet they average
+      // out to the signal's
+      if (channel.symbol_count > 0) {
+        double magnitude = channel.symbol_abs_sum / channel.symbol_count;
+        double variance = std::max(channel.symbol_sq_sum / channel.symbol_count - magnitude * magnitude, 1e-9);
+        channel.counters->record_link(
+          10 * std::log10((magnitude * magnitude) / variance),
+          channel.symbol_offset_sum / channel.symbol_count
+        );
+      }
+
+      packet_slot_t packet;
+      std::memcpy(packet.message, message, BYTES_PER_MESSAGE);
+      packet.channel_freq = freq;
+      packet.time_ms = time_ms;
+      packet.channel = channel.index;
+      if (packet_ring->push(packet)) {
+        channel.counters->add(channel_counter_t::FORWARDED);
+      }
+
+      if (event_handler) {
+        event_handler(altus_event_t::DECODE, freq);
+      }
+    }
+
+    int ChannelPool::work(
+      int noutput_items,
+      gr_vector_const_void_star &input_items,
+      gr_vector_void_star &output_items
+    ) {
+      // Only the latest tag is needed, every packet is timed from it
+      std::vector<tag_t> tags;
+      get_tags_in_window(tags, 0, 0, noutput_items, pmt::mp(SAMPLE_TIME_TAG));
+      for (std::vector<tag_t>::iterator it = tags.begin(); it != tags.end(); it++) {
+        if (pmt::is_tuple(it->value) && (!have_time_tag || it->offset >= time_tag_offset)) {
+          have_time_tag = true;
+          time_tag_offset = it->offset;
+          time_tag_ms = pmt::to_double(pmt::tuple_ref(it->value, 1));
+          time_tag_live = pmt::to_bool(pmt::tuple_ref(it->value, 2));
+        }
+      }
+
+      block_in = input_items[0];
+      block_count = noutput_items;
+      block_start = nitems_read(0);
+      next_channel = 0;
+      channels_left = channels.size();
+      {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        generation++;
+      }
+      block_ready.notify_all();
+
+      // This thread takes channels too, then waits for the workers to finish
+      // the ones they took
+      run_channels();
+      std::unique_lock<std::mutex> lock(pool_mutex);
+      block_done.wait(lock, [this]() {
+        return channels_left == 0;
+      });
+
+      return noutput_items;
+    }
+
+    void ChannelPool::set_channel(size_t channel, uint32_t c) {
+      channel_t &ch = *channels[channel];
+      uint32_t old = ch.freq;
+      if (old == c) {
+        std::cout << "Creating channel on " << std::fixed << std::setprecision(3) << (float(c) / 1000000) << std::endl;
+      } else {
+        std::cout << "Changing from " << std::fixed << std::setprecision(3) << (float(old) / 1000000) << " to ";
+        std::cout << std::fixed << std::setprecision(3) << (float(c) / 1000000) << std::endl;
+        ch.counters->add(channel_counter_t::RETUNES);
+      }
+      ch.freq = c;
+      ch.retune = true;
+    }
+
+    void ChannelPool::set_center_freq(double center) {
+      center_freq = center;
+      for (std::vector<std::unique_ptr<channel_t>>::iterator it = channels.begin(); it != channels.end(); it++) {
+        (*it)->recenter = true;
+      }
+    }
+
+    uint32_t ChannelPool::channel_freq(size_t channel) {
+      return channels[channel]->freq;
+    }
+
+    channel_counters_sptr ChannelPool::get_counters(size_t channel) {
+      return channels[channel]->counters;
+    }
+
+    void ChannelPool::set_parked(size_t channel, bool parked) {
+      channels[channel]->parked = parked;
+    }
+
+    bool ChannelPool::is_parked(size_t channel) {
+      return channels[channel]->parked;
+    }
+
+    void ChannelPool::set_low_cost(bool l) {
+      low_cost = l;
+    }
+
+    void ChannelPool::set_demod(channel_demod_t d) {
+      demod = d;
+    }
+
+    channel_demod_t ChannelPool::get_demod() {
+      return demod;
+    }
+
+    double ChannelPool::input_fill() {
+      if (detail() == nullptr) {
+        return 0;
+      }
+      gr::buffer_reader_sptr reader = detail()->input(0);
+      if (reader == nullptr) {
+        return 0;
+      }
+      return double(reader->items_available()) / reader->buffer()->bufsize();
+    }
+
+    void ChannelPool::set_event_handler(altus_event_handler_t handler) {
+      event_handler = handler;
+    }
+
+    void ChannelPool::set_latency_histogram(latency_histogram_sptr histogram) {
+      decode_latency = histogram;
+    }
+
+    size_t ChannelPool::channel_count() {
+      return channels.size();
+    }
+
+    uint16_t ChannelPool::threads() {
+      return thread_count;
+    }
+  }
+}
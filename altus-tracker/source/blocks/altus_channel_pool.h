@@ -0,0 +1,255 @@
+#ifndef INCLUDED_ALTUS_CHANNEL_POOL_H
+#define INCLUDED_ALTUS_CHANNEL_POOL_H
+
+#include <gnuradio/attributes.h>
+#include <gnuradio/sync_block.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../channel_counters.h"
+#include "../constants.h"
+#include "../latency_histogram.h"
+#include "../packet_ring.h"
+#include "altus_channel.h"
+#include "altus_channel_dsp.h"
+#include "altus_frame_decoder.h"
+
+#ifdef gnuradio_Altus_Decoder_EXPORTS
+#define ALTUS_DECODER_API __GR_ATTR_EXPORT
+#else
+#define ALTUS_DECODER_API __GR_ATTR_IMPORT
+#endif
+
+namespace gr {
+  namespace AltusDecoder {
+    /**
+     * Every channel of a receiver in one block, run on a fixed pool of threads
+     *
+     * Each channel is an AltusChannelDsp and a frame decoder in a struct of
+     * its own. For each block of input the channels are handed out to the
+     * workers (and the block's own thread) from a shared index, so a thread
+     * that finishes a cheap channel takes the next one rather than waiting,
+     * and the flowgraph has one buffer and one thread to schedule in place of
+     * ten blocks per channel.
+     *
+     * Retunes, parking, the cheaper filters and the demodulator are requested
+     * from any thread and applied by the channel at the start of its next
+     * block.
+     */
+    class ALTUS_DECODER_API ChannelPool : virtual public gr::sync_block {
+      private:
+        // Recent CRC failures, as AltusChannel
+        static const uint8_t crc_failure_burst = 5;
+        static const int64_t crc_failure_window_ms = 1000;
+
+        // The sync word is this many bits before the bit that completes it
+        static const uint8_t sync_word_bits = 16;
+
+        struct alignas(64) channel_t {
+          // Only touched by the thread running the channel
+          AltusChannelDsp dsp;
+          AltusFrameDecoder frame_decoder;
+          std::vector<channel_symbol_t> symbols;
+          uint64_t bit_samples[sync_word_bits];
+          uint8_t bit_idx = 0;
+          uint64_t sync_sample = 0;
+          double symbol_abs_sum = 0;
+          double symbol_sq_sum = 0;
+          uint32_t symbol_count = 0;
+          int64_t crc_failure_times[crc_failure_burst];
+          uint8_t crc_failure_idx = 0;
+          double symbol_offset_sum = 0;
+          bool low_cost = false;
+          channel_demod_t demod = channel_demod_t::FULL;
+          bool was_parked = false;
+
+          uint8_t index;
+          channel_counters_sptr counters;
+
+          // Set from other threads
+          std::atomic<uint32_t> freq;
+          std::atomic<bool> retune;
+          std::atomic<bool> recenter;
+          std::atomic<bool> parked;
+
+          channel_t(
+            ChannelPool *pool,
+            uint8_t index,
+            double input_sample_rate,
+            double center_freq,
+            uint32_t freq
+          );
+        };
+
+        double input_sample_rate;
+        bool cs16_input;
+        std::atomic<double> center_freq;
+        packet_ring_sptr packet_ring;
+        std::vector<std::unique_ptr<channel_t>> channels;
+        std::atomic<bool> low_cost;
+        std::atomic<channel_demod_t> demod;
+
+        altus_event_handler_t event_handler;
+        latency_histogram_sptr decode_latency;
+
+        // The last sample time tag, fixed while the channels run
+        bool have_time_tag = false;
+        uint64_t time_tag_offset = 0;
+        double time_tag_ms = 0;
+        bool time_tag_live = false;
+
+        // The block being worked on
+        const void *block_in = nullptr;     // gr_complex, or int16 pairs for cs16 input
+        size_t block_count = 0;
+        uint64_t block_start = 0;
+        std::atomic<size_t> next_channel;
+        std::atomic<size_t> channels_left;
+
+        // Workers sleep between blocks
+        uint16_t thread_count;
+        std::vector<std::thread> workers;
+        std::vector<int> worker_cores;
+        std::mutex pool_mutex;
+        std::condition_variable block_ready;
+        std::condition_variable block_done;
+        uint64_t generation = 0;
+        bool stopping = false;
+
+        void run_worker(uint16_t worker);
+        void run_channels();
+        void run_channel(channel_t &channel);
+        void pin_worker(std::thread &worker);
+        void handle_frame(channel_t &channel, uint8_t *message, uint16_t computed_crc, uint16_t received_crc);
+
+      public:
+        typedef std::shared_ptr<ChannelPool> sptr;
+
+        /**
+         * @param input_sample_rate The wideband sample rate
+         * @param center_freq The frequency of the receiver (in Hz)
+         * @param channel_freqs The starting frequency of each channel
+         * @param packet_ring The ring decoded packets are pushed into
+         * @param first_channel The index in the tracker of the first channel
+         * @param threads Threads to run the channels on, counting the block's
+         * own, 0 for one per core (but no more than the channels)
+         * @param cs16_input Take interleaved int16 pairs in place of
+         * gr_complex, the first stage filters them in integers
+         */
+        static sptr make(
+          double input_sample_rate,
+          double center_freq,
+          const std::vector<uint32_t> &channel_freqs,
+          packet_ring_sptr packet_ring,
+          uint8_t first_channel,
+          uint16_t threads,
+          bool cs16_input
+        );
+
+        ChannelPool(
+          double input_sample_rate,
+          double center_freq,
+          const std::vector<uint32_t> &channel_freqs,
+          packet_ring_sptr packet_ring,
+          uint8_t first_channel,
+          uint16_t threads,
+          bool cs16_input
+        );
+        ~ChannelPool();
+
+        bool start() override;
+        bool stop() override;
+
+        /**
+         * @brief Pin the block's thread, the workers go on the same cores
+         */
+        void set_processor_affinity(const std::vector<int> &mask) override;
+
+        int work(
+          int noutput_items,
+          gr_vector_const_void_star& input_items,
+          gr_vector_void_star& output_items
+        );
+
+        /**
+         * @brief Move a channel to a new frequency, as AltusChannel::set_channel
+         */
+        void set_channel(size_t channel, uint32_t freq);
+
+        /**
+         * @brief Follow the receiver to a new center frequency, as
+         * AltusChannel::set_center_freq
+         */
+        void set_center_freq(double center_freq);
+
+        /**
+         * @brief The current frequency of a channel
+         */
+        uint32_t channel_freq(size_t channel);
+
+        /**
+         * @brief The decode funnel and link quality counters of a channel
+         */
+        channel_counters_sptr get_counters(size_t channel);
+
+        /**
+         * @brief Stop or restart processing a channel, it keeps its frequency
+         */
+        void set_parked(size_t channel, bool parked);
+
+        /**
+         * @brief Whether a channel is parked
+         */
+        bool is_parked(size_t channel);
+
+        /**
+         * @brief Use the cheaper filters on every channel
+         */
+        void set_low_cost(bool low_cost);
+
+        /**
+         * @brief Switch every channel's demodulator, anything half decoded
+         * is dropped
+         */
+        void set_demod(channel_demod_t demod);
+
+        /**
+         * @brief The demodulator the channels run
+         */
+        channel_demod_t get_demod();
+
+        /**
+         * @brief How full the input buffer is, 0 to 1
+         */
+        double input_fill();
+
+        /**
+         * @brief Set the handler for decode and CRC failure events
+         * Called on the pool's threads
+         */
+        void set_event_handler(altus_event_handler_t handler);
+
+        /**
+         * @brief Count the decode latency of live packets
+         */
+        void set_latency_histogram(latency_histogram_sptr histogram);
+
+        /**
+         * @brief The number of channels
+         */
+        size_t channel_count();
+
+        /**
+         * @brief The number of threads running the channels, counting the
+         * block's own
+         */
+        uint16_t threads();
+    };
+  }
+}
+
+#endif
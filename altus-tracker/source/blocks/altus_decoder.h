@@ -9,14 +9,40 @@
 #include <string>
 #include <vector>
 
+#include "../channel_counters.h"
 #include "../constants.h"
+#include "altus_frame_decoder.h"
 
 typedef uint8_t message[BYTES_PER_MESSAGE];
 
+/**
+ * @brief Where a packet sits in the source stream
+ * The decoder only counts bits, sync_bits is the number of bits from the last
+ * sample time tag to the start of the sync word (negative if the tag came
+ * later) and the channel turns that into a time with its own rates
+ *
+ * With soft symbols connected the decoder also measures the packet's symbols,
+ * the spread around their mean magnitude gives the SNR and their mean (whitened
+ * data is balanced) the frequency error left after the FLL, as a fraction of
+ * the deviation
+ */
+struct packet_timing_t {
+  bool valid = false;
+  bool live = false;
+  uint64_t tag_sample = 0;
+  double tag_time_ms = 0;
+  int64_t sync_bits = 0;
+
+  bool have_symbols = false;
+  double symbol_snr_db = 0;
+  double symbol_mean = 0;
+};
+
 typedef std::function<void (
   message,
   uint16_t,
-  uint16_t
+  uint16_t,
+  const packet_timing_t &
 )> handle_message_t;
 
 #ifdef gnuradio_Altus_Decoder_EXPORTS
@@ -27,42 +53,33 @@ typedef std::function<void (
 
 namespace gr {
   namespace AltusDecoder {
+    /**
+     * Runs the frame decoder over the sliced bits of a channel and passes
+     * packets on with their position in the source stream
+     *
+     * The optional second input takes the soft symbols the bits were sliced
+     * from, one per bit, to measure the link quality of each packet.
+     */
     class ALTUS_DECODER_API Decoder : virtual public gr::block {
       private:
-        // Sync word detection
-        uint16_t last_16_bits;
-        bool found_sync_word;  
-
-        // Buffering of bits for interleaving
-        uint32_t bits_buffer;
-        uint8_t bits_buffer_idx;
-        uint8_t buffers_filled_for_packet;
-
-        // State for the viterbi decoding
-        uint8_t cost_index;
-        uint8_t cost[2][NUM_V_STATE];
-        uint32_t bits[2][NUM_V_STATE];
-        uint16_t bits_parsed;
-        uint16_t bits_saved;
-        uint8_t message[BYTES_PER_MESSAGE];
-        uint8_t message_index;
-
-        // Whitening of bytes
-        uint32_t whiten;
-
-        // CRC
-        uint16_t computed_crc;
-        uint16_t received_crc;
-
-        void parse_packet_bytes(); // Deinterleave and FEC decode
-        void parse_full_packet(); // Whiten and check CRC
-        uint32_t deinterleave(uint32_t base);
-        void viterbi_decode(uint32_t base); // Generates the viterbi state
-        void get_viterbi_bytes(); // Retrieves bytes of data from the viterbi state
-        uint8_t whiten_byte(uint8_t byte);
-        void add_byte_to_crc(uint8_t byte, uint8_t idx);
-  
+        AltusFrameDecoder frame_decoder;
+
+        // The last sample time tag, and the timing of the packet being parsed
+        bool have_time_tag;
+        uint64_t time_tag_offset;
+        packet_timing_t time_tag;
+        packet_timing_t packet_timing;
+
         handle_message_t handle_message;
+        channel_counters_sptr counters;
+
+        // Soft symbol sums over the packet being parsed
+        double symbol_sum;
+        double symbol_abs_sum;
+        double symbol_sq_sum;
+        uint32_t symbol_count;
+
+        void handle_frame(uint8_t *message, uint16_t computed_crc, uint16_t received_crc);
 
       public:
         typedef std::shared_ptr<Decoder> sptr;
@@ -82,6 +99,12 @@ namespace gr {
           gr_vector_void_star& output_items
         );
         void reset();
+
+        /**
+         * @brief Count syncs, attempts and mid-packet resets
+         * Must be called before the flowgraph starts
+         */
+        void set_counters(channel_counters_sptr counters);
     };
   }
 }
@@ -1,6 +1,8 @@
 #include "altus_detector.h"
 #include <gnuradio/io_signature.h>
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 const int max_channel_width = 40000;
 
@@ -18,7 +20,9 @@ namespace gr {
       uint16_t fft_size,
       int flex_channels,
       uint32_t min_channel,
-      uint32_t max_channel
+      uint32_t max_channel,
+      double spur_seconds,
+      double frame_rate
     ) {
       return gnuradio::get_initial_sptr(new Detector(
         peak_callback,
@@ -27,7 +31,9 @@ namespace gr {
         fft_size,
         flex_channels,
         min_channel,
-        max_channel
+        max_channel,
+        spur_seconds,
+        frame_rate
       ));
     }
 
@@ -38,7 +44,9 @@ namespace gr {
       uint16_t fft_size_p,
       int flex_channels,
       uint32_t min_channel_f,
-      uint32_t max_channel_f
+      uint32_t max_channel_f,
+      double spur_seconds,
+      double frame_rate
     ) : gr::block(
       "AltusDetector",
       gr::io_signature::make(
@@ -55,10 +63,34 @@ namespace gr {
       total_channels = flex_channels;
       min_channel = min_channel_f;
       max_channel = max_channel_f;
+      squelch = 60;
+      std::fill(last_n_channels, last_n_channels + MAX_CHANNELS, 0);
+      spur_mask = make_spur_mask(
+        sample_rate,
+        fft_size,
+        center_freq,
+        spur_seconds,
+        frame_rate
+      );
     }
 
     Detector::~Detector() {}
 
+    void Detector::set_band(uint32_t center_freq, uint32_t min_channel_f, uint32_t max_channel_f) {
+      center = center_freq;
+      min_channel = min_channel_f;
+      max_channel = max_channel_f;
+      spur_mask->set_center_freq(center_freq);
+    }
+
+    void Detector::set_squelch(float squelch_db) {
+      squelch = squelch_db;
+    }
+
+    spur_mask_sptr Detector::get_spur_mask() {
+      return spur_mask;
+    }
+
     uint32_t Detector::bucket_to_freq(int bucket) {
       // Get the bottom of the range
       uint32_t min_bucket = center - (samp_rate / 2);
@@ -73,94 +105,101 @@ namespace gr {
       return result;
     }
 
+    void Detector::process_frame(const float *frame) {
+      // The threshold follows the mean level of the spectrum
+      float all_v = 0;
+      for (int i = 0; i < fft_size; i++) {
+        all_v += frame[i];
+      }
+      float mean = all_v / fft_size;
+      if (!have_threshold) {
+        last_threshold = mean;
+        have_threshold = true;
+      }
+      float threshold = (mean + last_threshold) / 2;
+      last_threshold = threshold;
+
+      // Spurs and carriers are left out before the peaks are grouped, so one
+      // next to a rocket doesn't swallow it
+      std::vector<peak_t> peaks;
+      float level = threshold + squelch;
+      spur_mask->apply(frame, level, above);
+      for (int i = 0; i < fft_size; i++) {
+        if (above[i]) {
+          peak_t peak = { bucket_to_freq(i), frame[i] };
+          peaks.push_back(peak);
+        }
+      }
+
+      if (peaks.size() == 0) {
+        return;
+      }
+
+      std::vector<peak_t> new_peaks;
+      uint32_t first_peak_freq = 0;
+      uint32_t last_peak_freq = 0;
+      peak_t kept_peak;
+
+      for (std::vector<peak_t>::iterator it = peaks.begin(); it != peaks.end(); it++) {
+        peak_t peak = *it;
+
+        // Check for discontinuity
+        if (
+          first_peak_freq == 0 ||
+          (
+            first_peak_freq != 0 &&
+            peak.freq - first_peak_freq > max_channel_width
+          )
+        ) {
+          if (first_peak_freq > 0) {
+            new_peaks.push_back(kept_peak);
+          }
+          last_peak_freq = peak.freq;
+          first_peak_freq = peak.freq;
+          kept_peak = peak;
+        } else {
+          last_peak_freq = peak.freq;
+          if (peak.amp > kept_peak.amp) {
+            kept_peak = peak;
+          }
+        }
+      }
+      new_peaks.push_back(kept_peak);
+
+      // Check for any net-new channels
+      for (std::vector<peak_t>::iterator it = new_peaks.begin(); it != new_peaks.end(); it++) {
+        peak_t peak = *it;
+        uint32_t channel = round_freq(peak.freq);
+        if (channel < min_channel || channel > max_channel) {
+          continue;
+        }
+        bool keep = true;
+        for (int i = 0; i < total_channels; i++) {
+          if (channel == last_n_channels[i]) {
+            keep = false;
+            break;
+          }
+        }
+        if (keep) {
+          last_n_channels[channel_idx] = channel;
+          channel_idx++;
+          if (channel_idx >= total_channels) {
+            channel_idx = 0;
+          }
+          callback(channel);
+        }
+      }
+    }
+
     int Detector::general_work(
       int noutput_items,
       gr_vector_int& ninput_items,
       gr_vector_const_void_star &input_items,
       gr_vector_void_star &output_items
     ) {
-      size_t itemsize = sizeof(float);
-      const char* in = (const char*)input_items[0];
-
+      const float *in = (const float *)input_items[0];
       for (int j = 0; j < noutput_items; j++) {
-        auto start_in = in;
-        float all_v = 0;
-        for (int i = 0; i < fft_size; i++) {
-          float v;
-          std::memcpy(&v, in, itemsize);
-          all_v += v;
-        }
-        float threshold = (all_v + fft_size * last_threshold) / (fft_size * 2);
-        last_threshold = threshold;
-
-        in = start_in;
-        std::vector<peak_t> peaks;
-        for (int i = 0; i < fft_size; i++) {
-          float v;
-          std::memcpy(&v, in, itemsize);
-          if (v > threshold + 60) {
-            peak_t peak = { bucket_to_freq(i), v };
-            peaks.push_back(peak);
-          }
-          in += itemsize;
-        }
-
-        if (peaks.size() > 0) {
-          std::vector<peak_t> new_peaks;
-          uint32_t first_peak_freq = 0;
-          uint32_t last_peak_freq = 0;
-          peak_t kept_peak;
-
-          for (std::vector<peak_t>::iterator it = peaks.begin(); it != peaks.end(); it++) {
-            peak_t peak = *it;
-
-            // Check for discontinuity
-            if (
-              first_peak_freq == 0 ||
-              (
-                first_peak_freq != 0 &&
-                peak.freq - first_peak_freq > max_channel_width
-              )
-            ) {
-              if (first_peak_freq > 0) {
-                new_peaks.push_back(kept_peak);
-              }
-              last_peak_freq = peak.freq;
-              first_peak_freq = peak.freq;
-              kept_peak = peak;
-            } else {
-              last_peak_freq = peak.freq;
-              if (peak.amp > kept_peak.amp) {
-                kept_peak = peak;
-              }
-            }
-          }
-          new_peaks.push_back(kept_peak);
-
-          // Check for any net-new channels
-          for (std::vector<peak_t>::iterator it = new_peaks.begin(); it != new_peaks.end(); it++) {
-            peak_t peak = *it;
-            uint32_t channel = round_freq(peak.freq);
-            if (channel < min_channel || channel > max_channel) {
-              continue;
-            }
-            bool keep = true;
-            for (int i = 0; i < total_channels; i++) {
-              if (channel == last_n_channels[i]) {
-                keep = false;
-                break;
-              }
-            }
-            if (keep) {
-              last_n_channels[channel_idx] = channel;
-              channel_idx++;
-              if (channel_idx >= total_channels) {
-                channel_idx = 0;
-              }
-              callback(channel);
-            }
-          }
-        }
+        process_frame(in + j * fft_size);
       }
 
       consume_each(noutput_items);
@@ -4,9 +4,12 @@
 #include <gnuradio/attributes.h>
 #include <gnuradio/block.h>
 
+#include <atomic>
 #include <functional>
+#include <vector>
 
 #include "../constants.h"
+#include "../spur_mask.h"
 
 #ifdef gnuradio_Altus_Decoder_EXPORTS
 #define ALTUS_DECODER_API __GR_ATTR_EXPORT
@@ -24,21 +27,39 @@ namespace gr {
       private:
         peak_detected_t callback;
 
-        uint32_t center;
+        std::atomic<uint32_t> center;
         double samp_rate;
         uint16_t fft_size;
-        uint32_t min_channel;
-        uint32_t max_channel;
+        std::atomic<uint32_t> min_channel;
+        std::atomic<uint32_t> max_channel;
+        std::atomic<float> squelch;
+
+        spur_mask_sptr spur_mask;
+        std::vector<bool> above;
 
         uint32_t bucket_to_freq(int bucket);
         uint32_t round_freq(uint32_t freq);
         uint32_t last_n_channels[MAX_CHANNELS];
         int channel_idx = 0;
         int total_channels;
-        float last_threshold;
+        bool have_threshold = false;
+        float last_threshold = 0;
 
       public:
         typedef std::shared_ptr<Detector> sptr;
+
+        /**
+         * @param peak_callback Called with each new channel frequency
+         * @param center_freq The frequency of the receiver (in Hz)
+         * @param sample_rate The sample rate the spectrum covers
+         * @param fft_size The number of bins
+         * @param flex_channels The number of channels, recent detections aren't repeated
+         * @param min_channel The lowest channel frequency to report
+         * @param max_channel The highest channel frequency to report
+         * @param spur_seconds How long a bin has to stay up to be masked as a
+         * spur, 0 to only mask the exclusions
+         * @param frame_rate Spectrum frames per second
+         */
         static sptr make(
           peak_detected_t peak_callback,
           uint32_t center_freq,
@@ -46,7 +67,9 @@ namespace gr {
           uint16_t fft_size,
           int flex_channels,
           uint32_t min_channel,
-          uint32_t max_channel
+          uint32_t max_channel,
+          double spur_seconds,
+          double frame_rate
         );
 
         Detector(
@@ -56,10 +79,41 @@ namespace gr {
           uint16_t fft_size,
           int flex_channels,
           uint32_t min_channel,
-          uint32_t max_channel
+          uint32_t max_channel,
+          double spur_seconds,
+          double frame_rate
         );
         ~Detector();
 
+        /**
+         * @brief Follow the source to a new frequency
+         * Safe to call from any thread
+         *
+         * @param center_freq The frequency of the receiver (in Hz)
+         * @param min_channel The lowest channel frequency to report
+         * @param max_channel The highest channel frequency to report
+         */
+        void set_band(uint32_t center_freq, uint32_t min_channel, uint32_t max_channel);
+
+        /**
+         * @brief Set how far above the mean level (in dB) a peak has to be
+         * Safe to call from any thread
+         */
+        void set_squelch(float squelch_db);
+
+        /**
+         * @brief The bins kept from reporting, learned spurs and exclusions
+         */
+        spur_mask_sptr get_spur_mask();
+
+        /**
+         * @brief Look for new signals in one spectrum
+         * Calls the peak callback for each new channel found
+         *
+         * @param frame fft_size power levels (in dB), lowest frequency first
+         */
+        void process_frame(const float *frame);
+
         int general_work(
           int noutput_items,
           gr_vector_int& ninput_items,
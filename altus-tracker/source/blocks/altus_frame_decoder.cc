@@ -0,0 +1,224 @@
+#include "altus_frame_decoder.h"
+
+const uint16_t packet_length_in_bits = BYTES_PER_MESSAGE * 8;
+
+const uint8_t fec_encode_table[NUM_V_STATE * 2] = {
+	0, 3, /* 000 to 0000 or 0001 */
+	1, 2, /* 001 to 0010 or 0011 */
+	3, 0, /* 010 to 0100 or 101 */
+	2, 1, /* 011 to 0110 or 0111 */
+	3, 0, /* 100 to 1000 or 1001 */
+	2, 1, /* 101 to 1010 or 1011 */
+	0, 3, /* 110 to 1100 or 1101 */
+	1, 2  /* 111 to 1110 or 1111 */
+};
+
+AltusFrameDecoder::AltusFrameDecoder(frame_handler_t handler) {
+  handle_frame = handler;
+  found_sync_word = false;
+
+  reset();
+}
+
+void AltusFrameDecoder::reset() {
+  // Reset the variables used when looking for the sync word
+  last_16_bits = 0;
+  found_sync_word = false;
+
+  // Reset the buffer variables
+  buffers_filled_for_packet = 0;
+  bits_buffer = 0;
+  bits_buffer_idx = 0;
+
+  // Reset the viterbi state
+  cost_index = 0;
+  bits_parsed = 0;
+  bits_saved = 0;
+  for (uint8_t state = 0; state < NUM_V_STATE; state++) {
+    cost[0][state] = state == 0 ? 0 : 1 << 7;
+    bits[0][state] = 0;
+  }
+  message_index = 0;
+}
+
+bool AltusFrameDecoder::in_packet() {
+  return found_sync_word;
+}
+
+uint32_t AltusFrameDecoder::deinterleave(uint32_t base) {
+  uint32_t return_data = 0;
+  for (uint8_t bit = 0; bit < 4 * 4; bit++) {
+    uint8_t bit_shift = (bit & 0x3) << 3;
+    uint8_t byte_shift = (bit & 0xc) >> 1;
+
+    return_data = (return_data << 2) + ((base >> (byte_shift + bit_shift)) & 0x3);
+  }
+
+  return return_data;
+}
+
+void AltusFrameDecoder::get_viterbi_bytes() {
+  // Determine the minimum cost path
+  uint8_t min_state = 0;
+  uint8_t min_cost = cost[cost_index][0];
+  for (uint8_t i = 1; i < NUM_V_STATE; i++) {
+      if (cost[cost_index][i] < min_cost) {
+          min_state = i;
+          min_cost = cost[cost_index][i];
+      }
+  }
+
+  // Override the state if we're in the trellis terminator
+  if (bits_parsed == (BYTES_PER_MESSAGE - 1) * 8) {
+      min_state = 0;
+  } else if (bits_parsed == packet_length_in_bits) {
+      min_state = 0;
+  }
+
+  // Get the bits from the path
+  uint32_t state_bits = bits[cost_index][min_state];
+
+  // Get the byte or bytes
+  if (bits_parsed < packet_length_in_bits) {
+      uint8_t byte = (state_bits >> NUM_V_HIST) & 0xff;
+      message[message_index] = byte;
+      message_index++;
+  } else {
+      uint8_t b;
+      for (b = 0; b <= bits_saved && message_index < BYTES_PER_MESSAGE; b += 8) {
+          uint8_t byte = (state_bits >> (NUM_V_HIST - b)) & 0xff;
+          message[message_index] = byte;
+          message_index++;
+      }
+  }
+}
+
+void AltusFrameDecoder::viterbi_decode(uint32_t base) {
+  for (uint8_t d = 0; d < BITS_TO_BUFFER; d += 2) {
+    uint8_t last_cost_index = cost_index;
+    cost_index ^= 1;
+
+    // Get the next 2 bits
+    uint8_t s = (base >> (BITS_TO_BUFFER - d - 2)) & 0x3;
+
+    // Loop over the possible states
+    for (uint8_t state = 0; state < NUM_V_STATE; state++) {
+      // What states can we get to this state from?
+      uint8_t state1 = state;
+      uint8_t state2 = state + (1 << 3);
+
+      // What bits would be used to transition from each of those states?
+      uint8_t transition_bits_1 = fec_encode_table[state1];
+      uint8_t transition_bits_2 = fec_encode_table[state2];
+
+      // Get the cost of the transition
+      uint8_t cost1_bits = (s ^ transition_bits_1);
+      uint8_t cost2_bits = (s ^ transition_bits_2);
+      uint8_t cost1 = 0;
+      uint8_t cost2 = 0;
+      while (cost1_bits || cost2_bits) {
+          cost1 += cost1_bits & 1;
+          cost2 += cost2_bits & 1;
+
+          cost1_bits >>= 1;
+          cost2_bits >>= 1;
+      }
+
+      // Get the total cost of each path
+      uint8_t t_cost1 = cost[last_cost_index][state1 >> 1] + cost1;
+      uint8_t t_cost2 = cost[last_cost_index][state2 >> 1] + cost2;
+
+      // Save the lower cost path
+      uint8_t last_state = state2;
+      uint8_t last_cost = t_cost2;
+      if (t_cost1 < t_cost2) {
+          last_state = state1;
+          last_cost = t_cost1;
+      }
+
+      uint32_t new_bits = bits[last_cost_index][last_state >> 1] << 1;
+      uint8_t new_bit = last_state & 1;
+      new_bits += new_bit;
+
+      bits[cost_index][state] = new_bits;
+      cost[cost_index][state] = last_cost;
+    }
+
+    bits_parsed++;
+    bits_saved++;
+    if (bits_saved >= 8 + NUM_V_HIST) {
+      bits_saved -= 8;
+      get_viterbi_bytes();
+    }
+  }
+}
+
+void AltusFrameDecoder::whiten(uint8_t *bytes, size_t length) {
+  uint32_t whiten = 0x1FF;
+  for (size_t b = 0; b < length; b++) {
+    bytes[b] ^= whiten & 0xFF;
+
+    // Increment the whitening integer
+    for (uint8_t i = 0; i < 8; i++) {
+      whiten = ((whiten >> 1) + (((whiten & 0x1) ^ ((whiten >> 5) & 0x1)) << 8)) & 0x1FF;
+    }
+  }
+}
+
+uint16_t AltusFrameDecoder::crc(const uint8_t *bytes, size_t length) {
+  uint16_t computed_crc = 0xFFFF;
+  for (size_t b = 0; b < length; b++) {
+    uint8_t byte = bytes[b];
+    for (uint8_t i = 0; i < 8; i++) {
+        if (((computed_crc & 0x8000) >> 8) ^ (byte & 0x80)) {
+            computed_crc = ((computed_crc << 1) ^ 0x8005);
+        } else {
+            computed_crc = (computed_crc << 1);
+        }
+        byte = byte << 1;
+    }
+  }
+  return computed_crc;
+}
+
+void AltusFrameDecoder::parse_full_packet() {
+  whiten(message, BYTES_PER_MESSAGE);
+
+  // Bytes 34 and 35 are trellis terminators and ignored
+  uint16_t computed_crc = crc(message, DATA_BYTES_PER_MESSAGE);
+  uint16_t received_crc = (message[DATA_BYTES_PER_MESSAGE] << 8) + message[DATA_BYTES_PER_MESSAGE + 1];
+
+  // Failed packets are passed on too so the channel can count them
+  handle_frame(message, computed_crc, received_crc);
+}
+
+bool AltusFrameDecoder::push_bit(uint8_t bit) {
+  // Look for the sync word
+  if (!found_sync_word) {
+    last_16_bits = (last_16_bits << 1) | bit;
+    found_sync_word = last_16_bits == SYNC_WORD;
+    return found_sync_word;
+  }
+
+  // Cache some bits to be passed to the next function
+  bits_buffer = (bits_buffer << 1) + bit;
+  bits_buffer_idx++;
+
+  // Send the buffer to the next step when it is full
+  if (bits_buffer_idx >= BITS_TO_BUFFER) {
+    // Deinterleave, then parse from viterbi (reduces number of bits by 2)
+    viterbi_decode(deinterleave(bits_buffer));
+
+    // Each filled buffer equates to 2 bytes from the message
+    bits_buffer = 0;
+    bits_buffer_idx = 0;
+    buffers_filled_for_packet++;
+  }
+
+  // Once all the bytes for the packet are parsed, reset the state
+  if (buffers_filled_for_packet * 2 >= BYTES_PER_MESSAGE) {
+    parse_full_packet();
+    reset();
+  }
+  return false;
+}
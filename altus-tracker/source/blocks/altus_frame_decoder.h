@@ -0,0 +1,100 @@
+#ifndef ALTUS_FRAME_DECODER_H
+#define ALTUS_FRAME_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "../constants.h"
+
+/**
+ * @brief The two FEC bits sent for each 4 bit encoder state
+ */
+extern const uint8_t fec_encode_table[NUM_V_STATE * 2];
+
+/**
+ * @brief Called with each packet that synced, good CRC or not
+ */
+typedef std::function<void (
+  uint8_t *,
+  uint16_t,
+  uint16_t
+)> frame_handler_t;
+
+/**
+ * Turns sliced bits into Altus packets
+ *
+ * Finds the sync word, then deinterleaves, Viterbi decodes, whitens and
+ * checks the CRC of the packet after it. This has no GNU Radio dependency so
+ * the Decoder block, altus-bench and the tools can share it.
+ */
+class AltusFrameDecoder {
+  private:
+    // Sync word detection
+    uint16_t last_16_bits;
+    bool found_sync_word;
+
+    // Buffering of bits for interleaving
+    uint32_t bits_buffer;
+    uint8_t bits_buffer_idx;
+    uint8_t buffers_filled_for_packet;
+
+    // State for the viterbi decoding
+    uint8_t cost_index;
+    uint8_t cost[2][NUM_V_STATE];
+    uint32_t bits[2][NUM_V_STATE];
+    uint16_t bits_parsed;
+    uint16_t bits_saved;
+    uint8_t message[BYTES_PER_MESSAGE];
+    uint8_t message_index;
+
+    frame_handler_t handle_frame;
+
+    void parse_full_packet(); // Whiten and check CRC
+    void get_viterbi_bytes(); // Retrieves bytes of data from the viterbi state
+
+  public:
+    AltusFrameDecoder(frame_handler_t handle_frame);
+
+    /**
+     * @brief Add the next bit
+     *
+     * @param bit The bit (0 or 1)
+     * @return true If this bit completed a sync word
+     */
+    bool push_bit(uint8_t bit);
+
+    /**
+     * @brief Drop any partial packet and look for a sync word again
+     */
+    void reset();
+
+    /**
+     * @brief Whether a sync word has been found and the packet isn't done
+     */
+    bool in_packet();
+
+    // The stages, public so altus-bench can time them on their own
+
+    /**
+     * @brief Undo the interleaving of a buffer of 32 bits
+     */
+    static uint32_t deinterleave(uint32_t base);
+
+    /**
+     * @brief Run a deinterleaved buffer through the Viterbi decoder
+     */
+    void viterbi_decode(uint32_t base);
+
+    /**
+     * @brief Undo the PN9 whitening of a message in place
+     */
+    static void whiten(uint8_t *bytes, size_t length);
+
+    /**
+     * @brief The CRC16 (0x8005, starting at 0xffff) of the bytes
+     */
+    static uint16_t crc(const uint8_t *bytes, size_t length);
+};
+
+#endif
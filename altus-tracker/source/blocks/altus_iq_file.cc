@@ -0,0 +1,209 @@
+#include "altus_iq_file.h"
+
+// Full scale for each integer format, kept symmetric so a round trip through
+// a recording doesn't shift the signal
+const float cs8_scale = 127.0;
+const float cs16_scale = 32767.0;
+
+altus_iq_file_source_sptr make_altus_iq_file_source(
+  const std::string &file_path,
+  iq_format_t format,
+  bool keep_cs16
+) {
+  return gnuradio::get_initial_sptr(new AltusIqFileSource(
+    file_path,
+    format,
+    keep_cs16
+  ));
+}
+
+altus_iq_file_source_sptr make_altus_iq_memory_source(
+  const void *data,
+  uint64_t samples,
+  iq_format_t format,
+  bool keep_cs16
+) {
+  return gnuradio::get_initial_sptr(new AltusIqFileSource(
+    data,
+    samples,
+    format,
+    keep_cs16
+  ));
+}
+
+altus_iq_file_sink_sptr make_altus_iq_file_sink(
+  const std::string &file_path,
+  iq_format_t format
+) {
+  return gnuradio::get_initial_sptr(new AltusIqFileSink(
+    file_path,
+    format
+  ));
+}
+
+AltusIqFileSource::~AltusIqFileSource() {}
+
+// Size of each item the raw source emits, the integer formats are read as
+// separate I and Q items for the interleaved blocks unless cs16 is kept
+static size_t raw_item_size(iq_format_t format, bool keep_cs16) {
+  switch (format) {
+    case iq_format_t::CS8:
+      return sizeof(int8_t);
+    case iq_format_t::CS16:
+      return keep_cs16 ? 2 * sizeof(int16_t) : sizeof(int16_t);
+    default:
+      return sizeof(gr_complex);
+  }
+}
+
+size_t AltusIqFileSource::output_item_size(iq_format_t format, bool keep_cs16) {
+  return format == iq_format_t::CS16 && keep_cs16 ? 2 * sizeof(int16_t) : sizeof(gr_complex);
+}
+
+AltusIqFileSource::AltusIqFileSource(
+  const std::string &file_path,
+  iq_format_t format,
+  bool keep_cs16
+) : gr::hier_block2(
+  "AltusIqFileSource",
+  gr::io_signature::make(0, 0, 0),
+  gr::io_signature::make(
+    1,
+    1,
+    output_item_size(format, keep_cs16)
+  )
+) {
+  file = gr::blocks::file_source::make(
+    raw_item_size(format, keep_cs16),
+    file_path.c_str()
+  );
+  connect_raw(file, format, keep_cs16);
+}
+
+AltusIqFileSource::AltusIqFileSource(
+  const void *data,
+  uint64_t samples,
+  iq_format_t format,
+  bool keep_cs16
+) : gr::hier_block2(
+  "AltusIqMemorySource",
+  gr::io_signature::make(0, 0, 0),
+  gr::io_signature::make(
+    1,
+    1,
+    output_item_size(format, keep_cs16)
+  )
+) {
+  memory = gr::AltusDecoder::MemorySource::make(
+    data,
+    raw_item_size(format, keep_cs16),
+    samples * iq_format_sample_size(format) / raw_item_size(format, keep_cs16)
+  );
+  connect_raw(memory, format, keep_cs16);
+}
+
+void AltusIqFileSource::connect_raw(gr::basic_block_sptr raw, iq_format_t format, bool keep_cs16) {
+  if (format == iq_format_t::CS16 && keep_cs16) {
+    connect(raw, 0, self(), 0);
+    return;
+  }
+
+  switch (format) {
+    case iq_format_t::CS8:
+      char_to_complex = gr::blocks::interleaved_char_to_complex::make(
+        false,
+        cs8_scale
+      );
+      connect(raw, 0, char_to_complex, 0);
+      connect(char_to_complex, 0, self(), 0);
+      break;
+
+    case iq_format_t::CS16:
+      short_to_complex = gr::blocks::interleaved_short_to_complex::make(
+        false,
+        false,
+        cs16_scale
+      );
+      connect(raw, 0, short_to_complex, 0);
+      connect(short_to_complex, 0, self(), 0);
+      break;
+
+    default:
+      connect(raw, 0, self(), 0);
+      break;
+  }
+}
+
+AltusIqFileSink::~AltusIqFileSink() {}
+
+AltusIqFileSink::AltusIqFileSink(
+  const std::string &file_path,
+  iq_format_t format
+) : gr::hier_block2(
+  "AltusIqFileSink",
+  gr::io_signature::make(
+    1,
+    1,
+    sizeof(gr_complex)
+  ),
+  gr::io_signature::make(0, 0, 0)
+) {
+  switch (format) {
+    case iq_format_t::CS8:
+      complex_to_char = gr::blocks::complex_to_interleaved_char::make(
+        false,
+        cs8_scale
+      );
+      file = gr::blocks::file_sink::make(
+        sizeof(int8_t),
+        file_path.c_str(),
+        false
+      );
+      connect(self(), 0, complex_to_char, 0);
+      connect(complex_to_char, 0, file, 0);
+      break;
+
+    case iq_format_t::CS16:
+      complex_to_short = gr::blocks::complex_to_interleaved_short::make(
+        false,
+        cs16_scale
+      );
+      file = gr::blocks::file_sink::make(
+        sizeof(int16_t),
+        file_path.c_str(),
+        false
+      );
+      connect(self(), 0, complex_to_short, 0);
+      connect(complex_to_short, 0, file, 0);
+      break;
+
+    default:
+      file = gr::blocks::file_sink::make(
+        sizeof(gr_complex),
+        file_path.c_str(),
+        false
+      );
+      connect(self(), 0, file, 0);
+      break;
+  }
+}
+
+bool AltusIqFileSink::open(const std::string &file_path) {
+  return file->open(file_path.c_str());
+}
+
+void AltusIqFileSink::close() {
+  file->close();
+}
+
+stage_blocks_t AltusIqFileSink::stage_blocks() {
+  stage_blocks_t stages;
+  if (complex_to_char != nullptr) {
+    stages.push_back(std::make_pair("convert", complex_to_char));
+  }
+  if (complex_to_short != nullptr) {
+    stages.push_back(std::make_pair("convert", complex_to_short));
+  }
+  stages.push_back(std::make_pair("file", file));
+  return stages;
+}
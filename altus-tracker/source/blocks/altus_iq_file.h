@@ -0,0 +1,159 @@
+#ifndef IQ_FILE_H
+#define IQ_FILE_H
+
+#include <gnuradio/hier_block2.h>
+
+#include <gnuradio/blocks/complex_to_interleaved_char.h>
+#include <gnuradio/blocks/complex_to_interleaved_short.h>
+#include <gnuradio/blocks/file_sink.h>
+#include <gnuradio/blocks/file_source.h>
+#include <gnuradio/blocks/interleaved_char_to_complex.h>
+#include <gnuradio/blocks/interleaved_short_to_complex.h>
+
+#include "altus_memory_source.h"
+#include "../iq_format.h"
+#include "../perf_counters.h"
+
+class AltusIqFileSource;
+class AltusIqFileSink;
+
+typedef std::shared_ptr<AltusIqFileSource> altus_iq_file_source_sptr;
+typedef std::shared_ptr<AltusIqFileSink> altus_iq_file_sink_sptr;
+
+/**
+ * @brief Generate a source that reads a recording as gr_complex
+ *
+ * @param file_path The file to read
+ * @param format The sample format of the file
+ * @param keep_cs16 Output a cs16 recording as it is, an int16 pair per item,
+ * for the int16 front end
+ * @return altus_iq_file_source_sptr
+ */
+altus_iq_file_source_sptr make_altus_iq_file_source(
+  const std::string &file_path,
+  iq_format_t format,
+  bool keep_cs16
+);
+
+/**
+ * @brief Generate a source that reads samples already in memory as gr_complex
+ *
+ * @param data The first sample (must outlive the flowgraph)
+ * @param samples The number of complex samples to read
+ * @param format The sample format of the data
+ * @param keep_cs16 Output cs16 data as it is, an int16 pair per item
+ * @return altus_iq_file_source_sptr
+ */
+altus_iq_file_source_sptr make_altus_iq_memory_source(
+  const void *data,
+  uint64_t samples,
+  iq_format_t format,
+  bool keep_cs16
+);
+
+/**
+ * @brief Generate a sink that records gr_complex samples in a compact format
+ *
+ * @param file_path The file to write
+ * @param format The sample format to write
+ * @return altus_iq_file_sink_sptr
+ */
+altus_iq_file_sink_sptr make_altus_iq_file_sink(
+  const std::string &file_path,
+  iq_format_t format
+);
+
+/**
+ * Reads cf32, cs16 or cs8 samples and outputs gr_complex
+ *
+ * The integer formats are converted with the VOLK kernels in the GNU Radio
+ * interleaved blocks, so replay costs a quarter (cs8) or half (cs16) of the
+ * disk bandwidth of cf32. Kept as cs16 there is no conversion at all, the
+ * items go out as they are in the file.
+ */
+class AltusIqFileSource : public gr::hier_block2 {
+  friend altus_iq_file_source_sptr make_altus_iq_file_source(
+    const std::string &file_path,
+    iq_format_t format,
+    bool keep_cs16
+  );
+  friend altus_iq_file_source_sptr make_altus_iq_memory_source(
+    const void *data,
+    uint64_t samples,
+    iq_format_t format,
+    bool keep_cs16
+  );
+
+  private:
+    gr::blocks::file_source::sptr file;
+    gr::AltusDecoder::MemorySource::sptr memory;
+    gr::blocks::interleaved_char_to_complex::sptr char_to_complex;
+    gr::blocks::interleaved_short_to_complex::sptr short_to_complex;
+
+    void connect_raw(gr::basic_block_sptr raw, iq_format_t format, bool keep_cs16);
+
+  public:
+    AltusIqFileSource(
+      const std::string &file_path,
+      iq_format_t format,
+      bool keep_cs16
+    );
+    AltusIqFileSource(
+      const void *data,
+      uint64_t samples,
+      iq_format_t format,
+      bool keep_cs16
+    );
+    ~AltusIqFileSource();
+
+    /**
+     * @brief The size of each output item, 2 int16 when cs16 is kept
+     */
+    static size_t output_item_size(iq_format_t format, bool keep_cs16);
+};
+
+/**
+ * Takes gr_complex and writes cf32, cs16 or cs8 samples
+ *
+ * Samples are scaled so +/-1.0 is full scale, anything outside that is
+ * clipped in the integer formats.
+ */
+class AltusIqFileSink : public gr::hier_block2 {
+  friend altus_iq_file_sink_sptr make_altus_iq_file_sink(
+    const std::string &file_path,
+    iq_format_t format
+  );
+
+  private:
+    gr::blocks::file_sink::sptr file;
+    gr::blocks::complex_to_interleaved_char::sptr complex_to_char;
+    gr::blocks::complex_to_interleaved_short::sptr complex_to_short;
+
+  public:
+    AltusIqFileSink(
+      const std::string &file_path,
+      iq_format_t format
+    );
+    ~AltusIqFileSink();
+
+    /**
+     * @brief Switch to a new file, safe while the flowgraph is running
+     *
+     * @param file_path The file to write
+     * @return true If the file was opened
+     */
+    bool open(const std::string &file_path);
+
+    /**
+     * @brief Stop writing, samples are dropped until the next open
+     */
+    void close();
+
+    /**
+     * @brief The blocks doing the work, in processing order
+     * @return stage_blocks_t The blocks named by stage
+     */
+    stage_blocks_t stage_blocks();
+};
+
+#endif
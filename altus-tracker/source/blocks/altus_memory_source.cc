@@ -0,0 +1,57 @@
+#include "altus_memory_source.h"
+#include <gnuradio/io_signature.h>
+#include <algorithm>
+#include <cstring>
+
+namespace gr {
+  namespace AltusDecoder {
+    MemorySource::sptr MemorySource::make(
+      const void *data,
+      size_t item_size,
+      uint64_t items
+    ) {
+      return gnuradio::get_initial_sptr(new MemorySource(
+        data,
+        item_size,
+        items
+      ));
+    }
+
+    MemorySource::MemorySource(
+      const void *d,
+      size_t size,
+      uint64_t count
+    ) : gr::sync_block(
+      "AltusMemorySource",
+      gr::io_signature::make(0, 0, 0),
+      gr::io_signature::make(
+        1,
+        1,
+        size
+      )
+    ) {
+      data = (const char *)d;
+      item_size = size;
+      items = count;
+      offset = 0;
+    }
+
+    MemorySource::~MemorySource() {}
+
+    int MemorySource::work(
+      int noutput_items,
+      gr_vector_const_void_star &input_items,
+      gr_vector_void_star &output_items
+    ) {
+      if (offset >= items) {
+        return WORK_DONE;
+      }
+
+      uint64_t count = std::min(uint64_t(noutput_items), items - offset);
+      std::memcpy(output_items[0], data + offset * item_size, count * item_size);
+      offset += count;
+
+      return count;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef INCLUDED_ALTUS_MEMORY_SOURCE_H
+#define INCLUDED_ALTUS_MEMORY_SOURCE_H
+
+#include <gnuradio/attributes.h>
+#include <gnuradio/sync_block.h>
+
+#ifdef gnuradio_Altus_Decoder_EXPORTS
+#define ALTUS_DECODER_API __GR_ATTR_EXPORT
+#else
+#define ALTUS_DECODER_API __GR_ATTR_IMPORT
+#endif
+
+namespace gr {
+  namespace AltusDecoder {
+    /**
+     * Streams items out of a buffer owned by someone else (like a memory
+     * mapped file) and finishes at the end of it
+     *
+     * The buffer has to stay valid until the flowgraph is done.
+     */
+    class ALTUS_DECODER_API MemorySource : virtual public gr::sync_block {
+      private:
+        const char *data;
+        size_t item_size;
+        uint64_t items;
+        uint64_t offset;
+
+      public:
+        typedef std::shared_ptr<MemorySource> sptr;
+        static sptr make(
+          const void *data,
+          size_t item_size,
+          uint64_t items
+        );
+
+        MemorySource(
+          const void *data,
+          size_t item_size,
+          uint64_t items
+        );
+        ~MemorySource();
+
+        int work(
+          int noutput_items,
+          gr_vector_const_void_star& input_items,
+          gr_vector_void_star& output_items
+        );
+    };
+  }
+}
+
+#endif
@@ -1,14 +1,17 @@
+#include <algorithm>
 #include <cmath>
 
 #include "altus_power_level.h"
 
 altus_power_level_sptr make_altus_power_level(
   double input_sample_rate,
-  uint16_t fft_size
+  uint16_t fft_size,
+  uint16_t frame_rate
 ) {
   return gnuradio::get_initial_sptr(new AltusPowerLevel(
     input_sample_rate,
-    fft_size
+    fft_size,
+    frame_rate
   ));
 }
 
@@ -17,7 +20,8 @@ AltusPowerLevel::~AltusPowerLevel() {}
 
 AltusPowerLevel::AltusPowerLevel(
   double input_sample_rate,
-  uint16_t fft_size
+  uint16_t fft_size,
+  uint16_t frame_rate
 ) : gr::hier_block2(
   "AltusPowerLevel",
   gr::io_signature::make(
@@ -31,8 +35,10 @@ AltusPowerLevel::AltusPowerLevel(
     sizeof(float) * fft_size
   )
 ) {
-  int one_in_n = input_sample_rate / fft_size / 100;
-  static std::vector<float> window = gr::fft::window::blackman_harris(
+  one_in_n = std::max(1, int(input_sample_rate / fft_size / std::max(uint16_t(1), frame_rate)));
+  full_frame_rate = input_sample_rate / fft_size / one_in_n;
+  // Built for each block, autotune tries several FFT sizes in one process
+  std::vector<float> window = gr::fft::window::blackman_harris(
     fft_size
   );
 
@@ -75,3 +81,27 @@ AltusPowerLevel::AltusPowerLevel(
   connect(single_pole_filter, 0, nlog10, 0);
   connect(nlog10, 0, self(), 0);
 }
+
+void AltusPowerLevel::set_frame_rate_divisor(int divisor) {
+  frame_rate_divisor = std::max(1, divisor);
+  keep_one_in_n->set_n(one_in_n * frame_rate_divisor);
+}
+
+int AltusPowerLevel::get_frame_rate_divisor() {
+  return frame_rate_divisor;
+}
+
+double AltusPowerLevel::frame_rate() {
+  return full_frame_rate / frame_rate_divisor;
+}
+
+stage_blocks_t AltusPowerLevel::stage_blocks() {
+  stage_blocks_t stages;
+  stages.push_back(std::make_pair("stream_to_vector", stream_to_vector));
+  stages.push_back(std::make_pair("keep_one_in_n", keep_one_in_n));
+  stages.push_back(std::make_pair("fft", fft));
+  stages.push_back(std::make_pair("complex_to_mag", complex_to_mag));
+  stages.push_back(std::make_pair("single_pole_filter", single_pole_filter));
+  stages.push_back(std::make_pair("nlog10", nlog10));
+  return stages;
+}
@@ -12,22 +12,38 @@
 #include <gnuradio/filter/single_pole_iir_filter_ff.h>
 #include <gnuradio/blocks/nlog10_ff.h>
 
+#include "../perf_counters.h"
+
 class AltusPowerLevel;
 
 typedef std::shared_ptr<AltusPowerLevel> altus_power_level_sptr;
 
+/**
+ * @brief Generate a power level block
+ *
+ * @param input_sample_rate The input sample rate
+ * @param fft_size The number of bins
+ * @param frame_rate Frames to output per second
+ * @return altus_power_level_sptr
+ */
 altus_power_level_sptr make_altus_power_level(
   double input_sample_rate,
-  uint16_t fft_size
+  uint16_t fft_size,
+  uint16_t frame_rate
 );
 
 class AltusPowerLevel : public gr::hier_block2 {
   friend altus_power_level_sptr make_altus_power_level(
     double input_sample_rate,
-    uint16_t fft_size
+    uint16_t fft_size,
+    uint16_t frame_rate
   );
 
   private:
+    int one_in_n;
+    int frame_rate_divisor = 1;
+    double full_frame_rate;
+
     gr::blocks::stream_to_vector::sptr stream_to_vector;
     gr::blocks::keep_one_in_n::sptr keep_one_in_n;
     gr::fft::fft_v<gr_complex, true>::sptr fft;
@@ -38,9 +54,32 @@ class AltusPowerLevel : public gr::hier_block2 {
   public:
     AltusPowerLevel(
       double input_sample_rate,
-      uint16_t fft_size
+      uint16_t fft_size,
+      uint16_t frame_rate
     );
     ~AltusPowerLevel();
+
+    /**
+     * @brief Run fewer FFTs, keeping one in divisor of the usual frames
+     * @param divisor 1 for the full rate
+     */
+    void set_frame_rate_divisor(int divisor);
+
+    /**
+     * @brief The current frame rate divisor
+     */
+    int get_frame_rate_divisor();
+
+    /**
+     * @brief The frames actually output per second, after the divisor
+     */
+    double frame_rate();
+
+    /**
+     * @brief The blocks doing the work, in processing order
+     * @return stage_blocks_t The blocks named by stage
+     */
+    stage_blocks_t stage_blocks();
 };
 
 #endif
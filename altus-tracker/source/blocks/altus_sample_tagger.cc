@@ -0,0 +1,160 @@
+#include "altus_sample_tagger.h"
+#include <gnuradio/io_signature.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+// A tag every 10 ms keeps each channel within a few bits of one
+const double tag_interval_seconds = 0.01;
+
+// How far a live sample count can wander from the wall clock (buffering in
+// the driver included) before it is re-anchored
+const double resync_ms = 250;
+
+static double wall_ms() {
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+}
+
+namespace gr {
+  namespace AltusDecoder {
+    SampleTagger::sptr SampleTagger::make(
+      double sample_rate,
+      uint64_t first_sample,
+      int64_t start_time_ms,
+      bool live,
+      size_t item_size
+    ) {
+      return gnuradio::get_initial_sptr(new SampleTagger(
+        sample_rate,
+        first_sample,
+        start_time_ms,
+        live,
+        item_size
+      ));
+    }
+
+    SampleTagger::SampleTagger(
+      double rate,
+      uint64_t first,
+      int64_t start_time_ms,
+      bool l,
+      size_t size
+    ) : gr::sync_block(
+      "AltusSampleTagger",
+      gr::io_signature::make(
+        1,
+        1,
+        size
+      ),
+      gr::io_signature::make(
+        1,
+        1,
+        size
+      )
+    ) {
+      item_size = size;
+      sample_rate = rate;
+      first_sample = first;
+      live = l;
+      tag_interval = std::max(uint64_t(1), uint64_t(sample_rate * tag_interval_seconds));
+
+      // A recording is anchored at its first sample from the start
+      anchored = !live;
+      anchor_sample = 0;
+      anchor_ms = double(start_time_ms) + (first_sample * 1000.0) / sample_rate;
+
+      tagged = false;
+      last_tag = 0;
+
+      samples_seen = 0;
+      resyncs = 0;
+      behind_ms = 0;
+      pending_rate = 0;
+    }
+
+    SampleTagger::~SampleTagger() {}
+
+    uint64_t SampleTagger::sample_count() {
+      return samples_seen;
+    }
+
+    uint64_t SampleTagger::resync_count() {
+      return resyncs;
+    }
+
+    uint64_t SampleTagger::resync_behind_ms() {
+      return behind_ms;
+    }
+
+    void SampleTagger::set_sample_rate(double rate) {
+      pending_rate = rate;
+    }
+
+    double SampleTagger::sample_time_ms(uint64_t sample) {
+      return anchor_ms + ((double(sample) - double(anchor_sample)) * 1000.0) / sample_rate;
+    }
+
+    int SampleTagger::work(
+      int noutput_items,
+      gr_vector_const_void_star &input_items,
+      gr_vector_void_star &output_items
+    ) {
+      std::memcpy(output_items[0], input_items[0], noutput_items * item_size);
+
+      // The last sample of the buffer is the one that just arrived
+      uint64_t last = nitems_written(0) + noutput_items - 1;
+      double rate = pending_rate.exchange(0);
+      if (rate > 0) {
+        // Samples already counted keep their times, the rest follow the new rate
+        if (anchored) {
+          anchor_ms = sample_time_ms(last);
+          anchor_sample = last;
+        }
+        sample_rate = rate;
+        tag_interval = std::max(uint64_t(1), uint64_t(sample_rate * tag_interval_seconds));
+        anchored = !live;
+      }
+      if (live) {
+        double now_ms = wall_ms();
+        if (!anchored) {
+          anchored = true;
+          anchor_sample = last;
+          anchor_ms = now_ms;
+        } else if (std::fabs(now_ms - sample_time_ms(last)) > resync_ms) {
+          double off_ms = now_ms - sample_time_ms(last);
+          std::cout << "[WARN] Sample clock is " << std::fixed << std::setprecision(0) << off_ms;
+          std::cout << " ms off the wall clock, resyncing" << std::endl;
+          resyncs++;
+          if (off_ms > 0) {
+            behind_ms += uint64_t(off_ms);
+          }
+          anchor_sample = last;
+          anchor_ms = now_ms;
+        }
+      }
+
+      if (!tagged || last - last_tag >= tag_interval) {
+        add_item_tag(
+          0,
+          last,
+          pmt::mp(SAMPLE_TIME_TAG),
+          pmt::make_tuple(
+            pmt::from_uint64(first_sample + last),
+            pmt::from_double(sample_time_ms(last)),
+            pmt::from_bool(live)
+          )
+        );
+        tagged = true;
+        last_tag = last;
+      }
+
+      samples_seen += noutput_items;
+      return noutput_items;
+    }
+  }
+}
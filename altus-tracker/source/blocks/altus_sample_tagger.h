@@ -0,0 +1,118 @@
+#ifndef INCLUDED_ALTUS_SAMPLE_TAGGER_H
+#define INCLUDED_ALTUS_SAMPLE_TAGGER_H
+
+#include <gnuradio/attributes.h>
+#include <gnuradio/sync_block.h>
+
+#include <atomic>
+#include <string>
+
+#ifdef gnuradio_Altus_Decoder_EXPORTS
+#define ALTUS_DECODER_API __GR_ATTR_EXPORT
+#else
+#define ALTUS_DECODER_API __GR_ATTR_IMPORT
+#endif
+
+// Key of the tags carrying the sample index and time of a sample
+#define SAMPLE_TIME_TAG "altus_time"
+
+namespace gr {
+  namespace AltusDecoder {
+    /**
+     * Passes samples through and tags them with their sample index and time
+     *
+     * The tags follow the samples through the channel filters and resampler,
+     * so the decoder can work out the time of any bit from the last tag it
+     * saw. The value is a tuple of (sample index, time in ms, live).
+     *
+     * Recordings are timed purely from the sample count. Live sources are
+     * tied to the wall clock when the first samples arrive, and re-anchored if
+     * the count drifts too far from it (overflows drop samples).
+     */
+    class ALTUS_DECODER_API SampleTagger : virtual public gr::sync_block {
+      private:
+        double sample_rate;
+        uint64_t first_sample;
+        bool live;
+        size_t item_size;
+        uint64_t tag_interval;
+
+        // The time of one sample, the rest follow from the sample rate
+        bool anchored;
+        uint64_t anchor_sample;
+        double anchor_ms;
+
+        bool tagged;
+        uint64_t last_tag;
+
+        // Read from other threads to spot a live source falling behind
+        std::atomic<uint64_t> samples_seen;
+        std::atomic<uint64_t> resyncs;
+        std::atomic<uint64_t> behind_ms;
+
+        // A new sample rate, applied at the start of the next call to work
+        std::atomic<double> pending_rate;
+
+        double sample_time_ms(uint64_t sample);
+
+      public:
+        typedef std::shared_ptr<SampleTagger> sptr;
+
+        /**
+         * @param sample_rate The stream sample rate
+         * @param first_sample The index of the first sample in the source
+         * @param start_time_ms The time of sample 0, ignored when live
+         * @param live Whether the samples are arriving in real time
+         * @param item_size The size of each sample, a gr_complex or an int16 pair
+         */
+        static sptr make(
+          double sample_rate,
+          uint64_t first_sample,
+          int64_t start_time_ms,
+          bool live,
+          size_t item_size
+        );
+
+        SampleTagger(
+          double sample_rate,
+          uint64_t first_sample,
+          int64_t start_time_ms,
+          bool live,
+          size_t item_size
+        );
+        ~SampleTagger();
+
+        /**
+         * @brief The number of samples passed through
+         */
+        uint64_t sample_count();
+
+        /**
+         * @brief The number of times a live source was re-anchored
+         * Each one is an overflow or a stall somewhere before this block
+         */
+        uint64_t resync_count();
+
+        /**
+         * @brief The total time live samples were found to be behind the wall
+         * clock when re-anchoring, roughly the samples lost to overflows
+         */
+        uint64_t resync_behind_ms();
+
+        /**
+         * @brief Follow the source to a new sample rate
+         * A live source is anchored to the wall clock again, safe to call
+         * from any thread
+         */
+        void set_sample_rate(double sample_rate);
+
+        int work(
+          int noutput_items,
+          gr_vector_const_void_star& input_items,
+          gr_vector_void_star& output_items
+        );
+    };
+  }
+}
+
+#endif
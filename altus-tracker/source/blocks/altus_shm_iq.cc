@@ -0,0 +1,181 @@
+#include "altus_shm_iq.h"
+#include <gnuradio/io_signature.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// How long to sleep when the ring has nothing new, a few thousand samples
+const std::chrono::microseconds poll_interval(250);
+
+// Longest a call to work waits for samples before handing back to the scheduler
+const std::chrono::milliseconds max_wait(100);
+
+// The writer is taken to have stopped after this long without writing
+const int64_t writer_stall_ms = 2000;
+
+namespace gr {
+  namespace AltusDecoder {
+    ShmIqSink::sptr ShmIqSink::make(
+      const std::string &name,
+      uint64_t capacity,
+      double sample_rate,
+      double center_freq
+    ) {
+      return gnuradio::get_initial_sptr(new ShmIqSink(
+        name,
+        capacity,
+        sample_rate,
+        center_freq
+      ));
+    }
+
+    ShmIqSink::ShmIqSink(
+      const std::string &name,
+      uint64_t capacity,
+      double sample_rate,
+      double center_freq
+    ) : gr::sync_block(
+      "AltusShmIqSink",
+      gr::io_signature::make(
+        1,
+        1,
+        sizeof(gr_complex)
+      ),
+      gr::io_signature::make(0, 0, 0)
+    ), writer(name) {
+      ready = writer.open(capacity, sample_rate, center_freq);
+    }
+
+    ShmIqSink::~ShmIqSink() {}
+
+    bool ShmIqSink::is_ready() {
+      return ready;
+    }
+
+    uint64_t ShmIqSink::written() {
+      return writer.written();
+    }
+
+    uint64_t ShmIqSink::capacity() {
+      return writer.capacity();
+    }
+
+    bool ShmIqSink::on_huge_pages() {
+      return writer.on_huge_pages();
+    }
+
+    int ShmIqSink::work(
+      int noutput_items,
+      gr_vector_const_void_star &input_items,
+      gr_vector_void_star &output_items
+    ) {
+      writer.write((const shm_iq_sample_t *)input_items[0], noutput_items);
+      return noutput_items;
+    }
+
+    ShmIqSource::sptr ShmIqSource::make(const std::string &name) {
+      return gnuradio::get_initial_sptr(new ShmIqSource(name));
+    }
+
+    ShmIqSource::ShmIqSource(
+      const std::string &name
+    ) : gr::sync_block(
+      "AltusShmIqSource",
+      gr::io_signature::make(0, 0, 0),
+      gr::io_signature::make(
+        1,
+        1,
+        sizeof(gr_complex)
+      )
+    ), reader(name) {
+      attached = reader.open();
+      stopping = false;
+      writer_stalled = false;
+      lap_count = 0;
+      skipped_count = 0;
+      backlog_samples = 0;
+    }
+
+    ShmIqSource::~ShmIqSource() {}
+
+    bool ShmIqSource::start() {
+      stopping = false;
+      return true;
+    }
+
+    bool ShmIqSource::stop() {
+      stopping = true;
+      return true;
+    }
+
+    bool ShmIqSource::is_attached() {
+      return attached;
+    }
+
+    double ShmIqSource::sample_rate() {
+      return attached ? reader.sample_rate() : 0;
+    }
+
+    double ShmIqSource::center_freq() {
+      return attached ? reader.center_freq() : 0;
+    }
+
+    uint64_t ShmIqSource::capacity() {
+      return attached ? reader.ring_capacity() : 0;
+    }
+
+    uint64_t ShmIqSource::laps() {
+      return lap_count;
+    }
+
+    uint64_t ShmIqSource::skipped() {
+      return skipped_count;
+    }
+
+    uint64_t ShmIqSource::backlog() {
+      return backlog_samples;
+    }
+
+    int ShmIqSource::work(
+      int noutput_items,
+      gr_vector_const_void_star &input_items,
+      gr_vector_void_star &output_items
+    ) {
+      if (!attached) {
+        return WORK_DONE;
+      }
+
+      shm_iq_sample_t *out = (shm_iq_sample_t *)output_items[0];
+      std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now() + max_wait;
+      size_t count = 0;
+      while (!stopping) {
+        count = reader.read(out, noutput_items);
+        if (count > 0 || std::chrono::steady_clock::now() >= give_up) {
+          break;
+        }
+        std::this_thread::sleep_for(poll_interval);
+      }
+
+      if (reader.laps() != lap_count) {
+        uint64_t missed = reader.skipped() - skipped_count;
+        std::cout << "[WARN] Fell behind the IQ ring, skipped " << missed << " samples (";
+        std::cout << std::fixed << std::setprecision(0) << (missed * 1000.0 / reader.sample_rate()) << " ms)" << std::endl;
+        lap_count = reader.laps();
+        skipped_count = reader.skipped();
+      }
+      backlog_samples = reader.backlog();
+
+      int64_t idle_ms = reader.writer_idle_ms();
+      if (count == 0 && idle_ms > writer_stall_ms && !writer_stalled) {
+        std::cout << "[WARN] The IQ ring hasn't been written for " << idle_ms << " ms, is the ingest running?" << std::endl;
+        writer_stalled = true;
+      } else if (count > 0 && writer_stalled) {
+        std::cout << "IQ ring is being written again" << std::endl;
+        writer_stalled = false;
+      }
+
+      return count;
+    }
+  }
+}
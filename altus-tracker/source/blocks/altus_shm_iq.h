@@ -0,0 +1,163 @@
+#ifndef INCLUDED_ALTUS_SHM_IQ_H
+#define INCLUDED_ALTUS_SHM_IQ_H
+
+#include <gnuradio/attributes.h>
+#include <gnuradio/sync_block.h>
+
+#include <atomic>
+#include <string>
+
+#include "../shm_iq_reader.h"
+#include "../shm_iq_writer.h"
+
+#ifdef gnuradio_Altus_Decoder_EXPORTS
+#define ALTUS_DECODER_API __GR_ATTR_EXPORT
+#else
+#define ALTUS_DECODER_API __GR_ATTR_IMPORT
+#endif
+
+namespace gr {
+  namespace AltusDecoder {
+    /**
+     * Writes the stream into a shared memory IQ ring for other processes
+     *
+     * The samples go from the input buffer straight into the ring, and the
+     * block never waits on the readers, so the source runs the same however
+     * many are attached and however slow they are.
+     */
+    class ALTUS_DECODER_API ShmIqSink : virtual public gr::sync_block {
+      private:
+        ShmIqWriter writer;
+        bool ready;
+
+      public:
+        typedef std::shared_ptr<ShmIqSink> sptr;
+
+        /**
+         * @param name The shared memory object name (starting with /)
+         * @param capacity The number of samples the ring holds
+         * @param sample_rate The stream sample rate
+         * @param center_freq The frequency of the receiver (in Hz)
+         */
+        static sptr make(
+          const std::string &name,
+          uint64_t capacity,
+          double sample_rate,
+          double center_freq
+        );
+
+        ShmIqSink(
+          const std::string &name,
+          uint64_t capacity,
+          double sample_rate,
+          double center_freq
+        );
+        ~ShmIqSink();
+
+        /**
+         * @brief Whether the ring was created
+         */
+        bool is_ready();
+
+        /**
+         * @brief The number of samples written since the ring was created
+         */
+        uint64_t written();
+
+        /**
+         * @brief The number of samples the ring holds
+         */
+        uint64_t capacity();
+
+        /**
+         * @brief Whether the ring is on hugetlbfs
+         */
+        bool on_huge_pages();
+
+        int work(
+          int noutput_items,
+          gr_vector_const_void_star& input_items,
+          gr_vector_void_star& output_items
+        );
+    };
+
+    /**
+     * Streams samples out of a shared memory IQ ring written by another
+     * process (altus-ingest)
+     *
+     * The source starts at the newest sample. When it falls a ring behind it
+     * skips to the newest samples again, warns and counts what it skipped, and
+     * it warns when the writer stops writing. The tagger downstream re-anchors
+     * the sample times after a skip, as it does after an SDR overflow.
+     */
+    class ALTUS_DECODER_API ShmIqSource : virtual public gr::sync_block {
+      private:
+        ShmIqReader reader;
+        bool attached;
+        std::atomic<bool> stopping;
+        bool writer_stalled;
+
+        // Read from other threads for the metrics
+        std::atomic<uint64_t> lap_count;
+        std::atomic<uint64_t> skipped_count;
+        std::atomic<uint64_t> backlog_samples;
+
+      public:
+        typedef std::shared_ptr<ShmIqSource> sptr;
+
+        /**
+         * @param name The shared memory object name
+         */
+        static sptr make(const std::string &name);
+
+        ShmIqSource(const std::string &name);
+        ~ShmIqSource();
+
+        bool start() override;
+        bool stop() override;
+
+        /**
+         * @brief Whether the ring was found, the rest only mean something if it was
+         */
+        bool is_attached();
+
+        /**
+         * @brief The sample rate of the stream
+         */
+        double sample_rate();
+
+        /**
+         * @brief The frequency of the receiver (in Hz)
+         */
+        double center_freq();
+
+        /**
+         * @brief The number of samples the ring holds
+         */
+        uint64_t capacity();
+
+        /**
+         * @brief The number of times this source fell a ring behind
+         */
+        uint64_t laps();
+
+        /**
+         * @brief The number of samples skipped after falling behind
+         */
+        uint64_t skipped();
+
+        /**
+         * @brief The number of samples in the ring not read yet
+         */
+        uint64_t backlog();
+
+        int work(
+          int noutput_items,
+          gr_vector_const_void_star& input_items,
+          gr_vector_void_star& output_items
+        );
+    };
+  }
+}
+
+#endif
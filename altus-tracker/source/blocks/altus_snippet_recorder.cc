@@ -0,0 +1,366 @@
+#include "altus_snippet_recorder.h"
+#include "altus_sample_tagger.h"
+#include <gnuradio/blocks/rotator.h>
+#include <gnuradio/filter/fir_filter.h>
+#include <gnuradio/filter/firdes.h>
+#include <gnuradio/io_signature.h>
+#include <volk/volk.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Full scale for the cs16 ring, the same as recorded files
+const float ring_scale = 32767.0;
+
+// Samples moved out of the ring at a time by the writer
+const uint64_t writer_chunk = 65536;
+
+// Triggers held at once, more than this are counted as lost
+const size_t max_snippets = 16;
+
+// Channelized snippets use the same filter and rate as a channel's first stage
+const double snippet_channel_rate = 5 * 38400;
+const double snippet_channel_width = 4;
+
+static std::string event_name(altus_event_t reason) {
+  switch (reason) {
+    case altus_event_t::DETECTION:
+      return "detection";
+    case altus_event_t::DECODE:
+      return "decode";
+    default:
+      return "crc";
+  }
+}
+
+namespace gr {
+  namespace AltusDecoder {
+    SnippetRecorder::sptr SnippetRecorder::make(snippet_config_t config) {
+      return gnuradio::get_initial_sptr(new SnippetRecorder(config));
+    }
+
+    SnippetRecorder::SnippetRecorder(
+      snippet_config_t c
+    ) : gr::sync_block(
+      "AltusSnippetRecorder",
+      gr::io_signature::make(
+        1,
+        1,
+        sizeof(gr_complex)
+      ),
+      gr::io_signature::make(0, 0, 0)
+    ) {
+      config = c;
+      pre_samples = config.pre_seconds * config.sample_rate;
+      post_samples = config.post_seconds * config.sample_rate;
+
+      // Leave a second of slack so the writer isn't racing the flowgraph
+      ring_samples = std::max(
+        uint64_t(config.ring_seconds * config.sample_rate),
+        pre_samples + post_samples + uint64_t(config.sample_rate)
+      );
+      ring.resize(ring_samples * 2);
+
+      write_sample = 0;
+      center_freq = config.center_freq;
+      writer_running = false;
+      snippets_written = 0;
+      snippets_lost = 0;
+    }
+
+    SnippetRecorder::~SnippetRecorder() {
+      stop();
+    }
+
+    bool SnippetRecorder::start() {
+      std::error_code ec;
+      std::filesystem::create_directories(config.dir, ec);
+      if (ec) {
+        std::cout << "[WARN] Failed to create snippet directory " << config.dir << ": " << ec.message() << std::endl;
+      }
+
+      std::lock_guard<std::mutex> lock(snippet_mutex);
+      if (!writer_running) {
+        writer_running = true;
+        writer = std::thread(&SnippetRecorder::run_writer, this);
+      }
+      return true;
+    }
+
+    bool SnippetRecorder::stop() {
+      {
+        std::lock_guard<std::mutex> lock(snippet_mutex);
+        if (!writer_running) {
+          return true;
+        }
+        writer_running = false;
+      }
+      snippet_ready.notify_one();
+      writer.join();
+      return true;
+    }
+
+    int SnippetRecorder::work(
+      int noutput_items,
+      gr_vector_const_void_star &input_items,
+      gr_vector_void_star &output_items
+    ) {
+      const gr_complex *in = (const gr_complex *)input_items[0];
+      uint64_t first = write_sample.load(std::memory_order_relaxed);
+
+      // Convert straight into the ring, wrapping at the end
+      int done = 0;
+      while (done < noutput_items) {
+        uint64_t idx = (first + done) % ring_samples;
+        int count = std::min(uint64_t(noutput_items - done), ring_samples - idx);
+        volk_32f_s32f_convert_16i(
+          &ring[idx * 2],
+          (const float *)(in + done),
+          ring_scale,
+          count * 2
+        );
+        done += count;
+      }
+      uint64_t end = first + noutput_items;
+      write_sample.store(end, std::memory_order_release);
+
+      std::vector<tag_t> tags;
+      get_tags_in_window(tags, 0, 0, noutput_items, pmt::mp(SAMPLE_TIME_TAG));
+
+      // Hand over any snippet that now has all its samples
+      std::unique_lock<std::mutex> lock(snippet_mutex);
+      for (std::vector<tag_t>::iterator tag = tags.begin(); tag != tags.end(); tag++) {
+        if (tag->offset >= time_tag_offset && pmt::is_tuple(tag->value)) {
+          have_time_tag = true;
+          time_tag_offset = tag->offset;
+          time_tag_ms = pmt::to_double(pmt::tuple_ref(tag->value, 1));
+        }
+      }
+      bool any_ready = false;
+      while (pending.size() > 0 && pending.front().end_sample <= end) {
+        ready.push_back(pending.front());
+        pending.pop_front();
+        any_ready = true;
+      }
+      lock.unlock();
+      if (any_ready) {
+        snippet_ready.notify_one();
+      }
+
+      return noutput_items;
+    }
+
+    void SnippetRecorder::trigger(altus_event_t reason, uint32_t freq) {
+      if (
+        (reason == altus_event_t::DETECTION && !config.on_detection) ||
+        (reason == altus_event_t::DECODE && !config.on_decode) ||
+        (reason == altus_event_t::CRC_FAILURES && !config.on_crc_failures)
+      ) {
+        return;
+      }
+
+      uint64_t now = write_sample.load(std::memory_order_acquire);
+      uint64_t cooldown = config.cooldown_seconds * config.sample_rate;
+
+      std::lock_guard<std::mutex> lock(snippet_mutex);
+      std::map<uint32_t, uint64_t>::iterator last = last_trigger.find(freq);
+      if (last != last_trigger.end() && now - last->second < cooldown) {
+        return;
+      }
+      if (pending.size() + ready.size() >= max_snippets) {
+        snippets_lost++;
+        return;
+      }
+      last_trigger[freq] = now;
+
+      snippet_t snippet;
+      snippet.first_sample = now > pre_samples ? now - pre_samples : 0;
+      snippet.end_sample = now + post_samples;
+      snippet.freq = freq;
+      snippet.center_freq = center_freq;
+      snippet.reason = reason;
+      snippet.start_time_ms = 0;
+      if (have_time_tag) {
+        snippet.start_time_ms = std::llround(
+          time_tag_ms + ((double(snippet.first_sample) - double(time_tag_offset)) * 1000.0) / config.sample_rate
+        );
+      }
+      pending.push_back(snippet);
+    }
+
+    void SnippetRecorder::set_center_freq(double freq) {
+      std::lock_guard<std::mutex> lock(snippet_mutex);
+      center_freq = freq;
+    }
+
+    void SnippetRecorder::run_writer() {
+      while (true) {
+        std::unique_lock<std::mutex> lock(snippet_mutex);
+        snippet_ready.wait(lock, [this]() { return !writer_running || ready.size() > 0; });
+        if (ready.size() == 0) {
+          return;
+        }
+        snippet_t snippet = ready.front();
+        ready.pop_front();
+        lock.unlock();
+
+        if (write_snippet(snippet)) {
+          snippets_written++;
+        } else {
+          snippets_lost++;
+        }
+      }
+    }
+
+    bool SnippetRecorder::copy_from_ring(uint64_t first_sample, uint64_t count, int16_t *out) {
+      if (write_sample.load(std::memory_order_acquire) > first_sample + ring_samples) {
+        return false;
+      }
+
+      uint64_t done = 0;
+      while (done < count) {
+        uint64_t idx = (first_sample + done) % ring_samples;
+        uint64_t n = std::min(count - done, ring_samples - idx);
+        std::memcpy(out + done * 2, &ring[idx * 2], n * 2 * sizeof(int16_t));
+        done += n;
+      }
+
+      // Make sure the flowgraph didn't lap us while copying
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return write_sample.load(std::memory_order_relaxed) <= first_sample + ring_samples;
+    }
+
+    bool SnippetRecorder::write_snippet(const snippet_t &snippet) {
+      int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+      ).count();
+      std::stringstream path;
+      path << config.dir << "/snippet-" << now_ms << "-" << snippet.freq << "-" << event_name(snippet.reason) << ".sigmf-data";
+
+      FILE *file = fopen(path.str().c_str(), "wb");
+      if (file == NULL) {
+        std::cout << "[WARN] Failed to open snippet " << path.str() << ": " << strerror(errno) << std::endl;
+        return false;
+      }
+
+      // Channelizing shifts the trigger frequency to DC and decimates, the
+      // same way the channel's first stage does
+      double out_rate = config.sample_rate;
+      double out_freq = snippet.center_freq;
+      unsigned int decimation = 1;
+      std::unique_ptr<gr::filter::kernel::fir_filter_ccc> filter;
+      gr::blocks::rotator rotator;
+      std::vector<gr_complex> history;
+      size_t ntaps = 1;
+      if (config.channelize) {
+        decimation = std::max(1, int(std::floor(config.sample_rate / (snippet_channel_rate * snippet_channel_width))));
+        out_rate = config.sample_rate / decimation;
+        out_freq = snippet.freq;
+
+        double phase_inc = (2.0 * M_PI * (double(snippet.freq) - snippet.center_freq)) / config.sample_rate;
+        std::vector<gr_complex> taps = gr::filter::firdes::complex_band_pass_2(
+          1,
+          config.sample_rate,
+          -snippet_channel_rate,
+          snippet_channel_rate,
+          snippet_channel_rate / 4,
+          40
+        );
+        for (size_t i = 0; i < taps.size(); i++) {
+          taps[i] *= std::exp(gr_complex(0, i * phase_inc));
+        }
+        ntaps = taps.size();
+        filter = std::make_unique<gr::filter::kernel::fir_filter_ccc>(taps);
+        rotator.set_phase_incr(std::exp(gr_complex(0, -1 * phase_inc * decimation)));
+      }
+
+      std::vector<int16_t> raw(writer_chunk * 2);
+      std::vector<gr_complex> samples;
+      std::vector<gr_complex> filtered;
+      std::vector<int8_t> bytes(writer_chunk * 2);
+      bool ok = true;
+      for (uint64_t offset = snippet.first_sample; offset < snippet.end_sample && ok; offset += writer_chunk) {
+        uint64_t count = std::min(writer_chunk, snippet.end_sample - offset);
+        if (!copy_from_ring(offset, count, &raw[0])) {
+          std::cout << "[WARN] Snippet " << path.str() << " was overwritten before it could be saved" << std::endl;
+          ok = false;
+          break;
+        }
+
+        // Without channelizing the cs16 ring is already most of the way there
+        if (!config.channelize) {
+          if (config.format == iq_format_t::CS16) {
+            ok = fwrite(&raw[0], sizeof(int16_t) * 2, count, file) == count;
+          } else if (config.format == iq_format_t::CS8) {
+            for (uint64_t i = 0; i < count * 2; i++) {
+              bytes[i] = raw[i] >> 8;
+            }
+            ok = fwrite(&bytes[0], sizeof(int8_t) * 2, count, file) == count;
+          } else {
+            samples.resize(count);
+            volk_16i_s32f_convert_32f((float *)&samples[0], &raw[0], ring_scale, count * 2);
+            ok = fwrite(&samples[0], sizeof(gr_complex), count, file) == count;
+          }
+          continue;
+        }
+
+        // Filter with the history from the last chunk in front
+        size_t kept = history.size();
+        history.resize(kept + count);
+        volk_16i_s32f_convert_32f((float *)&history[kept], &raw[0], ring_scale, count * 2);
+        if (history.size() < ntaps) {
+          continue;
+        }
+        size_t outputs = (history.size() - ntaps + decimation) / decimation;
+        filtered.resize(outputs);
+        filter->filterNdec(&filtered[0], &history[0], outputs, decimation);
+        rotator.rotateN(&filtered[0], &filtered[0], outputs);
+        history.erase(history.begin(), history.begin() + outputs * decimation);
+
+        if (config.format == iq_format_t::CS16) {
+          volk_32f_s32f_convert_16i(&raw[0], (const float *)&filtered[0], ring_scale, outputs * 2);
+          ok = fwrite(&raw[0], sizeof(int16_t) * 2, outputs, file) == outputs;
+        } else if (config.format == iq_format_t::CS8) {
+          volk_32f_s32f_convert_8i(&bytes[0], (const float *)&filtered[0], 127.0, outputs * 2);
+          ok = fwrite(&bytes[0], sizeof(int8_t) * 2, outputs, file) == outputs;
+        } else {
+          ok = fwrite(&filtered[0], sizeof(gr_complex), outputs, file) == outputs;
+        }
+      }
+      fclose(file);
+
+      if (!ok) {
+        std::filesystem::remove(path.str());
+        return false;
+      }
+
+      iq_file_info_t info;
+      info.format = config.format;
+      info.sample_rate = out_rate;
+      info.center_freq = out_freq;
+      info.start_time_ms = snippet.start_time_ms;
+      std::stringstream description;
+      description << event_name(snippet.reason) << " on " << std::fixed << std::setprecision(3) << (float(snippet.freq) / 1000000) << " MHz";
+      info.description = description.str();
+      write_sigmf_meta(path.str(), info);
+
+      std::cout << "Saved snippet " << path.str() << std::endl;
+      return true;
+    }
+
+    uint64_t SnippetRecorder::written() {
+      return snippets_written;
+    }
+
+    uint64_t SnippetRecorder::lost() {
+      return snippets_lost;
+    }
+  }
+}
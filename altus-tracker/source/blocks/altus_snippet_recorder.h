@@ -0,0 +1,136 @@
+#ifndef INCLUDED_ALTUS_SNIPPET_RECORDER_H
+#define INCLUDED_ALTUS_SNIPPET_RECORDER_H
+
+#include <gnuradio/attributes.h>
+#include <gnuradio/sync_block.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "altus_channel.h"
+#include "../iq_format.h"
+
+#ifdef gnuradio_Altus_Decoder_EXPORTS
+#define ALTUS_DECODER_API __GR_ATTR_EXPORT
+#else
+#define ALTUS_DECODER_API __GR_ATTR_IMPORT
+#endif
+
+/**
+ * @brief Settings for the snippet recorder
+ */
+struct snippet_config_t {
+  std::string dir;
+  double center_freq = 0;
+  double sample_rate = 0;
+
+  // The ring has to hold more than pre + post
+  double ring_seconds = 3;
+  double pre_seconds = 1;
+  double post_seconds = 1;
+
+  // Triggers on the same frequency closer together than this are ignored
+  double cooldown_seconds = 30;
+
+  iq_format_t format = iq_format_t::CS16;
+  bool channelize = false;
+  bool on_detection = true;
+  bool on_decode = false;
+  bool on_crc_failures = true;
+};
+
+namespace gr {
+  namespace AltusDecoder {
+    /**
+     * Keeps the last few seconds of wideband IQ and writes a snippet around
+     * each trigger
+     *
+     * The ring is allocated once and holds cs16 samples. Snippets are written
+     * on a separate thread straight from the ring, a snippet the ring laps
+     * before it is written is abandoned rather than holding up the flowgraph.
+     */
+    class ALTUS_DECODER_API SnippetRecorder : virtual public gr::sync_block {
+      private:
+        struct snippet_t {
+          uint64_t first_sample;
+          uint64_t end_sample;
+          uint32_t freq;
+          double center_freq;
+          altus_event_t reason;
+          int64_t start_time_ms;
+        };
+
+        // The last sample time tag seen, to date the snippets
+        bool have_time_tag = false;
+        uint64_t time_tag_offset = 0;
+        double time_tag_ms = 0;
+
+        snippet_config_t config;
+        std::vector<int16_t> ring;
+        uint64_t ring_samples;
+        uint64_t pre_samples;
+        uint64_t post_samples;
+        std::atomic<uint64_t> write_sample;
+
+        // Triggers waiting for their post-trigger samples, then snippets
+        // waiting for the writer
+        std::mutex snippet_mutex;
+        std::condition_variable snippet_ready;
+        std::deque<snippet_t> pending;
+        std::deque<snippet_t> ready;
+        std::map<uint32_t, uint64_t> last_trigger;
+        double center_freq;
+        bool writer_running;
+        std::thread writer;
+
+        std::atomic<uint64_t> snippets_written;
+        std::atomic<uint64_t> snippets_lost;
+
+        void run_writer();
+        bool write_snippet(const snippet_t &snippet);
+        bool copy_from_ring(uint64_t first_sample, uint64_t count, int16_t *out);
+
+      public:
+        typedef std::shared_ptr<SnippetRecorder> sptr;
+        static sptr make(snippet_config_t config);
+
+        SnippetRecorder(snippet_config_t config);
+        ~SnippetRecorder();
+
+        bool start();
+        bool stop();
+
+        int work(
+          int noutput_items,
+          gr_vector_const_void_star& input_items,
+          gr_vector_void_star& output_items
+        );
+
+        /**
+         * @brief Record a snippet around now, if this kind of event is enabled
+         * Safe to call from any thread
+         *
+         * @param reason What happened
+         * @param freq The channel frequency it happened on
+         */
+        void trigger(altus_event_t reason, uint32_t freq);
+
+        /**
+         * @brief Follow the receiver to a new frequency, snippets triggered
+         * from now on are written with it
+         */
+        void set_center_freq(double center_freq);
+
+        uint64_t written();
+        uint64_t lost();
+    };
+  }
+}
+
+#endif
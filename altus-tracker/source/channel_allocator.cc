@@ -0,0 +1,97 @@
+#include "channel_allocator.h"
+
+#include <algorithm>
+
+channel_allocator_sptr make_channel_allocator() {
+  return std::make_shared<ChannelAllocator>();
+}
+
+ChannelAllocator::ChannelAllocator() {
+  handoffs = 0;
+}
+
+void ChannelAllocator::add_receiver(altus_receiver_sptr receiver) {
+  size_t source = receivers.size();
+  receivers.push_back(receiver);
+
+  // The allocator lives as long as the flowgraph, so no shared_ptr cycle
+  receiver->set_detection_handler([this, source](uint32_t freq) {
+    detect(source, freq);
+  });
+}
+
+void ChannelAllocator::detect(size_t source, uint32_t freq) {
+  std::lock_guard<std::mutex> lock(allocator_mutex);
+
+  // Already being decoded, add_channel just counts the detection
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    if ((*it)->has_channel(freq)) {
+      (*it)->add_channel(freq);
+      return;
+    }
+  }
+
+  // The detecting receiver wins ties
+  size_t best = source;
+  double best_coverage = receivers[source]->get_config().coverage(freq);
+  for (size_t i = 0; i < receivers.size(); i++) {
+    double coverage = receivers[i]->get_config().coverage(freq);
+    if (coverage > best_coverage) {
+      best = i;
+      best_coverage = coverage;
+    }
+  }
+  if (best != source) {
+    handoffs++;
+  }
+  receivers[best]->add_channel(freq);
+}
+
+int ChannelAllocator::pin(uint32_t freq) {
+  std::lock_guard<std::mutex> lock(allocator_mutex);
+  for (size_t i = 0; i < receivers.size(); i++) {
+    if (receivers[i]->has_channel(freq)) {
+      return receivers[i]->pin_channel(freq) ? int(i) : -1;
+    }
+  }
+
+  // Best covered first, falling back to the others if its channels are all pinned
+  std::vector<size_t> order;
+  for (size_t i = 0; i < receivers.size(); i++) {
+    order.push_back(i);
+  }
+  std::sort(order.begin(), order.end(), [this, freq](size_t a, size_t b) {
+    return receivers[a]->get_config().coverage(freq) > receivers[b]->get_config().coverage(freq);
+  });
+  for (std::vector<size_t>::iterator it = order.begin(); it != order.end(); it++) {
+    if (receivers[*it]->pin_channel(freq)) {
+      return int(*it);
+    }
+  }
+  return -1;
+}
+
+bool ChannelAllocator::unpin(uint32_t freq) {
+  std::lock_guard<std::mutex> lock(allocator_mutex);
+  bool found = false;
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    found = (*it)->unpin_channel(freq) || found;
+  }
+  return found;
+}
+
+int ChannelAllocator::source_of(size_t channel) {
+  for (size_t i = 0; i < receivers.size(); i++) {
+    const receiver_config_t &config = receivers[i]->get_config();
+    if (channel >= config.first_channel && channel < size_t(config.first_channel) + config.channel_count) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+void ChannelAllocator::write_metrics(std::ostream &out) {
+  out << "# HELP altus_channel_handoffs_total Detections assigned to a different source than the one that saw them\n";
+  out << "# TYPE altus_channel_handoffs_total counter\n";
+  out << "altus_channel_handoffs_total " << handoffs << "\n";
+}
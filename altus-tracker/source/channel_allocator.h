@@ -0,0 +1,88 @@
+#ifndef CHANNEL_ALLOCATOR_H
+#define CHANNEL_ALLOCATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "altus_receiver.h"
+
+class ChannelAllocator;
+
+typedef std::shared_ptr<ChannelAllocator> channel_allocator_sptr;
+
+/**
+ * @brief Generate a channel allocator
+ *
+ * @return channel_allocator_sptr The allocator
+ */
+channel_allocator_sptr make_channel_allocator();
+
+/**
+ * Shares channel assignment between the receivers of several sources
+ *
+ * Every receiver's detections come here instead of going straight to its own
+ * channels. A frequency that already has a channel on any receiver is left
+ * there, otherwise it goes to the receiver that covers it best (furthest from
+ * the edges of its band), so a rocket in the overlap of two sources is only
+ * decoded once and by the source least likely to clip it.
+ */
+class ChannelAllocator {
+  private:
+    std::vector<altus_receiver_sptr> receivers;
+    std::mutex allocator_mutex;
+    std::atomic<uint64_t> handoffs;
+
+  public:
+    ChannelAllocator();
+
+    /**
+     * @brief Take over a receiver's detections
+     * Add every receiver before the flowgraph starts
+     *
+     * @param receiver The receiver
+     */
+    void add_receiver(altus_receiver_sptr receiver);
+
+    /**
+     * @brief Assign a channel to a detected frequency
+     *
+     * @param source The index of the receiver that detected it
+     * @param freq The frequency
+     */
+    void detect(size_t source, uint32_t freq);
+
+    /**
+     * @brief Pin a channel to a frequency on the receiver that has it, or
+     * else the one that covers it best
+     *
+     * @param freq The frequency
+     * @return int The receiver index, -1 if no receiver could take it
+     */
+    int pin(uint32_t freq);
+
+    /**
+     * @brief Unpin the channel on a frequency, whichever receiver it is on
+     *
+     * @return true If a channel was pinned there
+     */
+    bool unpin(uint32_t freq);
+
+    /**
+     * @brief The receiver a channel belongs to, by tracker channel index
+     *
+     * @param channel The channel index (as packet_slot_t.channel)
+     * @return int The receiver index, -1 if there is no such channel
+     */
+    int source_of(size_t channel);
+
+    /**
+     * @brief Write the allocator's counters in the Prometheus text format
+     */
+    void write_metrics(std::ostream &out);
+};
+
+#endif
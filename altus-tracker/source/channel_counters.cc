@@ -0,0 +1,74 @@
+#include <iomanip>
+
+#include "channel_counters.h"
+
+// How much each new packet moves the average SNR
+const float snr_average_weight = 0.1;
+
+static const char *counter_names[size_t(channel_counter_t::COUNT)] = {
+  "detections",
+  "retunes",
+  "syncs",
+  "attempts",
+  "crc_pass",
+  "crc_fail",
+  "resets",
+  "forwarded"
+};
+
+static const char *counter_json_names[size_t(channel_counter_t::COUNT)] = {
+  "Detections",
+  "Retunes",
+  "Syncs",
+  "Attempts",
+  "CrcPass",
+  "CrcFail",
+  "Resets",
+  "Forwarded"
+};
+
+channel_counters_sptr make_channel_counters() {
+  return std::make_shared<ChannelCounters>();
+}
+
+ChannelCounters::ChannelCounters() {
+  for (size_t i = 0; i < size_t(channel_counter_t::COUNT); i++) {
+    counts[i] = 0;
+  }
+  have_link = false;
+  last_snr_db = 0;
+  avg_snr_db = 0;
+  last_offset_hz = 0;
+}
+
+void ChannelCounters::add(channel_counter_t counter) {
+  counts[size_t(counter)].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t ChannelCounters::get(channel_counter_t counter) {
+  return counts[size_t(counter)].load(std::memory_order_relaxed);
+}
+
+void ChannelCounters::record_link(float snr_db, float offset_hz) {
+  // Only the decoder thread of the channel writes these
+  float avg = have_link ? avg_snr_db.load(std::memory_order_relaxed) : snr_db;
+  avg_snr_db.store(avg + (snr_db - avg) * snr_average_weight, std::memory_order_relaxed);
+  last_snr_db.store(snr_db, std::memory_order_relaxed);
+  last_offset_hz.store(offset_hz, std::memory_order_relaxed);
+  have_link = true;
+}
+
+void ChannelCounters::write_json(std::ostream &out) {
+  for (size_t i = 0; i < size_t(channel_counter_t::COUNT); i++) {
+    out << (i > 0 ? "," : "") << "\"" << counter_json_names[i] << "\":" << counts[i].load(std::memory_order_relaxed);
+  }
+  if (have_link) {
+    out << ",\"SNR\":" << std::fixed << std::setprecision(1) << last_snr_db.load(std::memory_order_relaxed);
+    out << ",\"SNRAvg\":" << std::fixed << std::setprecision(1) << avg_snr_db.load(std::memory_order_relaxed);
+    out << ",\"FreqOffset\":" << std::fixed << std::setprecision(0) << last_offset_hz.load(std::memory_order_relaxed);
+  }
+}
+
+const char *ChannelCounters::name(channel_counter_t counter) {
+  return counter_names[size_t(counter)];
+}
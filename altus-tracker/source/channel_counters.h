@@ -0,0 +1,85 @@
+#ifndef CHANNEL_COUNTERS_H
+#define CHANNEL_COUNTERS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+/**
+ * @brief The steps a signal goes through on a channel, in order
+ * A rocket that is heard but never decoded stops somewhere along these
+ */
+enum class channel_counter_t {
+  DETECTIONS,   // The detector reported a signal this channel is (now) on
+  RETUNES,      // The channel was moved to a new frequency
+  SYNCS,        // Sync words found
+  ATTEMPTS,     // Packets fully received after a sync word
+  CRC_PASS,
+  CRC_FAIL,
+  RESETS,       // Packets cut off by a retune or squelch
+  FORWARDED,    // Good packets queued for the sinks
+  COUNT
+};
+
+class ChannelCounters;
+
+typedef std::shared_ptr<ChannelCounters> channel_counters_sptr;
+
+/**
+ * @brief Generate a set of channel counters
+ *
+ * @return channel_counters_sptr The counters
+ */
+channel_counters_sptr make_channel_counters();
+
+/**
+ * Counts how far signals get through one channel, and how clean the decoded
+ * packets were
+ *
+ * Every update is a relaxed atomic, so the block threads count freely and any
+ * thread can read. Counts only go up, readers take differences.
+ */
+class ChannelCounters {
+  private:
+    std::atomic<uint64_t> counts[size_t(channel_counter_t::COUNT)];
+    std::atomic<bool> have_link;
+    std::atomic<float> last_snr_db;
+    std::atomic<float> avg_snr_db;
+    std::atomic<float> last_offset_hz;
+
+  public:
+    ChannelCounters();
+
+    /**
+     * @brief Count one event
+     */
+    void add(channel_counter_t counter);
+
+    /**
+     * @brief The events counted so far
+     */
+    uint64_t get(channel_counter_t counter);
+
+    /**
+     * @brief Record the link quality of a decoded packet
+     *
+     * @param snr_db The symbol SNR estimate (in dB)
+     * @param offset_hz The carrier offset from the channel frequency (in Hz)
+     */
+    void record_link(float snr_db, float offset_hz);
+
+    /**
+     * @brief Write the counts and link quality as the fields of a JSON object
+     * (without the braces)
+     */
+    void write_json(std::ostream &out);
+
+    /**
+     * @brief The snake case name of a counter, for metrics
+     */
+    static const char *name(channel_counter_t counter);
+};
+
+#endif
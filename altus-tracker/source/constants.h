@@ -20,6 +20,13 @@
 // Number of bytes in an Altus message (32 bytes of data, 2 bytes checksum, 2 bytes terminator)
 #define BYTES_PER_MESSAGE 36
 
+// Bytes of data in a message, the part covered by the CRC
+#define DATA_BYTES_PER_MESSAGE 32
+
+// Bits on air for a message, from the start of the sync word (the FEC doubles
+// the message bits)
+#define PACKET_BITS (16 + BYTES_PER_MESSAGE * 8 * 2)
+
 // Max 20 channels per device monitoring
 #define MAX_CHANNELS 20
 
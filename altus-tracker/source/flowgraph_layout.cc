@@ -0,0 +1,313 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "flowgraph_layout.h"
+
+// Time for the source to start its driver threads before they are looked for
+const std::chrono::milliseconds driver_start_wait(250);
+
+// More unknown threads than this means the block threads weren't recognised,
+// better to leave them alone than make every DSP thread real time
+const size_t max_ingest_threads = 16;
+
+// Linux thread names are cut to this length
+const size_t thread_name_length = 15;
+
+bool parse_core_list(const std::string &list, std::vector<int> &cores) {
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    try {
+      size_t dash = item.find('-');
+      int first = std::stoi(item.substr(0, dash));
+      int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+      if (first < 0 || last < first) {
+        return false;
+      }
+      for (int core = first; core <= last; core++) {
+        cores.push_back(core);
+      }
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  return cores.size() > 0;
+}
+
+bool parse_stage_setting(const std::string &setting, std::string &stage, long &value) {
+  size_t equals = setting.find('=');
+  if (equals == std::string::npos || equals == 0) {
+    return false;
+  }
+  stage = setting.substr(0, equals);
+  try {
+    size_t used;
+    value = std::stol(setting.substr(equals + 1), &used);
+    return used == setting.length() - equals - 1 && value > 0;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+static std::string core_list(const std::vector<int> &cores) {
+  std::stringstream list;
+  for (size_t i = 0; i < cores.size(); i++) {
+    list << (i > 0 ? "," : "") << cores[i];
+  }
+  return list.str();
+}
+
+static std::string read_thread_name(const std::string &tid) {
+  std::ifstream comm("/proc/self/task/" + tid + "/comm");
+  std::string name;
+  std::getline(comm, name);
+  return name;
+}
+
+static std::set<std::string> thread_ids() {
+  std::set<std::string> ids;
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == NULL) {
+    return ids;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      ids.insert(entry->d_name);
+    }
+  }
+  closedir(dir);
+  return ids;
+}
+
+// GNU Radio names each block thread after the block and its id
+static std::string block_thread_name(gr::block_sptr block) {
+  return (block->name() + std::to_string(block->unique_id())).substr(0, thread_name_length);
+}
+
+flowgraph_layout_sptr make_flowgraph_layout(layout_config_t config) {
+  return std::make_shared<FlowgraphLayout>(config);
+}
+
+FlowgraphLayout::FlowgraphLayout(layout_config_t c) {
+  config = c;
+  cores = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void FlowgraphLayout::add_ingest(const stage_blocks_t &stages) {
+  ingest.insert(ingest.end(), stages.begin(), stages.end());
+}
+
+void FlowgraphLayout::add_spectrum(const stage_blocks_t &stages) {
+  spectrum.insert(spectrum.end(), stages.begin(), stages.end());
+}
+
+void FlowgraphLayout::add_channel(const stage_blocks_t &stages) {
+  channels.push_back(stages);
+}
+
+void FlowgraphLayout::add_channel_pool(const stage_blocks_t &stages) {
+  channel_pool.insert(channel_pool.end(), stages.begin(), stages.end());
+}
+
+void FlowgraphLayout::plan() {
+  groups.clear();
+  if (!config.pin) {
+    return;
+  }
+  if (cores < 2) {
+    std::cout << "[WARN] Only one core, not pinning threads" << std::endl;
+    config.pin = false;
+    return;
+  }
+
+  // Drop cores this box doesn't have
+  std::vector<int> *lists[] = {&config.ingest_cores, &config.spectrum_cores, &config.channel_cores};
+  for (std::vector<int> *list : lists) {
+    size_t before = list->size();
+    list->erase(std::remove_if(list->begin(), list->end(), [this](int core) {
+      return core >= int(cores);
+    }), list->end());
+    if (list->size() < before) {
+      std::cout << "[WARN] Ignoring cores past the last one (" << (cores - 1) << ")" << std::endl;
+    }
+  }
+
+  if (config.ingest_cores.size() == 0) {
+    config.ingest_cores.push_back(0);
+  }
+  if (config.spectrum_cores.size() == 0) {
+    int core = 0;
+    while (core < int(cores) - 1 && std::find(config.ingest_cores.begin(), config.ingest_cores.end(), core) != config.ingest_cores.end()) {
+      core++;
+    }
+    config.spectrum_cores.push_back(core);
+  }
+  if (config.channel_cores.size() == 0) {
+    for (int core = 0; core < int(cores); core++) {
+      bool taken = std::find(config.ingest_cores.begin(), config.ingest_cores.end(), core) != config.ingest_cores.end()
+        || std::find(config.spectrum_cores.begin(), config.spectrum_cores.end(), core) != config.spectrum_cores.end();
+      if (!taken) {
+        config.channel_cores.push_back(core);
+      }
+    }
+  }
+  if (config.channel_cores.size() == 0) {
+    config.channel_cores = config.spectrum_cores;
+  }
+
+  groups.push_back({"Ingest", config.ingest_cores, ingest});
+  groups.push_back({"Spectrum", config.spectrum_cores, spectrum});
+  for (size_t i = 0; i < channels.size(); i++) {
+    std::vector<int> core = {config.channel_cores[i % config.channel_cores.size()]};
+    groups.push_back({"Channel " + std::to_string(i), core, channels[i]});
+  }
+  if (channel_pool.size() > 0) {
+    groups.push_back({"Channel pool", config.channel_cores, channel_pool});
+  }
+}
+
+void FlowgraphLayout::apply_stage_settings(const stage_blocks_t &stages) {
+  for (stage_blocks_t::const_iterator it = stages.begin(); it != stages.end(); it++) {
+    std::map<std::string, int>::iterator items = config.max_noutput_items.find(it->first);
+    if (items != config.max_noutput_items.end()) {
+      it->second->set_max_noutput_items(items->second);
+    }
+    std::map<std::string, long>::iterator buffer = config.buffer_items.find(it->first);
+    if (buffer != config.buffer_items.end()) {
+      it->second->set_min_output_buffer(buffer->second);
+    }
+  }
+}
+
+std::set<std::string> FlowgraphLayout::known_thread_names() {
+  std::set<std::string> names;
+  std::vector<const stage_blocks_t *> lists = {&spectrum, &channel_pool};
+  for (size_t i = 0; i < channels.size(); i++) {
+    lists.push_back(&channels[i]);
+  }
+  for (const stage_blocks_t *list : lists) {
+    for (stage_blocks_t::const_iterator it = list->begin(); it != list->end(); it++) {
+      names.insert(block_thread_name(it->second));
+    }
+  }
+  return names;
+}
+
+void FlowgraphLayout::start(gr::top_block_sptr tb) {
+  plan();
+  for (std::vector<group_t>::iterator group = groups.begin(); group != groups.end(); group++) {
+    for (stage_blocks_t::iterator it = group->stages.begin(); it != group->stages.end(); it++) {
+      it->second->set_processor_affinity(group->cores);
+    }
+  }
+
+  // Stage settings apply whether or not anything is pinned
+  stage_notes.clear();
+  apply_stage_settings(ingest);
+  apply_stage_settings(spectrum);
+  for (size_t i = 0; i < channels.size(); i++) {
+    apply_stage_settings(channels[i]);
+  }
+  apply_stage_settings(channel_pool);
+  for (std::map<std::string, int>::iterator it = config.max_noutput_items.begin(); it != config.max_noutput_items.end(); it++) {
+    stage_notes.push_back(it->first + ": max_noutput_items " + std::to_string(it->second));
+  }
+  for (std::map<std::string, long>::iterator it = config.buffer_items.begin(); it != config.buffer_items.end(); it++) {
+    stage_notes.push_back(it->first + ": output buffer " + std::to_string(it->second) + " items");
+  }
+
+  if (config.mlock) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+      memory_locked = true;
+    } else {
+      std::cout << "[WARN] Failed to lock memory: " << strerror(errno) << std::endl;
+    }
+  }
+
+  std::set<std::string> before = thread_ids();
+  tb->start();
+  if (!config.pin && config.rt_priority <= 0) {
+    return;
+  }
+
+  // The new threads that aren't the spectrum path or a channel are the
+  // source's blocks, its driver and the tagger
+  std::this_thread::sleep_for(driver_start_wait);
+  std::set<std::string> known = known_thread_names();
+  std::vector<std::pair<pid_t, std::string>> ingest_threads;
+  std::set<std::string> after = thread_ids();
+  for (std::set<std::string>::iterator it = after.begin(); it != after.end(); it++) {
+    if (before.count(*it) > 0) {
+      continue;
+    }
+    std::string name = read_thread_name(*it);
+    if (known.count(name) == 0) {
+      ingest_threads.push_back(std::make_pair(pid_t(std::stol(*it)), name));
+    }
+  }
+  if (ingest_threads.size() > max_ingest_threads) {
+    std::cout << "[WARN] Couldn't tell the ingest threads apart (" << ingest_threads.size() << " found), leaving them as they are" << std::endl;
+    return;
+  }
+
+  cpu_set_t ingest_set;
+  CPU_ZERO(&ingest_set);
+  for (std::vector<int>::iterator it = config.ingest_cores.begin(); it != config.ingest_cores.end(); it++) {
+    CPU_SET(*it, &ingest_set);
+  }
+  struct sched_param param;
+  std::memset(&param, 0, sizeof(param));
+  param.sched_priority = config.rt_priority;
+  for (std::vector<std::pair<pid_t, std::string>>::iterator it = ingest_threads.begin(); it != ingest_threads.end(); it++) {
+    std::string note = it->second + " (" + std::to_string(it->first) + ")";
+    if (config.pin && sched_setaffinity(it->first, sizeof(ingest_set), &ingest_set) != 0) {
+      std::cout << "[WARN] Failed to pin " << it->second << ": " << strerror(errno) << std::endl;
+    }
+    if (config.rt_priority > 0) {
+      if (sched_setscheduler(it->first, SCHED_FIFO, &param) == 0) {
+        note += " SCHED_FIFO " + std::to_string(config.rt_priority);
+      } else {
+        std::cout << "[WARN] Failed to make " << it->second << " real time: " << strerror(errno) << std::endl;
+      }
+    }
+    ingest_notes.push_back(note);
+  }
+}
+
+void FlowgraphLayout::print(std::ostream &out) {
+  out << "Thread Layout (" << cores << " cores):" << std::endl;
+  if (!config.pin) {
+    out << "  Not pinned" << std::endl;
+  }
+  for (std::vector<group_t>::iterator group = groups.begin(); group != groups.end(); group++) {
+    out << "  " << group->name << ": core" << (group->cores.size() > 1 ? "s " : " ") << core_list(group->cores);
+    if (group->stages.size() > 0 && group->name.find("Channel") != 0) {
+      out << " (";
+      for (size_t i = 0; i < group->stages.size(); i++) {
+        out << (i > 0 ? ", " : "") << group->stages[i].first;
+      }
+      out << ")";
+    }
+    out << std::endl;
+  }
+  for (std::vector<std::string>::iterator it = ingest_notes.begin(); it != ingest_notes.end(); it++) {
+    out << "  Ingest thread: " << *it << std::endl;
+  }
+  if (memory_locked) {
+    out << "  Memory: locked" << std::endl;
+  }
+  for (std::vector<std::string>::iterator it = stage_notes.begin(); it != stage_notes.end(); it++) {
+    out << "  " << *it << std::endl;
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef FLOWGRAPH_LAYOUT_H
+#define FLOWGRAPH_LAYOUT_H
+
+#include <gnuradio/top_block.h>
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "perf_counters.h"
+
+/**
+ * @brief Where the flowgraph's threads run and how big its buffers are
+ */
+struct layout_config_t {
+  bool pin = false;
+  std::vector<int> ingest_cores;      // The source and tagger (default core 0)
+  std::vector<int> spectrum_cores;    // The power level and detector (default core 1)
+  std::vector<int> channel_cores;     // Spread one channel per core (default the rest)
+  int rt_priority = 0;                // SCHED_FIFO priority of the ingest threads, 0 for off
+  bool mlock = false;                 // Lock the process in memory
+
+  // By stage name (as in the metrics), applied to every channel
+  std::map<std::string, int> max_noutput_items;
+  std::map<std::string, long> buffer_items;
+};
+
+/**
+ * @brief Parse a list of cores, like 0,2 or 2-7
+ *
+ * @param list The list
+ * @param cores The cores
+ * @return true If the list is valid
+ */
+bool parse_core_list(const std::string &list, std::vector<int> &cores);
+
+/**
+ * @brief Parse a stage setting, like first_stage_filter=8192
+ *
+ * @param setting The setting
+ * @param stage The stage name
+ * @param value The value
+ * @return true If the setting is valid
+ */
+bool parse_stage_setting(const std::string &setting, std::string &stage, long &value);
+
+class FlowgraphLayout;
+
+typedef std::shared_ptr<FlowgraphLayout> flowgraph_layout_sptr;
+
+/**
+ * @brief Generate a flowgraph layout
+ *
+ * @param config Where to put things
+ * @return flowgraph_layout_sptr The layout
+ */
+flowgraph_layout_sptr make_flowgraph_layout(layout_config_t config);
+
+/**
+ * Pins the flowgraph's threads to cores and sizes its buffers
+ *
+ * The ingest path (the SDR source, its driver threads and the sample tagger)
+ * and the spectrum path get cores of their own, and the channels are spread
+ * one per core over the rest (or the channel pool gets all of them), so the
+ * DSP threads can't hold up the USB transfers. Affinity and buffer sizes go
+ * through GNU Radio before the flowgraph starts. The source's own blocks and the driver's threads aren't
+ * reachable that way, so they are found after the start as the new threads
+ * that don't belong to a known block, then pinned (and made real time) by
+ * thread id.
+ */
+class FlowgraphLayout {
+  private:
+    struct group_t {
+      std::string name;
+      std::vector<int> cores;
+      stage_blocks_t stages;
+    };
+
+    layout_config_t config;
+    uint32_t cores;
+    stage_blocks_t ingest;
+    stage_blocks_t spectrum;
+    std::vector<stage_blocks_t> channels;
+    stage_blocks_t channel_pool;
+    std::vector<group_t> groups;
+    std::vector<std::string> stage_notes;
+    std::vector<std::string> ingest_notes;
+    bool memory_locked = false;
+
+    void plan();
+    void apply_stage_settings(const stage_blocks_t &stages);
+    std::set<std::string> known_thread_names();
+
+  public:
+    FlowgraphLayout(layout_config_t config);
+
+    /**
+     * @brief Add blocks of the ingest path (after the source)
+     */
+    void add_ingest(const stage_blocks_t &stages);
+
+    /**
+     * @brief Add blocks of the spectrum path
+     */
+    void add_spectrum(const stage_blocks_t &stages);
+
+    /**
+     * @brief Add a channel's blocks
+     */
+    void add_channel(const stage_blocks_t &stages);
+
+    /**
+     * @brief Add a channel pool, the pools share every channel core
+     */
+    void add_channel_pool(const stage_blocks_t &stages);
+
+    /**
+     * @brief Apply the layout and start the flowgraph
+     *
+     * @param tb The top block, with every block already connected
+     */
+    void start(gr::top_block_sptr tb);
+
+    /**
+     * @brief Write the effective layout
+     */
+    void print(std::ostream &out);
+};
+
+#endif
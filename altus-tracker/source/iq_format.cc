@@ -0,0 +1,251 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "iq_format.h"
+
+const std::string sigmf_meta_extension = ".sigmf-meta";
+
+bool parse_iq_format(const std::string &name, iq_format_t &format) {
+  if (name == "cf32" || name == "cfile") {
+    format = iq_format_t::CF32;
+    return true;
+  }
+  if (name == "cs16") {
+    format = iq_format_t::CS16;
+    return true;
+  }
+  if (name == "cs8") {
+    format = iq_format_t::CS8;
+    return true;
+  }
+  return false;
+}
+
+static std::string path_extension(const std::string &path) {
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return "";
+  }
+  return path.substr(dot);
+}
+
+bool iq_format_from_path(const std::string &path, iq_format_t &format) {
+  std::string extension = path_extension(path);
+  if (extension.length() < 2) {
+    return false;
+  }
+  return parse_iq_format(extension.substr(1), format);
+}
+
+std::string iq_format_name(iq_format_t format) {
+  switch (format) {
+    case iq_format_t::CS16:
+      return "cs16";
+    case iq_format_t::CS8:
+      return "cs8";
+    default:
+      return "cf32";
+  }
+}
+
+size_t iq_format_sample_size(iq_format_t format) {
+  switch (format) {
+    case iq_format_t::CS16:
+      return 2 * sizeof(int16_t);
+    case iq_format_t::CS8:
+      return 2 * sizeof(int8_t);
+    default:
+      return 2 * sizeof(float);
+  }
+}
+
+static std::string sigmf_datatype(iq_format_t format) {
+  switch (format) {
+    case iq_format_t::CS16:
+      return "ci16_le";
+    case iq_format_t::CS8:
+      return "ci8";
+    default:
+      return "cf32_le";
+  }
+}
+
+static bool parse_sigmf_datatype(const std::string &datatype, iq_format_t &format) {
+  if (datatype == "cf32_le") {
+    format = iq_format_t::CF32;
+    return true;
+  }
+  if (datatype == "ci16_le") {
+    format = iq_format_t::CS16;
+    return true;
+  }
+  if (datatype == "ci8" || datatype == "ci8_le") {
+    format = iq_format_t::CS8;
+    return true;
+  }
+  return false;
+}
+
+std::string sigmf_meta_path(const std::string &data_path) {
+  std::string extension = path_extension(data_path);
+  return data_path.substr(0, data_path.length() - extension.length()) + sigmf_meta_extension;
+}
+
+bool write_sigmf_meta(const std::string &data_path, const iq_file_info_t &info) {
+  std::string meta_path = sigmf_meta_path(data_path);
+  std::ofstream meta(meta_path, std::ios::trunc);
+  if (!meta.is_open()) {
+    std::cout << "[WARN] Failed to write SigMF metadata to " << meta_path << std::endl;
+    return false;
+  }
+
+  int64_t start_ms = info.start_time_ms;
+  if (start_ms == 0) {
+    start_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+  }
+  std::time_t start = start_ms / 1000;
+  std::tm start_utc;
+  gmtime_r(&start, &start_utc);
+
+  meta << "{" << std::endl;
+  meta << "  \"global\": {" << std::endl;
+  meta << "    \"core:datatype\": \"" << sigmf_datatype(info.format) << "\"," << std::endl;
+  meta << "    \"core:sample_rate\": " << std::fixed << std::setprecision(0) << info.sample_rate << "," << std::endl;
+  if (info.hardware != "") {
+    meta << "    \"core:hw\": \"" << info.hardware << "\"," << std::endl;
+  }
+  if (info.description != "") {
+    meta << "    \"core:description\": \"" << info.description << "\"," << std::endl;
+  }
+  meta << "    \"core:recorder\": \"altus-tracker\"," << std::endl;
+  meta << "    \"core:version\": \"1.0.0\"" << std::endl;
+  meta << "  }," << std::endl;
+  meta << "  \"captures\": [" << std::endl;
+  meta << "    {" << std::endl;
+  meta << "      \"core:sample_start\": 0," << std::endl;
+  meta << "      \"core:frequency\": " << std::fixed << std::setprecision(0) << info.center_freq << "," << std::endl;
+  meta << "      \"core:datetime\": \"" << std::put_time(&start_utc, "%Y-%m-%dT%H:%M:%S");
+  meta << "." << std::setw(3) << std::setfill('0') << (start_ms % 1000) << std::setfill(' ') << "Z\"" << std::endl;
+  meta << "    }" << std::endl;
+  meta << "  ]," << std::endl;
+  meta << "  \"annotations\": []" << std::endl;
+  meta << "}" << std::endl;
+
+  return meta.good();
+}
+
+// Pull the raw value for a key out of the metadata, the files this reads are
+// small and flat enough that a full JSON parser isn't needed
+static bool find_sigmf_value(const std::string &meta, const std::string &key, std::string &value) {
+  size_t pos = meta.find("\"" + key + "\"");
+  if (pos == std::string::npos) {
+    return false;
+  }
+  pos = meta.find(':', pos + key.length() + 2);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  pos = meta.find_first_not_of(" \t\r\n", pos + 1);
+  if (pos == std::string::npos) {
+    return false;
+  }
+
+  size_t end;
+  if (meta[pos] == '"') {
+    pos++;
+    end = meta.find('"', pos);
+  } else {
+    end = meta.find_first_of(",}] \t\r\n", pos);
+  }
+  if (end == std::string::npos) {
+    return false;
+  }
+  value = meta.substr(pos, end - pos);
+  return true;
+}
+
+// An ISO 8601 UTC time (2024-06-01T12:00:00.250Z), 0 if it doesn't parse
+static int64_t parse_sigmf_datetime(const std::string &value) {
+  std::tm time = {};
+  double seconds = 0;
+  if (sscanf(
+    value.c_str(),
+    "%d-%d-%dT%d:%d:%lf",
+    &time.tm_year,
+    &time.tm_mon,
+    &time.tm_mday,
+    &time.tm_hour,
+    &time.tm_min,
+    &seconds
+  ) != 6) {
+    return 0;
+  }
+  time.tm_year -= 1900;
+  time.tm_mon -= 1;
+  time.tm_sec = int(seconds);
+  return int64_t(timegm(&time)) * 1000 + std::llround((seconds - time.tm_sec) * 1000);
+}
+
+bool read_sigmf_meta(const std::string &data_path, iq_file_info_t &info) {
+  std::ifstream meta_file(sigmf_meta_path(data_path));
+  if (!meta_file.is_open()) {
+    return false;
+  }
+  std::stringstream meta_stream;
+  meta_stream << meta_file.rdbuf();
+  std::string meta = meta_stream.str();
+
+  std::string value;
+  if (!find_sigmf_value(meta, "core:datatype", value)) {
+    std::cout << "[WARN] SigMF metadata for " << data_path << " has no datatype" << std::endl;
+    return false;
+  }
+  if (!parse_sigmf_datatype(value, info.format)) {
+    std::cout << "[WARN] Unsupported SigMF datatype " << value << " for " << data_path << std::endl;
+    return false;
+  }
+  try {
+    if (find_sigmf_value(meta, "core:sample_rate", value)) {
+      info.sample_rate = std::stod(value);
+    }
+    if (find_sigmf_value(meta, "core:frequency", value)) {
+      info.center_freq = std::stod(value);
+    }
+  } catch (const std::exception &) {
+    std::cout << "[WARN] SigMF metadata for " << data_path << " has a bad number " << value << std::endl;
+    return false;
+  }
+  if (find_sigmf_value(meta, "core:hw", value)) {
+    info.hardware = value;
+  }
+  if (find_sigmf_value(meta, "core:datetime", value)) {
+    info.start_time_ms = parse_sigmf_datetime(value);
+  }
+
+  return true;
+}
+
+int64_t iq_file_start_ms(const std::string &data_path, const iq_file_info_t &info, double sample_rate) {
+  if (info.start_time_ms != 0) {
+    return info.start_time_ms;
+  }
+
+  struct stat file_stat;
+  if (stat(data_path.c_str(), &file_stat) != 0 || sample_rate <= 0) {
+    return 0;
+  }
+  int64_t modified_ms = int64_t(file_stat.st_mtim.tv_sec) * 1000 + file_stat.st_mtim.tv_nsec / 1000000;
+  double samples = double(file_stat.st_size) / iq_format_sample_size(info.format);
+  return modified_ms - int64_t((samples * 1000) / sample_rate);
+}
@@ -0,0 +1,96 @@
+#ifndef IQ_FORMAT_H
+#define IQ_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Sample formats for recorded IQ files
+ * CF32 is interleaved 32 bit floats (gr_complex, .cfile), CS16 and CS8 are
+ * interleaved signed 16 and 8 bit integers scaled to full range
+ */
+enum class iq_format_t {
+  CF32,
+  CS16,
+  CS8
+};
+
+/**
+ * @brief What is known about a recording, read from or written to the SigMF
+ * metadata next to it
+ */
+struct iq_file_info_t {
+  iq_format_t format = iq_format_t::CF32;
+  double sample_rate = 0;
+  double center_freq = 0;
+  std::string hardware;
+  std::string description;
+  int64_t start_time_ms = 0;
+};
+
+/**
+ * @brief Parse a format name ("cf32", "cs16" or "cs8")
+ *
+ * @param name The format name
+ * @param format Set to the parsed format
+ * @return true If the name was valid
+ */
+bool parse_iq_format(const std::string &name, iq_format_t &format);
+
+/**
+ * @brief Guess the format from a file extension (.cs8, .cs16, .cf32, .cfile)
+ *
+ * @param path The file path
+ * @param format Set to the format if the extension is known
+ * @return true If the extension was known
+ */
+bool iq_format_from_path(const std::string &path, iq_format_t &format);
+
+/**
+ * @brief The short name of a format, as accepted by parse_iq_format
+ */
+std::string iq_format_name(iq_format_t format);
+
+/**
+ * @brief Bytes per complex sample
+ */
+size_t iq_format_sample_size(iq_format_t format);
+
+/**
+ * @brief The path of the SigMF metadata file for a data file
+ * data.sigmf-data and data.cs8 both map to data.sigmf-meta
+ */
+std::string sigmf_meta_path(const std::string &data_path);
+
+/**
+ * @brief Write a SigMF metadata file for a recording
+ *
+ * @param data_path The path of the data file
+ * @param info The recording details
+ * @return true If the file was written
+ */
+bool write_sigmf_meta(const std::string &data_path, const iq_file_info_t &info);
+
+/**
+ * @brief Read the SigMF metadata file for a recording, if there is one
+ *
+ * @param data_path The path of the data file
+ * @param info Updated with the values found in the metadata
+ * @return true If the metadata was found and the datatype is supported
+ */
+bool read_sigmf_meta(const std::string &data_path, iq_file_info_t &info);
+
+/**
+ * @brief The time of the first sample in a recording
+ * Taken from the SigMF capture time if there is one, otherwise worked back
+ * from when the file was last written
+ *
+ * @param data_path The path of the data file
+ * @param info The recording details
+ * @param sample_rate The sample rate of the recording
+ * @return int64_t The time in ms since the epoch, or 0 if it can't be found
+ */
+int64_t iq_file_start_ms(const std::string &data_path, const iq_file_info_t &info, double sample_rate);
+
+#endif
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "latency_histogram.h"
+
+// Upper edge of each bucket in ms, the last bucket takes everything above
+static const double bucket_edges_ms[LatencyHistogram::bucket_count] = {
+  1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 0
+};
+
+latency_histogram_sptr make_latency_histogram() {
+  return std::make_shared<LatencyHistogram>();
+}
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+void LatencyHistogram::record(double ms) {
+  ms = std::max(0.0, ms);
+  size_t bucket = 0;
+  while (bucket < bucket_count - 1 && ms > bucket_edges_ms[bucket]) {
+    bucket++;
+  }
+  counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+
+  int64_t us = int64_t(ms * 1000);
+  int64_t seen = max_us.load(std::memory_order_relaxed);
+  while (us > seen && !max_us.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+}
+
+uint64_t LatencyHistogram::count() {
+  return total.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(double fraction) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < bucket_count; i++) {
+    sum += counts[i].load(std::memory_order_relaxed);
+  }
+  uint64_t target = uint64_t(fraction * sum);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count - 1; i++) {
+    seen += counts[i].load(std::memory_order_relaxed);
+    if (seen > target) {
+      return std::min(bucket_edges_ms[i], max());
+    }
+  }
+  return max();
+}
+
+double LatencyHistogram::max() {
+  return double(max_us.load(std::memory_order_relaxed)) / 1000;
+}
+
+void LatencyHistogram::describe(std::ostream &out) {
+  out << count() << " packets";
+  if (count() == 0) {
+    return;
+  }
+  out << std::fixed << std::setprecision(1);
+  out << ", p50 <= " << percentile(0.5) << " ms";
+  out << ", p90 <= " << percentile(0.9) << " ms";
+  out << ", p99 <= " << percentile(0.99) << " ms";
+  out << ", max " << max() << " ms";
+}
+
+void LatencyHistogram::reset() {
+  for (size_t i = 0; i < bucket_count; i++) {
+    counts[i] = 0;
+  }
+  total = 0;
+  max_us = 0;
+}
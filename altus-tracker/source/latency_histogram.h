@@ -0,0 +1,76 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+class LatencyHistogram;
+
+typedef std::shared_ptr<LatencyHistogram> latency_histogram_sptr;
+
+/**
+ * @brief Generate a latency histogram
+ *
+ * @return latency_histogram_sptr The histogram
+ */
+latency_histogram_sptr make_latency_histogram();
+
+/**
+ * Counts latencies into roughly logarithmic millisecond buckets
+ *
+ * Recording is a couple of relaxed atomic adds, so it is safe from the block
+ * threads. Percentiles are reported as the upper edge of their bucket.
+ */
+class LatencyHistogram {
+  public:
+    static const size_t bucket_count = 14;
+
+  private:
+    std::atomic<uint64_t> counts[bucket_count];
+    std::atomic<uint64_t> total;
+    std::atomic<int64_t> max_us;
+
+  public:
+    LatencyHistogram();
+
+    /**
+     * @brief Count one latency
+     *
+     * @param ms The latency in milliseconds, negative values count as 0
+     */
+    void record(double ms);
+
+    /**
+     * @brief The number of latencies counted since the last reset
+     */
+    uint64_t count();
+
+    /**
+     * @brief The bucket edge at or below which a fraction of latencies fall
+     *
+     * @param fraction The fraction (0.5 for the median)
+     * @return double The bucket edge in milliseconds, or the max for the last
+     * bucket
+     */
+    double percentile(double fraction);
+
+    /**
+     * @brief The largest latency counted since the last reset (in ms)
+     */
+    double max();
+
+    /**
+     * @brief Print the count, p50, p90, p99 and max
+     */
+    void describe(std::ostream &out);
+
+    /**
+     * @brief Clear the counts
+     */
+    void reset();
+};
+
+#endif
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#include "load_shedder.h"
+
+// How often the stop flag is looked at while waiting for the next check
+const int stop_wait_ms = 50;
+
+load_shedder_sptr make_load_shedder(
+  altus_receiver_sptr receiver,
+  gr::AltusDecoder::SampleTagger::sptr tagger,
+  double sample_rate,
+  shed_config_t config
+) {
+  return std::make_shared<LoadShedder>(
+    receiver,
+    tagger,
+    sample_rate,
+    config
+  );
+}
+
+LoadShedder::LoadShedder(
+  altus_receiver_sptr r,
+  gr::AltusDecoder::SampleTagger::sptr t,
+  double rate,
+  shed_config_t c
+) {
+  receiver = r;
+  tagger = t;
+  sample_rate = rate;
+  config = c;
+  sheds = 0;
+  restores = 0;
+  running = false;
+}
+
+LoadShedder::~LoadShedder() {
+  stop();
+}
+
+void LoadShedder::start() {
+  if (running) {
+    return;
+  }
+  running = true;
+  thread = std::thread(&LoadShedder::run, this);
+}
+
+void LoadShedder::stop() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void LoadShedder::run() {
+  std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+  last_samples = tagger->sample_count();
+  last_resyncs = tagger->resync_count();
+
+  while (running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(stop_wait_ms));
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last).count();
+    if (elapsed < config.check_seconds) {
+      continue;
+    }
+    last = now;
+    check(elapsed);
+  }
+}
+
+void LoadShedder::check(double elapsed_seconds) {
+  uint64_t samples = tagger->sample_count();
+  uint64_t resyncs = tagger->resync_count();
+  double real_time = double(samples - last_samples) / (elapsed_seconds * sample_rate);
+  uint64_t new_resyncs = resyncs - last_resyncs;
+  last_samples = samples;
+  last_resyncs = resyncs;
+
+  // Nothing has arrived yet (the source is still starting) or it has ended
+  if (samples == 0 || real_time == 0) {
+    return;
+  }
+
+  double fill = receiver->channel_input_fill();
+
+  bool overloaded = fill > config.max_buffer_fill || real_time < config.min_real_time || new_resyncs > 0;
+  if (!overloaded) {
+    overloaded_run = 0;
+    healthy_run++;
+    if (healthy_run >= config.healthy_checks) {
+      healthy_run = 0;
+      restore();
+    }
+    return;
+  }
+
+  healthy_run = 0;
+  overloaded_run++;
+  if (overloaded_run < config.overloaded_checks) {
+    return;
+  }
+  overloaded_run = 0;
+
+  std::cout << "[WARN] Overloaded, input buffers " << std::fixed << std::setprecision(0) << (fill * 100) << "% full, ";
+  std::cout << std::setprecision(2) << real_time << "x real time, " << new_resyncs << " resync(s)" << std::endl;
+  shed();
+}
+
+bool LoadShedder::shed() {
+  std::lock_guard<std::mutex> lock(steps_mutex);
+  size_t channel_count = receiver->channel_count();
+
+  // Activity is counted from the last step taken, so a channel that has only
+  // just been brought back isn't parked straight away for being quiet
+  if (last_activity.size() != channel_count) {
+    last_activity.assign(channel_count, 0);
+  }
+
+  applied_step_t applied;
+  int divisor = receiver->get_detector_rate_divisor();
+  int active = 0;
+  int quietest = -1;
+  uint64_t quietest_activity = UINT64_MAX;
+  for (size_t i = 0; i < channel_count; i++) {
+    if (receiver->is_channel_parked(i)) {
+      continue;
+    }
+    active++;
+    channel_counters_sptr counters = receiver->channel_counters(i);
+    uint64_t activity = counters->get(channel_counter_t::SYNCS) + counters->get(channel_counter_t::CRC_PASS) - last_activity[i];
+    if (activity < quietest_activity) {
+      quietest_activity = activity;
+      quietest = i;
+    }
+  }
+  bool low_cost = std::find_if(steps.begin(), steps.end(), [](const applied_step_t &s) {
+    return s.step == shed_step_t::LOW_COST;
+  }) != steps.end();
+
+  if (divisor < config.max_detector_divisor) {
+    applied.step = shed_step_t::DETECTOR_RATE;
+    applied.channel = -1;
+    receiver->set_detector_rate_divisor(divisor * 2);
+    std::cout << "[WARN] Shedding load, detector at 1/" << (divisor * 2) << " of its frame rate" << std::endl;
+  } else if (active > config.min_active_channels && quietest != -1 && receiver->set_channel_parked(quietest, true)) {
+    applied.step = shed_step_t::PARK_CHANNEL;
+    applied.channel = quietest;
+    std::cout << "[WARN] Shedding load, parked channel " << quietest << " on " << std::fixed << std::setprecision(3);
+    std::cout << (receiver->channel_freq(quietest) / 1000000.0) << " (" << quietest_activity << " syncs and decodes)" << std::endl;
+  } else if (!low_cost) {
+    applied.step = shed_step_t::LOW_COST;
+    applied.channel = -1;
+    receiver->set_low_cost(true);
+    std::cout << "[WARN] Shedding load, channels on the cheaper filters" << std::endl;
+  } else {
+    std::cout << "[WARN] Overloaded with nothing left to shed" << std::endl;
+    return false;
+  }
+
+  steps.push_back(applied);
+  sheds++;
+  for (size_t i = 0; i < channel_count; i++) {
+    channel_counters_sptr counters = receiver->channel_counters(i);
+    last_activity[i] = counters->get(channel_counter_t::SYNCS) + counters->get(channel_counter_t::CRC_PASS);
+  }
+  return true;
+}
+
+bool LoadShedder::restore() {
+  std::lock_guard<std::mutex> lock(steps_mutex);
+  if (steps.size() == 0) {
+    return false;
+  }
+
+  applied_step_t applied = steps.back();
+  steps.pop_back();
+  restores++;
+  switch (applied.step) {
+    case shed_step_t::DETECTOR_RATE: {
+      int divisor = std::max(1, receiver->get_detector_rate_divisor() / 2);
+      receiver->set_detector_rate_divisor(divisor);
+      std::cout << "Load is down, detector back to 1/" << divisor << " of its frame rate" << std::endl;
+      break;
+    }
+    case shed_step_t::PARK_CHANNEL: {
+      receiver->set_channel_parked(applied.channel, false);
+      std::cout << "Load is down, channel " << applied.channel << " back on " << std::fixed << std::setprecision(3);
+      std::cout << (receiver->channel_freq(applied.channel) / 1000000.0) << std::endl;
+      break;
+    }
+    case shed_step_t::LOW_COST:
+      receiver->set_low_cost(false);
+      std::cout << "Load is down, channels back on the full filters" << std::endl;
+      break;
+  }
+  return true;
+}
+
+size_t LoadShedder::level() {
+  std::lock_guard<std::mutex> lock(steps_mutex);
+  return steps.size();
+}
+
+void LoadShedder::write_metrics(std::ostream &out) {
+  std::lock_guard<std::mutex> lock(steps_mutex);
+  out << "# HELP altus_shed_level Load shedding steps currently applied\n";
+  out << "# TYPE altus_shed_level gauge\n";
+  out << "altus_shed_level " << steps.size() << "\n";
+  out << "# HELP altus_shed_step Load shedding steps currently applied by kind\n";
+  out << "# TYPE altus_shed_step gauge\n";
+  for (shed_step_t step : {shed_step_t::DETECTOR_RATE, shed_step_t::PARK_CHANNEL, shed_step_t::LOW_COST}) {
+    size_t count = std::count_if(steps.begin(), steps.end(), [step](const applied_step_t &s) {
+      return s.step == step;
+    });
+    out << "altus_shed_step{step=\"" << name(step) << "\"} " << count << "\n";
+  }
+  out << "# HELP altus_shed_total Load shedding steps taken\n";
+  out << "# TYPE altus_shed_total counter\n";
+  out << "altus_shed_total " << sheds << "\n";
+  out << "# HELP altus_shed_restore_total Load shedding steps undone\n";
+  out << "# TYPE altus_shed_restore_total counter\n";
+  out << "altus_shed_restore_total " << restores << "\n";
+  out << "# HELP altus_source_resync_total Times the live sample clock was re-anchored (overflows or stalls)\n";
+  out << "# TYPE altus_source_resync_total counter\n";
+  out << "altus_source_resync_total " << tagger->resync_count() << "\n";
+}
+
+const char *LoadShedder::name(shed_step_t step) {
+  switch (step) {
+    case shed_step_t::DETECTOR_RATE:
+      return "detector_rate";
+    case shed_step_t::PARK_CHANNEL:
+      return "park_channel";
+    case shed_step_t::LOW_COST:
+      return "low_cost";
+  }
+  return "";
+}
@@ -0,0 +1,135 @@
+#ifndef LOAD_SHEDDER_H
+#define LOAD_SHEDDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "altus_receiver.h"
+#include "blocks/altus_sample_tagger.h"
+
+/**
+ * @brief The kinds of load the tracker sheds, in the order they are shed
+ */
+enum class shed_step_t {
+  DETECTOR_RATE,  // Halve the detector frame rate
+  PARK_CHANNEL,   // Stop the least active channel
+  LOW_COST        // Cheaper channel filters
+};
+
+/**
+ * @brief When the shedder acts
+ */
+struct shed_config_t {
+  double check_seconds = 1;
+  double max_buffer_fill = 0.8;       // Any channel input this full is falling behind
+  double min_real_time = 0.98;        // Live samples arriving slower than this
+  uint32_t overloaded_checks = 3;     // Checks in a row before shedding a step
+  uint32_t healthy_checks = 30;       // Checks in a row before restoring a step
+  int max_detector_divisor = 4;
+  uint16_t min_active_channels = 1;
+};
+
+class LoadShedder;
+
+typedef std::shared_ptr<LoadShedder> load_shedder_sptr;
+
+/**
+ * @brief Generate a load shedder
+ *
+ * @param receiver The receiver to shed load on, enable_load_shedding must be
+ * called on it before the flowgraph starts
+ * @param tagger The sample tagger right after the source
+ * @param sample_rate The source sample rate
+ * @param config When to act
+ * @return load_shedder_sptr The shedder
+ */
+load_shedder_sptr make_load_shedder(
+  altus_receiver_sptr receiver,
+  gr::AltusDecoder::SampleTagger::sptr tagger,
+  double sample_rate,
+  shed_config_t config
+);
+
+/**
+ * Watches for the tracker falling behind a live source and sheds work in a
+ * fixed order until it keeps up
+ *
+ * Overload is any channel input buffer filling up, samples arriving slower
+ * than real time, or the tagger re-anchoring (a source overflow or stall).
+ * The detector frame rate goes first, then the least active channels are
+ * parked one at a time, then every channel moves to the cheaper filters. Once
+ * healthy for a while the steps are undone one at a time, newest first.
+ */
+class LoadShedder {
+  private:
+    struct applied_step_t {
+      shed_step_t step;
+      int channel;
+    };
+
+    altus_receiver_sptr receiver;
+    gr::AltusDecoder::SampleTagger::sptr tagger;
+    double sample_rate;
+    shed_config_t config;
+
+    std::mutex steps_mutex;
+    std::vector<applied_step_t> steps;
+    std::atomic<uint64_t> sheds;
+    std::atomic<uint64_t> restores;
+
+    // State between checks
+    uint64_t last_samples = 0;
+    uint64_t last_resyncs = 0;
+    std::vector<uint64_t> last_activity;
+    uint32_t overloaded_run = 0;
+    uint32_t healthy_run = 0;
+
+    std::thread thread;
+    std::atomic<bool> running;
+
+    void run();
+    void check(double elapsed_seconds);
+    bool shed();
+    bool restore();
+
+  public:
+    LoadShedder(
+      altus_receiver_sptr receiver,
+      gr::AltusDecoder::SampleTagger::sptr tagger,
+      double sample_rate,
+      shed_config_t config
+    );
+    ~LoadShedder();
+
+    /**
+     * @brief Start checking the load
+     */
+    void start();
+
+    /**
+     * @brief Stop checking, whatever is shed stays shed
+     */
+    void stop();
+
+    /**
+     * @brief The number of steps currently shed
+     */
+    size_t level();
+
+    /**
+     * @brief Write the shed level and step counts as Prometheus metrics
+     */
+    void write_metrics(std::ostream &out);
+
+    /**
+     * @brief The snake case name of a step
+     */
+    static const char *name(shed_step_t step);
+};
+
+#endif
@@ -3,39 +3,44 @@
 #include <boost/thread/thread.hpp> 
 
 #include <gnuradio/block.h>
-#include <gnuradio/blocks/file_sink.h>
-#include <gnuradio/blocks/file_source.h>
 #include <gnuradio/blocks/head.h>
 #include <gnuradio/blocks/throttle.h>
 #include <gnuradio/top_block.h>
 
 #include <osmosdr/source.h>
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
+#include <cstdint>
 #include <iostream>
 #include <math.h>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
-#include <netdb.h>
-
-#include <errno.h>
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <netdb.h>
 
 #include "constants.h"
-#include "blocks/altus_channel.h"
 #include "altus_packet.h"
-#include "blocks/altus_power_level.h"
-#include "blocks/altus_detector.h"
-
-int socket_conn = -1;
-bool socket_connected = false;
+#include "altus_receiver.h"
+#include "autotune.h"
+#include "channel_allocator.h"
+#include "flowgraph_layout.h"
+#include "iq_format.h"
+#include "latency_histogram.h"
+#include "load_shedder.h"
+#include "metrics_server.h"
+#include "offline_decoder.h"
+#include "packet_ring.h"
+#include "perf_counters.h"
+#include "spur_mask.h"
+#include "sinks/packet_sink.h"
+#include "sinks/tcp_sink.h"
+#include "blocks/altus_iq_file.h"
+#include "blocks/altus_sample_tagger.h"
+#include "blocks/altus_shm_iq.h"
+#include "blocks/altus_snippet_recorder.h"
 
 namespace po = boost::program_options;
 
@@ -48,17 +53,38 @@ double sample_rate = 10000000;
 const char * data_file = "../data.cfile";
 
 gr::basic_block_sptr source;
-altus_channel_sptr channel_blocks[MAX_CHANNELS];
-int channel_idx = 0;
+osmosdr::source::sptr osmo_source;
+gr::AltusDecoder::ShmIqSource::sptr shm_iq_source;
+gr::AltusDecoder::SampleTagger::sptr tagger;
+gr::AltusDecoder::SnippetRecorder::sptr snippet_recorder;
+std::vector<altus_receiver_sptr> receivers;
+channel_allocator_sptr channel_allocator;
+altus_channel_sptr replay_channel;
+load_shedder_sptr load_shedder;
+
+packet_ring_sptr packet_ring;
+std::vector<packet_sink_sptr> sinks;
+latency_histogram_sptr decode_latency;
+const std::chrono::seconds sink_stats_interval(60);
+
+// One control command at a time, whichever sink it came in on
+std::mutex control_mutex;
+
+// The spur mask file and the static exclusions, both under the control mutex
+std::string spur_file;
+std::vector<freq_range_t> exclusions;
 
 gr::block_sptr make_file_source(
   gr::top_block_sptr tb,
   const char * file_path,
+  iq_format_t format,
+  bool keep_cs16,
   bool do_throttle
 ) {
-  gr::blocks::file_source::sptr file = gr::blocks::file_source::make(
-    sizeof(gr_complex),
-    file_path
+  altus_iq_file_source_sptr file = make_altus_iq_file_source(
+    file_path,
+    format,
+    keep_cs16
   );
 
   if (!do_throttle) {
@@ -66,7 +92,7 @@ gr::block_sptr make_file_source(
   }
 
   gr::blocks::throttle::sptr throttle = gr::blocks::throttle::make(
-    sizeof(gr_complex),
+    AltusIqFileSource::output_item_size(format, keep_cs16),
     sample_rate
   );
   tb->connect(file, 0, throttle, 0);
@@ -74,6 +100,41 @@ gr::block_sptr make_file_source(
   return throttle;
 }
 
+// An SDR beyond the first, each with its own detector and channels
+struct extra_source_t {
+  uint32_t center_freq;
+  double sample_rate;
+  uint16_t channel_count;
+  std::string args;
+};
+
+// center_freq:sample_rate:channels[:osmosdr args], the args may hold colons
+bool parse_extra_source(const std::string &spec, extra_source_t &extra) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+  while (fields.size() < 3) {
+    size_t colon = spec.find(':', start);
+    fields.push_back(spec.substr(start, colon == std::string::npos ? std::string::npos : colon - start));
+    if (colon == std::string::npos) {
+      start = spec.length();
+      break;
+    }
+    start = colon + 1;
+  }
+  if (fields.size() < 3) {
+    return false;
+  }
+  try {
+    extra.center_freq = uint32_t(std::stod(fields[0]));
+    extra.sample_rate = std::stod(fields[1]);
+    extra.channel_count = uint16_t(std::stoul(fields[2]));
+  } catch (const std::exception &) {
+    return false;
+  }
+  extra.args = start < spec.length() ? spec.substr(start) : "";
+  return extra.sample_rate > 0 && extra.channel_count > 0 && extra.channel_count <= MAX_CHANNELS;
+}
+
 void signal_handler(int signal) {
   if (signal == SIGINT) {
     std::cout << "SIGINT received. Cleaning up and exiting..." << std::endl;
@@ -82,240 +143,530 @@ void signal_handler(int signal) {
   }
 }
 
-void open_socket(std::string host, bool is_ip, uint16_t port) {
-  // Check for already connected socket
-  if (socket_connected) {
-    std::cout << "Tried to open already open socket" << std::endl;
-    return;
+// Channels are numbered across the receivers in the order they were added
+std::vector<uint32_t> all_channel_freqs() {
+  std::vector<uint32_t> freqs;
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    std::vector<uint32_t> receiver_freqs = (*it)->channel_freqs();
+    freqs.insert(freqs.end(), receiver_freqs.begin(), receiver_freqs.end());
   }
+  if (replay_channel != nullptr) {
+    freqs.push_back(replay_channel->channel_freq);
+  }
+  return freqs;
+}
 
-  // Open the socket (synchronously)
-  if ((socket_conn = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-    std::cout << "Failed to create socket: " << strerror(errno) << std::endl;
-    return;
+std::vector<channel_counters_sptr> all_channel_counters() {
+  std::vector<channel_counters_sptr> counters;
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    std::vector<channel_counters_sptr> receiver_counters = (*it)->all_channel_counters();
+    counters.insert(counters.end(), receiver_counters.begin(), receiver_counters.end());
+  }
+  if (replay_channel != nullptr) {
+    counters.push_back(replay_channel->get_counters());
   }
+  return counters;
+}
 
-  // Specify the address
-  struct sockaddr_in server_address;
-  server_address.sin_family = AF_INET;
-  server_address.sin_port = htons(port);
-
-  // Parse a host name to IP
-  if (!is_ip) {
-    struct hostent *he = gethostbyname(host.c_str());
-    if (he == NULL) {
-      std::cout << "Failed to parse " << host << " into an IP: " << strerror(errno) << std::endl;
-      close(socket_conn);
-      socket_conn = -1;
-      return;
-    }
-    char *ip_addr = inet_ntoa((*((struct in_addr *) he->h_addr_list[0])));
-    std::cout << "Using IP " << ip_addr << std::endl;
-    if (inet_pton(AF_INET, ip_addr, &server_address.sin_addr) <= 0) {
-      std::cout << "Failed to set socket address to " << host << ": " << strerror(errno) << std::endl;
-      close(socket_conn);
-      socket_conn = -1;
-      return;
-    }
-  } else if (inet_pton(AF_INET, host.c_str(), &server_address.sin_addr) <= 0) {
-    std::cout << "Failed to set socket address to " << host << ": " << strerror(errno) << std::endl;
-    close(socket_conn);
-    socket_conn = -1;
-    return;
+// The blocks of each channel, or each receiver's channel pool
+std::vector<stage_blocks_t> all_channel_stages() {
+  std::vector<stage_blocks_t> stages;
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    std::vector<stage_blocks_t> receiver_stages = (*it)->channel_stage_blocks();
+    stages.insert(stages.end(), receiver_stages.begin(), receiver_stages.end());
+  }
+  if (replay_channel != nullptr) {
+    stages.push_back(replay_channel->stage_blocks());
   }
+  return stages;
+}
 
-  // Make the socket async
-  int flags = fcntl(socket_conn, F_GETFL, 0);
-  if (flags == -1) {
-    flags = 0;
+// One s: line per channel with its decode funnel and link quality
+std::vector<std::string> channel_stats_lines() {
+  std::vector<std::string> lines;
+  std::vector<uint32_t> freqs = all_channel_freqs();
+  std::vector<channel_counters_sptr> counters = all_channel_counters();
+  for (size_t i = 0; i < counters.size() && i < freqs.size(); i++) {
+    std::stringstream line;
+    line << "s:{\"Channel\":" << i << ",\"Freq\":" << freqs[i] << ",";
+    counters[i]->write_json(line);
+    line << "}\n";
+    lines.push_back(line.str());
   }
-  flags = (flags | O_NONBLOCK);
-  if (fcntl(socket_conn, F_SETFL, flags) != 0) {
-    std::cout << "Failed to set socket flags: " << strerror(errno) << std::endl;
-    close(socket_conn);
-    socket_conn = -1;
-    return;
+  return lines;
+}
+
+// Every receiver's learned spurs, one in the band of two sources listed once
+std::vector<freq_range_t> all_learned_spurs() {
+  std::vector<freq_range_t> spurs;
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    std::vector<freq_range_t> learned = (*it)->learned_spurs();
+    for (std::vector<freq_range_t>::iterator spur = learned.begin(); spur != learned.end(); spur++) {
+      if (std::find(spurs.begin(), spurs.end(), *spur) == spurs.end()) {
+        spurs.push_back(*spur);
+      }
+    }
   }
+  return spurs;
+}
 
-  // Send the connection request
-  if (
-    connect(socket_conn, (struct sockaddr*)&server_address, sizeof(server_address)) < 0 &&
-    errno != EINPROGRESS
-  ) {
-    std::cout << "Failed to open socket: " << strerror(errno) << std::endl;
-    close(socket_conn);
-    socket_conn = -1;
+// Keep the mask for the next start, call it holding the control mutex
+void save_spur_mask() {
+  if (spur_file == "" || receivers.size() == 0) {
     return;
   }
+  if (!write_spur_file(spur_file, all_learned_spurs(), exclusions)) {
+    std::cout << "[WARN] Failed to write the spur mask " << spur_file << std::endl;
+  }
+}
+
+// The m: line with what the detectors are ignoring
+std::string spur_mask_line() {
+  std::lock_guard<std::mutex> lock(control_mutex);
+  uint64_t suppressed = 0;
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    suppressed += (*it)->suppressed_detections();
+  }
+  std::stringstream line;
+  line << "m:{\"Learned\":";
+  write_freq_ranges_json(line, all_learned_spurs());
+  line << ",\"Excluded\":";
+  write_freq_ranges_json(line, exclusions);
+  line << ",\"Suppressed\":" << suppressed << "}\n";
+  return line.str();
+}
+
+// exclude: and unexclude:, every receiver ignores the same frequencies
+bool change_exclusions(bool exclude, const std::vector<freq_range_t> &ranges, std::string &error) {
+  for (std::vector<freq_range_t>::const_iterator it = ranges.begin(); it != ranges.end(); it++) {
+    std::vector<freq_range_t>::iterator found = std::find(exclusions.begin(), exclusions.end(), *it);
+    if (exclude && found == exclusions.end()) {
+      exclusions.push_back(*it);
+    } else if (!exclude && found != exclusions.end()) {
+      exclusions.erase(found);
+    } else if (!exclude) {
+      error = "no exclusion matches " + std::to_string(it->low) + "-" + std::to_string(it->high);
+      return false;
+    }
+  }
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    (*it)->set_exclusions(exclusions);
+  }
+  save_spur_mask();
+  return true;
 }
 
-std::chrono::milliseconds last_message = duration_cast< std::chrono::milliseconds >(
-  std::chrono::system_clock::now().time_since_epoch()
-);
-const uint32_t min_ping_wait = 5000; // in ms
-const std::string ping_message = "ping\n";
+static bool parse_number(const std::string &text, double &value) {
+  try {
+    size_t used;
+    value = std::stod(text, &used);
+    return used == text.length();
+  } catch (const std::exception &) {
+    return false;
+  }
+}
 
-std::stringstream message_in;
-std::vector<std::string> outgoing_messages;
-std::mutex outgoing_messages_mutex;
-void handle_message() {
-  std::cout << "New message in: " << message_in.str() << std::endl;
+// cfg:key=value, the source and the receivers it feeds change in place
+bool apply_setting(const std::string &key, const std::string &value, std::string &error) {
+  double number = 0;
+  bool numeric = parse_number(value, number);
 
-  // Pull out the message and clear the buffer
-  std::string msg = message_in.str();
-  message_in.str(std::string());
+  if (key == "squelch") {
+    if (!numeric || number < 0 || number > 100) {
+      error = "squelch is 0 to 100 dB above the mean";
+      return false;
+    }
+    for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+      (*it)->set_squelch(int16_t(number));
+    }
+    return true;
+  }
 
-  if (msg == "!!") {
-    std::cout << "Init command" << std::endl;
-    outgoing_messages_mutex.lock();
-    for (int i = 0; i < channel_count; i++) {
-      std::stringstream msg;
-      msg << "c:" << std::fixed << std::setprecision(0) << channel_blocks[i]->channel_freq << "\n";
-      std::cout << "Msg out: " << msg.str();
-      outgoing_messages.push_back(msg.str());
+  if (key == "demod") {
+    channel_demod_t demod;
+    if (!parse_channel_demod(value, demod)) {
+      error = "demod is full or fast";
+      return false;
+    }
+    for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+      if (!(*it)->set_demod(demod)) {
+        error = "the fast demodulator needs --channel_pool";
+        return false;
+      }
     }
-    outgoing_messages_mutex.unlock();
+    return true;
   }
-}
 
-void process_queue(
-  std::string socket_host,
-  bool is_ip,
-  uint16_t socket_port
-) {
-  // Set up the socket
-  open_socket(socket_host, is_ip, socket_port);
+  if (key == "gain") {
+    if (osmo_source == nullptr) {
+      error = "only an SDR source has a gain";
+      return false;
+    }
+    if (value == "auto") {
+      osmo_source->set_gain_mode(true);
+      return true;
+    }
+    if (!numeric) {
+      error = "gain is in dB, or auto";
+      return false;
+    }
+    osmo_source->set_gain_mode(false);
+    osmo_source->set_gain(number);
+    return true;
+  }
 
-  while (running) {
-    // Check for incoming messages
-    if (socket_conn != -1) {
-      ssize_t valread;
-      static char buffer[1] = { 0 };
-      while ((valread = read(socket_conn, &buffer[0], 1)) > 0) {
-        socket_connected = true;
-
-        if (buffer[0] == '\n') {
-          handle_message();
-        } else {
-          message_in << buffer[0];
-          std::cout << "Received: " << buffer[0] << std::endl;
-        }
+  if (key == "center_freq") {
+    if (osmo_source == nullptr) {
+      error = "only an SDR source can be retuned";
+      return false;
+    }
+    if (!numeric || number <= 0 || number > UINT32_MAX) {
+      error = "center_freq is in Hz";
+      return false;
+    }
+    osmo_source->set_center_freq(number);
+    input_center_freq = uint32_t(number);
+    receivers[0]->set_center_freq(input_center_freq);
+    if (snippet_recorder != nullptr) {
+      snippet_recorder->set_center_freq(input_center_freq);
+    }
+    return true;
+  }
+
+  if (key == "sample_rate" || key == "channels") {
+    // Both replace the channels and the detector, the shedder and the
+    // snippets keep their own idea of the rate and channels
+    if (load_shedder != nullptr) {
+      error = key + " can't change while load shedding is on";
+      return false;
+    }
+    double new_rate = receivers[0]->get_config().sample_rate;
+    uint16_t new_count = receivers[0]->channel_count();
+    if (key == "sample_rate") {
+      if (osmo_source == nullptr) {
+        error = "only an SDR source can change its sample rate";
+        return false;
       }
+      if (snippet_recorder != nullptr) {
+        error = "sample_rate can't change while recording snippets";
+        return false;
+      }
+      if (!numeric || number < AltusChannelDsp::channel_rate * AltusChannelDsp::first_stage_channel_width) {
+        error = "sample_rate must be at least 4 channels wide";
+        return false;
+      }
+    } else {
+      if (!numeric || number < 1 || number > MAX_CHANNELS || number != std::floor(number)) {
+        error = "channels is 1 to " + std::to_string(MAX_CHANNELS);
+        return false;
+      }
+      if (receivers.size() > 1) {
+        error = "channels can only change with a single source";
+        return false;
+      }
+      new_count = uint16_t(number);
+    }
 
-      // Check for socket errors
-      if (
-        valread < 0 &&
-        errno != EWOULDBLOCK &&
-        errno != EAGAIN
-      ) {
-        std::cerr << "Failed to read from socket: " << strerror(errno) << std::endl;
-        socket_conn = -1;
-        socket_connected = false;
+    // Only the receiver is rebuilt, the source and tagger carry on
+    tb->lock();
+    try {
+      if (key == "sample_rate") {
+        osmo_source->set_sample_rate(number);
+        new_rate = osmo_source->get_sample_rate();
+        tagger->set_sample_rate(new_rate);
+        sample_rate = new_rate;
       }
+      receivers[0]->rebuild(new_rate, new_count);
+      channel_count = receivers[0]->channel_count();
+    } catch (...) {
+      tb->unlock();
+      throw;
+    }
+    tb->unlock();
+    return true;
+  }
+
+  error = "unknown setting " + key;
+  return false;
+}
+
+// Tell the servers about channels that came or went outside the detector
+void announce_channel_changes(const std::vector<uint32_t> &before, const std::vector<uint32_t> &after) {
+  std::stringstream msg;
+  for (std::vector<uint32_t>::const_iterator it = before.begin(); it != before.end(); it++) {
+    if (std::find(after.begin(), after.end(), *it) == after.end()) {
+      msg << "r:" << *it << "\n";
+    }
+  }
+  for (std::vector<uint32_t>::const_iterator it = after.begin(); it != after.end(); it++) {
+    if (std::find(before.begin(), before.end(), *it) == before.end()) {
+      msg << "c:" << *it << "\n";
     }
+  }
+  if (msg.str() == "") {
+    return;
+  }
+  for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+    (*it)->send_control(msg.str());
+  }
+}
+
+// Quote text from a command for a JSON string, the command and any error
+// (which may repeat it) come straight from the server
+std::string json_escape(const std::string &text) {
+  std::stringstream out;
+  for (std::string::const_iterator it = text.begin(); it != text.end(); it++) {
+    if (*it == '"' || *it == '\\') {
+      out << '\\' << *it;
+    } else if (*it == '\n') {
+      out << "\\n";
+    } else if (*it == '\r') {
+      out << "\\r";
+    } else if (*it == '\t') {
+      out << "\\t";
+    } else if ((unsigned char)*it < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(*it) << std::dec;
+    } else {
+      out << *it;
+    }
+  }
+  return out.str();
+}
 
-    bool sent_message = false;
-    uint16_t packets_sent = 0;
-    std::stringstream msg_value;
-    for (int i = 0; i < channel_count; i++) {
-      auto chan = channel_blocks[i];
-      chan->packet_queue_mutex.lock();
-      for (std::vector<std::string>::iterator msg_ptr = chan->packet_queue.begin(); msg_ptr != chan->packet_queue.end(); msg_ptr++) {
-        std::string msg = *msg_ptr;
-        msg_value << msg;
-        packets_sent++;
+// cfg:, pin:, unpin:, exclude:, unexclude: and mask:clear commands, answered
+// with an a: line saying whether it applied and how long that took
+std::string handle_control_command(const std::string &msg) {
+  std::lock_guard<std::mutex> lock(control_mutex);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<uint32_t> before = all_channel_freqs();
+
+  bool ok = false;
+  std::string error;
+  size_t colon = msg.find(':');
+  std::string command = msg.substr(0, colon);
+  std::string argument = msg.substr(colon + 1);
+  double freq = 0;
+  try {
+    if (receivers.size() == 0) {
+      error = "there are no receivers to change";
+    } else if (command == "cfg") {
+      size_t equals = argument.find('=');
+      if (equals == std::string::npos) {
+        error = "use cfg:setting=value";
+      } else {
+        ok = apply_setting(argument.substr(0, equals), argument.substr(equals + 1), error);
       }
-      chan->packet_queue.clear();
-      chan->packet_queue_mutex.unlock();
-    }
-    outgoing_messages_mutex.lock();
-    for (std::vector<std::string>::iterator msg_ptr = outgoing_messages.begin(); msg_ptr != outgoing_messages.end(); msg_ptr++) {
-      std::string msg = *msg_ptr;
-      msg_value << msg;
-      packets_sent++;
-    }
-    outgoing_messages.clear();
-    outgoing_messages_mutex.unlock();
-    if (packets_sent > 0) {
-      // Write to socket (if indicated)
-      if (socket_connected) {
-        std::string msg = msg_value.str();
-        write(socket_conn, msg.c_str(), msg.length());
-        sent_message = true;
+    } else if (command == "exclude" || command == "unexclude") {
+      std::vector<freq_range_t> ranges;
+      if (!parse_freq_ranges(argument, ranges)) {
+        error = "use " + command + ":low-high or a frequency in Hz, comma separated";
       } else {
-        std::cout << "[WARN] Have " << packets_sent << " packet(s) but no socket" << std::endl;
+        ok = change_exclusions(command == "exclude", ranges, error);
       }
-    }
-    if (sent_message) {
-      last_message = duration_cast< std::chrono::milliseconds >(
-        std::chrono::system_clock::now().time_since_epoch()
-      );
-    } else {
-      std::chrono::milliseconds now = duration_cast< std::chrono::milliseconds >(
-        std::chrono::system_clock::now().time_since_epoch()
-      );
-      if (uint32_t(now.count() - last_message.count()) >= min_ping_wait) {
-        if (socket_connected) {
-          // std::cout << "Ping after " << uint32_t(now.count() - last_message.count()) << std::endl;
-          write(socket_conn, ping_message.c_str(), ping_message.length());
-        } else if (socket_conn == -1) {
-          open_socket(socket_host, is_ip, socket_port);
+    } else if (command == "mask") {
+      if (argument != "clear") {
+        error = "use mask:clear";
+      } else {
+        for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+          (*it)->clear_learned_spurs();
         }
-        last_message = now;
+        save_spur_mask();
+        ok = true;
+      }
+    } else if (!parse_number(argument, freq) || freq <= 0 || freq > UINT32_MAX) {
+      error = "use " + command + ":frequency in Hz";
+    } else if (command == "pin") {
+      ok = channel_allocator->pin(uint32_t(freq)) >= 0;
+      if (!ok) {
+        error = "no source covers the frequency or every channel there is pinned";
+      }
+    } else {
+      ok = channel_allocator->unpin(uint32_t(freq));
+      if (!ok) {
+        error = "no channel is pinned on the frequency";
       }
     }
-    
-    // Wait before starting the next run
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  } catch (const std::exception &e) {
+    ok = false;
+    error = e.what();
   }
+  double apply_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  announce_channel_changes(before, all_channel_freqs());
 
-  if (socket_conn != -1) {
-    close(socket_conn);
+  std::cout << "Control " << msg << ": " << (ok ? "applied" : "failed, " + error) << " in ";
+  std::cout << std::fixed << std::setprecision(1) << apply_ms << " ms" << std::endl;
+
+  std::stringstream ack;
+  ack << "a:{\"Command\":\"" << json_escape(msg) << "\",\"Ok\":" << (ok ? "true" : "false");
+  ack << ",\"ApplyMs\":" << std::fixed << std::setprecision(1) << apply_ms;
+  if (!ok) {
+    ack << ",\"Error\":\"" << json_escape(error) << "\"";
   }
+  ack << "}\n";
+  return ack.str();
 }
 
-void add_channel(uint32_t channel_freq) {
-  // Check to see if the channel already exists
-  for (int i = 0; i < channel_count; i++) {
-    if (channel_blocks[i]->channel_freq == channel_freq) {
-      return;
+std::vector<std::string> handle_message(const std::string &msg) {
+  std::vector<std::string> responses;
+
+  if (msg == "!!") {
+    std::cout << "Init command" << std::endl;
+    std::vector<uint32_t> channel_freqs = all_channel_freqs();
+    for (std::vector<uint32_t>::iterator it = channel_freqs.begin(); it != channel_freqs.end(); it++) {
+      std::stringstream line;
+      line << "c:" << std::fixed << std::setprecision(0) << *it << "\n";
+      std::cout << "Msg out: " << line.str();
+      responses.push_back(line.str());
     }
+
+    std::vector<std::string> stats = channel_stats_lines();
+    responses.insert(responses.end(), stats.begin(), stats.end());
+  } else if (msg == "mask:") {
+    responses.push_back(spur_mask_line());
+  } else if (
+    msg.rfind("cfg:", 0) == 0 ||
+    msg.rfind("pin:", 0) == 0 ||
+    msg.rfind("unpin:", 0) == 0 ||
+    msg.rfind("exclude:", 0) == 0 ||
+    msg.rfind("unexclude:", 0) == 0 ||
+    msg.rfind("mask:", 0) == 0
+  ) {
+    responses.push_back(handle_control_command(msg));
+  }
+
+  return responses;
+}
+
+void process_queue() {
+  for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+    (*it)->start();
   }
 
-  // Add the channel
-  uint32_t channel_being_removed = channel_blocks[channel_idx]->channel_freq;
-  channel_blocks[channel_idx]->set_channel(channel_freq);
+  uint64_t last_dropped = 0;
+  std::chrono::steady_clock::time_point last_stats = std::chrono::steady_clock::now();
+  while (running) {
+    // Hand every packet to every sink, each sink queues and sends on its own
+    // thread so nothing here waits on a slow sink
+    packet_slot_t slot;
+    while (packet_ring->pop(slot)) {
+      for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+        (*it)->offer(slot);
+      }
+    }
+
+    // Report any packets lost to a full ring
+    uint64_t dropped = packet_ring->dropped();
+    if (dropped != last_dropped) {
+      std::cout << "[WARN] Packet queue full, dropped " << (dropped - last_dropped) << " packet(s) (";
+      std::cout << dropped << " total)" << std::endl;
+      last_dropped = dropped;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - last_stats >= sink_stats_interval) {
+      for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+        (*it)->log_stats();
+      }
+      std::vector<std::string> stats = channel_stats_lines();
+      for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+        for (std::vector<std::string>::iterator line = stats.begin(); line != stats.end(); line++) {
+          (*it)->send_control(*line);
+        }
+      }
+      if (decode_latency != nullptr) {
+        std::cout << "Arrival to decode: ";
+        decode_latency->describe(std::cout);
+        std::cout << std::endl;
+        decode_latency->reset();
+      }
+      {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        save_spur_mask();
+      }
+      last_stats = now;
+    }
+
+    // Wait before starting the next run
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
 
-  // Increment the index
-  channel_idx++;
-  if (channel_idx >= channel_count) {
-    channel_idx = 0;
+  for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+    (*it)->stop();
   }
+}
 
-  // Send a socket message (if open)
-  if (socket_connected) {
-    std::stringstream msg;
-    msg << "r:" << channel_being_removed << "\n";
-    msg << "c:" << channel_freq << "\n";
+void write_metrics(std::ostream &out) {
+  std::vector<block_metrics_t> metrics;
+  std::vector<stage_blocks_t> channel_stages = all_channel_stages();
+  for (size_t i = 0; i < channel_stages.size(); i++) {
+    read_stage_metrics(std::to_string(i), channel_stages[i], metrics);
+  }
+  for (size_t i = 0; i < receivers.size(); i++) {
+    read_stage_metrics(i == 0 ? std::string("detector") : "detector_" + std::to_string(i), receivers[i]->detector_stage_blocks(), metrics);
+  }
+  write_block_metrics(out, metrics);
 
-    outgoing_messages_mutex.lock();
-    outgoing_messages.push_back(msg.str());
-    outgoing_messages_mutex.unlock();
+  out << "# HELP altus_channel_frequency_hz The frequency each channel is tuned to\n";
+  out << "# TYPE altus_channel_frequency_hz gauge\n";
+  std::vector<uint32_t> freqs = all_channel_freqs();
+  for (size_t i = 0; i < freqs.size(); i++) {
+    out << "altus_channel_frequency_hz{channel=\"" << i << "\"} " << freqs[i] << "\n";
+  }
+  if (channel_allocator != nullptr) {
+    out << "# HELP altus_channel_source The source each channel belongs to\n";
+    out << "# TYPE altus_channel_source gauge\n";
+    for (size_t i = 0; i < freqs.size(); i++) {
+      out << "altus_channel_source{channel=\"" << i << "\"} " << channel_allocator->source_of(i) << "\n";
+    }
+    channel_allocator->write_metrics(out);
+  }
+  std::vector<channel_counters_sptr> counters = all_channel_counters();
+  for (size_t c = 0; c < size_t(channel_counter_t::COUNT); c++) {
+    std::string name = std::string("altus_channel_") + ChannelCounters::name(channel_counter_t(c)) + "_total";
+    out << "# TYPE " << name << " counter\n";
+    for (size_t i = 0; i < counters.size(); i++) {
+      out << name << "{channel=\"" << i << "\"} " << counters[i]->get(channel_counter_t(c)) << "\n";
+    }
+  }
+  out << "# HELP altus_packets_queued_total Decoded packets queued for the sinks\n";
+  out << "# TYPE altus_packets_queued_total counter\n";
+  out << "altus_packets_queued_total " << packet_ring->pushed() << "\n";
+  out << "# HELP altus_packets_dropped_total Decoded packets lost to a full queue\n";
+  out << "# TYPE altus_packets_dropped_total counter\n";
+  out << "altus_packets_dropped_total " << packet_ring->dropped() << "\n";
+  out << "# HELP altus_detector_spur_suppressed_total Detector bins above the level dropped by the spur mask\n";
+  out << "# TYPE altus_detector_spur_suppressed_total counter\n";
+  for (size_t i = 0; i < receivers.size(); i++) {
+    out << "altus_detector_spur_suppressed_total{source=\"" << i << "\"} " << receivers[i]->suppressed_detections() << "\n";
+  }
+  out << "# HELP altus_detector_learned_spurs The spurs and carriers the detector is ignoring\n";
+  out << "# TYPE altus_detector_learned_spurs gauge\n";
+  for (size_t i = 0; i < receivers.size(); i++) {
+    out << "altus_detector_learned_spurs{source=\"" << i << "\"} " << receivers[i]->learned_spurs().size() << "\n";
+  }
+  if (load_shedder != nullptr) {
+    load_shedder->write_metrics(out);
+  }
+  if (shm_iq_source != nullptr) {
+    out << "# HELP altus_shm_iq_laps_total Times this tracker fell a whole IQ ring behind the ingest\n";
+    out << "# TYPE altus_shm_iq_laps_total counter\n";
+    out << "altus_shm_iq_laps_total " << shm_iq_source->laps() << "\n";
+    out << "# HELP altus_shm_iq_skipped_samples_total Samples skipped after falling behind the ingest\n";
+    out << "# TYPE altus_shm_iq_skipped_samples_total counter\n";
+    out << "altus_shm_iq_skipped_samples_total " << shm_iq_source->skipped() << "\n";
+    out << "# HELP altus_shm_iq_backlog_samples Samples in the IQ ring not read yet\n";
+    out << "# TYPE altus_shm_iq_backlog_samples gauge\n";
+    out << "altus_shm_iq_backlog_samples " << shm_iq_source->backlog() << "\n";
   }
 }
 
-void build_channel(uint32_t channel_freq) {
-  // Add the channel
-  altus_channel_sptr channel = make_altus_channel(
-    channel_freq,
-    double(input_center_freq),
-    sample_rate
-  );
-  tb->connect(source, 0, channel, 0);
-  channel_blocks[channel_idx] = channel;
-  channel_idx++;
-  if (channel_idx >= channel_count) {
-    channel_idx = 0;
+void channel_changed(uint32_t channel_being_removed, uint32_t channel_freq) {
+  // Send a socket message (to the sinks that are open)
+  std::stringstream msg;
+  msg << "r:" << channel_being_removed << "\n";
+  msg << "c:" << channel_freq << "\n";
+  for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+    (*it)->send_control(msg.str());
   }
 }
 
@@ -326,15 +677,61 @@ int main(int argc, char **argv) {
     ("version,v", "Version Information")
     ("center_freq,c", po::value<uint32_t>(), "Input center frequency")
     ("sample_rate,s", po::value<uint32_t>(), "Sample rate")
-    ("squelch", po::value<int16_t>(), "Squelch level for power squelch")
+    ("squelch", po::value<int16_t>(), "How far above the mean spectrum level (in dB) the detector needs a signal to be (default 60)")
+    ("exclude", po::value<std::string>(), "Frequencies the detector ignores, ranges like 434550000-434560000 or single frequencies (half a channel either side), comma separated")
+    ("spur_seconds", po::value<double>(), "Seconds a bin has to stay above the detector level to be masked as a spur or carrier, 0 to only use --exclude (default 5)")
+    ("spur_file", po::value<std::string>(), "File to keep the learned spurs and the exclusions in, loaded at startup and saved every minute and on exit (default none)")
     ("file,f", po::value<std::string>(), "File to use as a source (complex data)")
+    ("file_format", po::value<std::string>(), "Sample format of the file or saved samples, cf32, cs16 or cs8 (default from the file extension or SigMF metadata, then cf32)")
     ("source", po::value<std::string>(), "OSMO SDR source to use")
+    ("shm_iq", po::value<std::string>(), "Read the SDR through the shared memory IQ ring of an altus-ingest process with this name (like " SHM_IQ_DEFAULT_NAME "), the rate and frequency come from the ring")
+    ("sdr", po::value<std::vector<std::string>>()->composing(), "Another SDR with its own detector and channels, center_freq:sample_rate:channels[:osmosdr args] (repeatable)")
     ("socket", po::value<std::string>(), "Socket host to connect to")
     ("socket_ip", po::value<std::string>(), "Socket IP to connect to (default 127.0.0.1)")
     ("port", po::value<uint16_t>(), "Socket port to connect to (default 8765)")
     ("channels", po::value<uint16_t>(),  "Number of channels to monitor (max 10)")
+    ("channel_pool", "Run every channel in one block on a pool of threads, in place of a chain of blocks per channel")
+    ("demod", po::value<std::string>(), "Channel demodulator, full or fast (a tone energy detector at a third of the CPU and a little less sensitivity, runs in the channel pool) (default full)")
+    ("int16_frontend", "Filter the channels' first stage in int16 from the SDR samples, a cs16 file goes in without converting to float (runs in the channel pool)")
+    ("pool_threads", po::value<uint16_t>(), "Threads for the channel pool (default one per core, no more than the channels)")
+    ("autotune", "Benchmark this host at startup and pick the channel count and detector settings to fit")
+    ("autotune_cache", po::value<std::string>(), "File to keep the autotune measurements in, so later starts skip the benchmark (default altus-autotune.cache, none to always benchmark)")
+    ("autotune_headroom", po::value<double>(), "Share of the CPU autotune leaves free (default 0.3)")
+    ("queue_size", po::value<uint32_t>(), "Number of decoded packets to buffer for the socket (default 1024)")
+    ("queue_drop", po::value<std::string>(), "Packet to drop when the queue is full, oldest or newest (default oldest)")
+    ("sink", po::value<std::vector<std::string>>()->composing(), "Extra packet output, tcp:host:port, udp:group:port or file:path with an optional :block, :drop or :spool policy (repeatable)")
+    ("spool_dir", po::value<std::string>(), "Directory to spool packets to while the socket is down (default off)")
+    ("spool_max_mb", po::value<uint32_t>(), "Most disk space the spool may use in MB (default 64)")
+    ("spool_replay_rate", po::value<uint32_t>(), "Spooled packets to send per second once reconnected (default 50)")
+    ("compress_level", po::value<int>(), "zstd level for TCP sinks when the server asks for compression (default 0, off)")
+    ("compress_flush_ms", po::value<uint32_t>(), "How long a compressing TCP sink gathers packets into one flushed batch in ms (default 100)")
     ("save_samples", "Save the samples to a data file")
-    ("throttle", "Throttle (only applies to file source)");
+    ("channel_record_dir", po::value<std::string>(), "Directory to record channel rate IQ to, one file per channel assignment (default off)")
+    ("channel_record_format", po::value<std::string>(), "Channel recording sample format, cf32, cs16 or cs8 (default cs16)")
+    ("channel_replay", "The file is a channel rate recording, decode it on a single channel")
+    ("snippet_dir", po::value<std::string>(), "Directory to save IQ snippets around detections and decodes to (default off)")
+    ("snippet_on", po::value<std::string>(), "Comma separated snippet triggers, detection, decode and crc (default detection,crc)")
+    ("snippet_seconds", po::value<double>(), "Seconds of wideband IQ to keep in memory for snippets, 4 bytes per sample (default 3)")
+    ("snippet_pre", po::value<double>(), "Seconds to save before a snippet trigger (default 1)")
+    ("snippet_post", po::value<double>(), "Seconds to save after a snippet trigger (default 1)")
+    ("snippet_format", po::value<std::string>(), "Snippet sample format, cf32, cs16 or cs8 (default cs16)")
+    ("snippet_channelize", "Save snippets filtered and decimated to the triggering channel")
+    ("pin", "Pin the ingest path, the spectrum path and each channel to their own cores")
+    ("ingest_cores", po::value<std::string>(), "Cores for the source and sample tagger, like 0 or 0-1 (default 0)")
+    ("spectrum_cores", po::value<std::string>(), "Cores for the power level and detector (default the next free core)")
+    ("channel_cores", po::value<std::string>(), "Cores to spread the channels over, one channel per core (default the rest)")
+    ("rt_priority", po::value<int>(), "Run the ingest threads SCHED_FIFO at this priority, 1 to 99 (default off, needs CAP_SYS_NICE)")
+    ("mlock", "Lock the tracker in memory so ingest never waits on a page fault")
+    ("stage_max_noutput", po::value<std::vector<std::string>>()->composing(), "Most items a stage makes per call, stage=items like first_stage_filter=8192 (repeatable)")
+    ("stage_buffer", po::value<std::vector<std::string>>()->composing(), "Output buffer size of a stage, stage=items (repeatable)")
+    ("metrics", po::value<std::string>(), "Serve per-block performance counters for Prometheus on this local port, or unix:path for a Unix socket (default off)")
+    ("throttle", "Throttle (only applies to file source)")
+    ("shed", "Shed load when the tracker can't keep up with a live or throttled source, detector rate first, then quiet channels, then cheaper filters")
+    ("offline", "Decode the file in parallel segments as fast as possible, write the packets and exit")
+    ("threads", po::value<uint32_t>(), "Segments to decode at once in offline mode (default all cores)")
+    ("segment_seconds", po::value<double>(), "Length of each offline segment in seconds (default 30)")
+    ("overlap_seconds", po::value<double>(), "Overlap between offline segments in seconds (default 2)")
+    ("offline_out", po::value<std::string>(), "File to write offline packets to as NDJSON (default the file path plus .packets.ndjson)");
 
   po::variables_map vm;
   po::store(parse_command_line(argc, argv, desc), vm);
@@ -365,7 +762,33 @@ int main(int argc, char **argv) {
   }
   int16_t squelch = 60;
   if (vm.count("squelch")) {
-    squelch = vm["squelch"].as<int8_t>();
+    squelch = vm["squelch"].as<int16_t>();
+  }
+
+  // Parse the spur mask options, a saved mask adds to what is given here
+  if (vm.count("exclude") && !parse_freq_ranges(vm["exclude"].as<std::string>(), exclusions)) {
+    std::cout << "Invalid exclude value " << vm["exclude"].as<std::string>() << ", use a list like 434550000-434560000,435025000" << std::endl;
+    return 1;
+  }
+  double spur_seconds = 5;
+  if (vm.count("spur_seconds")) {
+    spur_seconds = vm["spur_seconds"].as<double>();
+    if (spur_seconds < 0) {
+      std::cout << "Invalid spur_seconds value " << spur_seconds << std::endl;
+      return 1;
+    }
+  }
+  std::vector<freq_range_t> saved_spurs;
+  if (vm.count("spur_file")) {
+    spur_file = vm["spur_file"].as<std::string>();
+    std::vector<freq_range_t> saved_exclusions;
+    if (read_spur_file(spur_file, saved_spurs, saved_exclusions)) {
+      for (std::vector<freq_range_t>::iterator it = saved_exclusions.begin(); it != saved_exclusions.end(); it++) {
+        if (std::find(exclusions.begin(), exclusions.end(), *it) == exclusions.end()) {
+          exclusions.push_back(*it);
+        }
+      }
+    }
   }
 
   // Parse the socket options
@@ -382,36 +805,291 @@ int main(int argc, char **argv) {
     socket_port = vm["port"].as<uint16_t>();
   }
 
+  // Parse the packet queue options
+  uint32_t queue_size = 1024;
+  drop_policy_t queue_drop = drop_policy_t::DROP_OLDEST;
+  if (vm.count("queue_size")) {
+    queue_size = vm["queue_size"].as<uint32_t>();
+  }
+  if (vm.count("queue_drop") && !parse_drop_policy(vm["queue_drop"].as<std::string>(), queue_drop)) {
+    std::cout << "Invalid queue_drop value " << vm["queue_drop"].as<std::string>() << ", use oldest or newest" << std::endl;
+    return 1;
+  }
+
+  // Parse the spool options
+  sink_config_t sink_config;
+  sink_config.queue_size = queue_size;
+  uint32_t spool_max_mb = 64;
+  if (vm.count("spool_dir")) {
+    sink_config.spool_dir = vm["spool_dir"].as<std::string>();
+  }
+  if (vm.count("spool_max_mb")) {
+    spool_max_mb = vm["spool_max_mb"].as<uint32_t>();
+  }
+  sink_config.spool_max_bytes = uint64_t(spool_max_mb) << 20;
+  if (vm.count("spool_replay_rate")) {
+    sink_config.spool_replay_rate = vm["spool_replay_rate"].as<uint32_t>();
+  }
+  if (vm.count("compress_level")) {
+    sink_config.compress_level = vm["compress_level"].as<int>();
+  }
+  if (vm.count("compress_flush_ms")) {
+    sink_config.compress_flush_ms = vm["compress_flush_ms"].as<uint32_t>();
+  }
+
+  // Parse the channel recording options
+  std::string channel_record_dir = "";
+  iq_format_t channel_record_format = iq_format_t::CS16;
+  if (vm.count("channel_record_dir")) {
+    channel_record_dir = vm["channel_record_dir"].as<std::string>();
+  }
+  if (vm.count("channel_record_format") && !parse_iq_format(vm["channel_record_format"].as<std::string>(), channel_record_format)) {
+    std::cout << "Invalid channel_record_format value " << vm["channel_record_format"].as<std::string>() << ", use cf32, cs16 or cs8" << std::endl;
+    return 1;
+  }
+
+  // Parse the snippet options
+  snippet_config_t snippet_config;
+  if (vm.count("snippet_dir")) {
+    snippet_config.dir = vm["snippet_dir"].as<std::string>();
+  }
+  if (vm.count("snippet_on")) {
+    std::string triggers = vm["snippet_on"].as<std::string>();
+    snippet_config.on_detection = triggers.find("detection") != std::string::npos;
+    snippet_config.on_decode = triggers.find("decode") != std::string::npos;
+    snippet_config.on_crc_failures = triggers.find("crc") != std::string::npos;
+  }
+  if (vm.count("snippet_seconds")) {
+    snippet_config.ring_seconds = vm["snippet_seconds"].as<double>();
+  }
+  if (vm.count("snippet_pre")) {
+    snippet_config.pre_seconds = vm["snippet_pre"].as<double>();
+  }
+  if (vm.count("snippet_post")) {
+    snippet_config.post_seconds = vm["snippet_post"].as<double>();
+  }
+  if (vm.count("snippet_format") && !parse_iq_format(vm["snippet_format"].as<std::string>(), snippet_config.format)) {
+    std::cout << "Invalid snippet_format value " << vm["snippet_format"].as<std::string>() << ", use cf32, cs16 or cs8" << std::endl;
+    return 1;
+  }
+  snippet_config.channelize = vm.count("snippet_channelize") > 0;
+
+  // Thread placement and buffer sizes
+  layout_config_t layout_config;
+  layout_config.pin = vm.count("pin") > 0;
+  layout_config.mlock = vm.count("mlock") > 0;
+  const char *core_options[] = {"ingest_cores", "spectrum_cores", "channel_cores"};
+  std::vector<int> *core_lists[] = {&layout_config.ingest_cores, &layout_config.spectrum_cores, &layout_config.channel_cores};
+  for (int i = 0; i < 3; i++) {
+    if (vm.count(core_options[i]) && !parse_core_list(vm[core_options[i]].as<std::string>(), *core_lists[i])) {
+      std::cout << "Invalid " << core_options[i] << " value " << vm[core_options[i]].as<std::string>() << ", use a list like 0,2 or 2-7" << std::endl;
+      return 1;
+    }
+  }
+  if (vm.count("rt_priority")) {
+    layout_config.rt_priority = vm["rt_priority"].as<int>();
+    if (layout_config.rt_priority < 1 || layout_config.rt_priority > 99) {
+      std::cout << "Invalid rt_priority value " << layout_config.rt_priority << ", use 1 to 99" << std::endl;
+      return 1;
+    }
+  }
+  const char *stage_options[] = {"stage_max_noutput", "stage_buffer"};
+  for (int i = 0; i < 2; i++) {
+    if (!vm.count(stage_options[i])) {
+      continue;
+    }
+    std::vector<std::string> settings = vm[stage_options[i]].as<std::vector<std::string>>();
+    for (std::vector<std::string>::iterator it = settings.begin(); it != settings.end(); it++) {
+      std::string stage;
+      long value;
+      if (!parse_stage_setting(*it, stage, value)) {
+        std::cout << "Invalid " << stage_options[i] << " value " << *it << ", use stage=items" << std::endl;
+        return 1;
+      }
+      if (i == 0) {
+        layout_config.max_noutput_items[stage] = int(value);
+      } else {
+        layout_config.buffer_items[stage] = value;
+      }
+    }
+  }
+  flowgraph_layout_sptr layout = make_flowgraph_layout(layout_config);
+
   // Parse the source options
   std::string source_type = "sdr";
   bool throttle = false;
   bool save_samples = false;
+  bool offline = false;
+  bool channel_replay = false;
   std::string source_string = "";
+  iq_file_info_t file_info;
   if (vm.count("file")) {
     data_file = vm["file"].as<std::string>().c_str();
     source_type = "file";
     throttle = vm.count("throttle") > 0;
+    offline = vm.count("offline") > 0;
+    channel_replay = vm.count("channel_replay") > 0;
+
+    // A SigMF recording knows its own format, rate and frequency, anything
+    // given on the command line still wins
+    if (read_sigmf_meta(data_file, file_info)) {
+      if (!vm.count("sample_rate") && file_info.sample_rate > 0) {
+        sample_rate = file_info.sample_rate;
+      }
+      if (!vm.count("center_freq") && file_info.center_freq > 0) {
+        input_center_freq = uint32_t(file_info.center_freq);
+      }
+    } else {
+      iq_format_from_path(data_file, file_info.format);
+    }
+  } else if (vm.count("shm_iq")) {
+    // Another process owns the SDR, the ring says how it is set up
+    source_type = "shm";
+    source_string = vm["shm_iq"].as<std::string>();
+    shm_iq_source = gr::AltusDecoder::ShmIqSource::make(source_string);
+    if (!shm_iq_source->is_attached()) {
+      std::cout << "Couldn't attach to the IQ ring " << source_string << ", is altus-ingest running?" << std::endl;
+      return 1;
+    }
+    if (vm.count("sample_rate") || vm.count("center_freq")) {
+      std::cout << "[WARN] The IQ ring sets the sample rate and center frequency, ignoring the ones given" << std::endl;
+    }
+    sample_rate = shm_iq_source->sample_rate();
+    input_center_freq = uint32_t(shm_iq_source->center_freq());
   } else {
     save_samples = vm.count("save_samples") > 0;
     if (vm.count("source")) {
       source_string = vm["source"].as<std::string>();
     }
+    iq_format_from_path(data_file, file_info.format);
+  }
+
+  // More SDRs share the channel allocator and the outputs
+  std::vector<extra_source_t> extra_sources;
+  if (vm.count("sdr")) {
+    std::vector<std::string> specs = vm["sdr"].as<std::vector<std::string>>();
+    for (std::vector<std::string>::iterator it = specs.begin(); it != specs.end(); it++) {
+      extra_source_t extra;
+      if (!parse_extra_source(*it, extra)) {
+        std::cout << "Invalid sdr value " << *it << ", use center_freq:sample_rate:channels[:osmosdr args] with 1 to " << MAX_CHANNELS << " channels" << std::endl;
+        return 1;
+      }
+      extra_sources.push_back(extra);
+    }
+    if (source_type == "file") {
+      std::cout << "[WARN] Extra SDRs only apply to a live source, ignoring them" << std::endl;
+      extra_sources.clear();
+    }
+  }
+  if (vm.count("file_format") && !parse_iq_format(vm["file_format"].as<std::string>(), file_info.format)) {
+    std::cout << "Invalid file_format value " << vm["file_format"].as<std::string>() << ", use cf32, cs16 or cs8" << std::endl;
+    return 1;
+  }
+
+  receiver_config_t receiver_config;
+  receiver_config.center_freq = input_center_freq;
+  receiver_config.sample_rate = sample_rate;
+  receiver_config.channel_pool = vm.count("channel_pool") > 0;
+  if (vm.count("demod")) {
+    if (!parse_channel_demod(vm["demod"].as<std::string>(), receiver_config.demod)) {
+      std::cout << "Invalid demod value " << vm["demod"].as<std::string>() << ", use full or fast" << std::endl;
+      return 1;
+    }
+    if (receiver_config.demod == channel_demod_t::FAST && !receiver_config.channel_pool) {
+      std::cout << "The fast demodulator runs in the channel pool, using it" << std::endl;
+      receiver_config.channel_pool = true;
+    }
+  }
+  receiver_config.int16_frontend = vm.count("int16_frontend") > 0;
+  if (receiver_config.int16_frontend && !receiver_config.channel_pool) {
+    std::cout << "The int16 front end runs in the channel pool, using it" << std::endl;
+    receiver_config.channel_pool = true;
+  }
+  if (vm.count("pool_threads")) {
+    receiver_config.pool_threads = vm["pool_threads"].as<uint16_t>();
   }
 
-  uint32_t min_channel_freq = input_center_freq - (sample_rate * 0.4);
-  uint32_t max_channel_freq = input_center_freq + (sample_rate * 0.4);
+  // Size the channels and detector to the host, an explicit --channels wins
+  if (vm.count("autotune")) {
+    autotune_config_t autotune_config;
+    autotune_config.sample_rate = sample_rate;
+    autotune_config.center_freq = input_center_freq;
+    autotune_config.cache_path = vm.count("autotune_cache") ? vm["autotune_cache"].as<std::string>() : "altus-autotune.cache";
+    if (autotune_config.cache_path == "none") {
+      autotune_config.cache_path = "";
+    }
+    if (vm.count("autotune_headroom")) {
+      autotune_config.headroom = std::clamp(vm["autotune_headroom"].as<double>(), 0.0, 0.9);
+    }
+    if (source_type == "file") {
+      autotune_config.file = data_file;
+      autotune_config.file_format = file_info.format;
+    }
+    autotune_config.channel_pool = receiver_config.channel_pool;
+    autotune_config.pool_threads = receiver_config.pool_threads;
+    autotune_config.demod = receiver_config.demod;
+    autotune_config.int16_frontend = receiver_config.int16_frontend;
+
+    autotune_result_t autotune_result;
+    if (offline || channel_replay) {
+      std::cout << "[WARN] Autotune only applies to the live tracker, ignoring it" << std::endl;
+    } else if (run_autotune(autotune_config, autotune_result)) {
+      if (vm.count("channels")) {
+        std::cout << "  Keeping the " << channel_count << " channel(s) asked for with --channels" << std::endl;
+      } else {
+        channel_count = autotune_result.channel_count;
+      }
+      receiver_config.fft_size = autotune_result.fft_size;
+      receiver_config.detector_rate = autotune_result.detector_rate;
+    } else {
+      std::cout << "[WARN] Autotune failed, using the default settings" << std::endl;
+    }
+  }
+  receiver_config.channel_count = channel_count;
+  receiver_config.squelch = squelch;
+  receiver_config.spur_seconds = spur_seconds;
+  uint32_t min_channel_freq = receiver_config.min_channel_freq();
+  uint32_t max_channel_freq = receiver_config.max_channel_freq();
+
+  // Decode a recording as fast as the cores allow and exit
+  if (offline) {
+    offline_config_t offline_config;
+    offline_config.file_path = data_file;
+    offline_config.format = file_info.format;
+    offline_config.receiver = receiver_config;
+    offline_config.exclusions = exclusions;
+    offline_config.start_time_ms = iq_file_start_ms(data_file, file_info, sample_rate);
+    if (vm.count("threads")) {
+      offline_config.threads = vm["threads"].as<uint32_t>();
+    }
+    if (vm.count("segment_seconds")) {
+      offline_config.segment_seconds = vm["segment_seconds"].as<double>();
+    }
+    if (vm.count("overlap_seconds")) {
+      offline_config.overlap_seconds = vm["overlap_seconds"].as<double>();
+    }
+    if (vm.count("offline_out")) {
+      offline_config.out_path = vm["offline_out"].as<std::string>();
+    }
+    return decode_file_offline(offline_config) ? 0 : 1;
+  }
 
   std::cout << "**********" << std::endl << "SETTINGS" << std::endl;
   std::cout << "Source: ";
   if (source_type == "file") {
-    std::cout << data_file;
+    std::cout << data_file << " (" << iq_format_name(file_info.format) << ")";
     if (throttle) {
       std::cout << " (throttled)";
     }
+    if (channel_replay) {
+      std::cout << " (channel recording)";
+    }
+  } else if (source_type == "shm") {
+    std::cout << "IQ ring: " << source_string << " (" << shm_iq_source->capacity() << " samples)";
   } else {
     std::cout << "SDR";
     if (save_samples) {
-      std::cout << " (Samples Saved)";
+      std::cout << " (Samples Saved as " << iq_format_name(file_info.format) << ")";
     }
     if (source_string != "") {
       std::cout << ": " << source_string;
@@ -419,11 +1097,39 @@ int main(int argc, char **argv) {
   }
   std::cout << std::endl << "  Center Frequency: " << std::fixed << std::setprecision(4) << (float(input_center_freq) / 1000000) << " MHz";
   std::cout << std::endl << "  Sample Rate: " << std::fixed << std::setprecision(4) << (sample_rate / 1000000) << " MHz";
+  for (size_t i = 0; i < extra_sources.size(); i++) {
+    std::cout << std::endl << "Source " << (i + 1) << ": SDR";
+    if (extra_sources[i].args != "") {
+      std::cout << ": " << extra_sources[i].args;
+    }
+    std::cout << std::endl << "  Center Frequency: " << std::fixed << std::setprecision(4) << (float(extra_sources[i].center_freq) / 1000000) << " MHz";
+    std::cout << std::endl << "  Sample Rate: " << std::fixed << std::setprecision(4) << (extra_sources[i].sample_rate / 1000000) << " MHz";
+    std::cout << std::endl << "  Channels: " << extra_sources[i].channel_count;
+  }
   std::cout << std::endl << std::endl << "Channels:" << std::endl;
   std::cout << "  Number: " << std::fixed << std::setprecision(0) << channel_count << std::endl;
+  if (receiver_config.channel_pool) {
+    std::cout << "  Pool: " << (receiver_config.pool_threads > 0 ? std::to_string(receiver_config.pool_threads) : std::string("one per core")) << " thread(s)" << std::endl;
+  }
+  std::cout << "  Demodulator: " << channel_demod_name(receiver_config.demod) << std::endl;
+  if (receiver_config.int16_frontend) {
+    std::cout << "  Front End: int16" << std::endl;
+  }
+  std::cout << "  Detector: " << receiver_config.fft_size << " bins at " << receiver_config.detector_rate << " frames/s" << std::endl;
   std::cout << "  Min Freq: " << std::fixed << std::setprecision(4) << (float(min_channel_freq) / 1000000) << " MHz" << std::endl;
   std::cout << "  Max Freq: " << std::fixed << std::setprecision(4) << (float(max_channel_freq) / 1000000) << " MHz" << std::endl;
   std::cout << "  Min Amplitude: " << std::fixed << std::setprecision(0) << float(squelch) << " above noise" << std::endl;
+  std::cout << "  Spur Mask: ";
+  if (spur_seconds > 0) {
+    std::cout << "bins up for " << std::fixed << std::setprecision(1) << spur_seconds << " s";
+  } else {
+    std::cout << "exclusions only";
+  }
+  std::cout << ", " << exclusions.size() << " exclusion(s)";
+  if (spur_file != "") {
+    std::cout << ", " << saved_spurs.size() << " spur(s) from " << spur_file;
+  }
+  std::cout << std::endl;
   std::cout << std::endl << "Socket:" << std::endl;
   if (socket_host_is_ip) {
     std::cout << "  IP: " << socket_host << std::endl;
@@ -431,6 +1137,62 @@ int main(int argc, char **argv) {
     std::cout << "  Host: " << socket_host << std::endl;
   }
   std::cout << "  Port: " << std::fixed << std::setprecision(0) << socket_port << std::endl;
+  packet_ring = make_packet_ring(queue_size, queue_drop);
+  std::cout << "  Queue: " << std::fixed << std::setprecision(0) << packet_ring->capacity() << " packets, drop ";
+  std::cout << (queue_drop == drop_policy_t::DROP_OLDEST ? "oldest" : "newest") << std::endl;
+  if (sink_config.spool_dir != "") {
+    std::cout << "  Spool: " << sink_config.spool_dir << " (max " << spool_max_mb << " MB, replay ";
+    std::cout << sink_config.spool_replay_rate << " packets/s)" << std::endl;
+  }
+  if (sink_config.compress_level > 0) {
+    std::cout << "  Compression: zstd level " << sink_config.compress_level << ", a batch every ";
+    std::cout << sink_config.compress_flush_ms << " ms" << std::endl;
+  }
+
+  // Latency only means something when the samples arrive in real time
+  if (source_type != "file") {
+    sink_config.measure_latency = true;
+    decode_latency = make_latency_histogram();
+  }
+
+  // The main socket keeps the spool directory itself, any extra sinks get
+  // their own directory under it
+  sink_config_t main_sink_config = sink_config;
+  main_sink_config.name = "main";
+  if (main_sink_config.spool_dir != "") {
+    main_sink_config.policy = sink_policy_t::SPOOL;
+  }
+  sinks.push_back(std::make_shared<TcpSink>(
+    main_sink_config,
+    socket_host,
+    socket_host_is_ip,
+    socket_port,
+    handle_message
+  ));
+  if (vm.count("sink")) {
+    std::vector<std::string> sink_specs = vm["sink"].as<std::vector<std::string>>();
+    for (std::vector<std::string>::iterator it = sink_specs.begin(); it != sink_specs.end(); it++) {
+      packet_sink_sptr sink = make_packet_sink(*it, sink_config, handle_message);
+      if (sink == nullptr) {
+        return 1;
+      }
+      sinks.push_back(sink);
+    }
+  }
+  if (channel_record_dir != "") {
+    std::cout << std::endl << "Channel Recordings: " << channel_record_dir << " (" << iq_format_name(channel_record_format) << ")" << std::endl;
+  }
+  if (snippet_config.dir != "") {
+    std::cout << std::endl << "Snippets:" << std::endl;
+    std::cout << "  Directory: " << snippet_config.dir << std::endl;
+    std::cout << "  Window: " << std::fixed << std::setprecision(1) << snippet_config.pre_seconds << " s before, ";
+    std::cout << snippet_config.post_seconds << " s after (" << iq_format_name(snippet_config.format);
+    std::cout << (snippet_config.channelize ? ", channelized" : "") << ")" << std::endl;
+  }
+  std::cout << std::endl << "Outputs:" << std::endl;
+  for (std::vector<packet_sink_sptr>::iterator it = sinks.begin(); it != sinks.end(); it++) {
+    std::cout << "  " << (*it)->name() << std::endl;
+  }
   std::cout << "**********" << std::endl;
 
   // Build the top block
@@ -440,13 +1202,24 @@ int main(int argc, char **argv) {
   if (source_type == "file") {
     data_file = vm["file"].as<std::string>().c_str();
     std::cout << "Using data from file " << data_file << "\n";
+
+    // A cs16 file can feed an int16 pool as it is, unless something
+    // else on the tagger needs gr_complex
+    receiver_config.cs16_source = receiver_config.int16_frontend &&
+      file_info.format == iq_format_t::CS16 &&
+      snippet_config.dir == "" &&
+      !channel_replay;
     source = make_file_source(
       tb,
       data_file,
+      file_info.format,
+      receiver_config.cs16_source,
       throttle
     );
+  } else if (source_type == "shm") {
+    source = shm_iq_source;
+    layout->add_ingest({std::make_pair("shm_iq_source", shm_iq_source)});
   } else {
-    osmosdr::source::sptr osmo_source;
     if (source_string != "") {
       osmo_source = osmosdr::source::make(source_string);
     } else {
@@ -459,50 +1232,175 @@ int main(int argc, char **argv) {
     std::cout << "Radio source " << input_center_freq << "\n";
 
     if (save_samples) {
-      gr::blocks::file_sink::sptr file = gr::blocks::file_sink::make(
-        sizeof(gr_complex),
+      altus_iq_file_sink_sptr file = make_altus_iq_file_sink(
         data_file,
-        false
+        file_info.format
       );
       tb->connect(source, 0, file, 0);
+      layout->add_ingest(file->stage_blocks());
+
+      file_info.sample_rate = sample_rate;
+      file_info.center_freq = input_center_freq;
+      file_info.hardware = source_string;
+      write_sigmf_meta(data_file, file_info);
+    }
+  }
+
+  // Stamp the samples with their time, packets are timed from their sync word
+  tagger = gr::AltusDecoder::SampleTagger::make(
+    sample_rate,
+    0,
+    source_type == "file" ? iq_file_start_ms(data_file, file_info, sample_rate) : 0,
+    source_type != "file",
+    receiver_config.cs16_source ? 2 * sizeof(int16_t) : sizeof(gr_complex)
+  );
+  tb->connect(source, 0, tagger, 0);
+  source = tagger;
+  layout->add_ingest({std::make_pair("tagger", tagger)});
+
+  if (channel_replay) {
+    // A channel recording goes straight into a single channel
+    replay_channel = make_altus_channel(
+      input_center_freq,
+      double(input_center_freq),
+      sample_rate,
+      packet_ring,
+      0
+    );
+    tb->connect(source, 0, replay_channel, 0);
+    replay_channel->set_latency_histogram(decode_latency);
+  } else {
+    // Build the detector and channels
+    receivers.push_back(make_altus_receiver(
+      tb,
+      source,
+      receiver_config,
+      packet_ring,
+      channel_changed
+    ));
+
+    // Each extra SDR gets its own tagger, detector and channels, numbered
+    // after the ones before it
+    uint16_t first_channel = receiver_config.channel_count;
+    for (std::vector<extra_source_t>::iterator it = extra_sources.begin(); it != extra_sources.end(); it++) {
+      if (first_channel + it->channel_count > UINT8_MAX) {
+        std::cout << "[WARN] Too many channels, ignoring the SDR on " << it->center_freq << std::endl;
+        continue;
+      }
+      osmosdr::source::sptr extra_source = it->args != "" ? osmosdr::source::make(it->args) : osmosdr::source::make();
+      extra_source->set_sample_rate(it->sample_rate);
+      extra_source->set_center_freq(it->center_freq);
+      extra_source->set_gain_mode(true);
+      std::cout << "Radio source " << it->center_freq << "\n";
+
+      gr::AltusDecoder::SampleTagger::sptr extra_tagger = gr::AltusDecoder::SampleTagger::make(
+        it->sample_rate,
+        0,
+        0,
+        true,
+        sizeof(gr_complex)
+      );
+      tb->connect(extra_source, 0, extra_tagger, 0);
+      layout->add_ingest({std::make_pair("tagger", extra_tagger)});
+
+      receiver_config_t extra_config = receiver_config;
+      extra_config.center_freq = it->center_freq;
+      extra_config.sample_rate = it->sample_rate;
+      extra_config.channel_count = it->channel_count;
+      extra_config.first_channel = first_channel;
+      extra_config.cs16_source = false;
+      receivers.push_back(make_altus_receiver(
+        tb,
+        extra_tagger,
+        extra_config,
+        packet_ring,
+        channel_changed
+      ));
+      first_channel += it->channel_count;
+    }
+
+    // One allocator for every source, so a rocket seen by two is decoded once
+    channel_allocator = make_channel_allocator();
+    for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+      channel_allocator->add_receiver(*it);
+      (*it)->set_latency_histogram(decode_latency);
+      (*it)->set_exclusions(exclusions);
+      (*it)->add_learned_spurs(saved_spurs);
+      if (channel_record_dir != "") {
+        (*it)->enable_channel_recording(channel_record_dir, channel_record_format);
+      }
+    }
+
+    // An unthrottled file just runs slower, there is nothing to keep up with
+    if (vm.count("shed")) {
+      if (source_type == "file" && !throttle) {
+        std::cout << "[WARN] Load shedding only applies to live or throttled sources" << std::endl;
+      } else {
+        if (receivers.size() > 1) {
+          std::cout << "[WARN] Load shedding only watches the first source" << std::endl;
+        }
+        receivers[0]->enable_load_shedding();
+        load_shedder = make_load_shedder(receivers[0], tagger, sample_rate, shed_config_t());
+      }
     }
   }
 
-  // Generate all of the channel blocks
-  uint32_t channel_freq = uint32_t(min_channel_freq) + (ROUND_CHANNEL_TO / 2) - 1;
-  channel_freq -= channel_freq % ROUND_CHANNEL_TO;
-  for (uint8_t c = 0; c < channel_count; c++) {
-    build_channel(channel_freq);
-    channel_freq += ROUND_CHANNEL_TO * 2;
+  // Keep recent IQ for snippets around interesting events, on the first
+  // source only
+  if (snippet_config.dir != "" && receivers.size() > 0) {
+    snippet_config.center_freq = input_center_freq;
+    snippet_config.sample_rate = sample_rate;
+    snippet_recorder = gr::AltusDecoder::SnippetRecorder::make(
+      snippet_config
+    );
+    tb->connect(source, 0, snippet_recorder, 0);
+    layout->add_spectrum({std::make_pair("snippet_recorder", snippet_recorder)});
+    gr::AltusDecoder::SnippetRecorder::sptr recorder = snippet_recorder;
+    receivers[0]->set_event_handler([recorder](altus_event_t event, uint32_t freq) {
+      recorder->trigger(event, freq);
+    });
   }
 
-  // Open the socket and wait for events
-  std::thread packet_writer (
-    process_queue,
-    socket_host,
-    socket_host_is_ip,
-    socket_port
-  );
+  // The block counters are only switched on when someone is going to read
+  // them, they are picked up when the block threads start
+  metrics_server_sptr metrics_server;
+  if (vm.count("metrics")) {
+    metrics_server = make_metrics_server(vm["metrics"].as<std::string>(), write_metrics);
+    if (metrics_server == nullptr) {
+      std::cout << "Invalid metrics value " << vm["metrics"].as<std::string>() << ", use a port or unix:path" << std::endl;
+      return 1;
+    }
+    enable_perf_counters();
+    if (metrics_server->start()) {
+      std::cout << "Serving metrics on " << vm["metrics"].as<std::string>() << std::endl;
+    } else {
+      std::cout << "[WARN] Metrics disabled, the socket could not be opened" << std::endl;
+    }
+  }
 
-  // Build the detector
-  uint16_t fft_size = 1024;
-  auto b1 = make_altus_power_level(
-    sample_rate,
-    fft_size
-  );
-  tb->connect(source, 0, b1, 0);
-  auto b2 = gr::AltusDecoder::Detector::make(
-    add_channel,
-    input_center_freq,
-    sample_rate,
-    fft_size,
-    channel_count,
-    min_channel_freq,
-    max_channel_freq
+  // Open the sinks and wait for events
+  std::thread packet_writer (
+    process_queue
   );
-  tb->connect(b1, 0, b2, 0);
 
-  tb->start();
+  for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+    layout->add_spectrum((*it)->detector_stage_blocks());
+  }
+  if (receiver_config.channel_pool) {
+    for (std::vector<altus_receiver_sptr>::iterator it = receivers.begin(); it != receivers.end(); it++) {
+      layout->add_channel_pool((*it)->channel_stage_blocks()[0]);
+    }
+  } else {
+    std::vector<stage_blocks_t> channel_stages = all_channel_stages();
+    for (std::vector<stage_blocks_t>::iterator it = channel_stages.begin(); it != channel_stages.end(); it++) {
+      layout->add_channel(*it);
+    }
+  }
+  layout->start(tb);
+  layout->print(std::cout);
+  if (load_shedder != nullptr) {
+    load_shedder->start();
+  }
   std::signal(SIGINT, &signal_handler);
   std::cout << "\nRunning, press Ctrl + C to exit\n\n";
 
@@ -511,5 +1409,15 @@ int main(int argc, char **argv) {
   // tb->stop();
   std::cout << "\nDone Running\n\n";
   running = false;
+  if (load_shedder != nullptr) {
+    load_shedder->stop();
+  }
   packet_writer.join();
+  {
+    std::lock_guard<std::mutex> lock(control_mutex);
+    save_spur_mask();
+  }
+  if (metrics_server != nullptr) {
+    metrics_server->stop();
+  }
 }
@@ -0,0 +1,189 @@
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metrics_server.h"
+
+const int accept_wait_ms = 250;
+const int request_timeout_ms = 1000;
+const size_t max_request_size = 4096;
+const std::string unix_prefix = "unix:";
+
+metrics_server_sptr make_metrics_server(
+  const std::string &spec,
+  metrics_writer_t writer
+) {
+  if (spec.find(unix_prefix) != 0) {
+    try {
+      size_t used;
+      int port = std::stoi(spec, &used);
+      if (used != spec.length() || port <= 0 || port > 65535) {
+        return nullptr;
+      }
+    } catch (const std::exception &) {
+      return nullptr;
+    }
+  } else if (spec.length() == unix_prefix.length()) {
+    return nullptr;
+  }
+
+  return std::make_shared<MetricsServer>(spec, writer);
+}
+
+MetricsServer::MetricsServer(
+  const std::string &s,
+  metrics_writer_t w
+) {
+  spec = s;
+  writer = w;
+  running = false;
+}
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+bool MetricsServer::open_listener() {
+  if (spec.find(unix_prefix) == 0) {
+    unix_path = spec.substr(unix_prefix.length());
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (unix_path.length() >= sizeof(address.sun_path)) {
+      std::cout << "[metrics] Socket path too long: " << unix_path << std::endl;
+      return false;
+    }
+    std::strncpy(address.sun_path, unix_path.c_str(), sizeof(address.sun_path) - 1);
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      std::cout << "[metrics] Failed to create socket: " << strerror(errno) << std::endl;
+      return false;
+    }
+
+    // A socket left over from a previous run would stop the bind
+    unlink(unix_path.c_str());
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+      std::cout << "[metrics] Failed to bind " << unix_path << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+  } else {
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(std::stoi(spec));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      std::cout << "[metrics] Failed to create socket: " << strerror(errno) << std::endl;
+      return false;
+    }
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+      std::cout << "[metrics] Failed to bind port " << spec << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+  }
+
+  if (listen(listen_fd, 4) != 0) {
+    std::cout << "[metrics] Failed to listen: " << strerror(errno) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool MetricsServer::start() {
+  if (running) {
+    return true;
+  }
+  if (!open_listener()) {
+    if (listen_fd != -1) {
+      close(listen_fd);
+      listen_fd = -1;
+    }
+    return false;
+  }
+
+  running = true;
+  thread = std::thread(&MetricsServer::serve, this);
+  return true;
+}
+
+void MetricsServer::stop() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (listen_fd != -1) {
+    close(listen_fd);
+    listen_fd = -1;
+  }
+  if (unix_path != "") {
+    unlink(unix_path.c_str());
+  }
+}
+
+void MetricsServer::serve() {
+  while (running) {
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    if (::poll(&pfd, 1, accept_wait_ms) <= 0) {
+      continue;
+    }
+    int client = accept(listen_fd, NULL, NULL);
+    if (client < 0) {
+      continue;
+    }
+    handle_client(client);
+    close(client);
+  }
+}
+
+void MetricsServer::handle_client(int client) {
+  // Only the request line matters, read until the end of the headers
+  std::string request;
+  char buffer[512];
+  while (request.find("\r\n\r\n") == std::string::npos && request.length() < max_request_size) {
+    struct pollfd pfd = {client, POLLIN, 0};
+    if (::poll(&pfd, 1, request_timeout_ms) <= 0) {
+      return;
+    }
+    ssize_t count = read(client, buffer, sizeof(buffer));
+    if (count <= 0) {
+      return;
+    }
+    request.append(buffer, count);
+  }
+
+  std::stringstream body;
+  std::string status = "200 OK";
+  if (request.find("GET /metrics ") == 0 || request.find("GET / ") == 0) {
+    writer(body);
+  } else {
+    status = "404 Not Found";
+    body << "Metrics are at /metrics\n";
+  }
+
+  std::string content = body.str();
+  std::stringstream response;
+  response << "HTTP/1.0 " << status << "\r\n";
+  response << "Content-Type: text/plain; version=0.0.4\r\n";
+  response << "Content-Length: " << content.length() << "\r\n";
+  response << "Connection: close\r\n\r\n";
+  response << content;
+
+  std::string data = response.str();
+  size_t sent = 0;
+  while (sent < data.length()) {
+    ssize_t count = send(client, data.c_str() + sent, data.length() - sent, MSG_NOSIGNAL);
+    if (count <= 0) {
+      return;
+    }
+    sent += count;
+  }
+}
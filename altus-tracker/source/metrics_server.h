@@ -0,0 +1,73 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Writes the current metrics in the Prometheus text format
+ */
+typedef std::function<void (std::ostream &)> metrics_writer_t;
+
+class MetricsServer;
+
+typedef std::shared_ptr<MetricsServer> metrics_server_sptr;
+
+/**
+ * @brief Generate a metrics server
+ *
+ * @param spec A port to listen on at 127.0.0.1, or unix:path for a Unix socket
+ * @param writer Called on the server thread for each scrape
+ * @return metrics_server_sptr The server, nullptr if the spec is invalid
+ */
+metrics_server_sptr make_metrics_server(
+  const std::string &spec,
+  metrics_writer_t writer
+);
+
+/**
+ * Serves metrics over HTTP for Prometheus to scrape
+ *
+ * Listens on loopback or a Unix socket only, so nothing is exposed off the
+ * box. Requests are answered one at a time on the server's own thread, the
+ * metrics are only gathered when asked for.
+ */
+class MetricsServer {
+  private:
+    std::string spec;
+    metrics_writer_t writer;
+    int listen_fd = -1;
+    std::string unix_path;
+
+    std::thread thread;
+    std::atomic<bool> running;
+
+    bool open_listener();
+    void serve();
+    void handle_client(int client);
+
+  public:
+    MetricsServer(
+      const std::string &spec,
+      metrics_writer_t writer
+    );
+    ~MetricsServer();
+
+    /**
+     * @brief Open the socket and start answering requests
+     *
+     * @return true If the socket is listening
+     */
+    bool start();
+
+    /**
+     * @brief Stop answering and close the socket
+     */
+    void stop();
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include <gnuradio/top_block.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "offline_decoder.h"
+#include "altus_packet.h"
+#include "packet_ring.h"
+#include "blocks/altus_iq_file.h"
+#include "blocks/altus_sample_tagger.h"
+
+// Packets buffered per running segment between drains
+const size_t segment_ring_size = 4096;
+const std::chrono::milliseconds segment_drain_wait(50);
+
+struct segment_result_t {
+  std::vector<packet_slot_t> packets;
+  uint64_t dropped = 0;
+};
+
+static void decode_segment(
+  const offline_config_t &config,
+  const char *samples,
+  uint64_t first_sample,
+  uint64_t sample_count,
+  uint32_t index,
+  segment_result_t &result
+) {
+  gr::top_block_sptr tb = gr::make_top_block("AltusOffline " + std::to_string(index));
+  packet_ring_sptr ring = make_packet_ring(segment_ring_size, drop_policy_t::DROP_NEWEST);
+
+  // An int16 pool takes a cs16 file as it is
+  receiver_config_t receiver_config = config.receiver;
+  receiver_config.cs16_source = receiver_config.int16_frontend && config.format == iq_format_t::CS16;
+  altus_iq_file_source_sptr source = make_altus_iq_memory_source(
+    samples,
+    sample_count,
+    config.format,
+    receiver_config.cs16_source
+  );
+
+  // Tagged with the sample index in the whole file so the times line up
+  // across segments
+  gr::AltusDecoder::SampleTagger::sptr tagger = gr::AltusDecoder::SampleTagger::make(
+    receiver_config.sample_rate,
+    first_sample,
+    config.start_time_ms,
+    false,
+    AltusIqFileSource::output_item_size(config.format, receiver_config.cs16_source)
+  );
+  tb->connect(source, 0, tagger, 0);
+  altus_receiver_sptr receiver = make_altus_receiver(
+    tb,
+    tagger,
+    receiver_config,
+    ring,
+    nullptr
+  );
+  receiver->set_exclusions(config.exclusions);
+
+  // Drain the ring while the segment runs so long segments don't overflow it
+  std::atomic<bool> done(false);
+  tb->start();
+  std::thread waiter([&tb, &done]() {
+    tb->wait();
+    done = true;
+  });
+  packet_slot_t slot;
+  while (true) {
+    bool finished = done;
+    while (ring->pop(slot)) {
+      result.packets.push_back(slot);
+    }
+    if (finished) {
+      break;
+    }
+    std::this_thread::sleep_for(segment_drain_wait);
+  }
+  waiter.join();
+  result.dropped = ring->dropped();
+}
+
+// The same packet heard on the same channel, the AltOS tick in every packet
+// keeps repeats apart over a few segments
+static std::string packet_key(const packet_slot_t &packet) {
+  std::string key((const char *)packet.message, BYTES_PER_MESSAGE);
+  key.append((const char *)&packet.channel_freq, sizeof(packet.channel_freq));
+  return key;
+}
+
+bool decode_file_offline(const offline_config_t &config) {
+  size_t sample_size = iq_format_sample_size(config.format);
+  int fd = open(config.file_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    std::cout << "Failed to open " << config.file_path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || size_t(info.st_size) < sample_size) {
+    std::cout << "Failed to read the size of " << config.file_path << std::endl;
+    close(fd);
+    return false;
+  }
+  size_t file_size = info.st_size;
+  void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cout << "Failed to map " << config.file_path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  const char *samples = (const char *)map;
+
+  // Split the file up
+  uint64_t total_samples = file_size / sample_size;
+  uint64_t segment_samples = std::max(uint64_t(1), uint64_t(config.segment_seconds * config.receiver.sample_rate));
+  uint64_t overlap_samples = uint64_t(config.overlap_seconds * config.receiver.sample_rate);
+  uint32_t segment_count = (total_samples + segment_samples - 1) / segment_samples;
+  uint32_t threads = config.threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, segment_count);
+
+  double duration = double(total_samples) / config.receiver.sample_rate;
+  std::cout << "Decoding " << std::fixed << std::setprecision(1) << duration << " s of " << iq_format_name(config.format);
+  std::cout << " samples in " << segment_count << " segment(s) on " << threads << " thread(s)" << std::endl;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<segment_result_t> results(segment_count);
+  std::atomic<uint32_t> next_segment(0);
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&]() {
+      uint32_t index;
+      while ((index = next_segment++) < segment_count) {
+        uint64_t first = uint64_t(index) * segment_samples;
+        uint64_t last = std::min(total_samples, first + segment_samples + overlap_samples);
+        decode_segment(
+          config,
+          samples + first * sample_size,
+          first,
+          last - first,
+          index,
+          results[index]
+        );
+      }
+    }));
+  }
+  for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); it++) {
+    it->join();
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  munmap(map, file_size);
+
+  // Merge in segment order, anything the previous segment already had came
+  // from the overlap
+  std::vector<packet_slot_t> packets;
+  uint64_t duplicates = 0;
+  uint64_t dropped = 0;
+  std::set<std::string> previous_keys;
+  for (std::vector<segment_result_t>::iterator it = results.begin(); it != results.end(); it++) {
+    std::set<std::string> keys;
+    for (std::vector<packet_slot_t>::iterator packet = it->packets.begin(); packet != it->packets.end(); packet++) {
+      std::string key = packet_key(*packet);
+      if (previous_keys.count(key) > 0 || keys.count(key) > 0) {
+        duplicates++;
+        continue;
+      }
+      keys.insert(key);
+      packets.push_back(*packet);
+    }
+    previous_keys.swap(keys);
+    dropped += it->dropped;
+  }
+  std::stable_sort(packets.begin(), packets.end(), [](const packet_slot_t &a, const packet_slot_t &b) {
+    return a.time_ms < b.time_ms;
+  });
+
+  // Write the packets out
+  std::string out_path = config.out_path;
+  if (out_path == "") {
+    out_path = config.file_path + ".packets.ndjson";
+  }
+  std::ofstream out(out_path, std::ios::trunc);
+  if (!out.is_open()) {
+    std::cout << "Failed to open " << out_path << std::endl;
+    return false;
+  }
+  for (std::vector<packet_slot_t>::iterator it = packets.begin(); it != packets.end(); it++) {
+    std::unique_ptr<AltosBasePacket> packet(make_altus_packet(
+      it->message,
+      it->channel_freq,
+      it->time_ms
+    ));
+    out << packet->to_string() << '\n';
+  }
+  out.close();
+
+  std::cout << "Decoded " << packets.size() << " packet(s) to " << out_path << " (" << duplicates << " duplicate(s) removed";
+  if (dropped > 0) {
+    std::cout << ", " << dropped << " dropped, try shorter segments";
+  }
+  std::cout << ")" << std::endl;
+  std::cout << "Took " << std::fixed << std::setprecision(1) << wall << " s, ";
+  std::cout << std::fixed << std::setprecision(1) << (duration / wall) << "x real time" << std::endl;
+
+  return true;
+}
@@ -0,0 +1,50 @@
+#ifndef OFFLINE_DECODER_H
+#define OFFLINE_DECODER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "altus_receiver.h"
+#include "iq_format.h"
+
+/**
+ * @brief Settings for decoding a recording in parallel segments
+ */
+struct offline_config_t {
+  std::string file_path;
+  iq_format_t format = iq_format_t::CF32;
+  receiver_config_t receiver;
+
+  // Frequencies the detector ignores, as --exclude
+  std::vector<freq_range_t> exclusions;
+
+  // Time of the first sample, packets are timed from it
+  int64_t start_time_ms = 0;
+
+  // Segments decoded at once, 0 uses every core
+  uint32_t threads = 0;
+
+  // Each segment also decodes the first overlap_seconds of the next one, so a
+  // packet cut by the boundary (or missed while the next segment's detector
+  // settles) is still found once
+  double segment_seconds = 30;
+  double overlap_seconds = 2;
+
+  // NDJSON output, defaults to the recording path plus .packets.ndjson
+  std::string out_path;
+};
+
+/**
+ * @brief Decode a whole recording as fast as possible
+ * The file is memory mapped and split into overlapping segments, each run
+ * through its own receiver on a worker thread. The packets are merged with
+ * the duplicates from the overlaps removed, sorted by sample time, written out
+ * and the speed against real time is reported.
+ *
+ * @param config The offline settings
+ * @return true If the file was decoded
+ */
+bool decode_file_offline(const offline_config_t &config);
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * Bounded multi-producer queue based on the per-cell sequence number design
+ * (D. Vyukov). Each cell carries a sequence number that tells a producer or
+ * consumer whether the cell is ready for it, so the only shared writes are the
+ * CAS on the enqueue / dequeue positions.
+ */
+
+#include <algorithm>
+
+#include "packet_ring.h"
+
+bool parse_drop_policy(const std::string &name, drop_policy_t &policy) {
+  if (name == "oldest") {
+    policy = drop_policy_t::DROP_OLDEST;
+    return true;
+  }
+  if (name == "newest") {
+    policy = drop_policy_t::DROP_NEWEST;
+    return true;
+  }
+  return false;
+}
+
+packet_ring_sptr make_packet_ring(
+  size_t capacity,
+  drop_policy_t policy
+) {
+  return std::make_shared<PacketRing>(
+    capacity,
+    policy
+  );
+}
+
+PacketRing::PacketRing(
+  size_t capacity,
+  drop_policy_t drop_policy
+) {
+  size_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  cells.reset(new cell_t[size]);
+  for (size_t i = 0; i < size; i++) {
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  mask = size - 1;
+  policy = drop_policy;
+
+  enqueue_pos.store(0, std::memory_order_relaxed);
+  dequeue_pos.store(0, std::memory_order_relaxed);
+  pushed_count.store(0, std::memory_order_relaxed);
+  dropped_count.store(0, std::memory_order_relaxed);
+}
+
+PacketRing::~PacketRing() {}
+
+bool PacketRing::try_push(const packet_slot_t &packet) {
+  size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  cell_t *cell;
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    intptr_t dif = intptr_t(seq) - intptr_t(pos);
+    if (dif == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      // The cell still holds a packet from the previous lap, the ring is full
+      return false;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->packet = packet;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool PacketRing::push(const packet_slot_t &packet) {
+  pushed_count.fetch_add(1, std::memory_order_relaxed);
+
+  while (!try_push(packet)) {
+    // A consumer that has claimed the oldest cell but not copied it out yet
+    // makes the ring look full for a moment, wait for it rather than drop
+    if (size() < capacity()) {
+      continue;
+    }
+
+    dropped_count.fetch_add(1, std::memory_order_relaxed);
+    if (policy == drop_policy_t::DROP_NEWEST) {
+      return false;
+    }
+
+    // Make room by throwing away the oldest packet. If the consumer got there
+    // first the pop fails but there is room now, so either way try again.
+    packet_slot_t discarded;
+    if (!pop(discarded)) {
+      dropped_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  return true;
+}
+
+bool PacketRing::pop(packet_slot_t &packet) {
+  size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+  cell_t *cell;
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+    if (dif == 0) {
+      if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (dif < 0) {
+      // Nothing to read
+      return false;
+    } else {
+      pos = dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  packet = cell->packet;
+  cell->sequence.store(pos + mask + 1, std::memory_order_release);
+  return true;
+}
+
+size_t PacketRing::size() {
+  size_t dequeued = dequeue_pos.load(std::memory_order_acquire);
+  size_t enqueued = enqueue_pos.load(std::memory_order_acquire);
+  return enqueued - std::min(enqueued, dequeued);
+}
+
+size_t PacketRing::capacity() {
+  return mask + 1;
+}
+
+uint64_t PacketRing::pushed() {
+  return pushed_count.load(std::memory_order_relaxed);
+}
+
+uint64_t PacketRing::dropped() {
+  return dropped_count.load(std::memory_order_relaxed);
+}
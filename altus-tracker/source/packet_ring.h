@@ -0,0 +1,117 @@
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "constants.h"
+
+/**
+ * @brief A decoded packet as it sits in the queue
+ * The raw bytes are kept so that serialization happens on the consumer side
+ */
+struct packet_slot_t {
+  uint8_t message[BYTES_PER_MESSAGE];
+  double channel_freq;
+  int64_t time_ms;
+  uint8_t channel;
+};
+
+/**
+ * @brief What to throw away when the ring is full
+ */
+enum class drop_policy_t {
+  DROP_OLDEST,
+  DROP_NEWEST
+};
+
+/**
+ * @brief Parse a drop policy name ("oldest" or "newest")
+ *
+ * @param name The policy name
+ * @param policy Set to the parsed policy
+ * @return true If the name was valid
+ */
+bool parse_drop_policy(const std::string &name, drop_policy_t &policy);
+
+class PacketRing;
+
+typedef std::shared_ptr<PacketRing> packet_ring_sptr;
+
+/**
+ * @brief Generate a packet ring
+ *
+ * @param capacity The number of slots (rounded up to a power of 2)
+ * @param policy What to drop when the ring is full
+ * @return packet_ring_sptr The packet ring
+ */
+packet_ring_sptr make_packet_ring(
+  size_t capacity,
+  drop_policy_t policy
+);
+
+/**
+ * Bounded lock-free queue of fixed size packet slots
+ *
+ * Any number of threads may push (the channel decoders) and pop. Pushing never
+ * blocks or allocates, when the ring is full a packet is dropped according to
+ * the drop policy and counted.
+ */
+class PacketRing {
+  private:
+    struct cell_t {
+      std::atomic<size_t> sequence;
+      packet_slot_t packet;
+    };
+
+    std::unique_ptr<cell_t[]> cells;
+    size_t mask;
+    drop_policy_t policy;
+
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+
+    alignas(64) std::atomic<uint64_t> pushed_count;
+    std::atomic<uint64_t> dropped_count;
+
+    bool try_push(const packet_slot_t &packet);
+
+  public:
+    PacketRing(
+      size_t capacity,
+      drop_policy_t policy
+    );
+    ~PacketRing();
+
+    /**
+     * @brief Add a packet to the ring
+     *
+     * @param packet The packet to add
+     * @return true If the packet was queued (an older one may have been dropped)
+     * @return false If the packet was dropped
+     */
+    bool push(const packet_slot_t &packet);
+
+    /**
+     * @brief Remove the oldest packet from the ring
+     *
+     * @param packet Set to the removed packet
+     * @return true If a packet was removed
+     */
+    bool pop(packet_slot_t &packet);
+
+    /**
+     * @brief The packets queued, only a snapshot while other threads push
+     * and pop
+     */
+    size_t size();
+
+    size_t capacity();
+    uint64_t pushed();
+    uint64_t dropped();
+};
+
+#endif
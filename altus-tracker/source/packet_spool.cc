@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "packet_spool.h"
+
+// "ALTSPOOL" - marks a valid checkpoint file
+const uint64_t checkpoint_magic = 0x4c4f4f5053544c41;
+
+// Largest segment file, smaller caps get smaller segments
+const uint64_t max_segment_bytes = 1 << 20;
+
+static uint32_t fnv1a(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint32_t hash = 2166136261;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619;
+  }
+  return hash;
+}
+
+packet_spool_sptr make_packet_spool(
+  std::string dir,
+  uint64_t max_bytes
+) {
+  packet_spool_sptr spool = std::make_shared<PacketSpool>(
+    dir,
+    max_bytes
+  );
+  if (!spool->open()) {
+    return nullptr;
+  }
+  return spool;
+}
+
+PacketSpool::PacketSpool(
+  std::string spool_dir,
+  uint64_t max_bytes
+) {
+  dir = spool_dir;
+
+  uint64_t segment_bytes = std::min(max_bytes / 4, max_segment_bytes);
+  records_per_segment = std::max(uint64_t(16), segment_bytes / sizeof(record_t));
+  max_segments = std::max(uint64_t(2), max_bytes / (records_per_segment * sizeof(record_t)));
+
+  next_write_seq = 0;
+  next_send_seq = 0;
+  dropped_count = 0;
+  checkpoint_fd = -1;
+  checkpoint = nullptr;
+}
+
+PacketSpool::~PacketSpool() {
+  sync();
+  for (std::deque<segment_t>::iterator it = segments.begin(); it != segments.end(); it++) {
+    close_segment(*it, false);
+  }
+  if (checkpoint != nullptr) {
+    munmap(checkpoint, sizeof(checkpoint_t));
+  }
+  if (checkpoint_fd != -1) {
+    close(checkpoint_fd);
+  }
+}
+
+bool PacketSpool::open_segment(const std::string &path, uint64_t first_seq, bool create, segment_t &segment) {
+  size_t length = records_per_segment * sizeof(record_t);
+  int fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+  if (fd == -1) {
+    std::cout << "Failed to open spool segment " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (ftruncate(fd, length) != 0) {
+    std::cout << "Failed to size spool segment " << path << ": " << strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    std::cout << "Failed to map spool segment " << path << ": " << strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+
+  segment.first_seq = first_seq;
+  segment.count = 0;
+  segment.fd = fd;
+  segment.records = (record_t *)map;
+  segment.path = path;
+  return true;
+}
+
+void PacketSpool::close_segment(segment_t &segment, bool remove) {
+  munmap(segment.records, records_per_segment * sizeof(record_t));
+  close(segment.fd);
+  if (remove) {
+    unlink(segment.path.c_str());
+  }
+}
+
+void PacketSpool::recover_segment(segment_t &segment) {
+  // Keep the records up to the first one that is missing or torn
+  segment.count = 0;
+  while (segment.count < records_per_segment) {
+    record_t *record = &segment.records[segment.count];
+    if (
+      record->seq != segment.first_seq + segment.count ||
+      record->check != fnv1a(record, offsetof(record_t, check))
+    ) {
+      break;
+    }
+    segment.count++;
+  }
+}
+
+bool PacketSpool::open() {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    std::cout << "Failed to create spool directory " << dir << ": " << ec.message() << std::endl;
+    return false;
+  }
+
+  // Map the checkpoint
+  std::string checkpoint_path = dir + "/checkpoint";
+  checkpoint_fd = ::open(checkpoint_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (checkpoint_fd == -1) {
+    std::cout << "Failed to open spool checkpoint " << checkpoint_path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (ftruncate(checkpoint_fd, sizeof(checkpoint_t)) != 0) {
+    std::cout << "Failed to size spool checkpoint: " << strerror(errno) << std::endl;
+    return false;
+  }
+  void *map = mmap(NULL, sizeof(checkpoint_t), PROT_READ | PROT_WRITE, MAP_SHARED, checkpoint_fd, 0);
+  if (map == MAP_FAILED) {
+    std::cout << "Failed to map spool checkpoint: " << strerror(errno) << std::endl;
+    return false;
+  }
+  checkpoint = (checkpoint_t *)map;
+  bool have_checkpoint = checkpoint->magic == checkpoint_magic &&
+    checkpoint->check == fnv1a(checkpoint, offsetof(checkpoint_t, check));
+  if (have_checkpoint) {
+    next_send_seq = checkpoint->next_seq;
+  }
+
+  // Find the segments left from the last run
+  std::vector<uint64_t> first_seqs;
+  for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(dir, ec)) {
+    std::string name = entry.path().filename().string();
+    if (entry.path().extension() != ".seg") {
+      continue;
+    }
+    try {
+      first_seqs.push_back(std::stoull(name.substr(0, name.length() - 4)));
+    } catch (...) {
+      std::cout << "Ignoring unknown spool file " << name << std::endl;
+    }
+  }
+  std::sort(first_seqs.begin(), first_seqs.end());
+
+  for (std::vector<uint64_t>::iterator it = first_seqs.begin(); it != first_seqs.end(); it++) {
+    std::stringstream path;
+    path << dir << "/" << std::setw(20) << std::setfill('0') << *it << ".seg";
+
+    segment_t segment;
+    if (!open_segment(path.str(), *it, false, segment)) {
+      continue;
+    }
+    recover_segment(segment);
+
+    // Anything after a gap can't be trusted to be in order
+    if (segments.size() > 0 && segment.first_seq != segments.back().first_seq + segments.back().count) {
+      std::cout << "Discarding out of sequence spool segment " << segment.path << std::endl;
+      close_segment(segment, true);
+      continue;
+    }
+    segments.push_back(segment);
+  }
+
+  if (segments.size() > 0) {
+    next_write_seq = segments.back().first_seq + segments.back().count;
+    if (!have_checkpoint || next_send_seq < segments.front().first_seq) {
+      next_send_seq = segments.front().first_seq;
+    }
+  } else {
+    next_write_seq = next_send_seq;
+  }
+  if (next_send_seq > next_write_seq) {
+    next_send_seq = next_write_seq;
+  }
+  write_checkpoint();
+  drop_sent_segments();
+
+  if (pending() > 0) {
+    std::cout << "Recovered " << pending() << " unsent packet(s) from spool " << dir << std::endl;
+  }
+  return true;
+}
+
+void PacketSpool::write_checkpoint() {
+  checkpoint->magic = checkpoint_magic;
+  checkpoint->next_seq = next_send_seq;
+  checkpoint->check = fnv1a(checkpoint, offsetof(checkpoint_t, check));
+}
+
+void PacketSpool::drop_sent_segments() {
+  while (
+    segments.size() > 0 &&
+    segments.front().first_seq + segments.front().count <= next_send_seq &&
+    (segments.front().count == records_per_segment || segments.size() == 1)
+  ) {
+    close_segment(segments.front(), true);
+    segments.pop_front();
+  }
+}
+
+void PacketSpool::append(const packet_slot_t &packet) {
+  if (segments.size() == 0 || segments.back().count >= records_per_segment) {
+    // Make room by throwing away the oldest segment
+    if (segments.size() >= max_segments) {
+      segment_t &oldest = segments.front();
+      uint64_t oldest_end = oldest.first_seq + oldest.count;
+      if (next_send_seq < oldest_end) {
+        dropped_count += oldest_end - next_send_seq;
+        std::cout << "[WARN] Spool full, dropped " << (oldest_end - next_send_seq) << " packet(s)" << std::endl;
+        next_send_seq = oldest_end;
+        write_checkpoint();
+      }
+      close_segment(oldest, true);
+      segments.pop_front();
+    }
+
+    std::stringstream path;
+    path << dir << "/" << std::setw(20) << std::setfill('0') << next_write_seq << ".seg";
+    segment_t segment;
+    if (!open_segment(path.str(), next_write_seq, true, segment)) {
+      dropped_count++;
+      return;
+    }
+    segments.push_back(segment);
+  }
+
+  segment_t &segment = segments.back();
+  record_t record;
+  std::memset(&record, 0, sizeof(record));
+  record.seq = next_write_seq;
+  record.packet = packet;
+  record.check = fnv1a(&record, offsetof(record_t, check));
+  std::memcpy(&segment.records[segment.count], &record, sizeof(record));
+
+  segment.count++;
+  next_write_seq++;
+}
+
+size_t PacketSpool::peek(packet_slot_t *packets, size_t max) {
+  size_t copied = 0;
+  uint64_t seq = next_send_seq;
+  for (std::deque<segment_t>::iterator it = segments.begin(); it != segments.end() && copied < max; it++) {
+    while (seq < it->first_seq + it->count && copied < max) {
+      packets[copied] = it->records[seq - it->first_seq].packet;
+      copied++;
+      seq++;
+    }
+  }
+  return copied;
+}
+
+void PacketSpool::ack(size_t count) {
+  next_send_seq = std::min(next_send_seq + count, next_write_seq);
+  write_checkpoint();
+  drop_sent_segments();
+}
+
+void PacketSpool::sync() {
+  for (std::deque<segment_t>::iterator it = segments.begin(); it != segments.end(); it++) {
+    msync(it->records, records_per_segment * sizeof(record_t), MS_ASYNC);
+  }
+  if (checkpoint != nullptr) {
+    msync(checkpoint, sizeof(checkpoint_t), MS_ASYNC);
+  }
+}
+
+bool PacketSpool::empty() {
+  return next_send_seq == next_write_seq;
+}
+
+uint64_t PacketSpool::pending() {
+  return next_write_seq - next_send_seq;
+}
+
+uint64_t PacketSpool::dropped() {
+  return dropped_count;
+}
@@ -0,0 +1,124 @@
+#ifndef PACKET_SPOOL_H
+#define PACKET_SPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "packet_ring.h"
+
+class PacketSpool;
+
+typedef std::shared_ptr<PacketSpool> packet_spool_sptr;
+
+/**
+ * @brief Open (or create) a packet spool, recovering anything left in it
+ *
+ * @param dir The directory to keep the spool files in
+ * @param max_bytes The most disk space the spool may use
+ * @return packet_spool_sptr The spool, or nullptr if it could not be opened
+ */
+packet_spool_sptr make_packet_spool(
+  std::string dir,
+  uint64_t max_bytes
+);
+
+/**
+ * On-disk queue of packets that could not be sent
+ *
+ * Packets are appended to fixed size memory-mapped segment files, each record
+ * carrying a sequence number and a checksum so a torn write is found on
+ * recovery. A checkpoint file holds the sequence number of the next packet to
+ * send and is only advanced once the packets made it to the socket. When the
+ * disk cap is hit the oldest segment is thrown away.
+ */
+class PacketSpool {
+  private:
+    struct record_t {
+      uint64_t seq;
+      packet_slot_t packet;
+      uint32_t check;
+    };
+
+    struct checkpoint_t {
+      uint64_t magic;
+      uint64_t next_seq;
+      uint32_t check;
+    };
+
+    struct segment_t {
+      uint64_t first_seq;
+      uint32_t count;
+      int fd;
+      record_t *records;
+      std::string path;
+    };
+
+    std::string dir;
+    uint32_t records_per_segment;
+    size_t max_segments;
+
+    std::deque<segment_t> segments;
+    uint64_t next_write_seq;
+    uint64_t next_send_seq;
+    uint64_t dropped_count;
+
+    int checkpoint_fd;
+    checkpoint_t *checkpoint;
+
+    bool open_segment(const std::string &path, uint64_t first_seq, bool create, segment_t &segment);
+    void close_segment(segment_t &segment, bool remove);
+    void recover_segment(segment_t &segment);
+    void write_checkpoint();
+    void drop_sent_segments();
+
+  public:
+    PacketSpool(
+      std::string dir,
+      uint64_t max_bytes
+    );
+    ~PacketSpool();
+
+    /**
+     * @brief Map the checkpoint and any existing segments
+     *
+     * @return true If the spool is usable
+     */
+    bool open();
+
+    /**
+     * @brief Add a packet to the end of the spool
+     *
+     * @param packet The packet to save
+     */
+    void append(const packet_slot_t &packet);
+
+    /**
+     * @brief Copy unsent packets out of the spool without removing them
+     *
+     * @param packets Where to copy the packets
+     * @param max The most packets to copy
+     * @return size_t The number of packets copied
+     */
+    size_t peek(packet_slot_t *packets, size_t max);
+
+    /**
+     * @brief Mark packets returned by peek as sent and checkpoint
+     *
+     * @param count The number of packets sent
+     */
+    void ack(size_t count);
+
+    /**
+     * @brief Flush the mapped segments and checkpoint to disk
+     */
+    void sync();
+
+    bool empty();
+    uint64_t pending();
+    uint64_t dropped();
+};
+
+#endif
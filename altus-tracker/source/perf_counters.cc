@@ -0,0 +1,98 @@
+#include <gnuradio/block_detail.h>
+#include <gnuradio/high_res_timer.h>
+#include <gnuradio/prefs.h>
+
+#include <functional>
+#include <iomanip>
+
+#include "perf_counters.h"
+
+void enable_perf_counters() {
+  gr::prefs *prefs = gr::prefs::singleton();
+  prefs->set_bool("PerfCounters", "on", true);
+  prefs->set_string("PerfCounters", "clock", "thread");
+}
+
+double block_cpu_seconds(gr::block_sptr block) {
+  if (block == nullptr) {
+    return 0;
+  }
+  return double(block->pc_work_time_total()) / gr::high_res_timer_tps();
+}
+
+double stages_cpu_seconds(const stage_blocks_t &stages) {
+  double seconds = 0;
+  for (stage_blocks_t::const_iterator it = stages.begin(); it != stages.end(); it++) {
+    seconds += block_cpu_seconds(it->second);
+  }
+  return seconds;
+}
+
+void read_stage_metrics(
+  const std::string &channel,
+  const stage_blocks_t &stages,
+  std::vector<block_metrics_t> &metrics
+) {
+  for (stage_blocks_t::const_iterator it = stages.begin(); it != stages.end(); it++) {
+    gr::block_sptr block = it->second;
+    if (block == nullptr || block->detail() == nullptr) {
+      continue;
+    }
+
+    block_metrics_t m;
+    m.channel = channel;
+    m.stage = it->first;
+    m.work_seconds = block_cpu_seconds(block);
+    m.nproduced_avg = block->pc_nproduced_avg();
+    if (block->detail()->ninputs() > 0) {
+      m.items_in = block->nitems_read(0);
+      m.input_full = block->pc_input_buffers_full_avg(0);
+    }
+    if (block->detail()->noutputs() > 0) {
+      m.items_out = block->nitems_written(0);
+      m.output_full = block->pc_output_buffers_full_avg(0);
+    }
+    metrics.push_back(m);
+  }
+}
+
+static void write_family(
+  std::ostream &out,
+  const std::vector<block_metrics_t> &metrics,
+  const std::string &name,
+  const std::string &type,
+  const std::string &help,
+  std::function<double (const block_metrics_t &)> value
+) {
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " " << type << "\n";
+  for (std::vector<block_metrics_t>::const_iterator it = metrics.begin(); it != metrics.end(); it++) {
+    double v = value(*it);
+    if (v < 0) {
+      continue;
+    }
+    out << name << "{channel=\"" << it->channel << "\",stage=\"" << it->stage << "\"} ";
+    out << std::setprecision(9) << std::defaultfloat << v << "\n";
+  }
+}
+
+void write_block_metrics(std::ostream &out, const std::vector<block_metrics_t> &metrics) {
+  write_family(out, metrics, "altus_block_work_seconds_total", "counter",
+    "CPU time spent in the block's work function",
+    [](const block_metrics_t &m) { return m.work_seconds; });
+  write_family(out, metrics, "altus_block_items_in_total", "counter",
+    "Items consumed from the block's input",
+    [](const block_metrics_t &m) { return double(m.items_in); });
+  write_family(out, metrics, "altus_block_items_out_total", "counter",
+    "Items produced on the block's output",
+    [](const block_metrics_t &m) { return double(m.items_out); });
+  write_family(out, metrics, "altus_block_nproduced_avg", "gauge",
+    "Average items produced per work call",
+    [](const block_metrics_t &m) { return double(m.nproduced_avg); });
+  write_family(out, metrics, "altus_block_input_buffer_full", "gauge",
+    "Average fullness of the block's input buffer, near 1 means the block can't keep up",
+    [](const block_metrics_t &m) { return double(m.input_full); });
+  write_family(out, metrics, "altus_block_output_buffer_full", "gauge",
+    "Average fullness of the block's output buffer, near 1 means downstream can't keep up",
+    [](const block_metrics_t &m) { return double(m.output_full); });
+}
@@ -0,0 +1,79 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <gnuradio/block.h>
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The GNU Radio blocks inside a hier block, named by processing stage
+ */
+typedef std::vector<std::pair<std::string, gr::block_sptr>> stage_blocks_t;
+
+/**
+ * @brief Turn on GNU Radio's per-block performance counters, timed with the
+ * thread CPU clock
+ * Must be called before the flowgraph starts, the counters are only read when
+ * the block threads are created. Does nothing if GNU Radio was built without
+ * them, the counters then stay at 0.
+ */
+void enable_perf_counters();
+
+/**
+ * @brief The CPU time a block has spent in work() since the flowgraph started
+ *
+ * @param block The block
+ * @return double The time (in seconds), 0 if the counters are off
+ */
+double block_cpu_seconds(gr::block_sptr block);
+
+/**
+ * @brief The CPU time spent in work() by all of the blocks of a stage list
+ *
+ * @param stages The blocks
+ * @return double The time (in seconds), 0 if the counters are off
+ */
+double stages_cpu_seconds(const stage_blocks_t &stages);
+
+/**
+ * @brief A snapshot of one block's counters
+ */
+struct block_metrics_t {
+  std::string channel;          // Channel index, or "detector"
+  std::string stage;
+  double work_seconds = 0;      // CPU time in work()
+  uint64_t items_in = 0;        // Items read from the first input
+  uint64_t items_out = 0;       // Items written to the first output
+  float nproduced_avg = 0;      // Items produced per work() call
+  float input_full = -1;        // Average fullness of the first input buffer (0 to 1, -1 if none)
+  float output_full = -1;       // Average fullness of the first output buffer (0 to 1, -1 if none)
+};
+
+/**
+ * @brief Read the counters of a list of blocks
+ * Only reads values the block threads already keep, so it is cheap enough to
+ * call on every scrape
+ *
+ * @param channel The channel label for the blocks
+ * @param stages The blocks
+ * @param metrics The snapshots are appended here
+ */
+void read_stage_metrics(
+  const std::string &channel,
+  const stage_blocks_t &stages,
+  std::vector<block_metrics_t> &metrics
+);
+
+/**
+ * @brief Write block snapshots in the Prometheus text format, labelled by
+ * channel and stage
+ *
+ * @param out The stream to write to
+ * @param metrics The snapshots
+ */
+void write_block_metrics(std::ostream &out, const std::vector<block_metrics_t> &metrics);
+
+#endif
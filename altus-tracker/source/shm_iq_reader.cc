@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_iq_reader.h"
+
+ShmIqReader::ShmIqReader(std::string shm_name) {
+  name = shm_name;
+  fd = -1;
+  map_size = 0;
+  header = nullptr;
+  samples = nullptr;
+  capacity = 0;
+  mask = 0;
+  next_sample = 0;
+  lap_count = 0;
+  skipped_count = 0;
+  reset_count = 0;
+}
+
+ShmIqReader::~ShmIqReader() {
+  if (header != nullptr) {
+    munmap(header, map_size);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+bool ShmIqReader::map(int file) {
+  struct stat info;
+  if (fstat(file, &info) != 0 || size_t(info.st_size) < SHM_IQ_DATA_OFFSET) {
+    return false;
+  }
+  void *m = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+  if (m == MAP_FAILED) {
+    return false;
+  }
+
+  shm_iq_header_t *h = (shm_iq_header_t *)m;
+  if (
+    h->magic != SHM_IQ_MAGIC ||
+    h->version != SHM_IQ_VERSION ||
+    h->sample_size != sizeof(shm_iq_sample_t) ||
+    h->capacity == 0 ||
+    (h->capacity & (h->capacity - 1)) != 0 ||
+    size_t(info.st_size) < shm_iq_ring_size(h->capacity)
+  ) {
+    munmap(m, info.st_size);
+    return false;
+  }
+
+  fd = file;
+  map_size = info.st_size;
+  header = h;
+  samples = shm_iq_samples(h);
+  capacity = h->capacity;
+  mask = capacity - 1;
+  return true;
+}
+
+bool ShmIqReader::open() {
+  // The writer puts the ring on hugetlbfs when it can and removes a stale
+  // one when it can't, so look there first
+  int file = ::open(shm_iq_hugepage_path(name).c_str(), O_RDONLY);
+  if (file != -1 && !map(file)) {
+    close(file);
+    file = -1;
+  }
+  if (file == -1) {
+    file = shm_open(name.c_str(), O_RDONLY, 0);
+    if (file == -1) {
+      std::cout << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+      return false;
+    }
+    if (!map(file)) {
+      std::cout << "Shared memory " << name << " is not a compatible IQ ring" << std::endl;
+      close(file);
+      return false;
+    }
+  }
+
+  next_sample = header->write_sample.load(std::memory_order_acquire);
+  return true;
+}
+
+size_t ShmIqReader::read(shm_iq_sample_t *out, size_t max) {
+  for (;;) {
+    uint64_t write_sample = header->write_sample.load(std::memory_order_acquire);
+    if (write_sample < next_sample) {
+      // The writer started again with a fresh ring
+      reset_count++;
+      next_sample = write_sample;
+      return 0;
+    }
+    if (write_sample == next_sample) {
+      return 0;
+    }
+
+    // Skip to the newest samples if the writer has lapped us
+    if (write_sample - next_sample > capacity) {
+      lap_count++;
+      skipped_count += write_sample - next_sample;
+      next_sample = write_sample;
+      return 0;
+    }
+
+    size_t n = std::min(uint64_t(max), write_sample - next_sample);
+    size_t offset = next_sample & mask;
+    size_t first = std::min(n, size_t(capacity - offset));
+    std::memcpy(out, samples + offset, first * sizeof(shm_iq_sample_t));
+    if (first < n) {
+      std::memcpy(out + first, samples, (n - first) * sizeof(shm_iq_sample_t));
+    }
+
+    // Anything the writer claimed a ring past our first sample may have been
+    // overwritten while we copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t claim_sample = header->claim_sample.load(std::memory_order_relaxed);
+    if (claim_sample > next_sample + capacity) {
+      lap_count++;
+      uint64_t newest = header->write_sample.load(std::memory_order_acquire);
+      skipped_count += newest - next_sample;
+      next_sample = newest;
+      continue;
+    }
+
+    next_sample += n;
+    return n;
+  }
+}
+
+uint64_t ShmIqReader::laps() {
+  return lap_count;
+}
+
+uint64_t ShmIqReader::skipped() {
+  return skipped_count;
+}
+
+uint64_t ShmIqReader::resets() {
+  return reset_count;
+}
+
+uint64_t ShmIqReader::backlog() {
+  uint64_t write_sample = header->write_sample.load(std::memory_order_acquire);
+  return write_sample > next_sample ? write_sample - next_sample : 0;
+}
+
+uint64_t ShmIqReader::ring_capacity() {
+  return capacity;
+}
+
+int64_t ShmIqReader::writer_idle_ms() {
+  int64_t last = header->write_time_ms.load(std::memory_order_relaxed);
+  if (last == 0) {
+    return -1;
+  }
+  int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+  return std::max(int64_t(0), now - last);
+}
+
+double ShmIqReader::sample_rate() {
+  return header->sample_rate;
+}
+
+double ShmIqReader::center_freq() {
+  return header->center_freq;
+}
@@ -0,0 +1,100 @@
+#ifndef SHM_IQ_READER_H
+#define SHM_IQ_READER_H
+
+#include <cstdint>
+#include <string>
+
+#include "shm_iq_ring.h"
+
+/**
+ * Reads the IQ stream published by altus-ingest
+ *
+ * Readers never write to the ring, so any number can attach without slowing
+ * the ingest down. A reader that falls more than a ring behind, or is caught
+ * by the writer while copying, skips to the newest samples and counts what it
+ * missed.
+ */
+class ShmIqReader {
+  private:
+    std::string name;
+    int fd;
+    size_t map_size;
+    shm_iq_header_t *header;
+    const shm_iq_sample_t *samples;
+    uint64_t capacity;
+    uint64_t mask;
+
+    uint64_t next_sample;
+    uint64_t lap_count;
+    uint64_t skipped_count;
+    uint64_t reset_count;
+
+    bool map(int file);
+
+  public:
+    /**
+     * @brief Construct a new reader, call open before reading
+     *
+     * @param name The shared memory object name
+     */
+    ShmIqReader(std::string name);
+    ~ShmIqReader();
+
+    /**
+     * @brief Attach to the ring, starting at the newest sample
+     *
+     * @return true If the ring exists and has a known layout
+     */
+    bool open();
+
+    /**
+     * @brief Copy out the next samples
+     *
+     * @param out Where to copy the samples
+     * @param max The most samples to copy
+     * @return The number of samples copied, 0 when there are no new ones
+     */
+    size_t read(shm_iq_sample_t *out, size_t max);
+
+    /**
+     * @brief The number of times the writer lapped this reader
+     */
+    uint64_t laps();
+
+    /**
+     * @brief The number of samples skipped because the writer lapped this reader
+     */
+    uint64_t skipped();
+
+    /**
+     * @brief The number of times the writer started the ring again
+     */
+    uint64_t resets();
+
+    /**
+     * @brief The number of samples written but not read yet
+     */
+    uint64_t backlog();
+
+    /**
+     * @brief The number of samples the ring holds
+     */
+    uint64_t ring_capacity();
+
+    /**
+     * @brief The time since the writer last wrote, -1 if it hasn't yet
+     */
+    int64_t writer_idle_ms();
+
+    /**
+     * @brief The sample rate of the stream
+     */
+    double sample_rate();
+
+    /**
+     * @brief The frequency of the receiver (in Hz)
+     */
+    double center_freq();
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef SHM_IQ_RING_H
+#define SHM_IQ_RING_H
+
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// "ALTSHMIQ" - marks an initialized ring
+#define SHM_IQ_MAGIC 0x51494d4853544c41
+
+// Bump when the layout below changes
+#define SHM_IQ_VERSION 1
+
+// Default shared memory object name
+#define SHM_IQ_DEFAULT_NAME "/altus-iq"
+
+// Where hugetlbfs is mounted, the ring goes here when there are huge pages free
+#define SHM_IQ_HUGEPAGE_DIR "/dev/hugepages"
+
+// The samples start a page in, the whole map is a multiple of a huge page
+#define SHM_IQ_DATA_OFFSET 4096
+#define SHM_IQ_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+typedef std::complex<float> shm_iq_sample_t;
+
+/**
+ * Layout of the shared memory IQ ring
+ *
+ * There is one writer (altus-ingest) and any number of readers. Sample i
+ * lives at i % capacity. Before overwriting samples the writer moves
+ * claim_sample to the end of what it is about to write, and once they are in
+ * place it moves write_sample there too. A reader copies out samples below
+ * write_sample, then checks claim_sample to tell whether the writer got into
+ * them while it was copying (it was lapped).
+ */
+struct shm_iq_header_t {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t sample_size;
+  uint64_t capacity;                          // Samples, a power of two
+  double sample_rate;
+  double center_freq;
+  alignas(64) std::atomic<uint64_t> claim_sample;
+  alignas(64) std::atomic<uint64_t> write_sample;
+  std::atomic<int64_t> write_time_ms;        // Wall clock of the last write
+};
+
+static_assert(sizeof(shm_iq_header_t) <= SHM_IQ_DATA_OFFSET, "IQ ring header must fit before the samples");
+
+/**
+ * @brief The number of bytes to map for a ring with the given capacity
+ */
+inline size_t shm_iq_ring_size(uint64_t capacity) {
+  size_t size = SHM_IQ_DATA_OFFSET + capacity * sizeof(shm_iq_sample_t);
+  return (size + SHM_IQ_HUGEPAGE_SIZE - 1) / SHM_IQ_HUGEPAGE_SIZE * SHM_IQ_HUGEPAGE_SIZE;
+}
+
+/**
+ * @brief The samples follow the header, a page in
+ */
+inline shm_iq_sample_t *shm_iq_samples(shm_iq_header_t *header) {
+  return (shm_iq_sample_t *)((char *)header + SHM_IQ_DATA_OFFSET);
+}
+
+/**
+ * @brief The hugetlbfs file used for a shared memory name
+ */
+inline std::string shm_iq_hugepage_path(const std::string &name) {
+  return std::string(SHM_IQ_HUGEPAGE_DIR) + "/" + (name.size() > 0 && name[0] == '/' ? name.substr(1) : name);
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_iq_writer.h"
+
+// Samples written between moves of write_sample, so readers see a steady
+// stream and a big block can't lap the ring in one go
+const size_t max_write_chunk = 65536;
+
+static int64_t now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+}
+
+ShmIqWriter::ShmIqWriter(std::string shm_name) {
+  name = shm_name;
+  fd = -1;
+  map_size = 0;
+  huge_pages = false;
+  header = nullptr;
+  samples = nullptr;
+  mask = 0;
+}
+
+ShmIqWriter::~ShmIqWriter() {
+  if (header != nullptr) {
+    munmap(header, map_size);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+bool ShmIqWriter::map_hugepages() {
+  std::string path = shm_iq_hugepage_path(name);
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    return false;
+  }
+
+  // hugetlbfs reserves the pages when mapping, so a shortage fails here
+  // rather than with a SIGBUS later
+  struct stat info;
+  bool sized = fstat(fd, &info) == 0 && size_t(info.st_size) == map_size;
+  void *map = MAP_FAILED;
+  if (sized || ftruncate(fd, map_size) == 0) {
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (map == MAP_FAILED) {
+    std::cout << "[WARN] No huge pages for the IQ ring (" << strerror(errno) << "), using shared memory" << std::endl;
+    close(fd);
+    fd = -1;
+    unlink(path.c_str());
+    return false;
+  }
+  header = (shm_iq_header_t *)map;
+  huge_pages = true;
+  return true;
+}
+
+bool ShmIqWriter::map_shm() {
+  fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    std::cout << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat info;
+  bool sized = fstat(fd, &info) == 0 && size_t(info.st_size) == map_size;
+  if (!sized && ftruncate(fd, map_size) != 0) {
+    std::cout << "Failed to size shared memory: " << strerror(errno) << std::endl;
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    std::cout << "Failed to map shared memory: " << strerror(errno) << std::endl;
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  header = (shm_iq_header_t *)map;
+
+  // Only a hint, shmem huge pages depend on the system settings
+  madvise(map, map_size, MADV_HUGEPAGE);
+  return true;
+}
+
+bool ShmIqWriter::open(uint64_t c, double sample_rate, double center_freq) {
+  // At least two chunks, so a chunk never laps the ring
+  uint64_t cap = max_write_chunk * 2;
+  while (cap < c) {
+    cap <<= 1;
+  }
+  map_size = shm_iq_ring_size(cap);
+
+  bool hugepage_dir = access(SHM_IQ_HUGEPAGE_DIR, W_OK) == 0;
+  if (!(hugepage_dir && map_hugepages()) && !map_shm()) {
+    return false;
+  }
+  if (!huge_pages) {
+    // A stale hugetlbfs ring would be found first by readers
+    unlink(shm_iq_hugepage_path(name).c_str());
+  }
+  samples = shm_iq_samples(header);
+  mask = cap - 1;
+
+  // Carry on from a ring left by the last run so attached readers keep going,
+  // otherwise lay out a fresh one and mark it valid last
+  bool reuse =
+    header->magic == SHM_IQ_MAGIC &&
+    header->version == SHM_IQ_VERSION &&
+    header->sample_size == sizeof(shm_iq_sample_t) &&
+    header->capacity == cap &&
+    header->sample_rate == sample_rate &&
+    header->center_freq == center_freq;
+  if (!reuse) {
+    header->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->version = SHM_IQ_VERSION;
+    header->sample_size = sizeof(shm_iq_sample_t);
+    header->capacity = cap;
+    header->sample_rate = sample_rate;
+    header->center_freq = center_freq;
+    header->claim_sample.store(0, std::memory_order_relaxed);
+    header->write_sample.store(0, std::memory_order_relaxed);
+    header->write_time_ms.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_IQ_MAGIC;
+  }
+  return true;
+}
+
+void ShmIqWriter::write(const shm_iq_sample_t *in, size_t count) {
+  if (header == nullptr) {
+    return;
+  }
+
+  // Only one thread writes, so the sample counts are ours
+  uint64_t start = header->write_sample.load(std::memory_order_relaxed);
+  while (count > 0) {
+    size_t n = std::min(count, max_write_chunk);
+    header->claim_sample.store(start + n, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t offset = start & mask;
+    size_t first = std::min(n, size_t(header->capacity - offset));
+    std::memcpy(samples + offset, in, first * sizeof(shm_iq_sample_t));
+    if (first < n) {
+      std::memcpy(samples, in + first, (n - first) * sizeof(shm_iq_sample_t));
+    }
+
+    start += n;
+    header->write_sample.store(start, std::memory_order_release);
+    in += n;
+    count -= n;
+  }
+  header->write_time_ms.store(now_ms(), std::memory_order_relaxed);
+}
+
+uint64_t ShmIqWriter::written() {
+  return header != nullptr ? header->write_sample.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t ShmIqWriter::capacity() {
+  return header != nullptr ? header->capacity : 0;
+}
+
+bool ShmIqWriter::on_huge_pages() {
+  return huge_pages;
+}
@@ -0,0 +1,74 @@
+#ifndef SHM_IQ_WRITER_H
+#define SHM_IQ_WRITER_H
+
+#include <cstdint>
+#include <string>
+
+#include "shm_iq_ring.h"
+
+/**
+ * Publishes a wideband IQ stream into a shared memory ring for any number of
+ * local readers
+ *
+ * Writing is a copy into the ring that never waits on the readers, a reader
+ * that can't keep up is lapped and finds out from the ring. The ring goes on
+ * hugetlbfs when there are huge pages free, otherwise in POSIX shared memory
+ * with transparent huge pages asked for. It is left in place on exit so
+ * readers stay attached across restarts.
+ */
+class ShmIqWriter {
+  private:
+    std::string name;
+    int fd;
+    size_t map_size;
+    bool huge_pages;
+    shm_iq_header_t *header;
+    shm_iq_sample_t *samples;
+    uint64_t mask;
+
+    bool map_hugepages();
+    bool map_shm();
+
+  public:
+    /**
+     * @brief Construct a new writer, call open before writing
+     *
+     * @param name The shared memory object name (starting with /)
+     */
+    ShmIqWriter(std::string name);
+    ~ShmIqWriter();
+
+    /**
+     * @brief Create the ring, or carry on with the one left by the last run
+     * if it has the same layout, rate and frequency
+     *
+     * @param capacity The number of samples the ring holds, rounded up to a
+     * power of two
+     * @param sample_rate The stream sample rate
+     * @param center_freq The frequency of the receiver (in Hz)
+     * @return true If the ring is ready
+     */
+    bool open(uint64_t capacity, double sample_rate, double center_freq);
+
+    /**
+     * @brief Append samples to the ring
+     */
+    void write(const shm_iq_sample_t *in, size_t count);
+
+    /**
+     * @brief The number of samples written since the ring was created
+     */
+    uint64_t written();
+
+    /**
+     * @brief The number of samples the ring holds
+     */
+    uint64_t capacity();
+
+    /**
+     * @brief Whether the ring is on hugetlbfs
+     */
+    bool on_huge_pages();
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_packet_reader.h"
+
+ShmPacketReader::ShmPacketReader(std::string shm_name) {
+  name = shm_name;
+  fd = -1;
+  map_size = 0;
+  header = nullptr;
+  records = nullptr;
+  next_seq = 0;
+  overrun_count = 0;
+}
+
+ShmPacketReader::~ShmPacketReader() {
+  if (header != nullptr) {
+    munmap(header, map_size);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+bool ShmPacketReader::open(bool from_start) {
+  fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd == -1) {
+    std::cerr << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(shm_packet_header_t)) {
+    std::cerr << "Shared memory " << name << " is too small to be a packet ring" << std::endl;
+    return false;
+  }
+  map_size = info.st_size;
+
+  void *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    std::cerr << "Failed to map shared memory " << name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  header = (shm_packet_header_t *)map;
+  records = shm_packet_records(header);
+
+  if (
+    header->magic != SHM_PACKET_MAGIC ||
+    header->version != SHM_PACKET_VERSION ||
+    header->record_size != sizeof(shm_packet_record_t) ||
+    map_size < shm_packet_ring_size(header->capacity)
+  ) {
+    std::cerr << "Shared memory " << name << " is not a compatible packet ring" << std::endl;
+    return false;
+  }
+
+  uint64_t write_seq = header->write_seq.load(std::memory_order_acquire);
+  next_seq = write_seq;
+  if (from_start) {
+    next_seq = write_seq > header->capacity ? write_seq - header->capacity : 0;
+  }
+  return true;
+}
+
+bool ShmPacketReader::read(packet_slot_t &packet) {
+  for (;;) {
+    uint64_t write_seq = header->write_seq.load(std::memory_order_acquire);
+    if (next_seq >= write_seq) {
+      // Nothing new (or the ring was reset behind us)
+      next_seq = write_seq;
+      return false;
+    }
+
+    // Skip ahead if the writer has lapped us
+    if (write_seq - next_seq > header->capacity) {
+      uint64_t oldest = write_seq - header->capacity;
+      overrun_count += oldest - next_seq;
+      next_seq = oldest;
+    }
+
+    shm_packet_record_t *record = &records[next_seq % header->capacity];
+    uint64_t seq = record->seq.load(std::memory_order_acquire);
+    if (seq == next_seq + 1) {
+      packet = record->packet;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (record->seq.load(std::memory_order_relaxed) == seq) {
+        next_seq++;
+        return true;
+      }
+    }
+
+    // The record was overwritten before (or while) we read it
+    overrun_count++;
+    next_seq++;
+  }
+}
+
+uint64_t ShmPacketReader::overruns() {
+  return overrun_count;
+}
+
+uint64_t ShmPacketReader::backlog() {
+  uint64_t write_seq = header->write_seq.load(std::memory_order_acquire);
+  return write_seq > next_seq ? write_seq - next_seq : 0;
+}
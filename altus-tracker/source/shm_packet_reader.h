@@ -0,0 +1,63 @@
+#ifndef SHM_PACKET_READER_H
+#define SHM_PACKET_READER_H
+
+#include <cstdint>
+#include <string>
+
+#include "shm_packet_ring.h"
+
+/**
+ * Reads packets published by the tracker's shm sink
+ *
+ * Readers never write to the ring, so any number can attach without slowing
+ * the tracker down. A reader that falls more than a ring behind skips ahead
+ * and the skipped packets are counted as overruns.
+ */
+class ShmPacketReader {
+  private:
+    std::string name;
+    int fd;
+    size_t map_size;
+    shm_packet_header_t *header;
+    shm_packet_record_t *records;
+
+    uint64_t next_seq;
+    uint64_t overrun_count;
+
+  public:
+    /**
+     * @brief Construct a new reader, call open before reading
+     *
+     * @param name The shared memory object name
+     */
+    ShmPacketReader(std::string name);
+    ~ShmPacketReader();
+
+    /**
+     * @brief Attach to the ring
+     *
+     * @param from_start Start with the oldest packet still in the ring rather than the next new one
+     * @return true If the ring exists and has a known layout
+     */
+    bool open(bool from_start);
+
+    /**
+     * @brief Copy out the next packet
+     *
+     * @param packet Set to the packet
+     * @return true If there was a packet to read
+     */
+    bool read(packet_slot_t &packet);
+
+    /**
+     * @brief The number of packets skipped because the writer lapped this reader
+     */
+    uint64_t overruns();
+
+    /**
+     * @brief The number of packets written but not read yet
+     */
+    uint64_t backlog();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SHM_PACKET_RING_H
+#define SHM_PACKET_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet_ring.h"
+
+// "ALTSHMPK" - marks an initialized ring
+#define SHM_PACKET_MAGIC 0x4b504d4853544c41
+
+// Bump when the layout below changes
+#define SHM_PACKET_VERSION 1
+
+// Default shared memory object name
+#define SHM_PACKET_DEFAULT_NAME "/altus-packets"
+
+/**
+ * Layout of the shared memory packet ring
+ *
+ * There is one writer (the tracker) and any number of readers. The header
+ * holds the sequence number of the next record to be written, record i lives
+ * in slot i % capacity. Each record carries the sequence number it holds plus
+ * one, and ~0 while it is being written, so a reader can tell when the writer
+ * lapped it (an overrun) or a record changed under it while it was copied.
+ */
+struct shm_packet_header_t {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t capacity;
+  uint32_t reserved;
+  alignas(64) std::atomic<uint64_t> write_seq;
+};
+
+struct shm_packet_record_t {
+  std::atomic<uint64_t> seq;
+  packet_slot_t packet;
+};
+
+/**
+ * @brief The number of bytes needed for a ring with the given capacity
+ */
+inline size_t shm_packet_ring_size(uint32_t capacity) {
+  return sizeof(shm_packet_header_t) + size_t(capacity) * sizeof(shm_packet_record_t);
+}
+
+/**
+ * @brief The records follow the header
+ */
+inline shm_packet_record_t *shm_packet_records(shm_packet_header_t *header) {
+  return (shm_packet_record_t *)(header + 1);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
+
+#include "file_sink.h"
+
+const std::chrono::milliseconds reopen_wait(5000);
+
+FileSink::FileSink(
+  sink_config_t config,
+  std::string p
+) : PacketSink(config) {
+  path = p;
+  file_open = false;
+  open_file();
+}
+
+FileSink::~FileSink() {
+  stop();
+  if (file != nullptr) {
+    fclose(file);
+  }
+}
+
+void FileSink::open_file() {
+  last_attempt = std::chrono::steady_clock::now();
+  file = fopen(path.c_str(), "a");
+  file_open = file != nullptr;
+  if (file == nullptr) {
+    std::cout << "[" << config.name << "] Failed to open " << path << ": " << strerror(errno) << std::endl;
+  }
+}
+
+void FileSink::poll() {
+  if (file == nullptr && std::chrono::steady_clock::now() - last_attempt >= reopen_wait) {
+    open_file();
+  }
+}
+
+bool FileSink::is_connected() {
+  return file_open;
+}
+
+bool FileSink::write_batch(const std::string &batch) {
+  if (
+    fwrite(batch.c_str(), 1, batch.length(), file) != batch.length() ||
+    fflush(file) != 0
+  ) {
+    std::cout << "[" << config.name << "] Failed to write to " << path << ": " << strerror(errno) << std::endl;
+    fclose(file);
+    file = nullptr;
+    file_open = false;
+    return false;
+  }
+  return true;
+}
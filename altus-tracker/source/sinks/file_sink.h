@@ -0,0 +1,42 @@
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "packet_sink.h"
+
+/**
+ * Appends packets to a local NDJSON file
+ */
+class FileSink : public PacketSink {
+  private:
+    std::string path;
+    FILE *file = nullptr;
+    std::atomic<bool> file_open;
+    std::chrono::steady_clock::time_point last_attempt;
+
+    void open_file();
+
+  protected:
+    bool is_connected();
+    bool write_batch(const std::string &batch);
+    void poll();
+
+  public:
+    /**
+     * @brief Construct a new file sink
+     *
+     * @param config The sink settings
+     * @param path The file to append to
+     */
+    FileSink(
+      sink_config_t config,
+      std::string path
+    );
+    ~FileSink();
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <arpa/inet.h>
+
+#include "packet_sink.h"
+#include "file_sink.h"
+#include "shm_sink.h"
+#include "tcp_sink.h"
+#include "udp_sink.h"
+#include "../altus_packet.h"
+
+// How often the sink thread wakes up when there is nothing to send
+const std::chrono::milliseconds sink_tick(100);
+
+// Packets held in a shared memory ring, a few minutes at a busy launch
+const uint32_t shm_sink_capacity = 4096;
+
+bool parse_sink_policy(const std::string &name, sink_policy_t &policy) {
+  if (name == "block") {
+    policy = sink_policy_t::BLOCK;
+    return true;
+  }
+  if (name == "drop") {
+    policy = sink_policy_t::DROP_OLDEST;
+    return true;
+  }
+  if (name == "spool") {
+    policy = sink_policy_t::SPOOL;
+    return true;
+  }
+  return false;
+}
+
+static bool parse_port(const std::string &text, uint16_t &port) {
+  try {
+    size_t used;
+    unsigned long value = std::stoul(text, &used);
+    if (used != text.length() || value == 0 || value > 65535) {
+      return false;
+    }
+    port = uint16_t(value);
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+packet_sink_sptr make_packet_sink(
+  const std::string &spec,
+  sink_config_t config,
+  control_handler_t control_handler
+) {
+  // Split the spec on ':'
+  std::vector<std::string> parts;
+  std::stringstream spec_stream(spec);
+  std::string part;
+  while (std::getline(spec_stream, part, ':')) {
+    parts.push_back(part);
+  }
+  if (parts.size() < 2) {
+    std::cout << "Invalid sink " << spec << ", expected type:target[:policy]" << std::endl;
+    return nullptr;
+  }
+
+  // The policy is optional and always last
+  sink_policy_t policy;
+  if (parts.size() > 2 && parse_sink_policy(parts.back(), policy)) {
+    config.policy = policy;
+    parts.pop_back();
+  }
+
+  // Give each sink its own directory under the spool directory
+  std::string name = parts[0] + "-" + parts[1];
+  if (parts.size() > 2) {
+    name += "-" + parts[2];
+  }
+  std::replace_if(name.begin(), name.end(), [](char c) { return !isalnum(c) && c != '-' && c != '.'; }, '_');
+  config.name = name;
+  if (config.spool_dir != "") {
+    config.spool_dir += "/" + name;
+  }
+
+  uint16_t port;
+  if (parts[0] == "tcp" && parts.size() == 3 && parse_port(parts[2], port)) {
+    struct in_addr addr;
+    return std::make_shared<TcpSink>(
+      config,
+      parts[1],
+      inet_pton(AF_INET, parts[1].c_str(), &addr) == 1,
+      port,
+      control_handler
+    );
+  } else if (parts[0] == "udp" && parts.size() == 3 && parse_port(parts[2], port)) {
+    return std::make_shared<UdpSink>(
+      config,
+      parts[1],
+      port
+    );
+  } else if (parts[0] == "file" && parts.size() == 2) {
+    return std::make_shared<FileSink>(
+      config,
+      parts[1]
+    );
+  } else if (parts[0] == "shm" && parts.size() == 2) {
+    return std::make_shared<ShmSink>(
+      config,
+      parts[1],
+      shm_sink_capacity
+    );
+  }
+
+  std::cout << "Invalid sink " << spec << ", expected tcp:host:port, udp:group:port, file:path or shm:name" << std::endl;
+  return nullptr;
+}
+
+PacketSink::PacketSink(sink_config_t c) {
+  config = c;
+
+  // Block keeps what is queued and turns away new packets once full
+  queue = make_packet_ring(
+    config.queue_size,
+    config.policy == sink_policy_t::BLOCK ? drop_policy_t::DROP_NEWEST : drop_policy_t::DROP_OLDEST
+  );
+
+  if (config.policy == sink_policy_t::SPOOL) {
+    if (config.spool_dir == "") {
+      std::cout << "[WARN] Sink " << config.name << " wants to spool but there is no spool_dir, dropping instead" << std::endl;
+      config.policy = sink_policy_t::DROP_OLDEST;
+    } else {
+      spool = make_packet_spool(config.spool_dir, config.spool_max_bytes);
+      if (spool == nullptr) {
+        std::cout << "[WARN] Failed to open the spool for sink " << config.name << ", dropping instead" << std::endl;
+        config.policy = sink_policy_t::DROP_OLDEST;
+      }
+    }
+  }
+
+  running = false;
+  packets_sent = 0;
+  bytes_sent = 0;
+  packets_dropped = 0;
+  last_packets_sent = 0;
+  last_bytes_sent = 0;
+  last_stats = std::chrono::steady_clock::now();
+  last_write = last_stats;
+}
+
+PacketSink::~PacketSink() {
+  stop();
+}
+
+void PacketSink::start() {
+  running = true;
+  thread = std::thread(&PacketSink::run, this);
+}
+
+void PacketSink::stop() {
+  if (!running) {
+    return;
+  }
+  running = false;
+  wake.notify_one();
+  thread.join();
+
+  // Keep anything still queued for the next start
+  if (spool != nullptr) {
+    packet_slot_t slot;
+    while (queue->pop(slot)) {
+      spool->append(slot);
+    }
+    spool->sync();
+  }
+}
+
+void PacketSink::offer(const packet_slot_t &packet) {
+  queue->push(packet);
+  wake.notify_one();
+}
+
+void PacketSink::queue_control(const std::string &line) {
+  control_out_mutex.lock();
+  control_out.push_back(line);
+  control_out_mutex.unlock();
+  wake.notify_one();
+}
+
+void PacketSink::count_sent(uint64_t packets, uint64_t bytes) {
+  packets_sent += packets;
+  bytes_sent += bytes;
+}
+
+void PacketSink::send_control(const std::string &line) {
+  if (wants_control() && is_connected()) {
+    queue_control(line);
+  }
+}
+
+static void serialize_packet(packet_slot_t &slot, std::string &out) {
+  std::unique_ptr<AltosBasePacket> packet(make_altus_packet(
+    slot.message,
+    slot.channel_freq,
+    slot.time_ms
+  ));
+  out += packet->to_string();
+  out += '\n';
+}
+
+void PacketSink::run() {
+  // Spooled packets are replayed from a token bucket filled at
+  // spool_replay_rate, holding up to a tick's worth, so waking early for new
+  // packets doesn't replay any faster
+  double replay_burst = std::max(1.0, config.spool_replay_rate * std::chrono::duration<double>(sink_tick).count());
+  double replay_tokens = 0;
+  std::chrono::steady_clock::time_point last_refill = std::chrono::steady_clock::now();
+  size_t replay_max = size_t(replay_burst);
+  std::vector<packet_slot_t> replay_slots(replay_max);
+  std::string batch;
+
+  // The live packets in the batch, and for block sinks any from a batch that
+  // failed to write, sent again before anything newer
+  std::vector<packet_slot_t> batch_slots;
+  std::vector<packet_slot_t> held_slots;
+
+  while (running) {
+    poll();
+    bool up = is_connected();
+
+    batch.clear();
+    control_out_mutex.lock();
+    for (std::vector<std::string>::iterator it = control_out.begin(); it != control_out.end(); it++) {
+      batch += *it;
+    }
+    control_out.clear();
+    control_out_mutex.unlock();
+
+    // While the sink is down, or older packets are still waiting in the
+    // spool, new packets go to the spool so they are sent in order
+    batch_slots.clear();
+    if (up && held_slots.size() > 0) {
+      // Block leaves new packets in the queue until the held ones are sent
+      batch_slots.swap(held_slots);
+      for (std::vector<packet_slot_t>::iterator it = batch_slots.begin(); it != batch_slots.end(); it++) {
+        serialize_packet(*it, batch);
+      }
+    } else if (
+      (up && std::chrono::steady_clock::now() - last_write >= batch_interval()) ||
+      (!up && spool != nullptr)
+    ) {
+      // A batching sink gathers live packets in the queue until its interval
+      // since the last write is up, a sink that is down spools them now.
+      // Without a spool they stay in the queue, which keeps the newest
+      // queue_size for when the sink is back
+      bool use_spool = spool != nullptr && (!up || !spool->empty());
+      uint32_t packets_spooled = 0;
+      packet_slot_t slot;
+      while (queue->pop(slot)) {
+        if (use_spool) {
+          spool->append(slot);
+          packets_spooled++;
+        } else {
+          serialize_packet(slot, batch);
+          batch_slots.push_back(slot);
+        }
+      }
+      if (packets_spooled > 0) {
+        spool->sync();
+      }
+    }
+
+    // Replay spooled packets at a limited rate once the sink is back
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    replay_tokens = std::min(
+      replay_burst,
+      replay_tokens + config.spool_replay_rate * std::chrono::duration<double>(now - last_refill).count()
+    );
+    last_refill = now;
+    size_t packets_replayed = 0;
+    if (spool != nullptr && up && !spool->empty() && replay_tokens >= 1) {
+      packets_replayed = spool->peek(&replay_slots[0], std::min(replay_max, size_t(replay_tokens)));
+      replay_tokens -= packets_replayed;
+      for (size_t i = 0; i < packets_replayed; i++) {
+        serialize_packet(replay_slots[i], batch);
+      }
+    }
+
+    if (batch.length() > 0 && up) {
+      if (write_batch(batch)) {
+        packets_sent += batch_slots.size() + packets_replayed;
+        bytes_sent += batch.length();
+        last_write = std::chrono::steady_clock::now();
+
+        if (config.measure_latency && batch_slots.size() > 0) {
+          double now_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::system_clock::now().time_since_epoch()
+          ).count();
+          for (std::vector<packet_slot_t>::iterator it = batch_slots.begin(); it != batch_slots.end(); it++) {
+            write_latency.record(now_ms - (it->time_ms + (PACKET_BITS * 1000.0) / BAUD_RATE));
+          }
+        }
+
+        // Only checkpoint the replayed packets once they are on the wire
+        if (packets_replayed > 0) {
+          spool->ack(packets_replayed);
+          if (spool->empty()) {
+            std::cout << "Sink " << config.name << " spool replay complete" << std::endl;
+          }
+        }
+      } else if (spool != nullptr) {
+        // The spool was empty when these were taken, so they are still in
+        // order behind anything replayed, which stays unacked
+        for (std::vector<packet_slot_t>::iterator it = batch_slots.begin(); it != batch_slots.end(); it++) {
+          spool->append(*it);
+        }
+        spool->sync();
+      } else if (config.policy == sink_policy_t::BLOCK) {
+        held_slots.swap(batch_slots);
+      } else {
+        packets_dropped += batch_slots.size();
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    wake.wait_for(lock, sink_tick);
+  }
+
+  // A block sink has no spool to keep what it still holds
+  packets_dropped += held_slots.size();
+}
+
+void PacketSink::log_stats() {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - last_stats).count();
+  uint64_t sent_now = sent();
+  uint64_t bytes_now = bytes();
+
+  std::cout << "Sink " << config.name << (connected() ? "" : " (down)") << ": ";
+  std::cout << std::fixed << std::setprecision(1) << ((sent_now - last_packets_sent) / seconds) << " packets/s, ";
+  std::cout << std::fixed << std::setprecision(1) << ((bytes_now - last_bytes_sent) / seconds / 1024) << " KB/s, ";
+  std::cout << sent_now << " sent, " << dropped() << " dropped";
+  if (spool != nullptr) {
+    std::cout << ", " << spool->pending() << " spooled";
+  }
+  describe_stats(std::cout);
+  if (config.measure_latency) {
+    std::cout << ", arrival to write ";
+    write_latency.describe(std::cout);
+    write_latency.reset();
+  }
+  std::cout << std::endl;
+
+  last_packets_sent = sent_now;
+  last_bytes_sent = bytes_now;
+  last_stats = now;
+}
+
+std::string PacketSink::name() {
+  return config.name;
+}
+
+bool PacketSink::connected() {
+  return is_connected();
+}
+
+uint64_t PacketSink::sent() {
+  return packets_sent;
+}
+
+uint64_t PacketSink::bytes() {
+  return bytes_sent;
+}
+
+uint64_t PacketSink::dropped() {
+  uint64_t total = packets_dropped + queue->dropped();
+  if (spool != nullptr) {
+    total += spool->dropped();
+  }
+  return total;
+}
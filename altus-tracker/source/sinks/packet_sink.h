@@ -0,0 +1,197 @@
+#ifndef PACKET_SINK_H
+#define PACKET_SINK_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../latency_histogram.h"
+#include "../packet_ring.h"
+#include "../packet_spool.h"
+
+/**
+ * @brief What a sink does with packets it can't send right now
+ * BLOCK holds them in the sink queue and refuses new packets once it is full,
+ * DROP_OLDEST overwrites the oldest queued packet, and SPOOL moves them to an
+ * on-disk spool to be replayed later
+ */
+enum class sink_policy_t {
+  BLOCK,
+  DROP_OLDEST,
+  SPOOL
+};
+
+/**
+ * @brief Parse a sink policy name ("block", "drop" or "spool")
+ *
+ * @param name The policy name
+ * @param policy Set to the parsed policy
+ * @return true If the name was valid
+ */
+bool parse_sink_policy(const std::string &name, sink_policy_t &policy);
+
+/**
+ * @brief Called with each line received on a sink, returns the lines to send back
+ */
+typedef std::function<std::vector<std::string> (
+  const std::string &
+)> control_handler_t;
+
+/**
+ * @brief Settings shared by all sink types
+ */
+struct sink_config_t {
+  std::string name;
+  sink_policy_t policy = sink_policy_t::DROP_OLDEST;
+  size_t queue_size = 1024;
+  std::string spool_dir;
+  uint64_t spool_max_bytes = uint64_t(64) << 20;
+  uint32_t spool_replay_rate = 50;
+  int compress_level = 0;
+  uint32_t compress_flush_ms = 100;
+  bool measure_latency = false;
+};
+
+class PacketSink;
+
+typedef std::shared_ptr<PacketSink> packet_sink_sptr;
+
+/**
+ * @brief Generate a sink from a command line spec
+ * The spec is type:target[:policy] where type is tcp (host:port), file (path),
+ * udp (group:port) or shm (name)
+ *
+ * @param spec The sink spec
+ * @param config The defaults to use for the sink
+ * @param control_handler Handler for lines received from the sink
+ * @return packet_sink_sptr The sink, or nullptr if the spec is invalid
+ */
+packet_sink_sptr make_packet_sink(
+  const std::string &spec,
+  sink_config_t config,
+  control_handler_t control_handler
+);
+
+/**
+ * A destination for decoded packets
+ *
+ * Each sink has its own queue and thread, so a slow or dead sink never holds
+ * up the dispatcher, the other sinks or the decoders.
+ */
+class PacketSink {
+  private:
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+
+    packet_ring_sptr queue;
+    packet_spool_sptr spool;
+
+    std::vector<std::string> control_out;
+    std::mutex control_out_mutex;
+
+    std::atomic<uint64_t> packets_sent;
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> packets_dropped;
+
+    // Time from the last sample of a live packet arriving to it being written,
+    // spooled packets are left out
+    LatencyHistogram write_latency;
+
+    // Last values reported by log_stats
+    uint64_t last_packets_sent;
+    uint64_t last_bytes_sent;
+    std::chrono::steady_clock::time_point last_stats;
+
+    void run();
+
+  protected:
+    sink_config_t config;
+    std::chrono::steady_clock::time_point last_write;
+
+    /**
+     * @brief Whether the sink can take data right now
+     */
+    virtual bool is_connected() = 0;
+
+    /**
+     * @brief Write a batch of newline terminated lines
+     *
+     * @param batch The lines to write
+     * @return true If the whole batch was written
+     */
+    virtual bool write_batch(const std::string &batch) = 0;
+
+    /**
+     * @brief How long to leave live packets queued after the last write, so
+     * they go out in fewer, larger batches
+     */
+    virtual std::chrono::milliseconds batch_interval() { return std::chrono::milliseconds(0); }
+
+    /**
+     * @brief Called every tick on the sink thread (reconnects, reads, pings)
+     */
+    virtual void poll() {}
+
+    /**
+     * @brief Whether control lines (channel changes) should go to this sink
+     */
+    virtual bool wants_control() { return false; }
+
+    /**
+     * @brief Append sink specific stats to the log_stats line
+     */
+    virtual void describe_stats(std::ostream &) {}
+
+    /**
+     * @brief Queue a control line for this sink only
+     */
+    void queue_control(const std::string &line);
+
+    /**
+     * @brief Add to the sent counters (for sinks that bypass the queue)
+     */
+    void count_sent(uint64_t packets, uint64_t bytes);
+
+  public:
+    PacketSink(sink_config_t config);
+    virtual ~PacketSink();
+
+    void start();
+    void stop();
+
+    /**
+     * @brief Queue a packet for the sink, never blocks
+     *
+     * @param packet The packet to queue
+     */
+    virtual void offer(const packet_slot_t &packet);
+
+    /**
+     * @brief Queue a control line if this sink wants them and can send now
+     *
+     * @param line The newline terminated line
+     */
+    void send_control(const std::string &line);
+
+    /**
+     * @brief Print throughput and drop counters since the last call
+     */
+    void log_stats();
+
+    std::string name();
+    bool connected();
+    uint64_t sent();
+    uint64_t bytes();
+    uint64_t dropped();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_sink.h"
+
+ShmSink::ShmSink(
+  sink_config_t config,
+  std::string name,
+  uint32_t c
+) : PacketSink(config) {
+  shm_name = name;
+  capacity = c;
+  map_size = shm_packet_ring_size(capacity);
+
+  fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    std::cout << "[" << config.name << "] Failed to open shared memory " << shm_name << ": " << strerror(errno) << std::endl;
+    return;
+  }
+
+  struct stat info;
+  bool reuse = fstat(fd, &info) == 0 && size_t(info.st_size) == map_size;
+  if (!reuse && ftruncate(fd, map_size) != 0) {
+    std::cout << "[" << config.name << "] Failed to size shared memory: " << strerror(errno) << std::endl;
+    close(fd);
+    fd = -1;
+    return;
+  }
+
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    std::cout << "[" << config.name << "] Failed to map shared memory: " << strerror(errno) << std::endl;
+    close(fd);
+    fd = -1;
+    return;
+  }
+  header = (shm_packet_header_t *)map;
+  records = shm_packet_records(header);
+
+  // Carry on from a ring left by the last run so attached readers keep going,
+  // otherwise lay out a fresh one and mark it valid last
+  reuse = reuse &&
+    header->magic == SHM_PACKET_MAGIC &&
+    header->version == SHM_PACKET_VERSION &&
+    header->record_size == sizeof(shm_packet_record_t) &&
+    header->capacity == capacity;
+  if (!reuse) {
+    header->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->version = SHM_PACKET_VERSION;
+    header->record_size = sizeof(shm_packet_record_t);
+    header->capacity = capacity;
+    header->write_seq.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < capacity; i++) {
+      records[i].seq.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_PACKET_MAGIC;
+  }
+}
+
+ShmSink::~ShmSink() {
+  stop();
+  if (header != nullptr) {
+    munmap(header, map_size);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+void ShmSink::offer(const packet_slot_t &packet) {
+  if (header == nullptr) {
+    return;
+  }
+
+  // Only the dispatcher thread writes, so the sequence number is ours
+  uint64_t seq = header->write_seq.load(std::memory_order_relaxed);
+  shm_packet_record_t *record = &records[seq % capacity];
+  record->seq.store(~uint64_t(0), std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record->packet = packet;
+  record->seq.store(seq + 1, std::memory_order_release);
+  header->write_seq.store(seq + 1, std::memory_order_release);
+
+  count_sent(1, sizeof(packet_slot_t));
+}
+
+bool ShmSink::is_connected() {
+  return header != nullptr;
+}
+
+bool ShmSink::write_batch(const std::string &) {
+  // Control lines are not published, readers get packets only
+  return true;
+}
@@ -0,0 +1,47 @@
+#ifndef SHM_SINK_H
+#define SHM_SINK_H
+
+#include <string>
+
+#include "packet_sink.h"
+#include "../shm_packet_ring.h"
+
+/**
+ * Publishes raw packets into a POSIX shared memory ring for local readers
+ *
+ * Writing a record is a fixed size copy that never waits on the readers, so
+ * packets are written straight from offer rather than through the sink queue.
+ * The object is left in place on exit so readers stay attached across restarts.
+ */
+class ShmSink : public PacketSink {
+  private:
+    std::string shm_name;
+    uint32_t capacity;
+    int fd = -1;
+    size_t map_size = 0;
+    shm_packet_header_t *header = nullptr;
+    shm_packet_record_t *records = nullptr;
+
+  protected:
+    bool is_connected();
+    bool write_batch(const std::string &batch);
+
+  public:
+    /**
+     * @brief Construct a new shared memory sink
+     *
+     * @param config The sink settings
+     * @param shm_name The shared memory object name (starting with /)
+     * @param capacity The number of packets the ring holds
+     */
+    ShmSink(
+      sink_config_t config,
+      std::string shm_name,
+      uint32_t capacity
+    );
+    ~ShmSink();
+
+    void offer(const packet_slot_t &packet);
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <iostream>
+
+#include <time.h>
+
+#include "stream_compressor.h"
+#include "compression_dictionary.h"
+
+static uint64_t thread_cpu_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+StreamCompressor::StreamCompressor(int l) {
+  level = l;
+  total_in = 0;
+  total_out = 0;
+  total_cpu_ns = 0;
+}
+
+StreamCompressor::~StreamCompressor() {
+#ifdef HAVE_ZSTD
+  if (cctx != nullptr) {
+    ZSTD_freeCCtx(cctx);
+  }
+#endif
+}
+
+bool StreamCompressor::available() {
+#ifdef HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool StreamCompressor::start() {
+#ifdef HAVE_ZSTD
+  if (cctx == nullptr) {
+    cctx = ZSTD_createCCtx();
+    if (cctx == nullptr) {
+      std::cout << "Failed to create the zstd context" << std::endl;
+      return false;
+    }
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+  } else {
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+  }
+
+  // The dictionary stays loaded for every frame on this context
+  size_t result = ZSTD_CCtx_loadDictionary(
+    cctx,
+    compression_dictionary,
+    sizeof(compression_dictionary) - 1
+  );
+  if (ZSTD_isError(result)) {
+    std::cout << "Failed to load the zstd dictionary: " << ZSTD_getErrorName(result) << std::endl;
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef HAVE_ZSTD
+bool StreamCompressor::compress(const std::string &in, std::string &out) {
+  uint64_t cpu_start = thread_cpu_ns();
+  ZSTD_inBuffer input = { in.data(), in.length(), 0 };
+  size_t out_start = out.length();
+  size_t remaining;
+  do {
+    size_t chunk = ZSTD_CStreamOutSize();
+    size_t offset = out.length();
+    out.resize(offset + chunk);
+    ZSTD_outBuffer output = { &out[offset], chunk, 0 };
+    remaining = ZSTD_compressStream2(cctx, &output, &input, ZSTD_e_flush);
+    out.resize(offset + output.pos);
+    if (ZSTD_isError(remaining)) {
+      std::cout << "zstd compression failed: " << ZSTD_getErrorName(remaining) << std::endl;
+      return false;
+    }
+  } while (input.pos < input.size || remaining > 0);
+
+  total_in += in.length();
+  total_out += out.length() - out_start;
+  total_cpu_ns += thread_cpu_ns() - cpu_start;
+  return true;
+}
+#else
+bool StreamCompressor::compress(const std::string &, std::string &) {
+  return false;
+}
+#endif
+
+uint64_t StreamCompressor::bytes_in() {
+  return total_in;
+}
+
+uint64_t StreamCompressor::bytes_out() {
+  return total_out;
+}
+
+double StreamCompressor::cpu_seconds() {
+  return total_cpu_ns / 1e9;
+}
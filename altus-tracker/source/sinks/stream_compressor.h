@@ -0,0 +1,67 @@
+#ifndef STREAM_COMPRESSOR_H
+#define STREAM_COMPRESSOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+ * Streaming zstd compressor for a sink connection
+ *
+ * One frame is kept open for the life of the connection, so every batch is
+ * compressed against everything sent before it as well as the built-in
+ * dictionary. Each batch is flushed as it is compressed, so once its output
+ * is written the server can decode all of it.
+ */
+class StreamCompressor {
+  private:
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *cctx = nullptr;
+#endif
+    int level;
+
+    // Read by log_stats from the main thread
+    std::atomic<uint64_t> total_in;
+    std::atomic<uint64_t> total_out;
+    std::atomic<uint64_t> total_cpu_ns;
+
+  public:
+    /**
+     * @brief Construct a new compressor
+     *
+     * @param level The zstd compression level
+     */
+    StreamCompressor(int level);
+    ~StreamCompressor();
+
+    /**
+     * @brief Whether the tracker was built with zstd
+     */
+    static bool available();
+
+    /**
+     * @brief Start a new stream (for a new connection)
+     *
+     * @return true If the stream is ready
+     */
+    bool start();
+
+    /**
+     * @brief Compress and flush data
+     *
+     * @param in The bytes to compress
+     * @param out Compressed bytes are appended here
+     * @return true If the data was compressed
+     */
+    bool compress(const std::string &in, std::string &out);
+
+    uint64_t bytes_in();
+    uint64_t bytes_out();
+    double cpu_seconds();
+};
+
+#endif
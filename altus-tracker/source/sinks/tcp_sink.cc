@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tcp_sink.h"
+
+const std::chrono::milliseconds min_ping_wait(5000);
+const std::chrono::milliseconds reconnect_wait(5000);
+const int write_timeout_ms = 1000;
+const std::string ping_message = "ping\n";
+const std::string init_message = "!!";
+const std::string init_zstd_message = "!!zstd";
+
+TcpSink::TcpSink(
+  sink_config_t config,
+  std::string h,
+  bool ip,
+  uint16_t p,
+  control_handler_t handler
+) : PacketSink(config) {
+  host = h;
+  is_ip = ip;
+  port = p;
+  control_handler = handler;
+  socket_connected = false;
+  compressing = false;
+  last_attempt = std::chrono::steady_clock::now() - reconnect_wait;
+
+  if (config.compress_level > 0) {
+    if (StreamCompressor::available()) {
+      compressor = std::make_unique<StreamCompressor>(config.compress_level);
+    } else {
+      std::cout << "[WARN] Sink " << config.name << " was asked to compress but zstd support was not built in" << std::endl;
+    }
+  }
+}
+
+TcpSink::~TcpSink() {
+  stop();
+  close_socket();
+}
+
+void TcpSink::close_socket() {
+  if (socket_conn != -1) {
+    close(socket_conn);
+  }
+  socket_conn = -1;
+  socket_connected = false;
+  compressing = false;
+  message_in.clear();
+}
+
+void TcpSink::open_socket() {
+  last_attempt = std::chrono::steady_clock::now();
+
+  // Open the socket (synchronously)
+  if ((socket_conn = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+    std::cout << "[" << config.name << "] Failed to create socket: " << strerror(errno) << std::endl;
+    socket_conn = -1;
+    return;
+  }
+
+  // Specify the address
+  struct sockaddr_in server_address;
+  server_address.sin_family = AF_INET;
+  server_address.sin_port = htons(port);
+
+  // Parse a host name to IP
+  if (!is_ip) {
+    struct hostent *he = gethostbyname(host.c_str());
+    if (he == NULL) {
+      std::cout << "[" << config.name << "] Failed to parse " << host << " into an IP: " << strerror(errno) << std::endl;
+      close_socket();
+      return;
+    }
+    char *ip_addr = inet_ntoa((*((struct in_addr *) he->h_addr_list[0])));
+    std::cout << "[" << config.name << "] Using IP " << ip_addr << std::endl;
+    if (inet_pton(AF_INET, ip_addr, &server_address.sin_addr) <= 0) {
+      std::cout << "[" << config.name << "] Failed to set socket address to " << host << ": " << strerror(errno) << std::endl;
+      close_socket();
+      return;
+    }
+  } else if (inet_pton(AF_INET, host.c_str(), &server_address.sin_addr) <= 0) {
+    std::cout << "[" << config.name << "] Failed to set socket address to " << host << ": " << strerror(errno) << std::endl;
+    close_socket();
+    return;
+  }
+
+  // Make the socket async
+  int flags = fcntl(socket_conn, F_GETFL, 0);
+  if (flags == -1) {
+    flags = 0;
+  }
+  flags = (flags | O_NONBLOCK);
+  if (fcntl(socket_conn, F_SETFL, flags) != 0) {
+    std::cout << "[" << config.name << "] Failed to set socket flags: " << strerror(errno) << std::endl;
+    close_socket();
+    return;
+  }
+
+  // Send the connection request
+  if (
+    connect(socket_conn, (struct sockaddr*)&server_address, sizeof(server_address)) < 0 &&
+    errno != EINPROGRESS
+  ) {
+    std::cout << "[" << config.name << "] Failed to open socket: " << strerror(errno) << std::endl;
+    close_socket();
+    return;
+  }
+}
+
+void TcpSink::handle_line() {
+  std::cout << "[" << config.name << "] New message in: " << message_in << std::endl;
+
+  // The server asks for compression in place of the plain init command, the
+  // reply goes out uncompressed and everything after it is compressed
+  if (message_in == init_zstd_message) {
+    if (compressor != nullptr && compressor->start()) {
+      send_raw("z:zstd\n");
+      compressing = true;
+    } else {
+      send_raw("z:none\n");
+    }
+    message_in = init_message;
+  }
+
+  std::vector<std::string> responses = control_handler(message_in);
+  message_in.clear();
+  for (std::vector<std::string>::iterator it = responses.begin(); it != responses.end(); it++) {
+    queue_control(*it);
+  }
+}
+
+void TcpSink::poll() {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (socket_conn == -1) {
+    if (now - last_attempt >= reconnect_wait) {
+      open_socket();
+    }
+    return;
+  }
+
+  // Check for incoming messages, the server speaks first so the first byte
+  // read means the connection is up
+  ssize_t valread;
+  char buffer[256];
+  while ((valread = read(socket_conn, buffer, sizeof(buffer))) > 0) {
+    socket_connected = true;
+    for (ssize_t i = 0; i < valread; i++) {
+      if (buffer[i] == '\n') {
+        handle_line();
+      } else {
+        message_in += buffer[i];
+      }
+    }
+  }
+
+  // Check for socket errors
+  if (valread == 0 || (
+    valread < 0 &&
+    errno != EWOULDBLOCK &&
+    errno != EAGAIN
+  )) {
+    if (valread == 0) {
+      std::cout << "[" << config.name << "] Socket closed by server" << std::endl;
+    } else {
+      std::cerr << "[" << config.name << "] Failed to read from socket: " << strerror(errno) << std::endl;
+    }
+    close_socket();
+    return;
+  }
+
+  // Keep the connection alive
+  if (socket_connected && now - last_write >= min_ping_wait) {
+    if (write_batch(ping_message)) {
+      last_write = now;
+    }
+  }
+}
+
+bool TcpSink::is_connected() {
+  return socket_connected;
+}
+
+std::chrono::milliseconds TcpSink::batch_interval() {
+  return std::chrono::milliseconds(compressing ? config.compress_flush_ms : 0);
+}
+
+bool TcpSink::write_batch(const std::string &batch) {
+  if (!compressing) {
+    return send_raw(batch);
+  }
+
+  compressed.clear();
+  if (!compressor->compress(batch, compressed)) {
+    close_socket();
+    return false;
+  }
+  return send_raw(compressed);
+}
+
+bool TcpSink::send_raw(const std::string &batch) {
+  // The socket is non-blocking, so wait (on this sink's thread only) for room
+  // rather than leaving half a line on the wire
+  size_t offset = 0;
+  while (offset < batch.length()) {
+    ssize_t written = send(socket_conn, batch.c_str() + offset, batch.length() - offset, MSG_NOSIGNAL);
+    if (written > 0) {
+      offset += written;
+      continue;
+    }
+    if (written < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+      struct pollfd pfd = { socket_conn, POLLOUT, 0 };
+      if (::poll(&pfd, 1, write_timeout_ms) > 0) {
+        continue;
+      }
+      std::cerr << "[" << config.name << "] Timed out writing to socket" << std::endl;
+    } else {
+      std::cerr << "[" << config.name << "] Failed to write to socket: " << strerror(errno) << std::endl;
+    }
+    close_socket();
+    return false;
+  }
+
+  return true;
+}
+
+void TcpSink::describe_stats(std::ostream &out) {
+  if (compressor == nullptr || compressor->bytes_in() == 0) {
+    return;
+  }
+
+  double mb_in = compressor->bytes_in() / (1024.0 * 1024.0);
+  out << ", " << std::fixed << std::setprecision(2) << (double(compressor->bytes_in()) / std::max(uint64_t(1), compressor->bytes_out())) << "x compression";
+  out << ", " << std::fixed << std::setprecision(1) << (compressor->cpu_seconds() * 1000 / mb_in) << " ms CPU/MB";
+}
@@ -0,0 +1,68 @@
+#ifndef TCP_SINK_H
+#define TCP_SINK_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "packet_sink.h"
+#include "stream_compressor.h"
+
+/**
+ * Sends packets to a tracker server over TCP
+ *
+ * Reconnects when the connection drops, pings when idle and passes lines from
+ * the server (like the !! init command) to the control handler. A server that
+ * opens with !!zstd instead gets a z:zstd reply and a zstd stream from then on.
+ */
+class TcpSink : public PacketSink {
+  private:
+    std::string host;
+    bool is_ip;
+    uint16_t port;
+    control_handler_t control_handler;
+
+    int socket_conn = -1;
+    std::atomic<bool> socket_connected;
+    std::string message_in;
+    std::chrono::steady_clock::time_point last_attempt;
+
+    std::unique_ptr<StreamCompressor> compressor;
+    std::atomic<bool> compressing;
+    std::string compressed;
+
+    void open_socket();
+    void close_socket();
+    void handle_line();
+    bool send_raw(const std::string &data);
+
+  protected:
+    bool is_connected();
+    bool write_batch(const std::string &batch);
+    std::chrono::milliseconds batch_interval();
+    void poll();
+    bool wants_control() { return true; }
+    void describe_stats(std::ostream &out);
+
+  public:
+    /**
+     * @brief Construct a new TCP sink
+     *
+     * @param config The sink settings
+     * @param host The host or IP to connect to
+     * @param is_ip If the host is already an IP
+     * @param port The port to connect to
+     * @param control_handler Handler for lines received from the server
+     */
+    TcpSink(
+      sink_config_t config,
+      std::string host,
+      bool is_ip,
+      uint16_t port,
+      control_handler_t control_handler
+    );
+    ~TcpSink();
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include <cstring>
+#include <iostream>
+
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "udp_sink.h"
+
+// Keep multicast on the local network segment
+const unsigned char multicast_ttl = 1;
+
+UdpSink::UdpSink(
+  sink_config_t config,
+  std::string group,
+  uint16_t port
+) : PacketSink(config) {
+  std::memset(&group_address, 0, sizeof(group_address));
+  group_address.sin_family = AF_INET;
+  group_address.sin_port = htons(port);
+  if (inet_pton(AF_INET, group.c_str(), &group_address.sin_addr) <= 0) {
+    std::cout << "[" << config.name << "] Invalid UDP address " << group << std::endl;
+    return;
+  }
+
+  if ((socket_conn = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    std::cout << "[" << config.name << "] Failed to create socket: " << strerror(errno) << std::endl;
+    socket_conn = -1;
+    return;
+  }
+  if (IN_MULTICAST(ntohl(group_address.sin_addr.s_addr))) {
+    setsockopt(socket_conn, IPPROTO_IP, IP_MULTICAST_TTL, &multicast_ttl, sizeof(multicast_ttl));
+  }
+}
+
+UdpSink::~UdpSink() {
+  stop();
+  if (socket_conn != -1) {
+    close(socket_conn);
+  }
+}
+
+bool UdpSink::is_connected() {
+  return socket_conn != -1;
+}
+
+bool UdpSink::write_batch(const std::string &batch) {
+  // One datagram per line, a lost datagram only loses one packet
+  size_t start = 0;
+  bool all_sent = true;
+  while (start < batch.length()) {
+    size_t end = batch.find('\n', start);
+    if (end == std::string::npos) {
+      end = batch.length() - 1;
+    }
+    if (sendto(
+      socket_conn,
+      batch.c_str() + start,
+      end - start + 1,
+      MSG_DONTWAIT,
+      (struct sockaddr *)&group_address,
+      sizeof(group_address)
+    ) < 0) {
+      all_sent = false;
+    }
+    start = end + 1;
+  }
+  return all_sent;
+}
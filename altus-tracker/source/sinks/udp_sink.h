@@ -0,0 +1,38 @@
+#ifndef UDP_SINK_H
+#define UDP_SINK_H
+
+#include <string>
+
+#include <netinet/in.h>
+
+#include "packet_sink.h"
+
+/**
+ * Sends each packet as its own datagram to a UDP (usually multicast) group
+ */
+class UdpSink : public PacketSink {
+  private:
+    int socket_conn = -1;
+    struct sockaddr_in group_address;
+
+  protected:
+    bool is_connected();
+    bool write_batch(const std::string &batch);
+
+  public:
+    /**
+     * @brief Construct a new UDP sink
+     *
+     * @param config The sink settings
+     * @param group The IP (or multicast group) to send to
+     * @param port The port to send to
+     */
+    UdpSink(
+      sink_config_t config,
+      std::string group,
+      uint16_t port
+    );
+    ~UdpSink();
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "constants.h"
+#include "spur_mask.h"
+
+// A bin is masked once it is up for this fraction of spur_seconds, and
+// unmasked when it falls below the second, so a carrier near the level
+// doesn't flap in and out
+const float mask_occupancy = 0.6;
+const float unmask_occupancy = 0.3;
+
+static bool parse_freq(const std::string &text, uint32_t &freq) {
+  try {
+    size_t used;
+    double value = std::stod(text, &used);
+    if (used != text.length() || value <= 0 || value > UINT32_MAX) {
+      return false;
+    }
+    freq = uint32_t(value);
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+static bool parse_freq_range(const std::string &item, freq_range_t &range) {
+  size_t dash = item.find('-');
+  if (dash == std::string::npos) {
+    uint32_t freq;
+    if (!parse_freq(item, freq)) {
+      return false;
+    }
+    range.low = freq - std::min(freq, uint32_t(ROUND_CHANNEL_TO / 2));
+    range.high = freq + ROUND_CHANNEL_TO / 2;
+    return true;
+  }
+  return parse_freq(item.substr(0, dash), range.low) &&
+    parse_freq(item.substr(dash + 1), range.high) &&
+    range.low <= range.high;
+}
+
+bool parse_freq_ranges(const std::string &list, std::vector<freq_range_t> &ranges) {
+  std::stringstream items(list);
+  std::string item;
+  bool any = false;
+  while (std::getline(items, item, ',')) {
+    freq_range_t range;
+    if (!parse_freq_range(item, range)) {
+      return false;
+    }
+    ranges.push_back(range);
+    any = true;
+  }
+  return any;
+}
+
+void write_freq_ranges_json(std::ostream &out, const std::vector<freq_range_t> &ranges) {
+  out << "[";
+  for (std::vector<freq_range_t>::const_iterator it = ranges.begin(); it != ranges.end(); it++) {
+    out << (it != ranges.begin() ? "," : "") << "[" << it->low << "," << it->high << "]";
+  }
+  out << "]";
+}
+
+bool read_spur_file(
+  const std::string &path,
+  std::vector<freq_range_t> &learned,
+  std::vector<freq_range_t> &exclusions
+) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t equals = line.find('=');
+    if (equals == std::string::npos) {
+      continue;
+    }
+    std::string name = line.substr(0, equals);
+    freq_range_t range;
+    if (!parse_freq_range(line.substr(equals + 1), range)) {
+      continue;
+    }
+    if (name == "spur") {
+      learned.push_back(range);
+    } else if (name == "exclude") {
+      exclusions.push_back(range);
+    }
+  }
+  return true;
+}
+
+bool write_spur_file(
+  const std::string &path,
+  const std::vector<freq_range_t> &learned,
+  const std::vector<freq_range_t> &exclusions
+) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+  for (std::vector<freq_range_t>::const_iterator it = exclusions.begin(); it != exclusions.end(); it++) {
+    file << "exclude=" << it->low << "-" << it->high << "\n";
+  }
+  for (std::vector<freq_range_t>::const_iterator it = learned.begin(); it != learned.end(); it++) {
+    file << "spur=" << it->low << "-" << it->high << "\n";
+  }
+  return file.good();
+}
+
+spur_mask_sptr make_spur_mask(
+  double sample_rate,
+  uint16_t fft_size,
+  uint32_t center_freq,
+  double spur_seconds,
+  double frame_rate
+) {
+  return std::make_shared<SpurMask>(
+    sample_rate,
+    fft_size,
+    center_freq,
+    spur_seconds,
+    frame_rate
+  );
+}
+
+SpurMask::SpurMask(
+  double rate,
+  uint16_t size,
+  uint32_t center,
+  double seconds,
+  double frame_rate
+) {
+  sample_rate = rate;
+  fft_size = size;
+  center_freq = center;
+  spur_seconds = seconds;
+  occupancy.assign(fft_size, 0);
+  learned.assign(fft_size, false);
+  excluded.assign(fft_size, false);
+  suppressed_count = 0;
+  set_frame_rate(frame_rate);
+}
+
+uint32_t SpurMask::bin_low_freq(size_t bin) {
+  double freq = center_freq - sample_rate / 2 + (bin - 0.5) * sample_rate / fft_size;
+  return uint32_t(std::max(0.0, freq));
+}
+
+uint32_t SpurMask::bin_high_freq(size_t bin) {
+  double freq = center_freq - sample_rate / 2 + (bin + 0.5) * sample_rate / fft_size;
+  return uint32_t(std::max(0.0, freq));
+}
+
+bool SpurMask::bin_in_range(size_t bin, const freq_range_t &range) {
+  // The middle of the bin is inside the range, or a range narrower than a
+  // bin has its middle in the bin. A bin that only touches the range isn't
+  // in it, so a spur doesn't grow each time it is saved and loaded
+  double bin_width = sample_rate / fft_size;
+  double bin_middle = center_freq - sample_rate / 2 + bin * bin_width;
+  double range_middle = (double(range.low) + range.high) / 2;
+  return (bin_middle > range.low + 1.0 && bin_middle < range.high - 1.0) ||
+    std::fabs(range_middle - bin_middle) < bin_width / 2;
+}
+
+std::vector<freq_range_t> SpurMask::learned_ranges_locked() {
+  std::vector<freq_range_t> ranges;
+  for (size_t i = 0; i < fft_size; i++) {
+    if (!learned[i]) {
+      continue;
+    }
+    if (i > 0 && learned[i - 1]) {
+      ranges.back().high = bin_high_freq(i);
+    } else {
+      ranges.push_back({ bin_low_freq(i), bin_high_freq(i) });
+    }
+  }
+  return ranges;
+}
+
+void SpurMask::mark_learned(const std::vector<freq_range_t> &ranges) {
+  if (spur_seconds <= 0) {
+    return;
+  }
+  for (size_t i = 0; i < fft_size; i++) {
+    for (std::vector<freq_range_t>::const_iterator it = ranges.begin(); it != ranges.end(); it++) {
+      if (bin_in_range(i, *it)) {
+        learned[i] = true;
+        occupancy[i] = 1;
+        break;
+      }
+    }
+  }
+}
+
+void SpurMask::mark_excluded() {
+  for (size_t i = 0; i < fft_size; i++) {
+    excluded[i] = false;
+    for (std::vector<freq_range_t>::iterator it = exclusions.begin(); it != exclusions.end(); it++) {
+      if (bin_in_range(i, *it)) {
+        excluded[i] = true;
+        break;
+      }
+    }
+  }
+}
+
+void SpurMask::set_center_freq(uint32_t center) {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  if (center == center_freq) {
+    return;
+  }
+  std::vector<freq_range_t> ranges = learned_ranges_locked();
+  center_freq = center;
+  std::fill(occupancy.begin(), occupancy.end(), 0);
+  std::fill(learned.begin(), learned.end(), false);
+  mark_learned(ranges);
+  mark_excluded();
+}
+
+void SpurMask::set_frame_rate(double frame_rate) {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  alpha = spur_seconds > 0 && frame_rate > 0 ? std::min(1.0, 1.0 / (spur_seconds * frame_rate)) : 0;
+}
+
+void SpurMask::set_exclusions(const std::vector<freq_range_t> &e) {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  exclusions = e;
+  mark_excluded();
+}
+
+std::vector<freq_range_t> SpurMask::get_exclusions() {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  return exclusions;
+}
+
+void SpurMask::add_learned(const std::vector<freq_range_t> &ranges) {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  mark_learned(ranges);
+}
+
+std::vector<freq_range_t> SpurMask::get_learned() {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  return learned_ranges_locked();
+}
+
+void SpurMask::clear_learned() {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  std::fill(occupancy.begin(), occupancy.end(), 0);
+  std::fill(learned.begin(), learned.end(), false);
+}
+
+uint64_t SpurMask::suppressed() {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  return suppressed_count;
+}
+
+void SpurMask::apply(const float *frame, float level, std::vector<bool> &above) {
+  std::lock_guard<std::mutex> lock(mask_mutex);
+  above.resize(fft_size);
+  for (size_t i = 0; i < fft_size; i++) {
+    bool up = frame[i] > level;
+    if (alpha > 0) {
+      occupancy[i] += alpha * ((up ? 1.0f : 0.0f) - occupancy[i]);
+      if (occupancy[i] > mask_occupancy) {
+        learned[i] = true;
+      } else if (occupancy[i] < unmask_occupancy) {
+        learned[i] = false;
+      }
+    }
+
+    bool masked = learned[i] || excluded[i];
+    if (up && masked) {
+      suppressed_count++;
+    }
+    above[i] = up && !masked;
+  }
+}
@@ -0,0 +1,186 @@
+#ifndef SPUR_MASK_H
+#define SPUR_MASK_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A span of frequencies (in Hz), both ends included
+ */
+struct freq_range_t {
+  uint32_t low;
+  uint32_t high;
+
+  bool operator==(const freq_range_t &other) const {
+    return low == other.low && high == other.high;
+  }
+};
+
+/**
+ * @brief Parse a comma separated list of frequencies and ranges, like
+ * 434550000-434560000,435025000 (in Hz)
+ * A single frequency covers half a channel either side of it
+ *
+ * @param list The list
+ * @param ranges The parsed ranges are appended here
+ * @return true If every item was valid
+ */
+bool parse_freq_ranges(const std::string &list, std::vector<freq_range_t> &ranges);
+
+/**
+ * @brief Write ranges as a JSON array of [low, high] pairs
+ */
+void write_freq_ranges_json(std::ostream &out, const std::vector<freq_range_t> &ranges);
+
+/**
+ * @brief Read a mask file, learned spurs and static exclusions
+ *
+ * @param path The mask file
+ * @param learned The learned spurs are appended here
+ * @param exclusions The exclusions are appended here
+ * @return true If the file was read
+ */
+bool read_spur_file(
+  const std::string &path,
+  std::vector<freq_range_t> &learned,
+  std::vector<freq_range_t> &exclusions
+);
+
+/**
+ * @brief Write a mask file, replacing what was there
+ *
+ * @param path The mask file
+ * @param learned The learned spurs
+ * @param exclusions The exclusions
+ * @return true If the file was written
+ */
+bool write_spur_file(
+  const std::string &path,
+  const std::vector<freq_range_t> &learned,
+  const std::vector<freq_range_t> &exclusions
+);
+
+class SpurMask;
+
+typedef std::shared_ptr<SpurMask> spur_mask_sptr;
+
+/**
+ * @brief Generate a spur mask for a detector
+ *
+ * @param sample_rate The sample rate the FFT covers
+ * @param fft_size The number of bins
+ * @param center_freq The frequency of the receiver (in Hz)
+ * @param spur_seconds How long a bin has to stay up to be masked, 0 to only
+ * mask the exclusions
+ * @param frame_rate Detector frames per second
+ * @return spur_mask_sptr The mask
+ */
+spur_mask_sptr make_spur_mask(
+  double sample_rate,
+  uint16_t fft_size,
+  uint32_t center_freq,
+  double spur_seconds,
+  double frame_rate
+);
+
+/**
+ * Keeps the detector off bins that hold interference rather than rockets
+ *
+ * Each bin's occupancy is the fraction of recent frames it was above the
+ * detector level, averaged over spur_seconds. Altus packets are 15 ms on the
+ * air and RDF tones a second or so, so a bin that stays up for most of
+ * spur_seconds is a birdie, the SDR's DC spike or someone else's carrier,
+ * and it is masked until it has been mostly quiet for a while. Static
+ * exclusions are always masked.
+ *
+ * The mask is kept in Hz so it carries across a retune or a new FFT size,
+ * and it is safe to read and change from any thread.
+ */
+class SpurMask {
+  private:
+    double sample_rate;
+    uint16_t fft_size;
+    uint32_t center_freq;
+    double spur_seconds;
+    float alpha;
+
+    std::vector<float> occupancy;
+    std::vector<bool> learned;
+    std::vector<bool> excluded;
+    std::vector<freq_range_t> exclusions;
+    uint64_t suppressed_count;
+    std::mutex mask_mutex;
+
+    uint32_t bin_low_freq(size_t bin);
+    uint32_t bin_high_freq(size_t bin);
+    bool bin_in_range(size_t bin, const freq_range_t &range);
+    std::vector<freq_range_t> learned_ranges_locked();
+    void mark_learned(const std::vector<freq_range_t> &ranges);
+    void mark_excluded();
+
+  public:
+    SpurMask(
+      double sample_rate,
+      uint16_t fft_size,
+      uint32_t center_freq,
+      double spur_seconds,
+      double frame_rate
+    );
+
+    /**
+     * @brief Follow the receiver to a new frequency, the learned spurs stay
+     * where they are in Hz
+     */
+    void set_center_freq(uint32_t center_freq);
+
+    /**
+     * @brief Set the detector frames per second, when the detector is slowed
+     */
+    void set_frame_rate(double frame_rate);
+
+    /**
+     * @brief Replace the static exclusions
+     */
+    void set_exclusions(const std::vector<freq_range_t> &exclusions);
+
+    /**
+     * @brief The static exclusions
+     */
+    std::vector<freq_range_t> get_exclusions();
+
+    /**
+     * @brief Mask spurs learned earlier, like the ones saved from the last run
+     * They are unmasked again if they turn out to be gone
+     */
+    void add_learned(const std::vector<freq_range_t> &ranges);
+
+    /**
+     * @brief The learned spurs, each run of masked bins as a range
+     */
+    std::vector<freq_range_t> get_learned();
+
+    /**
+     * @brief Forget every learned spur
+     */
+    void clear_learned();
+
+    /**
+     * @brief The number of bin detections the mask has dropped
+     */
+    uint64_t suppressed();
+
+    /**
+     * @brief Learn from one frame and find the bins above the level
+     *
+     * @param frame fft_size power levels (in dB), lowest frequency first
+     * @param level The detector level
+     * @param above Set to whether each bin is above the level and not masked
+     */
+    void apply(const float *frame, float level, std::vector<bool> &above);
+};
+
+#endif
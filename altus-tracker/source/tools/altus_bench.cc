@@ -0,0 +1,408 @@
+/**
+ * Microbenchmarks for the hot paths of the tracker, printed as JSON so runs can
+ * be compared between releases on the same hardware
+ */
+
+#include <boost/program_options.hpp>
+
+#include <gnuradio/top_block.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../altus_generator.h"
+#include "../altus_packet.h"
+#include "../packet_ring.h"
+#include "../blocks/altus_channel.h"
+#include "../blocks/altus_detector.h"
+#include "../blocks/altus_frame_decoder.h"
+#include "../blocks/altus_memory_source.h"
+
+namespace po = boost::program_options;
+
+// Packet types with their own parser, plus one that falls through to the base
+const uint8_t packet_types[] = {
+  0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x10, 0x12, 0x13, 0x15, 0x7F
+};
+
+struct bench_result_t {
+  std::string name;
+  uint64_t iterations;
+  double seconds;
+  double items_per_op;
+  std::string unit;
+};
+
+// Results are folded in here so the work can't be optimized away
+volatile uint64_t bench_sink = 0;
+
+/**
+ * @brief Run an operation in growing batches until it has run for min_seconds
+ */
+static bench_result_t run_bench(
+  const std::string &name,
+  double min_seconds,
+  double items_per_op,
+  const std::string &unit,
+  std::function<void ()> op
+) {
+  uint64_t iterations = 0;
+  uint64_t batch = 1;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  double seconds = 0;
+  while (seconds < min_seconds) {
+    for (uint64_t i = 0; i < batch; i++) {
+      op();
+    }
+    iterations += batch;
+    batch *= 2;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  bench_result_t result;
+  result.name = name;
+  result.iterations = iterations;
+  result.seconds = seconds;
+  result.items_per_op = items_per_op;
+  result.unit = unit;
+  return result;
+}
+
+static std::vector<uint8_t> random_bits(std::mt19937 &rng, size_t count) {
+  std::vector<uint8_t> bits(count);
+  for (size_t i = 0; i < count; i++) {
+    bits[i] = rng() & 1;
+  }
+  return bits;
+}
+
+static std::vector<uint8_t> read_bits(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> bits((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  for (size_t i = 0; i < bits.size(); i++) {
+    bits[i] &= 1;
+  }
+  return bits;
+}
+
+static void bench_decoder(
+  std::vector<bench_result_t> &results,
+  double min_seconds,
+  std::mt19937 &rng,
+  const std::string &bits_path
+) {
+  uint64_t packets = 0;
+  AltusFrameDecoder decoder([&packets](uint8_t *message, uint16_t computed_crc, uint16_t received_crc) {
+    packets++;
+    bench_sink += computed_crc ^ received_crc;
+  });
+
+  // Noise that never syncs, so only the sync search runs
+  std::vector<uint8_t> noise = random_bits(rng, 1 << 16);
+  uint16_t last_16_bits = 0;
+  for (size_t i = 0; i < noise.size(); i++) {
+    last_16_bits = (last_16_bits << 1) | noise[i];
+    if (last_16_bits == SYNC_WORD) {
+      noise[i] ^= 1;
+      last_16_bits ^= 1;
+    }
+  }
+  results.push_back(run_bench("decoder.sync_search", min_seconds, noise.size(), "bits", [&]() {
+    for (size_t i = 0; i < noise.size(); i++) {
+      decoder.push_bit(noise[i]);
+    }
+  }));
+
+  // Back to back packets, every stage runs for every bit after the sync word
+  std::vector<uint8_t> packet_bits;
+  for (int p = 0; p < 64; p++) {
+    for (int b = 15; b >= 0; b--) {
+      packet_bits.push_back((SYNC_WORD >> b) & 1);
+    }
+    std::vector<uint8_t> body = random_bits(rng, PACKET_BITS - 16);
+    packet_bits.insert(packet_bits.end(), body.begin(), body.end());
+  }
+  decoder.reset();
+  results.push_back(run_bench("decoder.packets", min_seconds, packet_bits.size(), "bits", [&]() {
+    for (size_t i = 0; i < packet_bits.size(); i++) {
+      decoder.push_bit(packet_bits[i]);
+    }
+  }));
+
+  // The stages on their own
+  std::vector<uint32_t> words(BYTES_PER_MESSAGE / 2);
+  for (size_t i = 0; i < words.size(); i++) {
+    words[i] = rng();
+  }
+  results.push_back(run_bench("decoder.deinterleave", min_seconds, words.size(), "words", [&]() {
+    for (size_t i = 0; i < words.size(); i++) {
+      bench_sink += AltusFrameDecoder::deinterleave(words[i]);
+    }
+  }));
+  results.push_back(run_bench("decoder.viterbi", min_seconds, words.size(), "words", [&]() {
+    decoder.reset();
+    for (size_t i = 0; i < words.size(); i++) {
+      decoder.viterbi_decode(words[i]);
+    }
+  }));
+
+  uint8_t message[BYTES_PER_MESSAGE];
+  for (int i = 0; i < BYTES_PER_MESSAGE; i++) {
+    message[i] = rng();
+  }
+  results.push_back(run_bench("decoder.whiten", min_seconds, BYTES_PER_MESSAGE, "bytes", [&]() {
+    AltusFrameDecoder::whiten(message, BYTES_PER_MESSAGE);
+  }));
+  results.push_back(run_bench("decoder.crc", min_seconds, DATA_BYTES_PER_MESSAGE, "bytes", [&]() {
+    bench_sink += AltusFrameDecoder::crc(message, DATA_BYTES_PER_MESSAGE);
+  }));
+
+  // A stream sliced by a real channel
+  if (bits_path != "") {
+    std::vector<uint8_t> captured = read_bits(bits_path);
+    if (captured.size() == 0) {
+      std::cerr << "[WARN] No bits in " << bits_path << ", skipping decoder.captured" << std::endl;
+      return;
+    }
+    decoder.reset();
+    packets = 0;
+    results.push_back(run_bench("decoder.captured", min_seconds, captured.size(), "bits", [&]() {
+      for (size_t i = 0; i < captured.size(); i++) {
+        decoder.push_bit(captured[i]);
+      }
+    }));
+  }
+}
+
+static void bench_packets(
+  std::vector<bench_result_t> &results,
+  double min_seconds,
+  std::mt19937 &rng
+) {
+  for (size_t t = 0; t < sizeof(packet_types); t++) {
+    uint8_t data[DATA_BYTES_PER_MESSAGE];
+    uint8_t message[BYTES_PER_MESSAGE];
+    build_altus_data(packet_types[t], 1234, t, rng, data);
+    frame_altus_message(data, message);
+
+    std::stringstream name;
+    name << "packet.0x" << std::hex << std::setw(2) << std::setfill('0') << int(packet_types[t]);
+    results.push_back(run_bench(name.str(), min_seconds, 1, "packets", [&]() {
+      std::unique_ptr<AltosBasePacket> packet(make_altus_packet(
+        message,
+        435000000,
+        1700000000000
+      ));
+      bench_sink += packet->to_string().length();
+    }));
+  }
+}
+
+static void bench_detector(
+  std::vector<bench_result_t> &results,
+  double min_seconds,
+  std::mt19937 &rng,
+  double sample_rate,
+  uint16_t fft_size
+) {
+  uint32_t center_freq = 435000000;
+  uint64_t detections = 0;
+
+  // Learning spurs as the tracker does, at 5 seconds and 100 frames/s
+  gr::AltusDecoder::Detector::sptr detector = gr::AltusDecoder::Detector::make(
+    [&detections](uint32_t freq) {
+      detections++;
+    },
+    center_freq,
+    sample_rate,
+    fft_size,
+    MAX_CHANNELS,
+    center_freq - sample_rate * 0.4,
+    center_freq + sample_rate * 0.4,
+    5,
+    100
+  );
+
+  // A noise floor, and the same with a handful of strong carriers on it
+  std::normal_distribution<float> noise(-80, 2);
+  const int frame_count = 64;
+  std::vector<float> quiet(fft_size * frame_count);
+  for (size_t i = 0; i < quiet.size(); i++) {
+    quiet[i] = noise(rng);
+  }
+  std::vector<float> busy = quiet;
+  for (int f = 0; f < frame_count; f++) {
+    for (int c = 1; c <= 8; c++) {
+      int bin = (fft_size * c) / 10 + f % 8;
+      busy[f * fft_size + bin] = -10;
+      busy[f * fft_size + bin + 1] = -12;
+    }
+  }
+
+  results.push_back(run_bench("detector.quiet", min_seconds, frame_count, "frames", [&]() {
+    for (int f = 0; f < frame_count; f++) {
+      detector->process_frame(&quiet[f * fft_size]);
+    }
+  }));
+  results.push_back(run_bench("detector.busy", min_seconds, frame_count, "frames", [&]() {
+    for (int f = 0; f < frame_count; f++) {
+      detector->process_frame(&busy[f * fft_size]);
+    }
+  }));
+  bench_sink += detections;
+}
+
+static void bench_channel(
+  std::vector<bench_result_t> &results,
+  double min_seconds,
+  std::mt19937 &rng,
+  double sample_rate
+) {
+  // A second of noise through one channel, end to end
+  std::normal_distribution<float> noise(0, 0.1);
+  std::vector<gr_complex> samples(uint64_t(sample_rate));
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = gr_complex(noise(rng), noise(rng));
+  }
+  packet_ring_sptr ring = make_packet_ring(1024, drop_policy_t::DROP_OLDEST);
+
+  results.push_back(run_bench("channel.filter", min_seconds, samples.size(), "samples", [&]() {
+    gr::top_block_sptr tb = gr::make_top_block("AltusBench");
+    gr::AltusDecoder::MemorySource::sptr source = gr::AltusDecoder::MemorySource::make(
+      &samples[0],
+      sizeof(gr_complex),
+      samples.size()
+    );
+    altus_channel_sptr channel = make_altus_channel(
+      435000000 + 1000000,
+      435000000,
+      sample_rate,
+      ring,
+      0
+    );
+    tb->connect(source, 0, channel, 0);
+    tb->run();
+  }));
+}
+
+static std::string cpu_model() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.find("model name") == 0) {
+      size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        return line.substr(line.find_first_not_of(' ', colon + 1));
+      }
+    }
+  }
+  return "unknown";
+}
+
+static void write_json(std::ostream &out, const std::vector<bench_result_t> &results) {
+  char hostname[256] = "";
+  gethostname(hostname, sizeof(hostname) - 1);
+  int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+
+  out << "{" << std::endl;
+  out << "  \"time\": " << now_ms << "," << std::endl;
+  out << "  \"host\": \"" << hostname << "\"," << std::endl;
+  out << "  \"cpu\": \"" << cpu_model() << "\"," << std::endl;
+  out << "  \"compiler\": \"" << __VERSION__ << "\"," << std::endl;
+  out << "  \"benchmarks\": [" << std::endl;
+  for (size_t i = 0; i < results.size(); i++) {
+    const bench_result_t &r = results[i];
+    double ns_per_op = (r.seconds * 1e9) / r.iterations;
+    out << "    {\"name\": \"" << r.name << "\", ";
+    out << "\"iterations\": " << r.iterations << ", ";
+    out << "\"ns_per_op\": " << std::fixed << std::setprecision(2) << ns_per_op << ", ";
+    out << "\"items_per_second\": " << std::fixed << std::setprecision(0) << ((r.iterations * r.items_per_op) / r.seconds) << ", ";
+    out << "\"unit\": \"" << r.unit << "\"}" << (i + 1 < results.size() ? "," : "") << std::endl;
+  }
+  out << "  ]" << std::endl;
+  out << "}" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Help screen")
+    ("filter", po::value<std::string>(), "Only run benchmarks whose name starts with this (decoder, packet, detector, channel)")
+    ("min_seconds", po::value<double>(), "Minimum time to run each benchmark for (default 1)")
+    ("bits", po::value<std::string>(), "Sliced bits captured from a channel (one bit per byte) for decoder.captured")
+    ("sample_rate", po::value<double>(), "Wideband sample rate for the detector and channel benchmarks (default 10000000)")
+    ("fft_size", po::value<uint16_t>(), "Detector FFT size (default 1024)")
+    ("seed", po::value<uint32_t>(), "Seed for the synthetic data (default 1)")
+    ("out,o", po::value<std::string>(), "Write the JSON here instead of stdout");
+
+  po::variables_map vm;
+  po::store(parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << "Usage: altus-bench [options]\n";
+    std::cout << desc;
+    return 0;
+  }
+
+  std::string filter = vm.count("filter") ? vm["filter"].as<std::string>() : "";
+  double min_seconds = vm.count("min_seconds") ? vm["min_seconds"].as<double>() : 1;
+  std::string bits_path = vm.count("bits") ? vm["bits"].as<std::string>() : "";
+  double sample_rate = vm.count("sample_rate") ? vm["sample_rate"].as<double>() : 10000000;
+  uint16_t fft_size = vm.count("fft_size") ? vm["fft_size"].as<uint16_t>() : 1024;
+  std::mt19937 rng(vm.count("seed") ? vm["seed"].as<uint32_t>() : 1);
+
+  std::function<bool (const std::string &)> wanted = [&filter](const std::string &group) {
+    return filter == "" || group.find(filter) == 0 || filter.find(group) == 0;
+  };
+
+  std::vector<bench_result_t> results;
+  if (wanted("decoder")) {
+    bench_decoder(results, min_seconds, rng, bits_path);
+  }
+  if (wanted("packet")) {
+    bench_packets(results, min_seconds, rng);
+  }
+  if (wanted("detector")) {
+    bench_detector(results, min_seconds, rng, sample_rate, fft_size);
+  }
+  if (wanted("channel")) {
+    bench_channel(results, min_seconds, rng, sample_rate);
+  }
+
+  // Drop anything the filter was more specific than
+  std::vector<bench_result_t> kept;
+  for (std::vector<bench_result_t>::iterator it = results.begin(); it != results.end(); it++) {
+    if (it->name.find(filter) == 0) {
+      kept.push_back(*it);
+      std::cerr << std::left << std::setw(24) << it->name << std::right;
+      std::cerr << std::fixed << std::setprecision(1) << std::setw(14) << ((it->seconds * 1e9) / it->iterations) << " ns/op  ";
+      std::cerr << std::fixed << std::setprecision(0) << ((it->iterations * it->items_per_op) / it->seconds) << " " << it->unit << "/s" << std::endl;
+    }
+  }
+
+  if (vm.count("out")) {
+    std::ofstream out(vm["out"].as<std::string>(), std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "Failed to open " << vm["out"].as<std::string>() << std::endl;
+      return 1;
+    }
+    write_json(out, kept);
+  } else {
+    write_json(std::cout, kept);
+  }
+  return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * Writes a synthetic wideband capture with any number of Altus transmitters in
+ * it, plus the ground truth of every packet sent. With --score it compares a
+ * tracker's NDJSON output against that ground truth instead.
+ */
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../altus_generator.h"
+#include "../iq_format.h"
+
+namespace po = boost::program_options;
+
+// Samples generated and written at a time
+const size_t generate_chunk = 65536;
+
+// Yield is reported in SNR buckets this wide
+const double snr_bucket_db = 5;
+
+static bool write_samples(FILE *out, iq_format_t format, const std::complex<float> *samples, size_t count) {
+  if (format == iq_format_t::CF32) {
+    return fwrite(samples, sizeof(std::complex<float>), count, out) == count;
+  }
+
+  const float *values = (const float *)samples;
+  if (format == iq_format_t::CS16) {
+    std::vector<int16_t> converted(count * 2);
+    for (size_t i = 0; i < count * 2; i++) {
+      converted[i] = int16_t(std::clamp(values[i] * 32767.0f, -32767.0f, 32767.0f));
+    }
+    return fwrite(&converted[0], sizeof(int16_t) * 2, count, out) == count;
+  }
+
+  std::vector<int8_t> converted(count * 2);
+  for (size_t i = 0; i < count * 2; i++) {
+    converted[i] = int8_t(std::clamp(values[i] * 127.0f, -127.0f, 127.0f));
+  }
+  return fwrite(&converted[0], sizeof(int8_t) * 2, count, out) == count;
+}
+
+// The data and CRC of a packet, the trellis terminators don't survive decoding
+static std::string packet_key(const std::string &line) {
+  size_t pos = line.find("\"Raw\":\"");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  return line.substr(pos + 7, (DATA_BYTES_PER_MESSAGE + 2) * 2);
+}
+
+static double line_value(const std::string &line, const std::string &key) {
+  size_t pos = line.find("\"" + key + "\":");
+  if (pos == std::string::npos) {
+    return 0;
+  }
+  return std::stod(line.substr(pos + key.length() + 3));
+}
+
+static int score(const std::string &truth_path, const std::string &packets_path) {
+  std::ifstream truth_file(truth_path);
+  std::ifstream packets_file(packets_path);
+  if (!truth_file.is_open() || !packets_file.is_open()) {
+    std::cerr << "Failed to open " << (truth_file.is_open() ? packets_path : truth_path) << std::endl;
+    return 1;
+  }
+
+  std::set<std::string> decoded;
+  std::string line;
+  while (std::getline(packets_file, line)) {
+    std::string key = packet_key(line);
+    if (key != "") {
+      decoded.insert(key);
+    }
+  }
+
+  uint64_t sent = 0;
+  uint64_t found = 0;
+  std::set<std::string> sent_keys;
+  std::map<int, std::pair<uint64_t, uint64_t>> by_snr;
+  while (std::getline(truth_file, line)) {
+    std::string key = packet_key(line);
+    if (key == "") {
+      continue;
+    }
+    sent_keys.insert(key);
+    int bucket = int(std::floor(line_value(line, "SNR") / snr_bucket_db));
+    sent++;
+    by_snr[bucket].first++;
+    if (decoded.count(key) > 0) {
+      found++;
+      by_snr[bucket].second++;
+    }
+  }
+
+  uint64_t unexpected = 0;
+  for (std::set<std::string>::iterator it = decoded.begin(); it != decoded.end(); it++) {
+    if (sent_keys.count(*it) == 0) {
+      unexpected++;
+    }
+  }
+
+  std::cout << "{\"sent\":" << sent << ",\"decoded\":" << found << ",";
+  std::cout << "\"yield\":" << std::fixed << std::setprecision(4) << (sent > 0 ? double(found) / sent : 0) << ",";
+  std::cout << "\"unexpected\":" << unexpected << ",\"by_snr\":[";
+  for (std::map<int, std::pair<uint64_t, uint64_t>>::iterator it = by_snr.begin(); it != by_snr.end(); it++) {
+    if (it != by_snr.begin()) {
+      std::cout << ",";
+    }
+    std::cout << "{\"snr_db\":" << std::fixed << std::setprecision(0) << (it->first * snr_bucket_db) << ",";
+    std::cout << "\"sent\":" << it->second.first << ",\"decoded\":" << it->second.second << "}";
+  }
+  std::cout << "]}" << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Help screen")
+    ("out,o", po::value<std::string>(), "IQ file to write, - for stdout (default synthetic.cs16)")
+    ("format", po::value<std::string>(), "Sample format, cf32, cs16 or cs8 (default from the extension, else cs16)")
+    ("truth", po::value<std::string>(), "Ground truth NDJSON (default the IQ file plus .truth.ndjson)")
+    ("sample_rate", po::value<double>(), "Sample rate (default 10000000)")
+    ("center_freq", po::value<double>(), "Center frequency (default 435025000)")
+    ("duration", po::value<double>(), "Seconds to generate (default 10)")
+    ("noise_dbfs", po::value<double>(), "Noise power per sample in dB full scale (default -30)")
+    ("seed", po::value<uint32_t>(), "Random seed (default 1)")
+    ("tx", po::value<std::vector<std::string>>(), "A transmitter, offset_hz:snr_db[:drift_hz_per_s[:interval_s[:start_s]]] (can be repeated)")
+    ("random", po::value<uint32_t>(), "Add this many transmitters on random free 100 kHz channels")
+    ("snr_min", po::value<double>(), "Lowest SNR for random transmitters (default 10)")
+    ("snr_max", po::value<double>(), "Highest SNR for random transmitters (default 30)")
+    ("max_drift", po::value<double>(), "Largest drift for random transmitters in Hz/s (default 0)")
+    ("score", po::value<std::string>(), "Score decoded packets (NDJSON) against the ground truth given with --truth");
+
+  po::variables_map vm;
+  po::store(parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << "Usage: altus-generate [options]\n";
+    std::cout << desc;
+    return 0;
+  }
+
+  if (vm.count("score")) {
+    if (!vm.count("truth")) {
+      std::cerr << "--score needs the ground truth file given with --truth" << std::endl;
+      return 1;
+    }
+    return score(vm["truth"].as<std::string>(), vm["score"].as<std::string>());
+  }
+
+  scenario_config_t config;
+  if (vm.count("sample_rate")) {
+    config.sample_rate = vm["sample_rate"].as<double>();
+  }
+  if (vm.count("center_freq")) {
+    config.center_freq = vm["center_freq"].as<double>();
+  }
+  if (vm.count("duration")) {
+    config.duration_s = vm["duration"].as<double>();
+  }
+  if (vm.count("noise_dbfs")) {
+    config.noise_dbfs = vm["noise_dbfs"].as<double>();
+  }
+  if (vm.count("seed")) {
+    config.seed = vm["seed"].as<uint32_t>();
+  }
+  if (vm.count("tx")) {
+    std::vector<std::string> specs = vm["tx"].as<std::vector<std::string>>();
+    for (std::vector<std::string>::iterator it = specs.begin(); it != specs.end(); it++) {
+      transmitter_t transmitter;
+      if (!parse_transmitter(*it, transmitter)) {
+        std::cerr << "Invalid transmitter " << *it << ", expected offset_hz:snr_db[:drift_hz_per_s[:interval_s[:start_s]]]" << std::endl;
+        return 1;
+      }
+      config.transmitters.push_back(transmitter);
+    }
+  }
+  if (vm.count("random")) {
+    uint32_t count = vm["random"].as<uint32_t>();
+    size_t added = add_random_transmitters(
+      config,
+      count,
+      vm.count("snr_min") ? vm["snr_min"].as<double>() : 10,
+      vm.count("snr_max") ? vm["snr_max"].as<double>() : 30,
+      vm.count("max_drift") ? vm["max_drift"].as<double>() : 0
+    );
+    if (added < count) {
+      std::cerr << "[WARN] Only room for " << added << " random transmitter(s)" << std::endl;
+    }
+  }
+
+  std::string out_path = vm.count("out") ? vm["out"].as<std::string>() : "synthetic.cs16";
+  bool to_stdout = out_path == "-";
+  iq_format_t format = iq_format_t::CS16;
+  if (!to_stdout) {
+    iq_format_from_path(out_path, format);
+  }
+  if (vm.count("format") && !parse_iq_format(vm["format"].as<std::string>(), format)) {
+    std::cerr << "Invalid format " << vm["format"].as<std::string>() << ", use cf32, cs16 or cs8" << std::endl;
+    return 1;
+  }
+  std::string truth_path = vm.count("truth") ? vm["truth"].as<std::string>() : (to_stdout ? "synthetic" : out_path) + ".truth.ndjson";
+
+  FILE *out = to_stdout ? stdout : fopen(out_path.c_str(), "wb");
+  if (out == NULL) {
+    std::cerr << "Failed to open " << out_path << std::endl;
+    return 1;
+  }
+
+  std::cerr << "Generating " << std::fixed << std::setprecision(1) << config.duration_s << " s at ";
+  std::cerr << (config.sample_rate / 1000000) << " MS/s with " << config.transmitters.size() << " transmitter(s)" << std::endl;
+
+  int64_t start_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+  ScenarioGenerator generator(config);
+  std::vector<std::complex<float>> samples(generate_chunk);
+  size_t count;
+  while ((count = generator.generate(&samples[0], samples.size())) > 0) {
+    if (!write_samples(out, format, &samples[0], count)) {
+      std::cerr << "Failed to write " << out_path << std::endl;
+      return 1;
+    }
+  }
+  if (!to_stdout) {
+    fclose(out);
+
+    iq_file_info_t info;
+    info.format = format;
+    info.sample_rate = config.sample_rate;
+    info.center_freq = config.center_freq;
+    info.description = "altus-generate";
+    info.start_time_ms = start_time_ms;
+    write_sigmf_meta(out_path, info);
+  }
+
+  std::ofstream truth(truth_path, std::ios::trunc);
+  if (!truth.is_open()) {
+    std::cerr << "Failed to open " << truth_path << std::endl;
+    return 1;
+  }
+  const std::vector<ground_truth_t> &packets = generator.ground_truth();
+  for (std::vector<ground_truth_t>::const_iterator it = packets.begin(); it != packets.end(); it++) {
+    truth << ScenarioGenerator::truth_to_string(*it) << '\n';
+  }
+  std::cerr << "Sent " << packets.size() << " packet(s), ground truth in " << truth_path << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Opens the SDR and writes its samples into a shared memory IQ ring, so any
+ * number of trackers (altus-tracker --shm_iq) can decode the one antenna
+ */
+
+#include <boost/program_options.hpp>
+
+#include <gnuradio/top_block.h>
+#include <osmosdr/source.h>
+
+#include <chrono>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../flowgraph_layout.h"
+#include "../shm_iq_ring.h"
+#include "../blocks/altus_shm_iq.h"
+
+namespace po = boost::program_options;
+
+// How often the write rate is printed
+const std::chrono::seconds status_interval(10);
+
+bool running = true;
+
+void signal_handler(int signal) {
+  running = false;
+}
+
+int main(int argc, char **argv) {
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Help screen")
+    ("source", po::value<std::string>(), "OSMO SDR source to use")
+    ("center_freq,c", po::value<uint32_t>(), "Input center frequency (default 435025000)")
+    ("sample_rate,s", po::value<uint32_t>(), "Sample rate (default 10000000)")
+    ("gain", po::value<double>(), "RF gain in dB (default automatic)")
+    ("name,n", po::value<std::string>(), "Shared memory name (default " SHM_IQ_DEFAULT_NAME ")")
+    ("ring_seconds", po::value<double>(), "Seconds of IQ the ring holds, 8 bytes per sample, rounded up to a power of two samples (default 2)")
+    ("pin", "Pin the source and driver threads to the ingest cores")
+    ("ingest_cores", po::value<std::string>(), "Cores for the source, like 0 or 0-1 (default 0)")
+    ("rt_priority", po::value<int>(), "Run the source threads SCHED_FIFO at this priority, 1 to 99 (default off, needs CAP_SYS_NICE)")
+    ("mlock", "Lock the ingest in memory so it never waits on a page fault");
+
+  po::variables_map vm;
+  po::store(parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << "Usage: altus-ingest [options]\n";
+    std::cout << desc;
+    return 0;
+  }
+
+  std::string source_string = vm.count("source") ? vm["source"].as<std::string>() : "";
+  uint32_t center_freq = vm.count("center_freq") ? vm["center_freq"].as<uint32_t>() : 435025000;
+  double sample_rate = vm.count("sample_rate") ? double(vm["sample_rate"].as<uint32_t>()) : 10000000;
+  std::string name = vm.count("name") ? vm["name"].as<std::string>() : SHM_IQ_DEFAULT_NAME;
+  double ring_seconds = vm.count("ring_seconds") ? vm["ring_seconds"].as<double>() : 2;
+  if (ring_seconds <= 0) {
+    std::cout << "Invalid ring_seconds value " << ring_seconds << std::endl;
+    return 1;
+  }
+
+  layout_config_t layout_config;
+  layout_config.pin = vm.count("pin") > 0;
+  layout_config.mlock = vm.count("mlock") > 0;
+  if (vm.count("ingest_cores") && !parse_core_list(vm["ingest_cores"].as<std::string>(), layout_config.ingest_cores)) {
+    std::cout << "Invalid ingest_cores value " << vm["ingest_cores"].as<std::string>() << ", use a list like 0,2 or 2-3" << std::endl;
+    return 1;
+  }
+  if (vm.count("rt_priority")) {
+    layout_config.rt_priority = vm["rt_priority"].as<int>();
+    if (layout_config.rt_priority < 1 || layout_config.rt_priority > 99) {
+      std::cout << "Invalid rt_priority value " << layout_config.rt_priority << ", use 1 to 99" << std::endl;
+      return 1;
+    }
+  }
+
+  gr::AltusDecoder::ShmIqSink::sptr sink = gr::AltusDecoder::ShmIqSink::make(
+    name,
+    uint64_t(sample_rate * ring_seconds),
+    sample_rate,
+    center_freq
+  );
+  if (!sink->is_ready()) {
+    return 1;
+  }
+
+  osmosdr::source::sptr source = source_string != "" ? osmosdr::source::make(source_string) : osmosdr::source::make();
+  source->set_sample_rate(sample_rate);
+  source->set_center_freq(center_freq);
+  if (vm.count("gain")) {
+    source->set_gain_mode(false);
+    source->set_gain(vm["gain"].as<double>());
+  } else {
+    source->set_gain_mode(true);
+  }
+
+  // Nothing else runs here, every thread of the flowgraph is ingest
+  gr::top_block_sptr tb = gr::make_top_block("AltusIngest");
+  tb->connect(source, 0, sink, 0);
+  flowgraph_layout_sptr layout = make_flowgraph_layout(layout_config);
+
+  std::cout << "Ingest: " << (source_string != "" ? source_string : std::string("default SDR")) << std::endl;
+  std::cout << "  Center Frequency: " << std::fixed << std::setprecision(4) << (center_freq / 1000000.0) << " MHz" << std::endl;
+  std::cout << "  Sample Rate: " << std::fixed << std::setprecision(4) << (sample_rate / 1000000) << " MHz" << std::endl;
+  std::cout << "  Ring: " << name << ", " << sink->capacity() << " samples (";
+  std::cout << std::setprecision(2) << (sink->capacity() / sample_rate) << " s) on ";
+  std::cout << (sink->on_huge_pages() ? "huge pages" : "shared memory") << std::endl;
+
+  std::signal(SIGINT, &signal_handler);
+  std::signal(SIGTERM, &signal_handler);
+  layout->start(tb);
+  layout->print(std::cout);
+
+  std::chrono::steady_clock::time_point last_status = std::chrono::steady_clock::now();
+  uint64_t last_written = sink->written();
+  while (running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - last_status >= status_interval) {
+      double seconds = std::chrono::duration<double>(now - last_status).count();
+      uint64_t written = sink->written();
+      std::cout << "Ingest: " << std::fixed << std::setprecision(3) << ((written - last_written) / seconds / 1000000) << " MS/s written" << std::endl;
+      last_status = now;
+      last_written = written;
+    }
+  }
+
+  tb->stop();
+  tb->wait();
+  return 0;
+}
@@ -0,0 +1,531 @@
+/**
+ * Runs the full tracker flowgraph over a recording (or a synthetic scenario)
+ * as fast as it will go for each combination of sample rate and channel
+ * count, and reports how much faster than real time it kept up.
+ */
+
+#include <boost/program_options.hpp>
+
+#include <gnuradio/top_block.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../altus_generator.h"
+#include "../altus_receiver.h"
+#include "../iq_format.h"
+#include "../packet_ring.h"
+#include "../perf_counters.h"
+#include "../blocks/altus_iq_file.h"
+#include "../blocks/altus_sample_tagger.h"
+
+namespace po = boost::program_options;
+
+// Packets buffered between drains, the drain keeps up easily
+const size_t replay_ring_size = 4096;
+const std::chrono::milliseconds replay_drain_wait(20);
+
+struct replay_result_t {
+  double sample_rate;
+  uint16_t channel_count;
+  uint16_t fft_size;
+  bool channel_pool;
+  channel_demod_t demod;
+  bool int16_frontend;
+  uint64_t samples;
+  double wall_seconds;
+  double cpu_seconds;
+  double detector_cpu_seconds;
+  bool perf_counters;
+  std::vector<double> channel_cpu_seconds;
+  std::vector<uint64_t> channel_packets;
+  uint64_t packets;
+  uint64_t dropped;
+  uint64_t sent;
+  uint64_t matched;
+  long peak_rss_kb;
+};
+
+// Samples to replay, either mapped from a file or generated
+struct replay_input_t {
+  const void *data = nullptr;
+  uint64_t samples = 0;
+  iq_format_t format = iq_format_t::CS16;
+  double sample_rate = 0;
+  double center_freq = 0;
+  std::set<std::string> truth;
+};
+
+static double process_cpu_seconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// The data and CRC of a packet as hex, the same as the start of Raw
+static std::string packet_key(const uint8_t *message) {
+  std::stringstream key;
+  for (int i = 0; i < DATA_BYTES_PER_MESSAGE + 2; i++) {
+    key << std::hex << std::setw(2) << std::setfill('0') << int(message[i]);
+  }
+  return key.str();
+}
+
+static std::set<std::string> read_truth(const std::string &path) {
+  std::set<std::string> keys;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t pos = line.find("\"Raw\":\"");
+    if (pos != std::string::npos) {
+      keys.insert(line.substr(pos + 7, (DATA_BYTES_PER_MESSAGE + 2) * 2));
+    }
+  }
+  return keys;
+}
+
+static bool parse_demods(const std::string &list, std::vector<channel_demod_t> &demods) {
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    channel_demod_t demod;
+    if (!parse_channel_demod(item, demod)) {
+      return false;
+    }
+    demods.push_back(demod);
+  }
+  return demods.size() > 0;
+}
+
+static bool parse_list(const std::string &list, std::vector<double> &values) {
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    try {
+      values.push_back(std::stod(item));
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  return values.size() > 0;
+}
+
+static void generate_input(
+  scenario_config_t &config,
+  uint32_t transmitters,
+  double snr_min,
+  double snr_max,
+  std::vector<int16_t> &samples,
+  replay_input_t &input
+) {
+  config.transmitters.clear();
+  add_random_transmitters(config, transmitters, snr_min, snr_max, 0);
+
+  ScenarioGenerator generator(config);
+  samples.clear();
+  samples.reserve(size_t(config.duration_s * config.sample_rate) * 2);
+  std::vector<std::complex<float>> chunk(65536);
+  size_t count;
+  while ((count = generator.generate(&chunk[0], chunk.size())) > 0) {
+    const float *values = (const float *)&chunk[0];
+    for (size_t i = 0; i < count * 2; i++) {
+      samples.push_back(int16_t(std::clamp(values[i] * 32767.0f, -32767.0f, 32767.0f)));
+    }
+  }
+
+  input.data = &samples[0];
+  input.samples = samples.size() / 2;
+  input.format = iq_format_t::CS16;
+  input.sample_rate = config.sample_rate;
+  input.center_freq = config.center_freq;
+  input.truth.clear();
+  const std::vector<ground_truth_t> &truth = generator.ground_truth();
+  for (std::vector<ground_truth_t>::const_iterator it = truth.begin(); it != truth.end(); it++) {
+    input.truth.insert(packet_key(it->message));
+  }
+}
+
+static replay_result_t run_replay(
+  const replay_input_t &input,
+  uint16_t channel_count,
+  uint16_t fft_size,
+  bool channel_pool,
+  channel_demod_t demod,
+  bool int16_frontend
+) {
+  // The fast demodulator and the int16 front end only run in the pool
+  channel_pool = channel_pool || demod == channel_demod_t::FAST || int16_frontend;
+
+  receiver_config_t config;
+  config.center_freq = uint32_t(input.center_freq);
+  config.sample_rate = input.sample_rate;
+  config.channel_count = channel_count;
+  config.fft_size = fft_size;
+  config.channel_pool = channel_pool;
+  config.demod = demod;
+  config.int16_frontend = int16_frontend;
+  config.cs16_source = int16_frontend && input.format == iq_format_t::CS16;
+
+  // The same blocks as the tracker, minus the throttle and the sinks
+  gr::top_block_sptr tb = gr::make_top_block("AltusReplayBench");
+  packet_ring_sptr ring = make_packet_ring(replay_ring_size, drop_policy_t::DROP_NEWEST);
+  altus_iq_file_source_sptr source = make_altus_iq_memory_source(
+    input.data,
+    input.samples,
+    input.format,
+    config.cs16_source
+  );
+  gr::AltusDecoder::SampleTagger::sptr tagger = gr::AltusDecoder::SampleTagger::make(
+    config.sample_rate,
+    0,
+    0,
+    false,
+    AltusIqFileSource::output_item_size(input.format, config.cs16_source)
+  );
+  tb->connect(source, 0, tagger, 0);
+  altus_receiver_sptr receiver = make_altus_receiver(
+    tb,
+    tagger,
+    config,
+    ring,
+    nullptr
+  );
+  std::vector<stage_blocks_t> channel_stages = receiver->channel_stage_blocks();
+
+  replay_result_t result;
+  result.sample_rate = input.sample_rate;
+  result.channel_count = receiver->channel_count();
+  result.fft_size = fft_size;
+  result.channel_pool = channel_pool;
+  result.demod = demod;
+  result.int16_frontend = int16_frontend;
+  result.samples = input.samples;
+  result.channel_packets.assign(result.channel_count, 0);
+  result.packets = 0;
+  result.sent = input.truth.size();
+  result.matched = 0;
+
+  double cpu_start = process_cpu_seconds();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::atomic<bool> done(false);
+  tb->start();
+  std::thread waiter([&tb, &done]() {
+    tb->wait();
+    done = true;
+  });
+
+  // Count packets in place of sending them anywhere
+  std::set<std::string> found;
+  packet_slot_t slot;
+  while (true) {
+    bool finished = done;
+    while (ring->pop(slot)) {
+      result.packets++;
+      if (slot.channel < result.channel_packets.size()) {
+        result.channel_packets[slot.channel]++;
+      }
+      std::string key = packet_key(slot.message);
+      if (input.truth.count(key) > 0 && found.insert(key).second) {
+        result.matched++;
+      }
+    }
+    if (finished) {
+      break;
+    }
+    std::this_thread::sleep_for(replay_drain_wait);
+  }
+  waiter.join();
+  result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.cpu_seconds = process_cpu_seconds() - cpu_start;
+  result.dropped = ring->dropped();
+  result.peak_rss_kb = peak_rss_kb();
+
+  // Split the CPU by channel with the block counters, or evenly if GNU Radio
+  // was built without them. The pool is one block, its time is split evenly
+  // too (the block counters only see its own thread, not the workers)
+  result.detector_cpu_seconds = stages_cpu_seconds(receiver->detector_stage_blocks());
+  double counted = result.detector_cpu_seconds;
+  for (std::vector<stage_blocks_t>::iterator it = channel_stages.begin(); it != channel_stages.end(); it++) {
+    result.channel_cpu_seconds.push_back(stages_cpu_seconds(*it));
+    counted += result.channel_cpu_seconds.back();
+  }
+  result.perf_counters = counted > 0 && !channel_pool;
+  if (!result.perf_counters) {
+    double channels_cpu = result.cpu_seconds - (counted > 0 ? result.detector_cpu_seconds : 0);
+    result.channel_cpu_seconds.assign(result.channel_count, channels_cpu / std::max(uint16_t(1), result.channel_count));
+  }
+  return result;
+}
+
+static std::string cpu_model() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.find("model name") == 0) {
+      size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        return line.substr(line.find_first_not_of(' ', colon + 1));
+      }
+    }
+  }
+  return "unknown";
+}
+
+static void write_json(std::ostream &out, const std::string &input_name, const std::vector<replay_result_t> &results) {
+  char hostname[256] = "";
+  gethostname(hostname, sizeof(hostname) - 1);
+  int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  ).count();
+
+  out << "{" << std::endl;
+  out << "  \"time\": " << now_ms << "," << std::endl;
+  out << "  \"host\": \"" << hostname << "\"," << std::endl;
+  out << "  \"cpu\": \"" << cpu_model() << "\"," << std::endl;
+  out << "  \"cores\": " << std::thread::hardware_concurrency() << "," << std::endl;
+  out << "  \"compiler\": \"" << __VERSION__ << "\"," << std::endl;
+  out << "  \"input\": \"" << input_name << "\"," << std::endl;
+  out << "  \"runs\": [" << std::endl;
+  for (size_t i = 0; i < results.size(); i++) {
+    const replay_result_t &r = results[i];
+    double seconds = r.samples / r.sample_rate;
+    out << "    {\"sample_rate\": " << std::fixed << std::setprecision(0) << r.sample_rate << ", ";
+    out << "\"channels\": " << r.channel_count << ", ";
+    out << "\"fft_size\": " << r.fft_size << ", ";
+    out << "\"channel_pool\": " << (r.channel_pool ? "true" : "false") << ", ";
+    out << "\"demod\": \"" << channel_demod_name(r.demod) << "\", ";
+    out << "\"int16_frontend\": " << (r.int16_frontend ? "true" : "false") << ", ";
+    out << "\"samples\": " << r.samples << ", ";
+    out << "\"wall_seconds\": " << std::fixed << std::setprecision(3) << r.wall_seconds << ", ";
+    out << "\"samples_per_second\": " << std::fixed << std::setprecision(0) << (r.samples / r.wall_seconds) << ", ";
+    out << "\"real_time_factor\": " << std::fixed << std::setprecision(2) << (seconds / r.wall_seconds) << ", ";
+    out << "\"cpu_seconds\": " << std::fixed << std::setprecision(3) << r.cpu_seconds << ", ";
+    out << "\"perf_counters\": " << (r.perf_counters ? "true" : "false") << ", ";
+    out << "\"detector_cpu_seconds\": " << std::fixed << std::setprecision(3) << r.detector_cpu_seconds << ", ";
+    out << "\"channel_cpu_seconds\": [";
+    for (size_t c = 0; c < r.channel_cpu_seconds.size(); c++) {
+      out << (c > 0 ? ", " : "") << std::fixed << std::setprecision(3) << r.channel_cpu_seconds[c];
+    }
+    out << "], \"channel_packets\": [";
+    for (size_t c = 0; c < r.channel_packets.size(); c++) {
+      out << (c > 0 ? ", " : "") << r.channel_packets[c];
+    }
+    out << "], \"packets\": " << r.packets << ", ";
+    out << "\"dropped\": " << r.dropped << ", ";
+    if (r.sent > 0) {
+      out << "\"sent\": " << r.sent << ", ";
+      out << "\"yield\": " << std::fixed << std::setprecision(4) << (double(r.matched) / r.sent) << ", ";
+    }
+    out << "\"peak_rss_kb\": " << r.peak_rss_kb << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+  }
+  out << "  ]" << std::endl;
+  out << "}" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Help screen")
+    ("file,f", po::value<std::string>(), "Recording to replay (default a synthetic scenario)")
+    ("file_format", po::value<std::string>(), "Sample format of the file, cf32, cs16 or cs8 (default from the SigMF metadata or extension)")
+    ("truth", po::value<std::string>(), "Ground truth NDJSON from altus-generate, to report the yield of a file")
+    ("channels", po::value<std::string>(), "Channel counts to run, comma separated (default 5)")
+    ("sample_rate", po::value<std::string>(), "Sample rates to run, comma separated, a file has only its own (default 10000000)")
+    ("center_freq", po::value<double>(), "Center frequency (default from the SigMF metadata, else 435025000)")
+    ("fft_size", po::value<std::string>(), "Detector FFT sizes to run, comma separated, like the 1024,512 autotune tries (default 1024)")
+    ("pool", "Run the channels in the channel pool in place of a block chain each")
+    ("demod", po::value<std::string>(), "Demodulators to run, full and/or fast comma separated, fast always runs in the pool (default full)")
+    ("int16", "Filter the channels' first stage in int16, runs in the pool and takes a cs16 input without converting it")
+    ("duration", po::value<double>(), "Seconds of synthetic signal per sample rate (default 10)")
+    ("transmitters", po::value<uint32_t>(), "Synthetic transmitters (default 10)")
+    ("snr_min", po::value<double>(), "Lowest synthetic SNR (default 10)")
+    ("snr_max", po::value<double>(), "Highest synthetic SNR (default 30)")
+    ("seed", po::value<uint32_t>(), "Seed for the synthetic scenario (default 1)")
+    ("out,o", po::value<std::string>(), "Write the JSON here instead of stdout");
+
+  po::variables_map vm;
+  po::store(parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << "Usage: altus-replay-bench [options]\n";
+    std::cout << desc;
+    return 0;
+  }
+
+  std::vector<double> channel_counts;
+  if (!parse_list(vm.count("channels") ? vm["channels"].as<std::string>() : "5", channel_counts)) {
+    std::cerr << "Invalid channels value " << vm["channels"].as<std::string>() << std::endl;
+    return 1;
+  }
+  std::vector<double> sample_rates;
+  if (vm.count("sample_rate") && !parse_list(vm["sample_rate"].as<std::string>(), sample_rates)) {
+    std::cerr << "Invalid sample_rate value " << vm["sample_rate"].as<std::string>() << std::endl;
+    return 1;
+  }
+  std::vector<double> fft_sizes;
+  if (!parse_list(vm.count("fft_size") ? vm["fft_size"].as<std::string>() : "1024", fft_sizes)) {
+    std::cerr << "Invalid fft_size value " << vm["fft_size"].as<std::string>() << std::endl;
+    return 1;
+  }
+  bool channel_pool = vm.count("pool") > 0;
+  bool int16_frontend = vm.count("int16") > 0;
+  std::vector<channel_demod_t> demods;
+  if (!parse_demods(vm.count("demod") ? vm["demod"].as<std::string>() : "full", demods)) {
+    std::cerr << "Invalid demod value " << vm["demod"].as<std::string>() << ", use full, fast or full,fast" << std::endl;
+    return 1;
+  }
+  for (std::vector<double>::iterator it = channel_counts.begin(); it != channel_counts.end(); it++) {
+    if (*it < 1 || *it > MAX_CHANNELS) {
+      std::cerr << "Channel counts must be between 1 and " << MAX_CHANNELS << std::endl;
+      return 1;
+    }
+  }
+
+  // Must be on before any flowgraph starts
+  enable_perf_counters();
+
+  std::vector<replay_result_t> results;
+  std::string input_name;
+  if (vm.count("file")) {
+    std::string path = vm["file"].as<std::string>();
+    input_name = path;
+    iq_file_info_t info;
+    if (!read_sigmf_meta(path, info)) {
+      iq_format_from_path(path, info.format);
+    }
+    if (vm.count("file_format") && !parse_iq_format(vm["file_format"].as<std::string>(), info.format)) {
+      std::cerr << "Invalid file_format value " << vm["file_format"].as<std::string>() << ", use cf32, cs16 or cs8" << std::endl;
+      return 1;
+    }
+
+    replay_input_t input;
+    input.format = info.format;
+    input.sample_rate = sample_rates.size() > 0 ? sample_rates[0] : (info.sample_rate > 0 ? info.sample_rate : 10000000);
+    input.center_freq = vm.count("center_freq") ? vm["center_freq"].as<double>() : (info.center_freq > 0 ? info.center_freq : 435025000);
+    if (sample_rates.size() > 1) {
+      std::cerr << "[WARN] A recording only has one sample rate, using " << std::fixed << std::setprecision(0) << input.sample_rate << std::endl;
+    }
+    if (vm.count("truth")) {
+      input.truth = read_truth(vm["truth"].as<std::string>());
+    }
+
+    // Mapped and read through once so the disk isn't what gets measured
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      std::cerr << "Failed to open " << path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    struct stat file_stat;
+    size_t sample_size = iq_format_sample_size(input.format);
+    if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sample_size) {
+      std::cerr << "Failed to read the size of " << path << std::endl;
+      close(fd);
+      return 1;
+    }
+    size_t file_size = file_stat.st_size;
+    void *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      std::cerr << "Failed to map " << path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+    input.data = map;
+    input.samples = file_size / sample_size;
+
+    for (std::vector<double>::iterator it = channel_counts.begin(); it != channel_counts.end(); it++) {
+      for (std::vector<double>::iterator fft = fft_sizes.begin(); fft != fft_sizes.end(); fft++) {
+        for (std::vector<channel_demod_t>::iterator demod = demods.begin(); demod != demods.end(); demod++) {
+          std::cerr << "Replaying with " << int(*it) << " channel(s), " << int(*fft) << " bins, " << channel_demod_name(*demod) << " demodulator" << std::endl;
+          results.push_back(run_replay(input, uint16_t(*it), uint16_t(*fft), channel_pool, *demod, int16_frontend));
+        }
+      }
+    }
+    munmap(map, file_size);
+  } else {
+    if (sample_rates.size() == 0) {
+      sample_rates.push_back(10000000);
+    }
+    uint32_t transmitters = vm.count("transmitters") ? vm["transmitters"].as<uint32_t>() : 10;
+    double snr_min = vm.count("snr_min") ? vm["snr_min"].as<double>() : 10;
+    double snr_max = vm.count("snr_max") ? vm["snr_max"].as<double>() : 30;
+    std::stringstream name;
+    name << "synthetic, " << transmitters << " transmitter(s)";
+    input_name = name.str();
+
+    for (std::vector<double>::iterator rate = sample_rates.begin(); rate != sample_rates.end(); rate++) {
+      scenario_config_t scenario;
+      scenario.sample_rate = *rate;
+      if (vm.count("center_freq")) {
+        scenario.center_freq = vm["center_freq"].as<double>();
+      }
+      if (vm.count("duration")) {
+        scenario.duration_s = vm["duration"].as<double>();
+      }
+      if (vm.count("seed")) {
+        scenario.seed = vm["seed"].as<uint32_t>();
+      }
+
+      std::cerr << "Generating " << std::fixed << std::setprecision(1) << scenario.duration_s << " s at ";
+      std::cerr << (*rate / 1000000) << " MS/s" << std::endl;
+      replay_input_t input;
+      std::vector<int16_t> samples;
+      generate_input(scenario, transmitters, snr_min, snr_max, samples, input);
+
+      for (std::vector<double>::iterator it = channel_counts.begin(); it != channel_counts.end(); it++) {
+        for (std::vector<double>::iterator fft = fft_sizes.begin(); fft != fft_sizes.end(); fft++) {
+          for (std::vector<channel_demod_t>::iterator demod = demods.begin(); demod != demods.end(); demod++) {
+            std::cerr << "Replaying with " << int(*it) << " channel(s), " << int(*fft) << " bins, " << channel_demod_name(*demod) << " demodulator" << std::endl;
+            results.push_back(run_replay(input, uint16_t(*it), uint16_t(*fft), channel_pool, *demod, int16_frontend));
+          }
+        }
+      }
+    }
+  }
+
+  for (std::vector<replay_result_t>::iterator it = results.begin(); it != results.end(); it++) {
+    std::cerr << std::fixed << std::setprecision(1) << std::setw(6) << (it->sample_rate / 1000000) << " MS/s ";
+    std::cerr << std::setw(3) << it->channel_count << " channel(s) " << std::setw(4) << it->fft_size << " bins " << channel_demod_name(it->demod) << (it->int16_frontend ? " int16" : "") << ": ";
+    std::cerr << std::fixed << std::setprecision(2) << ((it->samples / it->sample_rate) / it->wall_seconds) << "x real time, ";
+    std::cerr << it->packets << " packet(s)";
+    if (it->sent > 0) {
+      std::cerr << ", yield " << std::fixed << std::setprecision(3) << (double(it->matched) / it->sent);
+    }
+    std::cerr << ", " << std::fixed << std::setprecision(3) << (it->cpu_seconds / (it->samples / it->sample_rate)) << " cores" << std::endl;
+  }
+
+  if (vm.count("out")) {
+    std::ofstream out(vm["out"].as<std::string>(), std::ios::trunc);
+    if (!out.is_open()) {
+      std::cerr << "Failed to open " << vm["out"].as<std::string>() << std::endl;
+      return 1;
+    }
+    write_json(out, input_name, results);
+  } else {
+    write_json(std::cout, input_name, results);
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * Prints the packets the tracker publishes to a shared memory ring (--sink shm:name)
+ * as NDJSON, one line per packet
+ */
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../altus_packet.h"
+#include "../shm_packet_reader.h"
+
+namespace po = boost::program_options;
+
+bool running = true;
+
+void signal_handler(int signal) {
+  running = false;
+}
+
+int main(int argc, char **argv) {
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Help screen")
+    ("name,n", po::value<std::string>(), "Shared memory name (default " SHM_PACKET_DEFAULT_NAME ")")
+    ("from_start", "Print the packets already in the ring before waiting for new ones")
+    ("poll_us", po::value<uint32_t>(), "Microseconds to sleep when there are no new packets (default 1000)");
+
+  po::variables_map vm;
+  po::store(parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << "Usage: altus-shm-reader [options]\n";
+    std::cout << desc;
+    return 0;
+  }
+
+  std::string name = SHM_PACKET_DEFAULT_NAME;
+  if (vm.count("name")) {
+    name = vm["name"].as<std::string>();
+  }
+  uint32_t poll_us = 1000;
+  if (vm.count("poll_us")) {
+    poll_us = vm["poll_us"].as<uint32_t>();
+  }
+
+  ShmPacketReader reader(name);
+  if (!reader.open(vm.count("from_start") > 0)) {
+    return 1;
+  }
+  std::signal(SIGINT, &signal_handler);
+  std::signal(SIGTERM, &signal_handler);
+
+  uint64_t last_overruns = 0;
+  packet_slot_t slot;
+  while (running) {
+    if (!reader.read(slot)) {
+      std::cout.flush();
+      std::this_thread::sleep_for(std::chrono::microseconds(poll_us));
+      continue;
+    }
+
+    if (reader.overruns() != last_overruns) {
+      std::cerr << "[WARN] Fell behind the tracker, skipped " << (reader.overruns() - last_overruns) << " packet(s)" << std::endl;
+      last_overruns = reader.overruns();
+    }
+
+    std::unique_ptr<AltosBasePacket> packet(make_altus_packet(
+      slot.message,
+      slot.channel_freq,
+      slot.time_ms
+    ));
+    std::cout << packet->to_string() << "\n";
+  }
+
+  std::cout.flush();
+  return 0;
+}
@@ -0,0 +1,59 @@
+package socket
+
+import (
+	"bufio"
+	"os"
+
+	"github.com/klauspost/compress/zstd"
+)
+
+// Sent in place of "!!" to ask the tracker for a zstd stream. A tracker
+// that can compress answers "z:zstd" and everything after that line is
+// compressed, anything else answers "z:none" and stays plain text.
+const (
+	INIT_MESSAGE      = "!!\n"
+	INIT_ZSTD_MESSAGE = "!!zstd\n"
+	ZSTD_REPLY        = "z:zstd\n"
+)
+
+// The raw content dictionary the tracker primes its compressor with. It has
+// to match altus-tracker/source/sinks/compression_dictionary.h byte for byte.
+const compressionDictionary = "ping\n" +
+	"c:434550000\n" +
+	"r:434550000\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":1,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000100000000000000000000000000000000000000000000000000000000000000\",\"GroundAccel\":0,\"AccelPlusG\":0,\"AccelMinusG\":0,\"Accelerometer\":0,\"GrdPress\":10556,\"Press\":10556,\"Temp\":-306,\"ApogeeVolts\":0,\"MainVolts\":0,\"Height\":0,\"Speed\":0.00,\"Accel\":0.00}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":4,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000400000000000000000000000000000000000000000000000000000000000000\",\"ApoDelay\":0.0,\"MainAlt\":0,\"Device\":0,\"Flight\":0,\"ConfMaj\":0,\"ConfMin\":0,\"MaxLog\":0,\"Callsign\":\"\",\"Version\":\"\"}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":5,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000500000000000000000000000000000000000000000000000000000000000000\",\"NSat\":0,\"Locked\":false,\"Connected\":false,\"Mode\":0,\"Altitude\":0,\"Latitude\":0.000000,\"Longitude\":0.000000,\"Year\":2000,\"Month\":0,\"Day\":0,\"Hour\":0,\"Minute\":0,\"Second\":0,\"PDop\":0.0,\"HDop\":0.0,\"VDop\":0.0,\"GroundSpeed\":0.00,\"ClimbRate\":0.00,\"Course\":0}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":6,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000600000000000000000000000000000000000000000000000000000000000000\",\"Channels\":0}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":7,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000700000000000000000000000000000000000000000000000000000000000000\",\"Channels\":0}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":8,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000800000000000000000000000000000000000000000000000000000000000000\",\"AccelAcross\":0,\"AccelAlong\":0,\"AccelThrough\":0,\"GyroRoll\":0,\"GyroPitch\":0,\"GyroYaw\":0,\"MagAcross\":0,\"MagAlong\":0,\"MagThrough\":0,\"Orient\":0,\"Accel\":0,\"Pres\":0,\"Temp\":0.00}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":9,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000900000000000000000000000000000000000000000000000000000000000000\",\"Pyro\":[0.00,0.00,0.00,0.00,0.00,0.00],\"State\":0,\"BattV\":0.00,\"PyroV\":0.00,\"GroundPres\":0,\"GroundAccel\":0,\"AccelPlusG\":0,\"AccelMinusG\":0,\"Accel\":0,\"Speed\":0,\"Height\":0}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":10,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000a00000000000000000000000000000000000000000000000000000000000000\",\"State\":0,\"Accelerometer\":0,\"Pres\":0,\"Temp\":0.00,\"Accel\":0.00,\"Speed\":0.00,\"Height\":0,\"BattV\":0.00,\"ApogeeVolts\":0.00,\"MainVolts\":0.00}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":11,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000000b00000000000000000000000000000000000000000000000000000000000000\",\"GroundPres\":0,\"GroundAccel\":0,\"AccelPlusG\":0,\"AccelMinusG\":0}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":16,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000001000000000000000000000000000000000000000000000000000000000000000\",\"State\":0,\"BattV\":0.00,\"ApogeeVolts\":0.00,\"MainVolts\":0.00,\"Pres\":0,\"Temp\":0.00,\"Accel\":0.00,\"Speed\":0.00,\"Height\":0,\"GroundPres\":0}\n" +
+	"{\"Serial\":12345,\"Freq\":434.550,\"Type\":19,\"RTime\":0,\"Time\":1760000000000,\"Raw\":\"393000001300000000000000000000000000000000000000000000000000000000000000\",\"Orient\":0,\"Accel\":0,\"Pres\":0,\"Temp\":0.00,\"AccelAlong\":0,\"AccelAcross\":0,\"AccelThrough\":0,\"GyroRoll\":0,\"GyroPitch\":0,\"GyroYaw\":0,\"MagAlong\":0,\"MagAcross\":0,\"MagThrough\":0}\n"
+
+// Trackers from before compression don't answer "!!zstd", so it is only
+// sent when SOCKET_ZSTD=y
+func initMessage() string {
+	if os.Getenv("SOCKET_ZSTD") == "y" {
+		return INIT_ZSTD_MESSAGE
+	}
+	return INIT_MESSAGE
+}
+
+// Wrap the rest of a connection in a zstd decoder, keeping whatever the
+// line reader has already buffered
+func newZstdReader(conn *bufio.Reader) (*zstd.Decoder, *bufio.Reader, error) {
+	// One goroutine decodes each block as it arrives, the tracker flushes
+	// after every batch so lines aren't held back waiting for more input
+	decoder, err := zstd.NewReader(
+		conn,
+		zstd.WithDecoderConcurrency(1),
+		zstd.WithDecoderDictRaw(0, []byte(compressionDictionary)),
+	)
+	if err != nil {
+		return nil, nil, err
+	}
+	return decoder, bufio.NewReader(decoder), nil
+}
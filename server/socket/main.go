@@ -14,6 +14,7 @@ import (
 	"sync"
 	"time"
 
+	"github.com/klauspost/compress/zstd"
 	log "github.com/sirupsen/logrus"
 )
 
@@ -110,6 +111,20 @@ func parseLine(message string, db *sql.DB, source Source) {
 		return
 	}
 
+	// Channel stats (s:) and anything else that isn't a packet
+	if strings.HasPrefix(message, "s:") {
+		baseLog.Debug("channel stats received")
+		return
+	}
+	if strings.HasPrefix(message, "a:") {
+		baseLog.Info("control command acknowledged")
+		return
+	}
+	if message[0] != '{' {
+		baseLog.Debug("non-packet line ignored")
+		return
+	}
+
 	var packet model.BasePacket
 	err := json.Unmarshal([]byte(message), &packet)
 	if err != nil {
@@ -147,7 +162,7 @@ func handleSource(conn net.Conn, db *sql.DB) {
 		source.Delete(db)
 	}()
 
-	_, err := conn.Write([]byte("!!\n"))
+	_, err := conn.Write([]byte(initMessage()))
 	if err != nil {
 		baseLog.WithError(err).Error("Error writing to source")
 		conn.Close()
@@ -158,6 +173,12 @@ func handleSource(conn net.Conn, db *sql.DB) {
 	packetsReceived := 0
 	go func() {
 		connReader := bufio.NewReader(conn)
+		var decoder *zstd.Decoder
+		defer func() {
+			if decoder != nil {
+				decoder.Close()
+			}
+		}()
 		for {
 			message, err := connReader.ReadString('\n')
 			if err != nil && err != io.EOF {
@@ -169,6 +190,18 @@ func handleSource(conn net.Conn, db *sql.DB) {
 				socketOpen = false
 				return
 			}
+			if message == ZSTD_REPLY {
+				var zstdReader *bufio.Reader
+				decoder, zstdReader, err = newZstdReader(connReader)
+				if err != nil {
+					baseLog.WithError(err).Error("Failed to start the zstd decoder")
+					socketOpen = false
+					return
+				}
+				connReader = zstdReader
+				baseLog.Info("Socket source is compressing with zstd")
+				continue
+			}
 			packetsReceived++
 			go parseLine(message, db, source)
 		}